@@ -0,0 +1,374 @@
+#include "config.h"
+#include "rdma_allreduce.h"
+#include "rdma_channel.h"
+#include "rdma_client_sess.h"
+#include "rdma_reduce.h"
+#include "rdma_server_sess.h"
+#include "rdma_tree_allreduce.h"
+#include "util/logging.h"
+
+#include "util/time_record.h"
+#include <algorithm>
+#include <cmath>
+#include <condition_variable>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+#define B (1)
+#define KB (1024 * B)
+#define MB (1024 * KB)
+#define ALLREDUCE_MAX_BYTES (64 * MB) // the largest vector of the sweep
+#define ALLREDUCE_MIN_BYTES (4 * KB)  // the smallest vector of the sweep
+#define ALLREDUCE_WARMUP_ITERS 5
+#define ALLREDUCE_ITERS 20
+#define NUM_WR 256 // sqes/rqes of each channel of the mesh
+#define TRAFFIC_CLASS 0
+
+using namespace rdma_core;
+
+namespace
+{
+    // the links of the mesh, handed over by the polling threads of the sessions, one channel per peer rank
+    class MeshChannels
+    {
+    public:
+        explicit MeshChannels(std::vector<std::string> ranks) :
+            ranks_(ranks)
+        {
+        }
+        void hand_over(RDMAChannel *channel) // called by the polling thread, kept until finish()
+        {
+            std::string peer_ip = channel->get_registered_endpoint()->get_peer_ip();
+            auto iter = std::find(ranks_.begin(), ranks_.end(), peer_ip);
+            CHECK(iter != ranks_.end()) << "Unexpected peer " << peer_ip << " of " << channel->info();
+            uint32_t peer_rank = iter - ranks_.begin();
+
+            std::unique_lock<std::mutex> lock(lock_);
+            CHECK(links_.find(peer_rank) == links_.end())
+                << "More than one channel to rank " << peer_rank << ", set --data-channels to 1";
+            links_[peer_rank] = channel;
+            cond_.notify_all();
+            cond_.wait(lock, [this]
+                       { return done_; });
+        }
+        std::map<uint32_t, RDMAChannel *> wait_links() // a link to every other rank
+        {
+            std::unique_lock<std::mutex> lock(lock_);
+            cond_.wait(lock, [this]
+                       { return links_.size() + 1 == ranks_.size(); });
+            return links_;
+        }
+        void finish() // the sessions may release the channels now
+        {
+            std::unique_lock<std::mutex> lock(lock_);
+            done_ = true;
+            cond_.notify_all();
+        }
+
+    private:
+        std::vector<std::string> ranks_;          // the IP of each rank
+        std::mutex lock_;
+        std::condition_variable cond_;
+        std::map<uint32_t, RDMAChannel *> links_; // the channel to each peer rank
+        bool done_ = false;
+    };
+
+    void config_mesh_channels(std::vector<std::unique_ptr<RDMAEndPoint>> &end_point_mgr)
+    {
+        for (auto &each_endpoint : end_point_mgr)
+        {
+            for (auto *each_channel : each_endpoint->get_all_channels())
+            {
+                auto &a_config = each_channel->get_config();
+                a_config.pd_key = "AllReduceMesh"; // the tree registers its vector once for all links
+                a_config.using_shared_cq = false;
+                a_config.max_recv_wr = NUM_WR;
+                a_config.max_send_wr = NUM_WR;
+                a_config.traffic_class = TRAFFIC_CLASS;
+                a_config.cq_size = a_config.max_recv_wr + a_config.max_send_wr;
+            }
+        }
+    }
+
+    class MeshServer : public RDMAServerSession // accepts the higher ranks
+    {
+    public:
+        MeshServer(Config &conf, MeshChannels *mesh) :
+            RDMAServerSession(conf),
+            mesh_(mesh)
+        {
+            VLOG(3) << "Creating RDMAServer for the allreduce mesh";
+        }
+        virtual ~MeshServer()
+        {
+            VLOG(3) << "Destroying RDMAServer for the allreduce mesh";
+        }
+
+    protected:
+        virtual void lazy_config_hca()
+        {
+            config_mesh_channels(end_point_mgr_);
+        }
+        virtual void post_connecting()
+        {
+        }
+        virtual void process_CQ(std::vector<RDMAChannel *> aggregated_channels)
+        {
+            for (auto *each_channel : aggregated_channels)
+                mesh_->hand_over(each_channel); // one channel per cq, the cqs are not shared
+        }
+
+    private:
+        MeshChannels *mesh_ = nullptr;
+    };
+
+    class MeshClient : public RDMAClientSession // connects to a lower rank
+    {
+    public:
+        MeshClient(Config &conf, MeshChannels *mesh) :
+            RDMAClientSession(conf),
+            mesh_(mesh)
+        {
+            VLOG(3) << "Creating RDMAClient for the allreduce mesh";
+        }
+        virtual ~MeshClient()
+        {
+            VLOG(3) << "Destroying RDMAClient for the allreduce mesh";
+        }
+
+    protected:
+        virtual void lazy_config_hca()
+        {
+            config_mesh_channels(end_point_mgr_);
+        }
+        virtual void post_connecting()
+        {
+        }
+        virtual void process_CQ(std::vector<RDMAChannel *> aggregated_channels)
+        {
+            CHECK(aggregated_channels.size() == 1) << "The mesh client only connects to one lower rank";
+            mesh_->hand_over(aggregated_channels[0]);
+        }
+
+    private:
+        MeshChannels *mesh_ = nullptr;
+    };
+
+    void start_server_service(Config conf, std::vector<std::string> higher_ips, MeshChannels *mesh)
+    {
+        conf.role = "master";
+        conf.master_ip = "";
+        conf.cluster = higher_ips; // each higher rank connects once
+        conf.serve_as_client = false;
+        conf.session_id = "AllReduceMesh";
+        std::unique_ptr<RDMASession> server_sess_mgr_(new MeshServer(conf, mesh));
+        server_sess_mgr_->init_session();
+        server_sess_mgr_->connecting();
+        server_sess_mgr_->running();
+    }
+
+    void start_client_service(Config conf, std::string lower_ip, MeshChannels *mesh)
+    {
+        conf.role = "slaver";
+        conf.master_ip = lower_ip;
+        conf.cluster.clear();
+        conf.serve_as_client = true;
+        conf.session_id = "AllReduceMesh";
+        std::unique_ptr<RDMASession> client_sess_mgr_(new MeshClient(conf, mesh));
+        client_sess_mgr_->init_session();
+        client_sess_mgr_->connecting();
+        client_sess_mgr_->running();
+    }
+
+    void store_element(void *buffer, size_t index, ReduceDataType type, float value)
+    {
+        switch (type)
+        {
+            case ReduceDataType::FLOAT32: ((float *)buffer)[index] = value; break;
+            case ReduceDataType::FLOAT16: ((uint16_t *)buffer)[index] = float_to_half(value); break;
+            case ReduceDataType::BFLOAT16: ((uint16_t *)buffer)[index] = float_to_bfloat16(value); break;
+            case ReduceDataType::INT8: ((int8_t *)buffer)[index] = (int8_t)value; break;
+            case ReduceDataType::INT32: ((int32_t *)buffer)[index] = (int32_t)value; break;
+            case ReduceDataType::INT64: ((int64_t *)buffer)[index] = (int64_t)value; break;
+        }
+    }
+
+    float load_element(const void *buffer, size_t index, ReduceDataType type)
+    {
+        switch (type)
+        {
+            case ReduceDataType::FLOAT32: return ((const float *)buffer)[index];
+            case ReduceDataType::FLOAT16: return half_to_float(((const uint16_t *)buffer)[index]);
+            case ReduceDataType::BFLOAT16: return bfloat16_to_float(((const uint16_t *)buffer)[index]);
+            case ReduceDataType::INT8: return (float)((const int8_t *)buffer)[index];
+            case ReduceDataType::INT32: return (float)((const int32_t *)buffer)[index];
+            case ReduceDataType::INT64: return (float)((const int64_t *)buffer)[index];
+        }
+        return 0;
+    }
+
+    // small integers, so the 16-bit floats reduce them exactly for up to 21 ranks
+    inline float element_of_rank(uint32_t rank, size_t index)
+    {
+        return (float)((rank % 4 + 1) * (index % 3 + 1));
+    }
+
+    // reduce vectors of a few sizes for each type and op, and compare them with the local reduction
+    template <typename AllReduce>
+    void correctness_test(AllReduce *allreduce, std::string name)
+    {
+        TRACE_IN;
+        uint32_t num_ranks = allreduce->get_num_ranks();
+        const ReduceDataType types[] = {ReduceDataType::FLOAT32, ReduceDataType::FLOAT16,
+                                        ReduceDataType::BFLOAT16, ReduceDataType::INT32};
+        const ReduceOp ops[] = {ReduceOp::SUM, ReduceOp::MAX, ReduceOp::MIN};
+        // one element per segment, one chunk per segment, and several uneven chunks per segment
+        const size_t counts[] = {num_ranks, std::max<size_t>(num_ranks, 1000),
+                                 std::min<size_t>(ALLREDUCE_CHUNK_SIZE / sizeof(float) * num_ranks * 3 + 7,
+                                                  ALLREDUCE_MAX_BYTES / sizeof(float))};
+
+        for (auto type : types)
+        {
+            for (auto op : ops)
+            {
+                float rank_term = 0;
+                for (uint32_t rank = 0; rank < num_ranks; rank++)
+                {
+                    float term = (float)(rank % 4 + 1);
+                    if (rank == 0)
+                        rank_term = term;
+                    else if (op == ReduceOp::SUM)
+                        rank_term += term;
+                    else if (op == ReduceOp::MAX)
+                        rank_term = std::max(rank_term, term);
+                    else
+                        rank_term = std::min(rank_term, term);
+                }
+                for (size_t count : counts)
+                {
+                    void *buffer = allreduce->get_buffer();
+                    for (size_t index = 0; index < count; index++)
+                        store_element(buffer, index, type, element_of_rank(allreduce->get_rank(), index));
+                    allreduce->allreduce(count, type, op);
+                    for (size_t index = 0; index < count; index++)
+                    {
+                        float expected = rank_term * (index % 3 + 1);
+                        float result = load_element(buffer, index, type);
+                        CHECK(std::fabs(result - expected) <= expected * 1e-2)
+                            << "Wrong " << reduce_op_to_str(op) << " of " << count << " "
+                            << reduce_type_to_str(type) << " elements at " << index << ": " << result
+                            << ", while " << expected << " is expected";
+                    }
+                }
+                VLOG(2) << name << " AllReduce (" << reduce_type_to_str(type) << ", " << reduce_op_to_str(op) << ") is OK";
+            }
+        }
+        TRACE_OUT;
+    }
+
+    // algbw is the vector size over the time, busbw scales it by 2(n-1)/n, the share each link carries in a ring;
+    // returns the time of each size of the sweep
+    template <typename AllReduce>
+    std::map<size_t, double> bandwidth_test(AllReduce *allreduce, std::string name)
+    {
+        TRACE_IN;
+        std::map<size_t, double> times;
+        uint32_t num_ranks = allreduce->get_num_ranks();
+        for (size_t msg_length = ALLREDUCE_MIN_BYTES; msg_length <= ALLREDUCE_MAX_BYTES; msg_length *= 2)
+        {
+            size_t count = msg_length / sizeof(float);
+            if (count < num_ranks)
+                continue;
+            for (int iter = 0; iter < ALLREDUCE_WARMUP_ITERS; iter++)
+                allreduce->allreduce(count, ReduceDataType::FLOAT32, ReduceOp::SUM);
+
+            uint64_t stalls = allreduce->get_num_stalls();
+            newplan::Timer timer;
+            timer.Start();
+            for (int iter = 0; iter < ALLREDUCE_ITERS; iter++)
+                allreduce->allreduce(count, ReduceDataType::FLOAT32, ReduceOp::SUM);
+            timer.Stop();
+
+            double time_us = (double)timer.MicroSeconds() / ALLREDUCE_ITERS;
+            double algbw = 8.0 * msg_length / time_us / 1000; // Gbps
+            double busbw = algbw * 2 * (num_ranks - 1) / num_ranks;
+            times[msg_length] = time_us;
+            if (allreduce->get_rank() == 0)
+                VLOG(0) << name << " AllReduce of " << msg_length << " bytes over " << num_ranks << " ranks: " << time_us
+                        << " us, algbw: " << algbw << " Gbps, busbw: " << busbw << " Gbps, stalled "
+                        << allreduce->get_num_stalls() - stalls << " time(s) for the credits";
+        }
+        TRACE_OUT;
+        return times;
+    }
+}; // namespace
+
+int main(int argc, char *argv[])
+{
+    Derived_Config conf;
+    conf.parse_args(argc, argv);
+    if (conf.all_reduce == FULL_MESH_ALLREDUCE || conf.all_reduce == SERVER_CLIENT)
+        LOG(WARNING) << "Only the ring and the tree allreduces are implemented, comparing both instead";
+    bool run_ring = conf.all_reduce != TREE_ALLREDUCE && conf.all_reduce != DOUBLE_BINARY_TREE_ALLREDUCE;
+    bool run_tree = conf.all_reduce != RING_ALLREDUCE;
+    TreeShape shape = conf.all_reduce == TREE_ALLREDUCE ? TreeShape::KARY : TreeShape::DOUBLE_BINARY;
+    uint32_t tree_width = conf.tree_width > 0 ? conf.tree_width : 2;
+
+    // every rank sorts the same IPs, so all of them agree on the ranks
+    std::vector<std::string> ranks = conf.cluster;
+    ranks.push_back(conf.get_local_ip());
+    std::sort(ranks.begin(), ranks.end());
+    CHECK(ranks.size() >= 2) << "An allreduce needs at least 2 ranks, list the peers by --cluster";
+    uint32_t num_ranks = ranks.size();
+    uint32_t rank = std::find(ranks.begin(), ranks.end(), conf.get_local_ip()) - ranks.begin();
+    VLOG(3) << "Rank " << rank << "/" << num_ranks << " connects to the lower ranks, accepts the higher ones";
+
+    // a full mesh, one channel per pair, so the ring and the trees pick their neighbors out of it
+    MeshChannels mesh(ranks);
+    std::vector<std::thread> session_threads;
+    std::vector<std::string> higher_ips(ranks.begin() + rank + 1, ranks.end());
+    if (!higher_ips.empty())
+        session_threads.emplace_back(start_server_service, conf, higher_ips, &mesh);
+    for (uint32_t lower = 0; lower < rank; lower++)
+        session_threads.emplace_back(start_client_service, conf, ranks[lower], &mesh);
+
+    std::map<uint32_t, RDMAChannel *> links = mesh.wait_links();
+    std::map<size_t, double> ring_times, tree_times;
+    if (run_ring)
+    {
+        std::unique_ptr<RingAllReduce> allreduce(
+            RingAllReduce::build_ring_allreduce(links[(rank + 1) % num_ranks], links[(rank + num_ranks - 1) % num_ranks],
+                                                rank, num_ranks, ALLREDUCE_MAX_BYTES));
+        correctness_test(allreduce.get(), "Ring");
+        ring_times = bandwidth_test(allreduce.get(), "Ring");
+    }
+    if (run_tree)
+    { // built after the ring is done, its handshakes keep the chunks of the trees away from a ring still running
+        std::unique_ptr<TreeAllReduce> allreduce(
+            TreeAllReduce::build_tree_allreduce(links, rank, num_ranks, shape, tree_width, ALLREDUCE_MAX_BYTES));
+        if (rank == 0)
+            VLOG(0) << "Tree AllReduce over " << allreduce->get_num_trees() << " tree(s) of height "
+                    << allreduce->get_height();
+        correctness_test(allreduce.get(), "Tree");
+        tree_times = bandwidth_test(allreduce.get(), "Tree");
+    }
+    if (rank == 0 && run_ring && run_tree)
+    {
+        for (auto &each : ring_times)
+        {
+            AllReduceAlgorithm selected = select_allreduce_algorithm(each.first, num_ranks, shape, tree_width);
+            AllReduceAlgorithm faster = each.second <= tree_times[each.first] ? AllReduceAlgorithm::RING
+                                                                               : AllReduceAlgorithm::TREE;
+            VLOG(0) << "AllReduce of " << each.first << " bytes: ring " << each.second << " us, tree "
+                    << tree_times[each.first] << " us, selected " << allreduce_algorithm_to_str(selected)
+                    << ", measured " << allreduce_algorithm_to_str(faster) << " faster";
+        }
+    }
+    mesh.finish();
+
+    for (auto &each_thread : session_threads)
+        each_thread.join();
+    return 0;
+}
@@ -0,0 +1,131 @@
+
+#include "rdma_channel.h"
+#include "rdma_completion.h"
+#include "util/logging.h"
+
+#include "util/time_record.h"
+#include <cstring>
+#include <functional>
+#include <vector>
+
+#define NUM_CQE_PER_POLL 128
+
+// measuring the cqe processing rate of the two dispatch paths with synthetic cqes, i.e.,
+//      -- std::function callbacks bound by std::bind and selected by switch (the registration api)
+//      -- CompletionHandler with the opcode handlers resolved at compile time
+// no rdma device is needed, only the dispatch overhead is measured.
+
+using namespace rdma_core;
+
+class CountingSession // mimic how RDMASession binds its default callbacks
+{
+public:
+    CountingSession()
+    {
+        process_send_done_ = std::bind(&CountingSession::count_send, this,
+                                       std::placeholders::_1, std::placeholders::_2);
+        process_recv_done_ = std::bind(&CountingSession::count_recv, this,
+                                       std::placeholders::_1, std::placeholders::_2);
+        process_recv_write_with_imm_done_ = std::bind(&CountingSession::count_recv, this,
+                                                      std::placeholders::_1, std::placeholders::_2);
+        process_write_done_ = std::bind(&CountingSession::count_send, this,
+                                        std::placeholders::_1, std::placeholders::_2);
+        process_read_done_ = std::bind(&CountingSession::count_send, this,
+                                       std::placeholders::_1, std::placeholders::_2);
+    }
+    void count_send(struct ibv_wc *wc, void *)
+    {
+        send_bytes += wc->byte_len;
+    }
+    void count_recv(struct ibv_wc *wc, void *)
+    {
+        recv_bytes += wc->byte_len;
+    }
+
+    uint64_t send_bytes = 0;
+    uint64_t recv_bytes = 0;
+    std::function<void(struct ibv_wc *wc, void *args)> process_send_done_;
+    std::function<void(struct ibv_wc *wc, void *args)> process_recv_done_;
+    std::function<void(struct ibv_wc *wc, void *args)> process_recv_write_with_imm_done_;
+    std::function<void(struct ibv_wc *wc, void *args)> process_write_done_;
+    std::function<void(struct ibv_wc *wc, void *args)> process_read_done_;
+};
+
+class CountingHandler : public CompletionHandler<CountingHandler>
+{
+public:
+    inline void on_send_done(struct ibv_wc *wc)
+    {
+        send_bytes += wc->byte_len;
+    }
+    inline void on_recv_done(struct ibv_wc *wc)
+    {
+        recv_bytes += wc->byte_len;
+    }
+    inline void on_write_done(struct ibv_wc *wc)
+    {
+        send_bytes += wc->byte_len;
+    }
+    inline void on_read_done(struct ibv_wc *wc)
+    {
+        send_bytes += wc->byte_len;
+    }
+    inline void on_recv_write_with_imm_done(struct ibv_wc *wc)
+    {
+        recv_bytes += wc->byte_len;
+    }
+
+    uint64_t send_bytes = 0;
+    uint64_t recv_bytes = 0;
+};
+
+template <typename Handler>
+double dispatch_rate_test(CompletionHandler<Handler> &handler,
+                          std::vector<struct ibv_wc> &wc_list,
+                          uint64_t num_polls)
+{
+    newplan::Timer timer;
+    timer.Start();
+    for (uint64_t poll_index = 0; poll_index < num_polls; poll_index++)
+        handler.dispatch_batch((RDMAChannel *)nullptr, wc_list.data(), wc_list.size());
+    timer.Stop();
+    return num_polls * wc_list.size() / (double)timer.MicroSeconds(); // Mops
+}
+
+int main(int argc, char *argv[])
+{
+    uint64_t num_polls = argc > 1 ? std::stoull(argv[1]) : 1000000;
+
+    const enum ibv_wc_opcode opcode_mix[] = {IBV_WC_SEND, IBV_WC_RECV, IBV_WC_RDMA_WRITE,
+                                             IBV_WC_RDMA_READ, IBV_WC_RECV_RDMA_WITH_IMM};
+    std::vector<struct ibv_wc> wc_list(NUM_CQE_PER_POLL);
+    for (uint32_t index = 0; index < wc_list.size(); index++)
+    {
+        memset(&wc_list[index], 0, sizeof(struct ibv_wc));
+        wc_list[index].status = IBV_WC_SUCCESS;
+        wc_list[index].opcode = opcode_mix[(index * 7) % 5]; // mixing opcodes, not a fixed pattern per slot
+        wc_list[index].byte_len = index;
+    }
+
+    CountingSession session;
+    CallbackCompletionHandler callback_handler(session.process_send_done_,
+                                               session.process_recv_done_,
+                                               session.process_recv_write_with_imm_done_,
+                                               session.process_write_done_,
+                                               session.process_read_done_);
+    CountingHandler static_handler;
+
+    dispatch_rate_test(callback_handler, wc_list, num_polls / 10); // warm up
+    dispatch_rate_test(static_handler, wc_list, num_polls / 10);
+
+    double callback_rate = dispatch_rate_test(callback_handler, wc_list, num_polls);
+    double static_rate = dispatch_rate_test(static_handler, wc_list, num_polls);
+
+    CHECK(session.send_bytes + session.recv_bytes == static_handler.send_bytes + static_handler.recv_bytes)
+        << "The two dispatch paths processed different cqes";
+
+    VLOG(0) << "CQE processing rate with std::function callbacks: " << callback_rate << " Mops";
+    VLOG(0) << "CQE processing rate with CompletionHandler: " << static_rate << " Mops ("
+            << static_rate / callback_rate << "x)";
+    return 0;
+}
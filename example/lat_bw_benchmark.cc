@@ -6,13 +6,36 @@
 #include "util/logging.h"
 
 #include "rdma_buffer.h"
+#include "rdma_completion_engine.h"
+#include "rdma_coroutine.h"
+#include "rdma_credit.h"
+#include "rdma_future.h"
+#include "rdma_messaging.h"
+#include "rdma_ring.h"
+#include "rdma_striping.h"
+#include "rdma_work_batch.h"
 
+#include "util/latency_histogram.h"
 #include "util/time_record.h"
+#include <atomic>
 #include <chrono>
+#include <fstream>
+#include <pthread.h>
 #include <thread>
+#include <time.h>
 #define B (1)
 #define KB (1024 * B)
 #define MB (1024 * KB)
+#define SMALL_MSG_SIZE (256 * B) // messages up to this size are inlined
+#define CREDIT_WINDOW 16         // receives posted by each side in the credit test
+#define CREDIT_TEST_MSGS 100000
+#define MESSAGE_PINGPONG_ITERS 1000
+#define RING_SIZE (1 * MB)        // the ring each side writes into in the ring test
+#define RING_TEST_MSGS 100000
+#define RATE_TEST_MS 1000          // each test of the message-rate mode posts so long
+#define RATE_MAX_MSG_SIZE (4 * KB) // the largest message of the message-rate mode
+#define RATE_RECV_DEPTH 1000       // receives the server keeps posted on each qp in the message-rate mode
+#define RATE_MAX_DEPTH 512         // so the reposted receives always cover the window of the client
 
 enum class MessageforTest : uint32_t
 {
@@ -24,12 +47,181 @@ enum class MessageforTest : uint32_t
     RESPONSE_TO_WRITE_TEST_REQUEST = 6,
     READ_TEST_REQUEST = 7,
     RESPONSE_TO_READ_TEST_REQUEST = 8,
+    RATE_TEST_STOP = 9, // the last message of a send test on each qp of the message-rate mode
 
     BYEBYE = 255,
     TEST_RAW_DATA = 299
 };
 
 using namespace rdma_core;
+
+static uint64_t thread_cpu_time_us() // cpu time consumed by the calling thread
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return ts.tv_sec * 1000000ULL + ts.tv_nsec / 1000;
+}
+
+static std::string mode_to_str(CompletionMode mode)
+{
+    switch (mode)
+    {
+        case CompletionMode::BUSY_POLLING:
+            return "busy-polling";
+        case CompletionMode::EVENT_DRIVEN:
+            return "event-driven";
+        case CompletionMode::ADAPTIVE:
+            return "adaptive";
+    }
+    return "unknown";
+}
+
+static std::string size_to_str(size_t msg_length)
+{
+    if (msg_length < KB)
+        return std::to_string(msg_length);
+    else if (msg_length < MB)
+        return std::to_string(msg_length / KB) + " K";
+    return std::to_string(msg_length / MB) + " M";
+}
+
+// the percentiles of every latency test, written as json if the file name ends with .json, as csv otherwise,
+// so the results can be compared across builds
+class LatencyReport
+{
+public:
+    void add(const std::string &test, size_t msg_length, const newplan::LatencyHistogram &histogram)
+    {
+        rows_.push_back({test, msg_length, histogram.count(), histogram.min(), histogram.percentile(50),
+                         histogram.percentile(90), histogram.percentile(99), histogram.percentile(99.9),
+                         histogram.max(), histogram.mean()});
+    }
+    void write(const std::string &file_name) const
+    {
+        std::ofstream out(file_name);
+        CHECK(out.is_open()) << "Failed to open " << file_name << " for the latency report";
+        bool json = file_name.size() >= 5 && file_name.compare(file_name.size() - 5, 5, ".json") == 0;
+        if (json)
+            out << "[\n";
+        else
+            out << "test,bytes,iters,min_ns,p50_ns,p90_ns,p99_ns,p999_ns,max_ns,avg_ns\n";
+        for (size_t index = 0; index < rows_.size(); index++)
+        {
+            const Row &row = rows_[index];
+            if (json)
+                out << "  {\"test\": \"" << row.test << "\", \"bytes\": " << row.bytes
+                    << ", \"iters\": " << row.iters << ", \"min_ns\": " << row.min
+                    << ", \"p50_ns\": " << row.p50 << ", \"p90_ns\": " << row.p90
+                    << ", \"p99_ns\": " << row.p99 << ", \"p999_ns\": " << row.p999
+                    << ", \"max_ns\": " << row.max << ", \"avg_ns\": " << row.avg << "}"
+                    << (index + 1 < rows_.size() ? ",\n" : "\n");
+            else
+                out << "\"" << row.test << "\"," << row.bytes << "," << row.iters << "," << row.min << ","
+                    << row.p50 << "," << row.p90 << "," << row.p99 << "," << row.p999 << "," << row.max << ","
+                    << row.avg << "\n";
+        }
+        if (json)
+            out << "]\n";
+        VLOG(0) << "Written " << rows_.size() << " latency results to " << file_name;
+    }
+
+private:
+    struct Row
+    {
+        std::string test; // e.g., "send, inline, busy-polling"
+        size_t bytes;
+        uint64_t iters, min, p50, p90, p99, p999, max; // in ns
+        double avg;
+    };
+    std::vector<Row> rows_;
+};
+
+enum class RateOp
+{
+    SEND = 0,
+    WRITE = 1,
+    READ = 2
+};
+
+static std::string rate_op_to_str(RateOp op)
+{
+    switch (op)
+    {
+        case RateOp::SEND:
+            return "send";
+        case RateOp::WRITE:
+            return "write";
+        case RateOp::READ:
+            return "read";
+    }
+    return "unknown";
+}
+
+static const uint32_t rate_msg_sizes[] = {8, 64, 512, RATE_MAX_MSG_SIZE};
+
+static void pin_to_core(uint32_t thread_index) // the threads of the message-rate mode run on their own cores
+{
+    uint32_t core = thread_index % std::max(std::thread::hardware_concurrency(), 1u);
+    cpu_set_t cpu_set;
+    CPU_ZERO(&cpu_set);
+    CPU_SET(core, &cpu_set);
+    if (pthread_setaffinity_np(pthread_self(), sizeof(cpu_set), &cpu_set) != 0)
+        LOG(WARNING) << "Failed to pin the thread " << thread_index << " to core " << core;
+}
+
+// the qps of one thread of the message-rate mode, only that thread posts to and polls them;
+// padded to a cache line, so the counters of the threads do not share one
+struct alignas(64) RateWorker
+{
+    std::vector<RDMAChannel *> channels;  // rate_qps data channels of the endpoint
+    std::unique_ptr<RDMABuffer> buffer;   // source or destination of every message of the thread
+    uint64_t completed = 0;               // operations completed before the end of the test
+    uint64_t elapsed_us = 0;              // how long the thread kept posting
+};
+
+// thread t takes the data channels [t * rate_qps, (t + 1) * rate_qps) of the endpoint
+static std::vector<RateWorker> build_rate_workers(RDMAEndPoint *endpoint, Config &work_env)
+{
+    CHECK(endpoint->get_num_channels() == work_env.rate_threads * work_env.rate_qps)
+        << "The message-rate mode needs " << work_env.rate_threads * work_env.rate_qps << " data channels, "
+        << "the endpoint holds " << endpoint->get_num_channels();
+    std::vector<RateWorker> workers(work_env.rate_threads);
+    for (uint32_t thread_index = 0; thread_index < work_env.rate_threads; thread_index++)
+    {
+        RateWorker &worker = workers[thread_index];
+        for (uint32_t qp_index = 0; qp_index < work_env.rate_qps; qp_index++)
+            worker.channels.push_back(endpoint->get_channel(thread_index * work_env.rate_qps + qp_index));
+        // one registration is valid for all the channels of the endpoint, they are on the same pd
+        worker.buffer.reset(RDMABuffer::allocate_buffer(RATE_MAX_MSG_SIZE, 1,
+                                                        "rate_buffer_" + std::to_string(thread_index),
+                                                        nullptr,
+                                                        RDMABuffer::device_local_policy(worker.channels[0])));
+        worker.channels[0]->register_buffer(worker.buffer.get());
+    }
+    return workers;
+}
+
+// runs body(worker) on one thread per worker, each pinned to its core, starting all of them at once
+template <typename Body>
+static void run_rate_workers(std::vector<RateWorker> &workers, Body body)
+{
+    std::atomic<uint32_t> num_ready{0};
+    std::vector<std::thread> threads;
+    for (uint32_t thread_index = 0; thread_index < workers.size(); thread_index++)
+    {
+        threads.emplace_back([&, thread_index]
+                             {
+                                 pin_to_core(thread_index);
+                                 num_ready++;
+                                 while (num_ready.load() < workers.size())
+                                     ;
+                                 body(&workers[thread_index]);
+                             });
+    }
+    for (auto &each_thread : threads)
+        each_thread.join();
+}
+
 class SchedulingClient : public RDMAClientSession
 {
 private:
@@ -37,6 +229,10 @@ private:
     RDMABuffer *benchmark_buffer = nullptr;
     struct ibv_wc global_wc[128];
     struct CommDescriptor buffer_peer;
+    std::unique_ptr<RDMAFutureTable> futures{RDMAFutureTable::build_future_table(16, "benchmark")};
+    RDMAFuture buffer_info_recv; // the response to REQUEST_BUFFER
+    std::unique_ptr<CreditChannel> credit; // one per channel, shared by the credit and the messaging tests
+    LatencyReport latency_report;          // the percentiles of lat_send, write_test and read_test
 
     void register_buffer(RDMAChannel *active_channel_)
     {
@@ -45,13 +241,16 @@ private:
         { // register memory buffer for test
             active_channel = active_channel_;
             benchmark_buffer = RDMABuffer::allocate_buffer(8 * MB, 1000,
-                                                           "benchmark_buffer");
+                                                           "benchmark_buffer",
+                                                           nullptr,
+                                                           RDMABuffer::device_local_policy(active_channel));
             active_channel->register_buffer(benchmark_buffer);
         }
 
         { // post recv here to recv buffer key
             RDMABuffer *buffer_recv = benchmark_buffer->at(0);
-            active_channel->recv_remote(buffer_recv, buffer_recv->buffer_size);
+            futures->attach(active_channel);
+            buffer_info_recv = futures->recv_remote(active_channel, buffer_recv, buffer_recv->buffer_size);
         }
         VLOG(0) << "Register buffer for test@" << info();
         TRACE_OUT;
@@ -61,44 +260,104 @@ private:
         TRACE_IN;
         // request exchange info
         RDMABuffer *buffer_to_send = benchmark_buffer->at(1);
-        active_channel->send_remote(buffer_to_send, 2,
-                                    static_cast<uint32_t>(MessageforTest::REQUEST_BUFFER));
+        RDMAFuture exchange[2];
+        exchange[0] = futures->send_remote(active_channel, buffer_to_send, 2,
+                                           static_cast<uint32_t>(MessageforTest::REQUEST_BUFFER));
+        exchange[1] = std::move(buffer_info_recv);
+        RDMAFuture exchanged = futures->when_all(exchange, 2);
+        CHECK(exchanged.wait())
+            << "Failed to query exchange info with error "
+            << ibv_wc_status_str(exchanged.get().status);
+        CHECK(static_cast<MessageforTest>(exchange[1].get().imm_data) == MessageforTest::RESPONSE_TO_REQUEST_BUFFER)
+            << "Unexpected message for the test benchmark";
+        // loading peer buffer
+        buffer_peer = *(struct CommDescriptor *)benchmark_buffer->at(0)->data_ptr;
+        VLOG(2) << "Exchange buffer Done";
+        TRACE_OUT;
+    }
+
+    // waits for the completion of the one operation in flight, by engine if it is set, otherwise by spinning
+    void wait_completion(CompletionEngine *engine, enum ibv_wc_opcode opcode)
+    {
         int num_wqe = 0;
-        bool send_completion = false;
-        bool recv_completion = false;
-        for (;;)
+        if (engine != nullptr)
+        {
+            num_wqe = engine->poll_completions(global_wc, 1);
+        }
+        else
         {
-            if (send_completion && recv_completion)
-                break;
             do
             {
                 num_wqe = active_channel->poll_cq_batch(global_wc, 1);
             } while (num_wqe == 0);
+        }
 
-            CHECK(global_wc[0].status == IBV_WC_SUCCESS)
-                << "Failed to query exchange info with error "
-                << ibv_wc_status_str(global_wc[0].status);
-            if (global_wc[0].opcode == IBV_WC_SEND)
-            {
-                CHECK(send_completion == false)
-                    << "Unexpected send completion events";
-                send_completion = true;
-                continue;
-            }
-            CHECK(global_wc[0].opcode == IBV_WC_RECV)
-                << "Receive unexpected opcode";
-            CHECK(static_cast<MessageforTest>(global_wc[0].imm_data) == MessageforTest::RESPONSE_TO_REQUEST_BUFFER)
-                << "Unexpected message for the test benchmark";
-            CHECK(recv_completion == false) << "Unexpected receive completion events";
-            recv_completion = true;
+        CHECK(global_wc[0].status == IBV_WC_SUCCESS)
+            << "Failed to query exchange info with error "
+            << ibv_wc_status_str(global_wc[0].status);
+        CHECK(global_wc[0].opcode == opcode) << "Unexpected opcode";
+        benchmark_buffer->last();
+    }
+    // one operation of a latency test: post it and wait for its completion
+    void send_once(size_t msg_length, CompletionEngine *engine)
+    {
+        active_channel->send_remote(benchmark_buffer->next(), msg_length,
+                                    static_cast<uint32_t>(MessageforTest::TEST_RAW_DATA));
+        wait_completion(engine, IBV_WC_SEND);
+    }
+    void write_once(size_t msg_length)
+    {
+        active_channel->write_remote(benchmark_buffer->next(),
+                                     msg_length,
+                                     &buffer_peer,
+                                     static_cast<uint32_t>(MessageforTest::TEST_RAW_DATA));
+        wait_completion(nullptr, IBV_WC_RDMA_WRITE);
+    }
+    void read_once(size_t msg_length)
+    {
+        active_channel->read_remote(benchmark_buffer->next(),
+                                    msg_length,
+                                    &buffer_peer);
+        wait_completion(nullptr, IBV_WC_RDMA_READ);
+    }
+
+    // bench_warmup untimed operations, then bench_iters ones, each timed on its own into histogram;
+    // returns the wall time of the timed ones in us, and their cpu time in cpu_us if it is set
+    template <typename Operation>
+    uint64_t measure_latency(newplan::LatencyHistogram *histogram, uint64_t *cpu_us, Operation operation)
+    {
+        for (uint32_t index = 0; index < work_env_.bench_warmup; index++)
+            operation();
+        histogram->reset();
+        uint64_t cpu_start_us = thread_cpu_time_us();
+        auto test_start = std::chrono::steady_clock::now();
+        for (uint32_t index = 0; index < work_env_.bench_iters; index++)
+        {
+            auto start = std::chrono::steady_clock::now();
+            operation();
+            auto stop = std::chrono::steady_clock::now();
+            histogram->record(std::chrono::duration_cast<std::chrono::nanoseconds>(stop - start).count());
         }
-        // loading peer buffer
-        buffer_peer = *(struct CommDescriptor *)benchmark_buffer->at(0)->data_ptr;
-        VLOG(2) << "Exchange buffer Done";
-        TRACE_OUT;
+        auto test_stop = std::chrono::steady_clock::now();
+        if (cpu_us != nullptr)
+            *cpu_us = thread_cpu_time_us() - cpu_start_us;
+        return std::chrono::duration_cast<std::chrono::microseconds>(test_stop - test_start).count();
+    }
+    void report_latency(const std::string &test, size_t msg_length, const newplan::LatencyHistogram &histogram)
+    {
+        VLOG(2) << "Latency for " << test << " (" << size_to_str(msg_length) << " bytes) in us: "
+                << "min " << histogram.min() / 1000.0
+                << ", p50 " << histogram.percentile(50) / 1000.0
+                << ", p90 " << histogram.percentile(90) / 1000.0
+                << ", p99 " << histogram.percentile(99) / 1000.0
+                << ", p99.9 " << histogram.percentile(99.9) / 1000.0
+                << ", max " << histogram.max() / 1000.0
+                << ", avg " << histogram.mean() / 1000.0;
+        latency_report.add(test, msg_length, histogram);
     }
 
-    void lat_send(size_t msg_length)
+    // the completions of the timed loop are waited by engine if it is set, otherwise by spinning
+    void lat_send(size_t msg_length, CompletionEngine *engine = nullptr)
     {
         TRACE_IN;
         active_channel->recv_remote(benchmark_buffer->at(0), 64);
@@ -135,81 +394,44 @@ private:
             CHECK(recv_completion == false) << "Unexpected receive completion events";
             recv_completion = true;
         }
-        newplan::Timer timer;
-        std::this_thread::sleep_for(std::chrono::milliseconds(1));
-        timer.Start();
-        for (int index = 0; index < 1000; index++)
-        {
-            active_channel->send_remote(benchmark_buffer->next(), msg_length,
-                                        static_cast<uint32_t>(MessageforTest::TEST_RAW_DATA));
-            do
-            {
-                num_wqe = active_channel->poll_cq_batch(global_wc, 1);
-            } while (num_wqe == 0);
-
-            CHECK(global_wc[0].status == IBV_WC_SUCCESS)
-                << "Failed to query exchange info with error "
-                << ibv_wc_status_str(global_wc[0].status);
-            CHECK(global_wc[0].opcode == IBV_WC_SEND) << "Unexpected opcode";
-            benchmark_buffer->last();
-        }
-        timer.Stop();
-        std::string format;
-        if (msg_length < KB)
-            format = std::to_string(msg_length);
-        else if (msg_length < MB)
-            format = std::to_string(msg_length / KB) + " K";
-        else
-            format = std::to_string(msg_length / MB) + " M";
-        VLOG(2) << "Latency for send (" << format << " bytes): " << timer.MicroSeconds() / 1000.0 << " us/op";
+        newplan::LatencyHistogram histogram;
+        uint64_t cpu_us = 0;
+        uint64_t elapsed_us = measure_latency(&histogram, &cpu_us, [&]
+                                              { send_once(msg_length, engine); });
+        std::string test = "send";
+        if (msg_length <= active_channel->get_inline_threshold())
+            test += ", inline";
+        if (engine != nullptr)
+            test += ", " + mode_to_str(engine->get_mode());
+        report_latency(test, msg_length, histogram);
+        VLOG(2) << "CPU usage of send (" << size_to_str(msg_length) << " bytes): "
+                << 100.0 * cpu_us / std::max<uint64_t>(elapsed_us, 1) << "%";
         TRACE_OUT;
     }
 
     void write_test(size_t msg_length)
     {
         TRACE_IN;
-        int num_wqe = 0;
-        newplan::Timer timer;
-        std::this_thread::sleep_for(std::chrono::milliseconds(1));
-        timer.Start();
-        for (int index = 0; index < 1000; index++)
-        {
-            active_channel->write_remote(benchmark_buffer->next(),
-                                         msg_length,
-                                         &buffer_peer,
-                                         static_cast<uint32_t>(MessageforTest::TEST_RAW_DATA));
-            do
-            {
-                num_wqe = active_channel->poll_cq_batch(global_wc, 1);
-            } while (num_wqe == 0);
-
-            CHECK(global_wc[0].status == IBV_WC_SUCCESS)
-                << "Failed to query exchange info with error "
-                << ibv_wc_status_str(global_wc[0].status);
-            CHECK(global_wc[0].opcode == IBV_WC_RDMA_WRITE) << "Unexpected opcode";
-            benchmark_buffer->last();
-        }
-        timer.Stop();
-        std::string format;
-        if (msg_length < KB)
-            format = std::to_string(msg_length);
-        else if (msg_length < MB)
-            format = std::to_string(msg_length / KB) + " K";
-        else
-            format = std::to_string(msg_length / MB) + " M";
-        VLOG(2) << "Latency for write (" << format << " bytes): " << timer.MicroSeconds() / 1000.0 << " us/op";
+        newplan::LatencyHistogram histogram;
+        measure_latency(&histogram, nullptr, [&]
+                        { write_once(msg_length); });
+        report_latency("write", msg_length, histogram);
         TRACE_OUT;
     }
 
-    void write_bw_test(size_t msg_length)
+    void write_bw_test(size_t msg_length, uint32_t signal_interval = 1)
     {
         TRACE_IN;
+        active_channel->set_signal_policy(SignalPolicy::SIGNAL_EVERY_N, signal_interval);
         int num_wqe = 0;
+        int num_cqe = 0;
         newplan::Timer timer;
         std::this_thread::sleep_for(std::chrono::milliseconds(1));
         timer.Start();
         for (int index = 0; index < 1000; index++)
         {
+            if (index == 999) // whatever the interval, the cqe of the last write retires the tail
+                active_channel->flush_signal();
             active_channel->write_remote(benchmark_buffer->next(), //next
                                          msg_length,
                                          &buffer_peer,
@@ -230,12 +452,15 @@ private:
                     << "Failed to query exchange info with error "
                     << ibv_wc_status_str(global_wc[wc_index].status);
                 CHECK(global_wc[wc_index].opcode == IBV_WC_RDMA_WRITE) << "Unexpected opcode";
-                benchmark_buffer->last();
-                confirm++;
+                int64_t retired = active_channel->retire_sqe();
+                benchmark_buffer->release(retired);
+                confirm += retired;
+                num_cqe++;
             }
         }
         timer.Stop();
         CHECK(confirm == 1000);
+        active_channel->set_signal_policy(SignalPolicy::SIGNAL_ALL);
         std::string format;
         if (msg_length < KB)
             format = std::to_string(msg_length);
@@ -243,7 +468,9 @@ private:
             format = std::to_string(msg_length / KB) + " K";
         else
             format = std::to_string(msg_length / MB) + " M";
-        VLOG(2) << "BW for write (" << format << " bytes): " << 8 * (1000.0 * msg_length) / timer.MicroSeconds() / 1000 << " Gbps";
+        VLOG(2) << "BW for write (" << format << " bytes, signal 1/" << signal_interval << "): "
+                << 8 * (1000.0 * msg_length) / timer.MicroSeconds() / 1000 << " Gbps, polled "
+                << num_cqe << " cqes";
         TRACE_OUT;
     }
 
@@ -293,28 +520,258 @@ private:
         TRACE_OUT;
     }
 
-    void read_test(size_t msg_length)
+    // a burst far beyond the receives of the peer, the sends queue locally instead of meeting RNR naks
+    void credit_send_test(size_t msg_length)
     {
         TRACE_IN;
-        int num_wqe = 0;
+        newplan::Timer timer;
+        timer.Start();
+        uint32_t num_sent = 0;
+        while (num_sent < CREDIT_TEST_MSGS || !credit->idle())
+        {
+            while (num_sent < CREDIT_TEST_MSGS &&
+                   credit->send_remote(benchmark_buffer->at(1), msg_length,
+                                       static_cast<uint32_t>(MessageforTest::TEST_RAW_DATA)))
+                num_sent++;
+
+            int num_wqe = active_channel->poll_cq_batch(global_wc, 128);
+            for (int wc_index = 0; wc_index < num_wqe; wc_index++)
+            {
+                CHECK(!(global_wc[wc_index].opcode & IBV_WC_RECV)) << "Unexpected recv in the credit test";
+                credit->on_send_done(&global_wc[wc_index]);
+            }
+            credit->progress(); // the credit words written by the peer
+        }
+        timer.Stop();
+        VLOG(2) << "Message rate with " << CREDIT_WINDOW << " credits (" << msg_length << " bytes): "
+                << CREDIT_TEST_MSGS / (double)timer.MicroSeconds() << " M msg/s, stalled "
+                << credit->get_num_stalls() << " times";
+        active_channel->get_registered_endpoint()->sync_with_peer("credit test done");
+        TRACE_OUT;
+    }
+
+    // feed the cqes to the engine until a message of the peer arrives, the completions of the sends are dropped
+    struct MessageCompletion wait_message(MessageEngine *engine)
+    {
+        struct MessageCompletion completion;
+        for (;;)
+        {
+            while (engine->next_completion(&completion))
+            {
+                if (!completion.is_send)
+                    return completion;
+            }
+            int num_wqe = active_channel->poll_cq_batch(global_wc, 128);
+            for (int wc_index = 0; wc_index < num_wqe; wc_index++)
+                engine->on_completion(&global_wc[wc_index]);
+            engine->progress();
+        }
+    }
+
+    // round trips of one message size by the protocol the eager threshold picks, return us per round trip
+    double message_pingpong_test(MessageEngine *engine, size_t msg_length)
+    {
+        RDMABuffer *source = benchmark_buffer->at(2);
+        RDMABuffer *dest = benchmark_buffer->at(3);
+        newplan::Timer timer;
+        timer.Start();
+        for (int index = 0; index < MESSAGE_PINGPONG_ITERS; index++)
+        {
+            engine->post_recv(dest, dest->buffer_size);
+            CHECK(engine->send_message(source, msg_length, static_cast<uint32_t>(MessageforTest::TEST_RAW_DATA)) != 0)
+                << "No staging block left for the ping";
+            struct MessageCompletion pong = wait_message(engine);
+            CHECK(pong.length == msg_length) << "Unexpected pong of " << pong.length << " bytes";
+        }
+        timer.Stop();
+        return timer.MicroSeconds() / (double)MESSAGE_PINGPONG_ITERS;
+    }
+
+    // ping-pong each size eagerly and by rendezvous, the crossover is the first size where rendezvous wins
+    void message_crossover_test()
+    {
+        TRACE_IN;
+        std::unique_ptr<MessageEngine> engine(
+            MessageEngine::build_message_engine(credit.get(), work_env_.eager_threshold));
+        uint32_t configured_threshold = engine->get_eager_threshold();
+        size_t max_eager = engine->get_max_eager_threshold();
+        size_t crossover = 0;
+        for (size_t msg_length = 64; msg_length <= 1 * MB; msg_length *= 2)
+        {
+            double eager_us = 0;
+            if (msg_length <= max_eager)
+            {
+                engine->set_eager_threshold(msg_length);
+                eager_us = message_pingpong_test(engine.get(), msg_length);
+            }
+            engine->set_eager_threshold(std::min(msg_length - 1, max_eager));
+            double rendezvous_us = message_pingpong_test(engine.get(), msg_length);
+            if (eager_us > 0)
+                VLOG(2) << "Round trip of " << msg_length << " bytes: " << eager_us << " us eager, "
+                        << rendezvous_us << " us rendezvous";
+            else
+                VLOG(2) << "Round trip of " << msg_length << " bytes: " << rendezvous_us << " us rendezvous";
+            if (crossover == 0 && eager_us > 0 && rendezvous_us < eager_us)
+                crossover = msg_length;
+        }
+        if (crossover != 0)
+            VLOG(0) << "Eager/rendezvous crossover at " << crossover << " bytes, the eager threshold is "
+                    << configured_threshold << " bytes";
+        else
+            VLOG(0) << "Eager wins up to " << max_eager << " bytes (the bounce buffers), the eager threshold is "
+                    << configured_threshold << " bytes";
+
+        engine->set_eager_threshold(configured_threshold);
+        CHECK(engine->send_message(benchmark_buffer->at(2), 0, static_cast<uint32_t>(MessageforTest::BYEBYE)) != 0)
+            << "No staging block left for byebye";
+        while (!engine->idle())
+        {
+            int num_wqe = active_channel->poll_cq_batch(global_wc, 128);
+            for (int wc_index = 0; wc_index < num_wqe; wc_index++)
+                engine->on_completion(&global_wc[wc_index]);
+            engine->progress();
+        }
+        active_channel->get_registered_endpoint()->sync_with_peer("message test done");
+        TRACE_OUT;
+    }
+
+    // messages of 64 B - 4 KB written into the ring of the peer, no receive buffer is posted per message
+    void ring_send_test()
+    {
+        TRACE_IN;
+        std::unique_ptr<RingChannel> ring(RingChannel::build_ring_channel(active_channel, RING_SIZE));
+        newplan::Timer timer;
+        timer.Start();
+        uint32_t num_sent = 0;
+        uint64_t bytes_sent = 0;
+        while (num_sent < RING_TEST_MSGS || !ring->idle())
+        {
+            while (num_sent < RING_TEST_MSGS)
+            {
+                uint32_t msg_length = 64 << (num_sent % 7);
+                if (!ring->send_remote(benchmark_buffer->at(1), msg_length,
+                                       static_cast<uint32_t>(MessageforTest::TEST_RAW_DATA)))
+                    break;
+                num_sent++;
+                bytes_sent += msg_length;
+            }
+
+            int num_wqe = active_channel->poll_cq_batch(global_wc, 128);
+            for (int wc_index = 0; wc_index < num_wqe; wc_index++)
+            {
+                CHECK(!(global_wc[wc_index].opcode & IBV_WC_RECV)) << "Unexpected recv in the ring test";
+                ring->on_send_done(&global_wc[wc_index]);
+            }
+            ring->progress();
+        }
+        timer.Stop();
+        VLOG(2) << "Message rate through a " << RING_SIZE / KB << " KB ring (64 B - 4 KB): "
+                << RING_TEST_MSGS / (double)timer.MicroSeconds() << " M msg/s, "
+                << 8.0 * bytes_sent / timer.MicroSeconds() / 1000 << " Gbps, stalled " << ring->get_num_stalls()
+                << " times, read the head back " << ring->get_num_head_reads() << " times";
+        active_channel->get_registered_endpoint()->sync_with_peer("ring test done");
+        TRACE_OUT;
+    }
+
+    // one coroutine keeps one write in flight, the scheduler resumes it once the write completes
+    RDMATask write_worker(RDMAScheduler *scheduler, size_t msg_length, uint32_t num_writes)
+    {
+        for (uint32_t index = 0; index < num_writes; index++)
+        {
+            struct ibv_wc wc = co_await scheduler->write_remote(active_channel,
+                                                                benchmark_buffer->next(),
+                                                                msg_length,
+                                                                &buffer_peer,
+                                                                static_cast<uint32_t>(MessageforTest::TEST_RAW_DATA));
+            CHECK(wc.status == IBV_WC_SUCCESS)
+                << "Failed to write with error " << ibv_wc_status_str(wc.status);
+            benchmark_buffer->release(1);
+        }
+    }
+
+    void write_bw_coroutine_test(size_t msg_length, uint32_t num_coroutines)
+    {
+        TRACE_IN;
+        CHECK(1000 % num_coroutines == 0) << "The writes should be shared evenly by the coroutines";
+        std::unique_ptr<RDMAScheduler> scheduler(RDMAScheduler::build_scheduler(num_coroutines, "write_bw"));
+        newplan::Timer timer;
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        timer.Start();
+        for (uint32_t coroutine_index = 0; coroutine_index < num_coroutines; coroutine_index++)
+            scheduler->spawn(write_worker(scheduler.get(), msg_length, 1000 / num_coroutines));
+        scheduler->run();
+        timer.Stop();
+        std::string format;
+        if (msg_length < KB)
+            format = std::to_string(msg_length);
+        else if (msg_length < MB)
+            format = std::to_string(msg_length / KB) + " K";
+        else
+            format = std::to_string(msg_length / MB) + " M";
+        VLOG(2) << "BW for write (" << format << " bytes, " << num_coroutines << " coroutine(s)): "
+                << 8 * (1000.0 * msg_length) / timer.MicroSeconds() / 1000 << " Gbps";
+        TRACE_OUT;
+    }
+
+    void write_bw_striped_test(StripedChannel *striped, size_t msg_length)
+    {
+        TRACE_IN;
+        std::vector<uint64_t> transfers;
         newplan::Timer timer;
         std::this_thread::sleep_for(std::chrono::milliseconds(1));
         timer.Start();
         for (int index = 0; index < 1000; index++)
         {
-            active_channel->read_remote(benchmark_buffer->next(),
-                                        msg_length,
-                                        &buffer_peer);
-            do
-            {
-                num_wqe = active_channel->poll_cq_batch(global_wc, 1);
-            } while (num_wqe == 0);
+            transfers.push_back(striped->write_remote(benchmark_buffer->at(index), msg_length, &buffer_peer,
+                                                      static_cast<uint32_t>(MessageforTest::TEST_RAW_DATA)));
+        }
+        for (uint64_t transfer_id : transfers)
+            striped->wait(transfer_id);
+        timer.Stop();
+        std::string format;
+        if (msg_length < KB)
+            format = std::to_string(msg_length);
+        else if (msg_length < MB)
+            format = std::to_string(msg_length / KB) + " K";
+        else
+            format = std::to_string(msg_length / MB) + " M";
+        VLOG(2) << "BW for striped write (" << format << " bytes, " << striped->get_num_channels() << " qps): "
+                << 8 * (1000.0 * msg_length) / timer.MicroSeconds() / 1000 << " Gbps";
+        TRACE_OUT;
+    }
 
-            CHECK(global_wc[0].status == IBV_WC_SUCCESS)
-                << "Failed to query exchange info with error "
-                << ibv_wc_status_str(global_wc[0].status);
-            CHECK(global_wc[0].opcode == IBV_WC_RDMA_READ) << "Unexpected opcode";
-            benchmark_buffer->last();
+    void write_rate_test(size_t msg_length, uint32_t batch_size)
+    {
+        TRACE_IN;
+        const int total_msgs = 64 * 1000;
+        const int max_outstanding = 512;
+        WorkBatch batch(batch_size, "write_rate_batch");
+        int num_wqe = 0;
+        int posted = 0, confirm = 0;
+        newplan::Timer timer;
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        timer.Start();
+        while (confirm < total_msgs)
+        {
+            while (posted < total_msgs && posted - confirm + (int)batch_size <= max_outstanding)
+            {
+                for (uint32_t index = 0; index < batch_size && posted + (int)batch.size() < total_msgs; index++)
+                {
+                    batch.add_write(benchmark_buffer->at(0), msg_length, &buffer_peer,
+                                    static_cast<uint32_t>(MessageforTest::TEST_RAW_DATA));
+                }
+                posted += batch.size();
+                active_channel->post_batch(&batch);
+            }
+            num_wqe = active_channel->poll_cq_batch(global_wc, 128);
+            for (int wc_index = 0; wc_index < num_wqe; wc_index++)
+            {
+                CHECK(global_wc[wc_index].status == IBV_WC_SUCCESS)
+                    << "Failed to query exchange info with error "
+                    << ibv_wc_status_str(global_wc[wc_index].status);
+                CHECK(global_wc[wc_index].opcode == IBV_WC_RDMA_WRITE) << "Unexpected opcode";
+                confirm += active_channel->retire_sqe();
+            }
         }
         timer.Stop();
         std::string format;
@@ -324,10 +781,150 @@ private:
             format = std::to_string(msg_length / KB) + " K";
         else
             format = std::to_string(msg_length / MB) + " M";
-        VLOG(2) << "Latency for read (" << format << " bytes): " << timer.MicroSeconds() / 1000.0 << " us/op";
+        VLOG(2) << "Message rate for write (" << format << " bytes, batch " << batch_size << "): "
+                << total_msgs / (double)timer.MicroSeconds() << " Mops";
+        TRACE_OUT;
+    }
+
+    void read_test(size_t msg_length)
+    {
+        TRACE_IN;
+        newplan::LatencyHistogram histogram;
+        measure_latency(&histogram, nullptr, [&]
+                        { read_once(msg_length); });
+        report_latency("read", msg_length, histogram);
         TRACE_OUT;
     }
 
+    void post_rate_op(RDMAChannel *channel, RDMABuffer *buffer, RateOp op, uint32_t msg_length)
+    {
+        switch (op)
+        {
+            case RateOp::SEND:
+                channel->send_remote(buffer, msg_length, static_cast<uint32_t>(MessageforTest::TEST_RAW_DATA));
+                break;
+            case RateOp::WRITE:
+                channel->write_remote(buffer, msg_length, &buffer_peer,
+                                      static_cast<uint32_t>(MessageforTest::TEST_RAW_DATA));
+                break;
+            case RateOp::READ:
+                channel->read_remote(buffer, msg_length, &buffer_peer);
+                break;
+        }
+    }
+
+    // keeps rate_depth operations in flight on each qp of the worker for RATE_TEST_MS, then drains them
+    void rate_worker_loop(RateWorker *worker, RateOp op, uint32_t msg_length)
+    {
+        struct ibv_wc wc[64];
+        std::vector<uint32_t> outstanding(worker->channels.size(), 0);
+        worker->completed = 0;
+        bool stopped = false;
+        auto start = std::chrono::steady_clock::now();
+        auto deadline = start + std::chrono::milliseconds(RATE_TEST_MS);
+        for (uint64_t round = 1;; round++)
+        {
+            bool in_flight = false;
+            for (size_t qp_index = 0; qp_index < worker->channels.size(); qp_index++)
+            {
+                RDMAChannel *channel = worker->channels[qp_index];
+                for (; !stopped && outstanding[qp_index] < work_env_.rate_depth; outstanding[qp_index]++)
+                    post_rate_op(channel, worker->buffer.get(), op, msg_length);
+                if (outstanding[qp_index] == 0)
+                    continue;
+                in_flight = true;
+                int num_wqe = channel->poll_cq_batch(wc, 64);
+                uint32_t retired = 0;
+                for (int wc_index = 0; wc_index < num_wqe; wc_index++)
+                {
+                    CHECK(wc[wc_index].status == IBV_WC_SUCCESS)
+                        << "Failed to " << rate_op_to_str(op) << " in the message-rate test with error "
+                        << ibv_wc_status_str(wc[wc_index].status);
+                    retired += channel->retire_sqe();
+                }
+                outstanding[qp_index] -= retired;
+                if (!stopped)
+                    worker->completed += retired;
+            }
+            if (!stopped && round % 64 == 0 && std::chrono::steady_clock::now() >= deadline)
+            {
+                stopped = true;
+                worker->elapsed_us = std::chrono::duration_cast<std::chrono::microseconds>(
+                                         std::chrono::steady_clock::now() - start)
+                                         .count();
+            }
+            if (stopped && !in_flight)
+                break;
+        }
+
+        if (op != RateOp::SEND)
+            return;
+        for (auto *channel : worker->channels)
+        { // the server counts the send tests by these, one per qp each
+            channel->send_remote(worker->buffer.get(), 0, static_cast<uint32_t>(MessageforTest::RATE_TEST_STOP));
+            int num_wqe = 0;
+            do
+            {
+                num_wqe = channel->poll_cq_batch(wc, 1);
+            } while (num_wqe == 0);
+            CHECK(wc[0].status == IBV_WC_SUCCESS && wc[0].opcode == IBV_WC_SEND)
+                << "Failed to stop the message-rate test with error " << ibv_wc_status_str(wc[0].status);
+            channel->retire_sqe();
+        }
+    }
+
+    void rate_test(std::vector<RateWorker> &workers, RateOp op, uint32_t msg_length)
+    {
+        TRACE_IN;
+        run_rate_workers(workers, [&](RateWorker *worker)
+                         { rate_worker_loop(worker, op, msg_length); });
+
+        // the aggregated rate, and how evenly the threads share it (jain's index, 1 for a fair share)
+        double total_mops = 0, sum_squares = 0;
+        double min_mops = 0, max_mops = 0;
+        std::string per_thread;
+        for (size_t index = 0; index < workers.size(); index++)
+        {
+            double mops = workers[index].completed / (double)std::max<uint64_t>(workers[index].elapsed_us, 1);
+            total_mops += mops;
+            sum_squares += mops * mops;
+            min_mops = index == 0 ? mops : std::min(min_mops, mops);
+            max_mops = std::max(max_mops, mops);
+            per_thread += (index == 0 ? "" : ", ") + std::to_string(mops);
+        }
+        double fairness = sum_squares > 0 ? total_mops * total_mops / (workers.size() * sum_squares) : 0;
+        VLOG(2) << "Message rate for " << rate_op_to_str(op) << " (" << size_to_str(msg_length) << " bytes, "
+                << workers.size() << " threads x " << work_env_.rate_qps << " qps, depth " << work_env_.rate_depth
+                << "): " << total_mops << " Mops, " << total_mops * msg_length * 8 / 1000 << " Gbps, "
+                << "per thread " << min_mops << " ~ " << max_mops << " Mops, fairness " << fairness;
+        VLOG(3) << "Mops of each thread: " << per_thread;
+        TRACE_OUT;
+    }
+
+    // the message-rate mode instead of the tests above: rate_threads threads, each on its own core, keep
+    // rate_depth operations in flight on each of their rate_qps qps, as a nic only saturates with many of both
+    void rate_tests(RDMAEndPoint *endpoint)
+    {
+        std::vector<RateWorker> workers = build_rate_workers(endpoint, work_env_);
+        endpoint->sync_with_peer("message-rate test start"); // the server has posted its receives
+
+        for (RateOp op : {RateOp::SEND, RateOp::WRITE, RateOp::READ})
+        {
+            for (uint32_t msg_length : rate_msg_sizes)
+                rate_test(workers, op, msg_length);
+        }
+
+        active_channel->send_remote(benchmark_buffer->at(0), 64,
+                                    static_cast<uint32_t>(MessageforTest::BYEBYE));
+        int num_wqe = 0;
+        do
+        {
+            num_wqe = active_channel->poll_cq_batch(global_wc, 1);
+        } while (num_wqe == 0);
+        CHECK(global_wc[0].status == IBV_WC_SUCCESS && global_wc[0].opcode == IBV_WC_SEND)
+            << "Failed to say byebye with error " << ibv_wc_status_str(global_wc[0].status);
+    }
+
 public:
     SchedulingClient(Config &conf) :
         RDMAClientSession(conf)
@@ -351,12 +948,42 @@ public:
             aggregated_channels[0]->get_registered_endpoint()->sync_with_peer("benchmark test start");
         }
         exchange_buffer_info();
+        if (work_env_.rate_threads > 0)
+        {
+            rate_tests(active_channel->get_registered_endpoint());
+            return;
+        }
         std::this_thread::sleep_for(std::chrono::seconds(1));
         for (uint32_t buffer_size = 1; buffer_size <= 8 * MB; buffer_size *= 2)
         {
             std::this_thread::sleep_for(std::chrono::milliseconds(10));
             lat_send(buffer_size);
         }
+        { // the same small messages without inlining, to compare with the above
+            uint32_t inline_threshold = active_channel->get_inline_threshold();
+            active_channel->set_inline_threshold(0);
+            for (uint32_t buffer_size = 1; buffer_size <= SMALL_MSG_SIZE; buffer_size *= 2)
+            {
+                std::this_thread::sleep_for(std::chrono::milliseconds(10));
+                lat_send(buffer_size);
+            }
+            active_channel->set_inline_threshold(inline_threshold);
+        }
+        for (CompletionMode mode : {CompletionMode::BUSY_POLLING,
+                                    CompletionMode::EVENT_DRIVEN,
+                                    CompletionMode::ADAPTIVE})
+        { // the small messages again, waiting for the completions in each mode
+            std::unique_ptr<CompletionEngine> engine(
+                CompletionEngine::build_completion_engine(mode, work_env_.busy_poll_us, 64,
+                                                          "lat_send_" + mode_to_str(mode)));
+            engine->attach(active_channel);
+            for (uint32_t buffer_size = 1; buffer_size <= SMALL_MSG_SIZE; buffer_size *= 2)
+            {
+                std::this_thread::sleep_for(std::chrono::milliseconds(10));
+                lat_send(buffer_size, engine.get());
+            }
+            VLOG(2) << engine->info() << " blocked " << engine->get_num_sleeps() << " times";
+        }
 
         for (uint32_t buffer_size = 1; buffer_size <= 8 * MB; buffer_size *= 2)
         {
@@ -366,12 +993,20 @@ public:
         {
             read_test(buffer_size);
         }
+        if (!work_env_.latency_report.empty())
+            latency_report.write(work_env_.latency_report);
 
         VLOG(0) << "Using round-robin data buffer for BW test";
         for (uint32_t buffer_size = 1; buffer_size <= 8 * MB; buffer_size *= 2)
         {
             write_bw_test(buffer_size);
         }
+        VLOG(0) << "Using selective signaling for BW test";
+        for (uint32_t buffer_size = 1; buffer_size <= 8 * MB; buffer_size *= 2)
+        {
+            write_bw_test(buffer_size, 2);
+            write_bw_test(buffer_size, 8);
+        }
         // using fake data(only one piece of data buffer)
         VLOG(0) << "Using one data buffer for BW test";
         for (uint32_t buffer_size = 1; buffer_size <= 8 * MB; buffer_size *= 2)
@@ -379,19 +1014,72 @@ public:
             write_bw_test_fake(buffer_size);
         }
 
+        VLOG(0) << "Using coroutines for BW test";
+        for (uint32_t num_coroutines : {1, 8, 125})
+        {
+            for (uint32_t buffer_size = 1; buffer_size <= 8 * MB; buffer_size *= 4)
+            {
+                write_bw_coroutine_test(buffer_size, num_coroutines);
+            }
+        }
+
+        RDMAEndPoint *active_ep = active_channel->get_registered_endpoint();
+        if (active_ep->get_num_channels() > 1)
+        {
+            VLOG(0) << "Striping writes over " << active_ep->get_num_channels() << " data channels for BW test";
+            std::unique_ptr<StripedChannel> striped(StripedChannel::build_striped_channel(active_ep));
+            for (uint32_t buffer_size = 64 * KB; buffer_size <= 8 * MB; buffer_size *= 2)
+            {
+                write_bw_striped_test(striped.get(), buffer_size);
+            }
+        }
+
+        VLOG(0) << "Using linked work request chains for message rate test";
+        for (uint32_t batch_size : {1, 4, 16, 64})
+        {
+            for (uint32_t buffer_size = 1; buffer_size <= 4 * KB; buffer_size *= 4)
+            {
+                write_rate_test(buffer_size, batch_size);
+            }
+        }
+
         active_channel->send_remote(benchmark_buffer->at(0), 64,
                                     static_cast<uint32_t>(MessageforTest::BYEBYE));
+        int num_wqe = 0;
+        do
+        {
+            num_wqe = active_channel->poll_cq_batch(global_wc, 1);
+        } while (num_wqe == 0);
+        CHECK(global_wc[0].status == IBV_WC_SUCCESS && global_wc[0].opcode == IBV_WC_SEND)
+            << "Failed to say byebye with error " << ibv_wc_status_str(global_wc[0].status);
+
+        VLOG(0) << "Using credit-based flow control for message rate test";
+        credit.reset(CreditChannel::build_credit_channel(active_channel, CREDIT_WINDOW, work_env_.bounce_buffer_size));
+        credit_send_test(64);
+
+        VLOG(0) << "Using eager/rendezvous messages for latency test";
+        message_crossover_test();
+        credit.reset(); // its receives stay posted, they carry the first notifications of the ring
+
+        VLOG(0) << "Using a remote ring buffer for message rate test";
+        ring_send_test();
     }
     virtual void lazy_config_hca()
     {
         CHECK(end_point_mgr_.size() == 1) << "Invalid configuration for your test";
         for (auto &each_endpoint : end_point_mgr_)
         {
-            auto &a_config = each_endpoint->get_channel()->get_config();
-            a_config.using_shared_cq = false;
-            a_config.max_recv_wr = 1024;
-            a_config.max_send_wr = 1024;
-            a_config.cq_size = a_config.max_recv_wr + a_config.max_send_wr;
+            for (auto *each_channel : each_endpoint->get_all_channels())
+            {
+                auto &a_config = each_channel->get_config();
+                a_config.using_shared_cq = false;
+                a_config.max_recv_wr = 1024;
+                a_config.max_send_wr = 1024;
+                a_config.max_inline_data = SMALL_MSG_SIZE;
+                a_config.max_send_sge = 2; // the ring test gathers the frame header and the payload
+                a_config.use_event_channel = true; // to compare the completion modes
+                a_config.cq_size = a_config.max_recv_wr + a_config.max_send_wr;
+            }
         }
     } // hook before the connecting endpoint
     virtual void post_connecting()
@@ -407,6 +1095,7 @@ private:
     RDMABuffer *benchmark_buffer = nullptr;
     struct ibv_wc global_wc[128];
     std::mutex m_mutex;
+    std::unique_ptr<CreditChannel> credit; // one per channel, shared by the credit and the messaging tests
 
     void register_buffer(RDMAChannel *active_channel_)
     {
@@ -414,7 +1103,9 @@ private:
         { // register memory buffer for test
             active_channel = active_channel_;
             benchmark_buffer = RDMABuffer::allocate_buffer(8 * MB, 1000,
-                                                           "benchmark_buffer");
+                                                           "benchmark_buffer",
+                                                           nullptr,
+                                                           RDMABuffer::device_local_policy(active_channel));
             active_channel->register_buffer(benchmark_buffer);
         }
 
@@ -480,7 +1171,11 @@ private:
         CHECK(global_wc[0].opcode == IBV_WC_RECV)
             << "Receive unexpected opcode";
 
-        for (int index = 0; index < 1000; index++)
+        // the client sends bench_warmup + bench_iters messages, more than the receive queue holds are
+        // reposted as the first ones complete
+        uint32_t total_msgs = work_env_.bench_warmup + work_env_.bench_iters;
+        uint32_t num_posted = std::min<uint32_t>(total_msgs, 1000);
+        for (uint32_t index = 0; index < num_posted; index++)
         {
             RDMABuffer *buffer_bin = benchmark_buffer->next();
             active_channel->recv_remote(buffer_bin, buffer_bin->buffer_size);
@@ -498,7 +1193,7 @@ private:
         CHECK(global_wc[0].opcode == IBV_WC_SEND)
             << "Receive unexpected opcode";
 
-        for (int index = 0; index < 1000; index++)
+        for (uint32_t index = 0; index < total_msgs; index++)
         {
             do
             {
@@ -513,7 +1208,115 @@ private:
             CHECK(static_cast<MessageforTest>(global_wc[0].imm_data) == MessageforTest::TEST_RAW_DATA)
                 << "Invalid msg_type";
             benchmark_buffer->last();
+            if (num_posted < total_msgs)
+            {
+                RDMABuffer *buffer_bin = benchmark_buffer->next();
+                active_channel->recv_remote(buffer_bin, buffer_bin->buffer_size);
+                num_posted++;
+            }
+        }
+    }
+
+    // consume the burst of the client with CREDIT_WINDOW receives, the credits go back by credit writes
+    void credit_recv_test()
+    {
+        uint32_t num_received = 0;
+        while (num_received < CREDIT_TEST_MSGS || !credit->idle())
+        {
+            int num_wqe = active_channel->poll_cq_batch(global_wc, 128);
+            for (int wc_index = 0; wc_index < num_wqe; wc_index++)
+            {
+                if (!(global_wc[wc_index].opcode & IBV_WC_RECV))
+                {
+                    credit->on_send_done(&global_wc[wc_index]);
+                    continue;
+                }
+                RDMABuffer *block = credit->on_recv_done(&global_wc[wc_index]);
+                CHECK(static_cast<MessageforTest>(global_wc[wc_index].imm_data) == MessageforTest::TEST_RAW_DATA)
+                    << "Invalid msg_type";
+                credit->repost(block);
+                num_received++;
+            }
+        }
+        VLOG(2) << "Received " << num_received << " messages with " << CREDIT_WINDOW << " credits, written "
+                << credit->get_num_credit_updates() << " credit updates";
+        active_channel->get_registered_endpoint()->sync_with_peer("credit test done");
+    }
+
+    // feed the cqes to the engine until a message of the peer arrives, the completions of the sends are dropped
+    struct MessageCompletion wait_message(MessageEngine *engine)
+    {
+        struct MessageCompletion completion;
+        for (;;)
+        {
+            while (engine->next_completion(&completion))
+            {
+                if (!completion.is_send)
+                    return completion;
+            }
+            int num_wqe = active_channel->poll_cq_batch(global_wc, 128);
+            for (int wc_index = 0; wc_index < num_wqe; wc_index++)
+                engine->on_completion(&global_wc[wc_index]);
+            engine->progress();
+        }
+    }
+
+    // echo each message of the client by the protocol it came with, until byebye
+    void message_echo_test()
+    {
+        std::unique_ptr<MessageEngine> engine(
+            MessageEngine::build_message_engine(credit.get(), work_env_.eager_threshold));
+        RDMABuffer *source = benchmark_buffer->at(2);
+        RDMABuffer *dest = benchmark_buffer->at(3);
+        size_t max_eager = engine->get_max_eager_threshold();
+        uint32_t num_echoed = 0;
+        for (;;)
+        {
+            engine->post_recv(dest, dest->buffer_size);
+            struct MessageCompletion ping = wait_message(engine.get());
+            if (static_cast<MessageforTest>(ping.msg_tag) == MessageforTest::BYEBYE)
+                break;
+            engine->set_eager_threshold(std::min(ping.eager ? ping.length : ping.length - 1, max_eager));
+            CHECK(engine->send_message(source, ping.length, ping.msg_tag) != 0) << "No staging block left for the pong";
+            num_echoed++;
         }
+        while (!engine->idle())
+        {
+            int num_wqe = active_channel->poll_cq_batch(global_wc, 128);
+            for (int wc_index = 0; wc_index < num_wqe; wc_index++)
+                engine->on_completion(&global_wc[wc_index]);
+            engine->progress();
+        }
+        VLOG(2) << "Echoed " << num_echoed << " messages, " << engine->get_num_eager() << " eagerly and "
+                << engine->get_num_rendezvous() << " by rendezvous";
+        active_channel->get_registered_endpoint()->sync_with_peer("message test done");
+    }
+
+    // release each message of the client as soon as it arrives, the head goes back by the reads of the client
+    void ring_recv_test()
+    {
+        std::unique_ptr<RingChannel> ring(RingChannel::build_ring_channel(active_channel, RING_SIZE));
+        uint32_t num_received = 0;
+        while (num_received < RING_TEST_MSGS)
+        {
+            int num_wqe = active_channel->poll_cq_batch(global_wc, 128);
+            for (int wc_index = 0; wc_index < num_wqe; wc_index++)
+            {
+                if (!(global_wc[wc_index].opcode & IBV_WC_RECV))
+                {
+                    ring->on_send_done(&global_wc[wc_index]);
+                    continue;
+                }
+                struct RingMessage message;
+                ring->on_recv_done(&global_wc[wc_index], &message);
+                CHECK(static_cast<MessageforTest>(message.msg_tag) == MessageforTest::TEST_RAW_DATA)
+                    << "Invalid msg_type";
+                ring->release();
+                num_received++;
+            }
+        }
+        VLOG(2) << "Received " << num_received << " messages through a " << RING_SIZE / KB << " KB ring";
+        active_channel->get_registered_endpoint()->sync_with_peer("ring test done");
     }
 
 public:
@@ -528,6 +1331,62 @@ public:
     }
 
     // a loop to processing complement queue events
+    // reposts each receive once it completes, until the worker got the stop of every qp for every send test
+    void serve_rate_sends(RateWorker *worker, uint32_t num_send_tests)
+    {
+        struct ibv_wc wc[64];
+        uint32_t num_stops = 0;
+        while (num_stops < num_send_tests * worker->channels.size())
+        {
+            for (auto *channel : worker->channels)
+            {
+                int num_wqe = channel->poll_cq_batch(wc, 64);
+                for (int wc_index = 0; wc_index < num_wqe; wc_index++)
+                {
+                    CHECK(wc[wc_index].status == IBV_WC_SUCCESS && wc[wc_index].opcode == IBV_WC_RECV)
+                        << "Failed to receive in the message-rate test with error "
+                        << ibv_wc_status_str(wc[wc_index].status);
+                    if (static_cast<MessageforTest>(wc[wc_index].imm_data) == MessageforTest::RATE_TEST_STOP)
+                        num_stops++;
+                    else
+                        CHECK(static_cast<MessageforTest>(wc[wc_index].imm_data) == MessageforTest::TEST_RAW_DATA)
+                            << "Invalid msg_type";
+                    channel->recv_remote(worker->buffer.get(), RATE_MAX_MSG_SIZE);
+                }
+            }
+        }
+    }
+
+    // the peer of SchedulingClient::rate_tests(), only its send tests need the server
+    void rate_tests(RDMAEndPoint *endpoint)
+    {
+        std::vector<RateWorker> workers = build_rate_workers(endpoint, work_env_);
+        for (auto &worker : workers)
+        {
+            for (auto *channel : worker.channels)
+            {
+                for (uint32_t index = 0; index < RATE_RECV_DEPTH; index++)
+                    channel->recv_remote(worker.buffer.get(), RATE_MAX_MSG_SIZE);
+            }
+        }
+        endpoint->sync_with_peer("message-rate test start");
+
+        uint32_t num_send_tests = sizeof(rate_msg_sizes) / sizeof(rate_msg_sizes[0]);
+        run_rate_workers(workers, [&](RateWorker *worker)
+                         { serve_rate_sends(worker, num_send_tests); });
+
+        // the byebye after the write and read tests lands in a receive still posted on the first channel
+        int num_wqe = 0;
+        do
+        {
+            num_wqe = active_channel->poll_cq_batch(global_wc, 1);
+        } while (num_wqe == 0);
+        CHECK(global_wc[0].status == IBV_WC_SUCCESS && global_wc[0].opcode == IBV_WC_RECV)
+            << "Failed to receive byebye with error " << ibv_wc_status_str(global_wc[0].status);
+        CHECK(static_cast<MessageforTest>(global_wc[0].imm_data) == MessageforTest::BYEBYE)
+            << "Unexpected message for the test benchmark";
+    }
+
     virtual void process_CQ(std::vector<RDMAChannel *> aggregated_channels)
     {
         CHECK(aggregated_channels.size() == 1) << "Invalid aggregated_channels for this task";
@@ -539,11 +1398,25 @@ public:
         }
 
         exchange_buffer_info();
+        if (work_env_.rate_threads > 0)
+        {
+            rate_tests(active_channel->get_registered_endpoint());
+            return;
+        }
 
         for (uint32_t buffer_size = 1; buffer_size <= 8 * MB; buffer_size *= 2)
         {
             lat_send();
         }
+        for (uint32_t buffer_size = 1; buffer_size <= SMALL_MSG_SIZE; buffer_size *= 2)
+        { // the small messages are sent again without inlining
+            lat_send();
+        }
+        for (uint32_t mode_index = 0; mode_index < 3; mode_index++)
+        { // and again for each completion mode of the client
+            for (uint32_t buffer_size = 1; buffer_size <= SMALL_MSG_SIZE; buffer_size *= 2)
+                lat_send();
+        }
 
         active_channel->recv_remote(benchmark_buffer->at(0), 64);
         int num_wqe = 0;
@@ -559,18 +1432,27 @@ public:
             << "Receive unexpected opcode";
         CHECK(static_cast<MessageforTest>(global_wc[0].imm_data) == MessageforTest::BYEBYE)
             << "Unexpected message for the test benchmark";
+
+        credit.reset(CreditChannel::build_credit_channel(active_channel, CREDIT_WINDOW, work_env_.bounce_buffer_size));
+        credit_recv_test();
+        message_echo_test();
+        credit.reset(); // its receives stay posted, they carry the first notifications of the ring
+        ring_recv_test();
     }
     virtual void lazy_config_hca()
     {
         //CHECK(end_point_mgr_.size() == 1) << "Invalid configuration for server";
         for (auto &each_endpoint : end_point_mgr_)
         {
-            auto &a_config = each_endpoint->get_channel()->get_config();
-            a_config.using_shared_cq = false;
-            a_config.max_recv_wr = 1024;
-            a_config.max_send_wr = 1024;
-            a_config.cq_size = a_config.max_recv_wr + a_config.max_send_wr;
-            //a_config.traffic_class = 64;
+            for (auto *each_channel : each_endpoint->get_all_channels())
+            {
+                auto &a_config = each_channel->get_config();
+                a_config.using_shared_cq = false;
+                a_config.max_recv_wr = 1024;
+                a_config.max_send_wr = 1024;
+                a_config.cq_size = a_config.max_recv_wr + a_config.max_send_wr;
+                //a_config.traffic_class = 64;
+            }
         }
     } // hook before the connecting endpoint
     virtual void post_connecting()
@@ -588,6 +1470,11 @@ int main(int argc, char *argv[])
 {
     Derived_Config conf;
     conf.parse_args(argc, argv);
+    if (conf.rate_threads > 0)
+    { // each thread of the message-rate mode takes its own data channels of the peer
+        CHECK(conf.rate_depth <= RATE_MAX_DEPTH) << "At most " << RATE_MAX_DEPTH << " operations in flight per qp";
+        conf.num_data_channels = conf.rate_threads * conf.rate_qps;
+    }
 
     std::unique_ptr<rdma_core::RDMASession> session = nullptr;
     if (conf.role == "master")
@@ -614,6 +1501,7 @@ int main(int argc, char *argv[])
     session->init_session();
     session->connecting();
     session->running();
+    VLOG(0) << "Counters of the channels:\n" << stats_to_text(session->snapshot_stats());
 
     return 0;
 }
\ No newline at end of file
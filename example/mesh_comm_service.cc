@@ -2,7 +2,10 @@
 
 #include "config.h"
 #include "rdma_client_sess.h"
+#include "rdma_memory_pool.h"
 #include "rdma_server_sess.h"
+#include "rdma_srq.h"
+#include "rdma_work_batch.h"
 #include "util/logging.h"
 #include <memory>
 #include <thread>
@@ -13,6 +16,7 @@
 
 #define NUM_BLOCK 128
 #define BLOCK_SIZE 16 * KB
+#define SRQ_POOL_BLOCKS 1024 // receive blocks shared by all channels of the server, whatever the cluster size
 #define TRAFFIC_CLASS 0
 
 enum class MsgDataChannel : uint32_t
@@ -53,13 +57,19 @@ namespace
             // CHECK(end_point_mgr_.size() == 1) << "Invalid configuration for your test";
             for (auto &each_endpoint : end_point_mgr_)
             {
-                auto &a_config = each_endpoint->get_channel()->get_config();
-                a_config.using_shared_cq = true;
-                a_config.max_recv_wr = NUM_BLOCK;
-                a_config.max_send_wr = NUM_BLOCK;
-                a_config.traffic_class = TRAFFIC_CLASS;
-                a_config.cq_key = "GlobalSharedCQForRecv";
-                a_config.cq_size = (a_config.max_recv_wr + a_config.max_send_wr) * end_point_mgr_.size();
+                for (auto *each_channel : each_endpoint->get_all_channels())
+                {
+                    auto &a_config = each_channel->get_config();
+                    a_config.using_shared_cq = true;
+                    a_config.max_recv_wr = NUM_BLOCK;
+                    a_config.max_send_wr = NUM_BLOCK;
+                    a_config.traffic_class = TRAFFIC_CLASS;
+                    a_config.cq_key = "GlobalSharedCQForRecv";
+                    a_config.cq_size = (a_config.max_recv_wr + a_config.max_send_wr) * end_point_mgr_.size();
+                    a_config.using_shared_rq = true; // recv blocks come from one bounded pool
+                    a_config.srq_key = "GlobalSharedRQForRecv";
+                    a_config.srq_size = SRQ_POOL_BLOCKS;
+                }
             }
         }
         virtual void post_connecting()
@@ -73,35 +83,31 @@ namespace
 
             VLOG(2) << "This thread holds " << num_channels << " Channels";
 
-            std::vector<std::unique_ptr<RDMABuffer>> tensor_buffer_recv;
             std::vector<std::unique_ptr<RDMABuffer>> tensor_buffer_send;
+            // the channels share one pd (keyed by srq_key), so their send buffers come from one registered pool
+            RDMAMemoryPool *send_pool = RDMAMemoryPool::get_memory_pool(aggregated_channels[0]);
 
             for (uint32_t chan_index = 0; chan_index < num_channels; chan_index++)
             {
                 RDMABuffer *tmp_buffer;
                 tmp_buffer = RDMABuffer::allocate_buffer(BLOCK_SIZE, // 1MB bytes per block
                                                          NUM_BLOCK,  // 128 blocks
-                                                         "datachannel_write_placeholder");
+                                                         "datachannel_write_placeholder",
+                                                         send_pool);
                 tensor_buffer_send.push_back(std::move(std::unique_ptr<RDMABuffer>(tmp_buffer)));
                 aggregated_channels[chan_index]->register_buffer(tmp_buffer); // register send buffer
-
-                tmp_buffer = RDMABuffer::allocate_buffer(BLOCK_SIZE, // 1MB bytes per block
-                                                         NUM_BLOCK,  // 128 blocks
-                                                         "datachannel_recv_placeholder");
-                tensor_buffer_recv.push_back(std::move(std::unique_ptr<RDMABuffer>(tmp_buffer)));
-                aggregated_channels[chan_index]->register_buffer(tmp_buffer); // register recv buffer
                 aggregated_channels[chan_index]->setup_index_in_session(chan_index);
             }
 
-            for (uint32_t chan_index = 0; chan_index < num_channels; chan_index++)
-            {
-                for (uint32_t buffer_bin = 0; buffer_bin < NUM_BLOCK; buffer_bin++)
-                {
-                    RDMAChannel *active_channel = aggregated_channels[chan_index];
-                    RDMABuffer *recv_buf = tensor_buffer_recv[chan_index]->next();
-                    active_channel->recv_remote(recv_buf, BLOCK_SIZE);
-                }
-            }
+            // all channels share the srq, so the recv pool is registered once and posted once
+            std::unique_ptr<RDMASharedRecvQueue> shared_recv_queue(
+                RDMASharedRecvQueue::build_shared_recv_queue(aggregated_channels[0],
+                                                             BLOCK_SIZE,
+                                                             SRQ_POOL_BLOCKS,
+                                                             32,
+                                                             "datachannel_recv_pool"));
+            for (auto *active_channel : aggregated_channels)
+                shared_recv_queue->attach(active_channel);
 
             for (auto &active_channel : aggregated_channels)
             {
@@ -127,23 +133,26 @@ namespace
                             LOG(FATAL) << "[ERROR]: Encounting unsuccess wqe: " << each_channel->info()
                                        << ", for: " << ibv_wc_status_str(global_wc[wqe_index].status);
                         }
-                        RDMAChannel *active_channel = (RDMAChannel *)global_wc[wqe_index].wr_id;
+                        RDMAChannel *active_channel = nullptr;
+                        if (global_wc[wqe_index].opcode & IBV_WC_RECV) // recv cqes carry the srq block as wr_id
+                            active_channel = static_cast<RDMAChannel *>(shared_recv_queue->resolve_source(&global_wc[wqe_index]));
+                        else
+                            active_channel = (RDMAChannel *)global_wc[wqe_index].wr_id;
                         uint32_t channel_index = active_channel->get_index_in_session();
 
                         switch (global_wc[wqe_index].opcode)
                         {
                             case IBV_WC_SEND:
                             {
-                                active_channel->decrease_sqe();
-                                tensor_buffer_send[channel_index]->last(); // ack last
+                                int64_t retired = active_channel->retire_sqe();
+                                tensor_buffer_send[channel_index]->release(retired); // ack the retired ones
                                 VLOG_EVERY_N(3, SHOWN_LOG_EVERN_N) << "Send Done";
                                 break;
                             }
                             case IBV_WC_RECV:
                             {
                                 VLOG_EVERY_N(3, SHOWN_LOG_EVERN_N) << "Recv completion";
-                                tensor_buffer_recv[channel_index]->last();
-                                active_channel->decrease_rqe();
+                                RDMABuffer *recv_block = shared_recv_queue->fetch_block(&global_wc[wqe_index]);
 
                                 MsgDataChannel msg = static_cast<MsgDataChannel>(global_wc[wqe_index].imm_data);
                                 if (msg == MsgDataChannel::REQUEST_BUFFER)
@@ -164,8 +173,7 @@ namespace
                                     UNIMPLEMENTED;
                                 }
 
-                                RDMABuffer *next_recv_buffer = tensor_buffer_recv[channel_index]->next();
-                                active_channel->recv_remote(next_recv_buffer, BLOCK_SIZE);
+                                shared_recv_queue->release(recv_block);
                                 break;
                             }
                             case IBV_WC_RECV_RDMA_WITH_IMM:
@@ -206,13 +214,16 @@ namespace
             CHECK(end_point_mgr_.size() == 1) << "Invalid configuration for your test";
             for (auto &each_endpoint : end_point_mgr_)
             {
-                auto &a_config = each_endpoint->get_channel()->get_config();
-                a_config.using_shared_cq = false;
-                a_config.max_recv_wr = NUM_BLOCK;
-                a_config.max_send_wr = NUM_BLOCK;
-                a_config.traffic_class = TRAFFIC_CLASS;
-                // a_config.cq_key = "GlobalSharedCQForRecv";
-                a_config.cq_size = (a_config.max_recv_wr + a_config.max_send_wr) * end_point_mgr_.size();
+                for (auto *each_channel : each_endpoint->get_all_channels())
+                {
+                    auto &a_config = each_channel->get_config();
+                    a_config.using_shared_cq = false;
+                    a_config.max_recv_wr = NUM_BLOCK;
+                    a_config.max_send_wr = NUM_BLOCK;
+                    a_config.traffic_class = TRAFFIC_CLASS;
+                    // a_config.cq_key = "GlobalSharedCQForRecv";
+                    a_config.cq_size = (a_config.max_recv_wr + a_config.max_send_wr) * end_point_mgr_.size();
+                }
             }
         }
         virtual void post_connecting()
@@ -237,13 +248,17 @@ namespace
                 RDMABuffer *tmp_buffer;
                 tmp_buffer = RDMABuffer::allocate_buffer(BLOCK_SIZE, // 1MB bytes per block
                                                          NUM_BLOCK,  // 128 blocks
-                                                         "datachannel_write_placeholder");
+                                                         "datachannel_write_placeholder",
+                                                         nullptr,
+                                                         RDMABuffer::device_local_policy(aggregated_channels[chan_index]));
                 tensor_buffer_send.push_back(std::move(std::unique_ptr<RDMABuffer>(tmp_buffer)));
                 aggregated_channels[chan_index]->register_buffer(tmp_buffer); // register send buffer
 
                 tmp_buffer = RDMABuffer::allocate_buffer(BLOCK_SIZE, // 1MB bytes per block
                                                          NUM_BLOCK,  // 128 blocks
-                                                         "datachannel_recv_placeholder");
+                                                         "datachannel_recv_placeholder",
+                                                         nullptr,
+                                                         RDMABuffer::device_local_policy(aggregated_channels[chan_index]));
                 tensor_buffer_recv.push_back(std::move(std::unique_ptr<RDMABuffer>(tmp_buffer)));
                 aggregated_channels[chan_index]->register_buffer(tmp_buffer); // register recv buffer
                 aggregated_channels[chan_index]->setup_index_in_session(chan_index);
@@ -273,6 +288,7 @@ namespace
             }
 
             struct ibv_wc global_wc[128];
+            WorkBatch write_batch(NUM_BLOCK, "mesh_write_batch");
 
             do {
                 for (auto *each_channel : aggregated_channels)
@@ -297,8 +313,8 @@ namespace
                         {
                             case IBV_WC_SEND:
                             {
-                                active_channel->decrease_sqe();
-                                tensor_buffer_send[channel_index]->last(); // ack last
+                                int64_t retired = active_channel->retire_sqe();
+                                tensor_buffer_send[channel_index]->release(retired); // ack the retired ones
                                 VLOG_EVERY_N(3, SHOWN_LOG_EVERN_N) << "Send Done";
                                 break;
                             }
@@ -320,13 +336,14 @@ namespace
                                     UNIMPLEMENTED;
                                 }
                                 for (uint32_t bin_index = 0; bin_index < NUM_BLOCK - 1; bin_index++)
-                                { // write to peer
+                                { // write to peer, one doorbell for the whole window
                                     RDMABuffer *next_send_buf = tensor_buffer_send[channel_index]->next();
                                     // next_send_buf = tensor_buffer_send[channel_index]->at(0);
-                                    active_channel->write_remote(
+                                    write_batch.add_write(
                                         next_send_buf, next_send_buf->buffer_size, &peer_comm_fd_mgr[channel_index],
                                         static_cast<uint32_t>(MsgDataChannel::TRANSFER_RAW_DATA));
                                 }
+                                active_channel->post_batch(&write_batch);
                                 break;
                             }
                             case IBV_WC_RECV_RDMA_WITH_IMM:
@@ -337,15 +354,18 @@ namespace
                             case IBV_WC_RDMA_WRITE:
                             {
                                 VLOG_EVERY_N(3, SHOWN_LOG_EVERN_N / 100) << "WRITE completion";
-                                active_channel->decrease_sqe();
-
-                                tensor_buffer_send[channel_index]->last(); // ack last
+                                int64_t retired = active_channel->retire_sqe();
 
-                                RDMABuffer *next_send_buf = tensor_buffer_send[channel_index]->next();
-                                // next_send_buf = tensor_buffer_send[channel_index]->at(0);
-                                active_channel->write_remote(next_send_buf, next_send_buf->buffer_size,
-                                                             &peer_comm_fd_mgr[channel_index],
-                                                             static_cast<uint32_t>(MsgDataChannel::TRANSFER_RAW_DATA));
+                                tensor_buffer_send[channel_index]->release(retired); // ack the retired ones
+                                for (int64_t bin = 0; bin < retired; bin++)
+                                { // refill the window
+                                    RDMABuffer *next_send_buf = tensor_buffer_send[channel_index]->next();
+                                    // next_send_buf = tensor_buffer_send[channel_index]->at(0);
+                                    write_batch.add_write(next_send_buf, next_send_buf->buffer_size,
+                                                          &peer_comm_fd_mgr[channel_index],
+                                                          static_cast<uint32_t>(MsgDataChannel::TRANSFER_RAW_DATA));
+                                }
+                                active_channel->post_batch(&write_batch);
                                 break;
                             }
                             default:
@@ -0,0 +1,180 @@
+#include "rdma_reduce.h"
+#include "util/logging.h"
+
+#include "util/time_record.h"
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <string>
+#include <vector>
+
+#define B (1)
+#define KB (1024 * B)
+#define MB (1024 * KB)
+#define REDUCE_BYTES (256 * KB) // a chunk of the allreduce, so the buffers stay in the caches
+#define REDUCE_ITERS 50 // per type, op and isa, the whole run takes seconds even unoptimized
+
+// measuring the reduction kernels of each isa the cpu supports, i.e.,
+//      -- GB/s of reduce_buffers() per type and op, the bytes of dst over the time, next to memcpy of the same bytes
+//      -- reduce_copy_buffers() against reduce_buffers() followed by a memcpy of the result
+// every kernel is first checked against the scalar one, tails included.
+// no rdma device is needed, usage: reduce_benchmark [bytes] [iterations]
+
+using namespace rdma_core;
+
+namespace
+{
+    const ReduceDataType all_types[] = {ReduceDataType::FLOAT32, ReduceDataType::FLOAT16, ReduceDataType::BFLOAT16,
+                                        ReduceDataType::INT8, ReduceDataType::INT32, ReduceDataType::INT64};
+    const ReduceOp all_ops[] = {ReduceOp::SUM, ReduceOp::PROD, ReduceOp::MAX, ReduceOp::MIN};
+    const ReduceIsa all_isas[] = {ReduceIsa::SCALAR, ReduceIsa::AVX2, ReduceIsa::AVX512};
+
+    // values around 1, so a few products neither overflow nor vanish, and never a nan;
+    // ones only, if the buffer is folded in over and over by prod, so the floats never become denormal
+    void fill_buffer(std::vector<uint8_t> &buffer, ReduceDataType type, std::mt19937 &random, bool ones = false)
+    {
+        size_t count = buffer.size() / reduce_type_size(type);
+        std::uniform_real_distribution<float> real(0.5f, 2.0f);
+        for (size_t index = 0; index < count; index++)
+        {
+            float value = ones ? 1.0f : real(random);
+            uint64_t bits = ones ? 1 : ((uint64_t)random() << 32) | random();
+            switch (type)
+            {
+                case ReduceDataType::FLOAT32: ((float *)buffer.data())[index] = value; break;
+                case ReduceDataType::FLOAT16: ((uint16_t *)buffer.data())[index] = float_to_half(value); break;
+                case ReduceDataType::BFLOAT16: ((uint16_t *)buffer.data())[index] = float_to_bfloat16(value); break;
+                case ReduceDataType::INT8: ((int8_t *)buffer.data())[index] = (int8_t)bits; break;
+                case ReduceDataType::INT32: ((int32_t *)buffer.data())[index] = (int32_t)bits; break;
+                case ReduceDataType::INT64: ((int64_t *)buffer.data())[index] = (int64_t)bits; break;
+            }
+        }
+    }
+
+    // every isa must produce the bytes of the scalar kernel, for a count with a tail after the last vector
+    void correctness_test(ReduceIsa isa)
+    {
+        std::mt19937 random(2024);
+        for (auto type : all_types)
+        {
+            size_t count = 4 * KB + 13;
+            size_t bytes = count * reduce_type_size(type);
+            std::vector<uint8_t> dst(bytes), src(bytes);
+            fill_buffer(dst, type, random);
+            fill_buffer(src, type, random);
+            for (auto op : all_ops)
+            {
+                std::vector<uint8_t> expected = dst, result = dst, copy(bytes, 0);
+                set_reduce_isa(ReduceIsa::SCALAR);
+                reduce_buffers(expected.data(), src.data(), count, type, op);
+                set_reduce_isa(isa);
+                reduce_copy_buffers(result.data(), copy.data(), src.data(), count, type, op);
+                CHECK(result == expected && copy == expected)
+                    << "The " << reduce_isa_to_str(isa) << " kernel of " << reduce_op_to_str(op) << " over "
+                    << reduce_type_to_str(type) << " differs from the scalar one";
+            }
+        }
+        VLOG(2) << "The " << reduce_isa_to_str(isa) << " kernels match the scalar ones";
+    }
+
+    void usage(const char *argv0)
+    {
+        fprintf(stdout, "Usage:\n");
+        fprintf(stdout, " %s [bytes] [iterations]\n", argv0);
+        fprintf(stdout, "\n");
+        fprintf(stdout, "Options:\n");
+        fprintf(stdout, " bytes       bytes of each buffer to reduce (default %d)\n", REDUCE_BYTES);
+        fprintf(stdout, " iterations  timed reductions per type, op and isa (default %d)\n", REDUCE_ITERS);
+        fprintf(stdout, " -h, --help  show this message\n");
+    }
+
+    // a positive number in arg, or 0 if it is not one
+    uint64_t parse_count(const char *arg)
+    {
+        char *end = nullptr;
+        errno = 0;
+        unsigned long long value = strtoull(arg, &end, 0);
+        if (arg[0] == '-' || end == arg || *end != '\0' || errno != 0)
+            return 0;
+        return value;
+    }
+
+    template <typename Function>
+    double gbytes_per_second(size_t bytes, uint64_t iterations, Function function)
+    {
+        for (uint64_t iter = 0; iter < iterations / 10 + 1; iter++) // warm up
+            function();
+        newplan::Timer timer;
+        timer.Start();
+        for (uint64_t iter = 0; iter < iterations; iter++)
+            function();
+        timer.Stop();
+        return (double)bytes * iterations / timer.MicroSeconds() / 1000;
+    }
+}; // namespace
+
+int main(int argc, char *argv[])
+{
+    if (argc > 1 && (strcmp(argv[1], "-h") == 0 || strcmp(argv[1], "--help") == 0))
+    {
+        usage(argv[0]);
+        exit(0);
+    }
+    size_t bytes = argc > 1 ? parse_count(argv[1]) : REDUCE_BYTES;
+    uint64_t iterations = argc > 2 ? parse_count(argv[2]) : REDUCE_ITERS;
+    bytes = bytes / sizeof(int64_t) * sizeof(int64_t);
+    if (argc > 3 || bytes == 0 || iterations == 0)
+    { // at least one int64 to reduce, once
+        usage(argv[0]);
+        exit(-1);
+    }
+
+    ReduceIsa widest = get_reduce_isa();
+    VLOG(0) << "The cpu supports the " << reduce_isa_to_str(widest) << " kernels, reducing " << bytes << " bytes "
+            << iterations << " times";
+    for (auto isa : all_isas)
+    {
+        if (reduce_isa_supported(isa))
+            correctness_test(isa);
+    }
+
+    std::mt19937 random(7);
+    std::vector<uint8_t> dst(bytes), src(bytes), copy(bytes);
+    double memcpy_rate = gbytes_per_second(bytes, iterations, [&]
+                                           { memcpy(dst.data(), src.data(), bytes); });
+    VLOG(0) << "memcpy: " << memcpy_rate << " GB/s";
+
+    for (auto isa : all_isas)
+    {
+        if (!reduce_isa_supported(isa))
+            continue;
+        set_reduce_isa(isa);
+        for (auto type : all_types)
+        {
+            size_t count = bytes / reduce_type_size(type);
+            for (auto op : all_ops)
+            {
+                // dst folds src in over and over, the 16-bit floats may saturate, which costs no more
+                fill_buffer(src, type, random, op == ReduceOp::PROD);
+                fill_buffer(dst, type, random);
+                double reduce_rate = gbytes_per_second(bytes, iterations, [&]
+                                                       { reduce_buffers(dst.data(), src.data(), count, type, op); });
+                double two_pass_rate = gbytes_per_second(bytes, iterations, [&]
+                                                         {
+                                                             reduce_buffers(dst.data(), src.data(), count, type, op);
+                                                             memcpy(copy.data(), dst.data(), bytes);
+                                                         });
+                double fused_rate = gbytes_per_second(bytes, iterations, [&]
+                                                      { reduce_copy_buffers(dst.data(), copy.data(), src.data(),
+                                                                            count, type, op); });
+                VLOG(0) << reduce_isa_to_str(isa) << " " << reduce_op_to_str(op) << " of " << reduce_type_to_str(type)
+                        << ": " << reduce_rate << " GB/s (" << reduce_rate / memcpy_rate << "x memcpy), "
+                        << "reduce+copy: " << fused_rate << " GB/s fused, " << two_pass_rate << " GB/s in two passes";
+            }
+        }
+    }
+    set_reduce_isa(widest);
+    return 0;
+}
@@ -0,0 +1,77 @@
+
+#include "config.h"
+#include "rdma_client_sess.h"
+#include "rdma_server_sess.h"
+#include "util/logging.h"
+
+#include "util/time_record.h"
+#include <iostream>
+#include <thread>
+#include <vector>
+
+#define DEFAULT_NUM_PEERS 128
+
+// measuring how long a server takes to connect many loopback peers, i.e.,
+//      -- accepting the peers and creating their endpoints
+//      -- loading, exchanging and connecting the qps of all endpoints
+// once with a single bootstrap worker (close to the sequential setup), once with the whole pool.
+// usage: startup_benchmark -d <dev> --num <peers> -p <base port>
+
+using namespace rdma_core;
+
+static uint64_t connect_peers(Config conf, uint32_t num_peers, uint32_t bootstrap_workers)
+{
+    conf.bootstrap_workers = bootstrap_workers;
+    conf.cluster.assign(num_peers, "127.0.0.1"); // the server waits for cluster.size() peers
+    conf.master_ip = "127.0.0.1";
+
+    newplan::Timer timer;
+    std::unique_ptr<RDMASession> server_sess(nullptr);
+    std::thread server_thread([&]
+                              {
+                                  conf.serve_as_client = false;
+                                  server_sess.reset(new RDMAServerSession(conf));
+                                  timer.Start();
+                                  server_sess->init_session();
+                                  server_sess->connecting();
+                                  timer.Stop();
+                              });
+
+    std::vector<std::unique_ptr<RDMASession>> client_sess(num_peers);
+    std::vector<std::thread> client_threads;
+    for (uint32_t peer_index = 0; peer_index < num_peers; peer_index++)
+    {
+        client_threads.push_back(std::thread([&, peer_index]
+                                             {
+                                                 Config client_conf = conf;
+                                                 client_conf.serve_as_client = true;
+                                                 client_conf.cluster.clear();
+                                                 client_sess[peer_index].reset(new RDMAClientSession(client_conf));
+                                                 client_sess[peer_index]->init_session();
+                                                 client_sess[peer_index]->connecting();
+                                             }));
+    }
+    for (auto &client_thread : client_threads)
+        client_thread.join();
+    server_thread.join();
+    return timer.MicroSeconds();
+}
+
+int main(int argc, char *argv[])
+{
+    Derived_Config conf;
+    conf.parse_args(argc, argv);
+    uint32_t num_peers = conf.num_senders > 0 ? conf.num_senders : DEFAULT_NUM_PEERS;
+
+    uint32_t base_port = conf.tcp_port;
+    uint32_t round = 0;
+    for (uint32_t bootstrap_workers : {1u, 0u})
+    {
+        conf.tcp_port = base_port + round++; // a fresh port, the last listener may linger in TIME_WAIT
+        uint64_t elapsed_us = connect_peers(conf, num_peers, bootstrap_workers);
+        std::cout << "Connecting " << num_peers << " loopback peers with "
+                  << (bootstrap_workers == 0 ? std::string("all") : std::to_string(bootstrap_workers))
+                  << " bootstrap worker(s): " << elapsed_us / 1000.0 << " ms" << std::endl;
+    }
+    return 0;
+}
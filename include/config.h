@@ -57,6 +57,18 @@ public:
         fprintf(stdout, " -d, --ib-dev <dev> use IB device <dev> (default first device found)\n");
         fprintf(stdout, " -i, --ib-port <port> use port <port> of IB device (default 1)\n");
         fprintf(stdout, " -g, --gid_idx <git index> gid index to be used in GRH (default not used)\n");
+        fprintf(stdout, " -e, --event-channel wait for completions on the event channel instead of spinning\n");
+        fprintf(stdout, " --busy-poll-us <us> busy-poll so long after the last completion before blocking (default 50)\n");
+        fprintf(stdout, " --data-channels <n> connect each peer with n data channels, striping large writes (default 1)\n");
+        fprintf(stdout, " --ctrl-channel connect each peer with an extra channel for small control messages\n");
+        fprintf(stdout, " --eager-threshold <bytes> send messages up to this size eagerly, larger ones by rendezvous (default 8192)\n");
+        fprintf(stdout, " --bounce-size <bytes> size of each pre-posted bounce buffer for eager messages (default 65536)\n");
+        fprintf(stdout, " --iters <n> timed iterations of each latency test (default 1000)\n");
+        fprintf(stdout, " --warmup <n> untimed iterations before each latency test (default 100)\n");
+        fprintf(stdout, " --latency-report <file> write the latency percentiles to <file>, JSON for *.json, CSV otherwise\n");
+        fprintf(stdout, " --rate-threads <n> run the message-rate mode with n posting threads pinned to cores (default 0, off)\n");
+        fprintf(stdout, " --rate-qps <n> qps per peer for each thread of the message-rate mode (default 1)\n");
+        fprintf(stdout, " --rate-depth <n> operations in flight on each qp of the message-rate mode (default 64)\n");
     }
 
     int parse_args(int argc, char **argv)
@@ -81,6 +93,17 @@ public:
             {.name = "topo", .has_arg = required_argument, .flag = 0, .val = 261},
             {.name = "tree-width", .has_arg = required_argument, .flag = 0, .val = 262},
             {.name = "role", .has_arg = required_argument, .flag = 0, .val = 263},
+            {.name = "busy-poll-us", .has_arg = required_argument, .flag = 0, .val = 265},
+            {.name = "data-channels", .has_arg = required_argument, .flag = 0, .val = 266},
+            {.name = "ctrl-channel", .has_arg = no_argument, .flag = 0, .val = 267},
+            {.name = "eager-threshold", .has_arg = required_argument, .flag = 0, .val = 268},
+            {.name = "bounce-size", .has_arg = required_argument, .flag = 0, .val = 269},
+            {.name = "iters", .has_arg = required_argument, .flag = 0, .val = 270},
+            {.name = "warmup", .has_arg = required_argument, .flag = 0, .val = 271},
+            {.name = "latency-report", .has_arg = required_argument, .flag = 0, .val = 272},
+            {.name = "rate-threads", .has_arg = required_argument, .flag = 0, .val = 273},
+            {.name = "rate-qps", .has_arg = required_argument, .flag = 0, .val = 274},
+            {.name = "rate-depth", .has_arg = required_argument, .flag = 0, .val = 275},
             {0, 0, 0, 0},
         };
 
@@ -92,7 +115,7 @@ public:
 
         while (iarg != -1)
         {
-            iarg = getopt_long(argc, argv, "s:h:p:d:i:g:t:c:u:m:e:", longopts, &index);
+            iarg = getopt_long(argc, argv, "s:h:p:d:i:g:t:c:u:m:e", longopts, &index);
 
             switch (iarg)
             {
@@ -165,6 +188,17 @@ public:
                 case 262: tree_width = atoi(optarg); break;
                 case 263: role = optarg; break;
                 case 264: master_ip = optarg; break;
+                case 265: busy_poll_us = strtoul(optarg, NULL, 0); break;
+                case 266: num_data_channels = strtoul(optarg, NULL, 0); break;
+                case 267: use_ctrl_channel = true; break;
+                case 268: eager_threshold = strtoul(optarg, NULL, 0); break;
+                case 269: bounce_buffer_size = strtoul(optarg, NULL, 0); break;
+                case 270: bench_iters = strtoul(optarg, NULL, 0); break;
+                case 271: bench_warmup = strtoul(optarg, NULL, 0); break;
+                case 272: latency_report = optarg; break;
+                case 273: rate_threads = strtoul(optarg, NULL, 0); break;
+                case 274: rate_qps = strtoul(optarg, NULL, 0); break;
+                case 275: rate_depth = strtoul(optarg, NULL, 0); break;
             }
         }
 
@@ -187,6 +221,13 @@ public:
         if (gid_idx >= 0) fprintf(stdout, " GID index : %u\n", gid_idx);
         printf(" Traffic Class: %d\n", traffic_class);
         std::cout << " Using event channel: " << use_event << std::endl;
+        if (use_event) std::cout << " Busy-poll budget: " << busy_poll_us << " us" << std::endl;
+        std::cout << " Data channels per peer: " << num_data_channels << (use_ctrl_channel ? " (+1 ctrl)" : "") << std::endl;
+        std::cout << " Eager threshold: " << eager_threshold << " bytes, bounce buffers: " << bounce_buffer_size << " bytes" << std::endl;
+        std::cout << " Latency tests: " << bench_warmup << " warmup + " << bench_iters << " timed iterations"
+                  << (latency_report.empty() ? "" : ", reported to " + latency_report) << std::endl;
+        if (rate_threads > 0)
+            std::cout << " Message rate: " << rate_threads << " threads x " << rate_qps << " qps, depth " << rate_depth << std::endl;
         std::cout << " MSG size: " << DATA_MSG_SIZE << "*" << MSG_BLOCK_NUM << std::endl;
         std::cout << " My IP addr: " << get_local_ip() << std::endl;
         if (cluster.size() != 0)
@@ -267,6 +308,18 @@ private:
         //     continue_check = false;
         // }
 
+        if (continue_check && bench_iters == 0)
+        {
+            LOG(WARNING) << "The latency tests need at least one timed iteration.";
+            continue_check = false;
+        }
+
+        if (continue_check && rate_threads > 0 && (rate_qps == 0 || rate_depth == 0))
+        {
+            LOG(WARNING) << "In message-rate mode, rate_qps(" << rate_qps << ") and rate_depth(" << rate_depth << ") should be > 0.";
+            continue_check = false;
+        }
+
         if (continue_check && all_reduce == TREE_ALLREDUCE && tree_width <= 0)
         {
             LOG(WARNING) << "In tree allreduce mode, tree_width(" << tree_width << ") should be > 0.";
@@ -5,6 +5,7 @@
  *      -- qp, a handler of rdma communication in verbs
  *      -- pd, protection domain for operations on qp
  *      -- cq, may be shared with other connections 
+ *      -- stats, the counters of its post and poll paths
  * ****************************************************************/
 
 #ifndef __RDMA_COMM_CORE_RDMAADAPTER_H__
@@ -13,16 +14,21 @@
 
 #include "rdma_adapter.h"
 #include "rdma_buffer.h"
+#include "rdma_stats.h"
 #include "util/logging.h"
 #include <infiniband/verbs.h>
 
+#include <algorithm>
 #include <map>
 #include <memory>
 #include <unordered_map>
+#include <vector>
 namespace rdma_core
 {
     class RDMADevice;
     class RDMABuffer;
+    class WorkBatch;
+    class RDMARegistrationCache;
 
     enum class MessageType : uint32_t
     {
@@ -43,6 +49,16 @@ namespace rdma_core
         uint32_t fd_;          // socket fd, only used in TCP/IP model
     } __attribute__((packed));
 
+    // a piece of registered memory, i.e., one entry of a scatter/gather list
+    struct BufferSlice
+    {
+        RDMABuffer *buffer = nullptr; // the registered buffer holding the data
+        uint32_t offset = 0;          // offset of the data in the buffer
+        uint32_t length = 0;          // data length in bytes
+    };
+
+#define MAX_SGE_PER_WR 32 // upper bound of sges in one work request, the device may support less
+
     enum class AdapterState : uint32_t
     {
         UNUSED = 0,
@@ -51,6 +67,13 @@ namespace rdma_core
         CONNECTING = 3
     };
 
+    enum class SignalPolicy : uint32_t
+    {
+        SIGNAL_ALL = 0,       // every sqe generates a cqe
+        SIGNAL_EVERY_N = 1,   // only one of signal_interval sqes generates a cqe
+        SIGNAL_BATCH_TAIL = 2 // only the last sqe of a post_batch generates a cqe
+    };
+
     struct AdapterConfig
     {
         std::string unique_id = "Adapter";    // unique id of this adapter
@@ -61,14 +84,20 @@ namespace rdma_core
         int gid_index = 3;                    // gid index to use
         enum ibv_mtu used_mtu = IBV_MTU_4096; // used mtu of the path
         std::string cq_key = "";              // the completion_queue id, same id means shared_cq
+        std::string pd_key = "";              // the protection_domain id, same id means shared pd (ignored with srq)
         bool signal_all_wqe = false;          //signal all events
+        SignalPolicy signal_policy = SignalPolicy::SIGNAL_ALL; // which sqe should generate a cqe
+        uint32_t signal_interval = 16;        // signal one of N sqes under SIGNAL_EVERY_N
         bool using_shared_cq = true;          // whether should use shared completion
         bool use_event_channel = false;       // whether use event channel
+        bool using_shared_rq = false;         // whether attach the qp to a shared receive queue
+        std::string srq_key = "";             // the shared_receive_queue id, same id means shared srq (and pd)
+        uint32_t srq_size = 4096;             // maximum recv_wqe in the shared receive queue
         uint32_t max_send_wr = 128;           //maximum send_wqe in parallel
         uint32_t max_recv_wr = 128;           //maximum recv_wqe in parallel
         uint32_t max_send_sge = 1;            //maximum send_sge in parallel
         uint32_t max_recv_sge = 1;            //maximum recv_sge in parallel
-        uint32_t max_inline_data = 1;         //maximum inline_sge in parallel
+        uint32_t max_inline_data = 64;        //maximum bytes of payload inlined into a sqe
     };
 
     struct AdapterInfo
@@ -117,6 +146,35 @@ namespace rdma_core
             return this->used_cq_;
         }
 
+        // get the protection domain this adapter is using
+        inline struct ibv_pd *get_protected_domain()
+        {
+            return this->pd_;
+        }
+
+        // get the device this adapter is using
+        inline std::shared_ptr<RDMADevice> get_device()
+        {
+            return this->rdma_device_;
+        }
+
+        // get the event channel of the completion queue, nullptr if it works in active (polling) mode
+        inline struct ibv_comp_channel *get_event_channel()
+        {
+            return this->event_channel;
+        }
+
+        // get the shared receive queue this adapter is attached to, nullptr if it is not
+        inline struct ibv_srq *get_shared_recvQ()
+        {
+            return this->srq_;
+        }
+
+        // check that the receives of the qp are its own, i.e., no srq, before a protocol (credit, ring,
+        // allreduce) posts them. They stay posted when the protocol is released, so build one such
+        // protocol per channel, after the peer is done with the plain receives
+        void claim_recv_queue(const std::string &user);
+
         // get the configuration it is using
         inline struct AdapterConfig &get_config()
         {
@@ -144,6 +202,10 @@ namespace rdma_core
         {
             sq_inflight++;
         }
+        inline void increase_sqe(int64_t num_wqe)
+        {
+            sq_inflight += num_wqe;
+        }
         inline void increase_rqe()
         {
             rq_inflight++;
@@ -160,11 +222,54 @@ namespace rdma_core
         {
             return sq_inflight;
         }
+        // whether the sq holds another sqe, keeping reserved ones free for later posts
+        inline bool sq_has_room(uint32_t reserved = 0)
+        {
+            return (uint64_t)sq_inflight + 1 + reserved <= _adapter_config_.max_send_wr;
+        }
         inline int64_t get_rqe()
         {
             return rq_inflight;
         }
 
+        // the counters of this adapter, safe to snapshot() from any thread while it is busy
+        inline const ChannelStats &get_stats() const
+        {
+            return stats_;
+        }
+
+        // payloads no larger than this are inlined into the sqe (capped by the negotiated max_inline_data)
+        inline void set_inline_threshold(uint32_t inline_bytes)
+        {
+            inline_threshold_ = std::min(inline_bytes, qp_init_attr.cap.max_inline_data);
+        }
+        inline uint32_t get_inline_threshold()
+        {
+            return inline_threshold_;
+        }
+
+        // switch the signaling policy at runtime, only allowed when no unsignaled sqe is pending,
+        // and away from SIGNAL_ALL once its sqes are completed, as their cqes are not tracked in spans
+        void set_signal_policy(SignalPolicy policy,          // which sqe should generate a cqe
+                               uint32_t signal_interval = 1); // signal one of N sqes under SIGNAL_EVERY_N
+
+        // retire the sqes covered by a polled send-side cqe, return how many sqes are retired
+        int64_t retire_sqe();
+
+        // the next posted sqe is signaled whatever the policy is, so its cqe retires the unsignaled ones before
+        // it, e.g., the tail of a burst that is not a multiple of signal_interval; the last sqe under post_batch
+        inline void flush_signal()
+        {
+            signal_next_wr_ = true;
+        }
+
+        // the next posted work request carries wr_id instead of this adapter, send-side ones are always signaled
+        inline void tag_next_wr(uint64_t wr_id)
+        {
+            tagged_wr_id_ = wr_id;
+            signal_next_wr_ = true;
+        }
+
     protected:
         // by default, do not expost the construction function to the outside
         explicit RDMAAdapter(std::string info_);
@@ -179,7 +284,32 @@ namespace rdma_core
         void create_pd();              //create pd;
         void create_cq();              //create cq;
         void create_compt_channel();   //create completion channel, if we use event
+        void create_srq();             //create srq, if we use shared receive queue
         void update_my_adapter_info(); //update this adapt info
+        int acquire_send_flags(uint32_t unsignaled_sqe,      // decide whether the next sqe is signaled,
+                               bool batch_tail = true) const; // after unsignaled_sqe unsignaled ones
+        void commit_send_flags(int send_flags);               // account the posted sqe in the signaled spans
+        bool finish_post(bool posted, int send_flags);        // commit the flags of a sqe once it is posted
+        inline bool tracks_spans() const // under SIGNAL_ALL each cqe retires its own sqe, no span is kept
+        {
+            return !_adapter_config_.signal_all_wqe && _adapter_config_.signal_policy != SignalPolicy::SIGNAL_ALL;
+        }
+        uint32_t fill_sge_list(const BufferSlice *slices, // map the slices to a scatter/gather list
+                               uint32_t num_slices,       // how many slices to map
+                               uint32_t max_sge,          // how many sges the qp supports
+                               struct ibv_sge *sge_list); // placeholder of the mapped sges, return total bytes
+        inline int inline_flags(uint32_t data_length_in_bytes) // inline the small payload into the sqe
+        {
+            return data_length_in_bytes <= inline_threshold_ ? IBV_SEND_INLINE : 0;
+        }
+        inline uint64_t take_wr_id(bool send_side = true) // the wr_id of the next work request
+        {
+            uint64_t wr_id = tagged_wr_id_ != 0 ? tagged_wr_id_ : (uint64_t)this;
+            if (!send_side && tagged_wr_id_ != 0) // no sqe consumes the signal of the tag, but keeps a flush
+                signal_next_wr_ = false;
+            tagged_wr_id_ = 0;
+            return wr_id;
+        }
 
     protected:
         std::string id_ = "DefaultRDMAAdapter";             // the id of this adapter;
@@ -198,8 +328,21 @@ namespace rdma_core
         struct ibv_qp *qp_ = 0;                           // used_q_pair;
         struct ibv_qp_init_attr qp_init_attr;             // init_qp_status
         struct ibv_cq *used_cq_ = 0;                      // completion queue this adapter used
+        struct ibv_srq *srq_ = nullptr;                   // shared receive queue if it using srq
         struct ibv_comp_channel *event_channel = nullptr; // event_channel if it using the passive mode
 
+        // sqes covered by each in-flight signaled sqe (in posting order) under SIGNAL_EVERY_N/SIGNAL_BATCH_TAIL,
+        // RC completes in order
+        std::vector<uint32_t> signaled_spans_;
+        uint64_t span_head_ = 0;     // the oldest signaled sqe that is not completed
+        uint64_t span_tail_ = 0;     // where the next signaled sqe is recorded
+        uint32_t unsignaled_sqe_ = 0; // sqes posted since the last signaled one
+        uint32_t inline_threshold_ = 0; // payloads no larger than this are posted with IBV_SEND_INLINE
+        RDMARegistrationCache *reg_cache_ = nullptr; // registration cache of the pd, for user memory
+        uint64_t tagged_wr_id_ = 0;     // wr_id of the next work request, 0 for this adapter
+        bool signal_next_wr_ = false;   // the next sqe is signaled whatever the policy is
+        ChannelStats stats_;            // posted/completed work requests, updated by the post and poll paths
+
     public:
         // using the adapter to send the msg to its peer adapter
         bool send_remote(RDMABuffer *buffer,            // placeholder of the data to send
@@ -222,6 +365,48 @@ namespace rdma_core
                           uint32_t msg_tag,                                // tagging the message type to notify peer
                           bool notify_peer = false);                       // notify peer explicit or not
 
+        // post all work requests of the batch as one linked chain, the batch is cleared after posting
+        bool post_batch(WorkBatch *batch); // the collected send/write/read work requests
+
+        // gather the slices into one message and send it to the peer adapter, without copying
+        bool send_remote(const BufferSlice *slices, // the slices of data to send
+                         uint32_t num_slices,       // how many slices, at most max_send_sge
+                         uint32_t msg_tag = 0);     // tagging the message type to notify peer
+
+        // scatter one message from the peer adapter into the slices
+        bool recv_remote(const BufferSlice *slices, // the slices that capture the recv data
+                         uint32_t num_slices);      // how many slices, at most max_recv_sge
+
+        // post a receive without any buffer, it only captures the imm_data of a write with notify
+        bool recv_notification();
+
+        // read a contiguous remote region and scatter it into the slices
+        bool read_remote(const BufferSlice *slices,                        // the slices that cache the read data
+                         uint32_t num_slices,                              // how many slices, at most max_send_sge
+                         struct CommDescriptor *remote_buffer_descriptor); // remote buffer_describptor
+
+        // gather the slices and write them to a contiguous remote region
+        bool write_remote(const BufferSlice *slices,                       // the slices of data to write
+                          uint32_t num_slices,                             // how many slices, at most max_send_sge
+                          struct CommDescriptor *remote_buffer_descriptor, // remote buffer_describptor
+                          uint32_t msg_tag,                                // tagging the message type to notify peer
+                          bool notify_peer = false);                       // notify peer explicit or not
+
+        // send user memory without copying, it stays pinned until release_user_memory(data)
+        bool send_remote(const void *data,              // the user memory to send
+                         uint32_t data_length_in_bytes, // data length to send
+                         uint32_t msg_tag = 0);         // tagging the message type to notify peer
+
+        // write user memory without copying, it stays pinned until release_user_memory(data)
+        bool write_remote(const void *data,                                // the user memory to write
+                          uint32_t data_length_in_bytes,                   // data length to write
+                          struct CommDescriptor *remote_buffer_descriptor, // remote buffer_describptor
+                          uint32_t msg_tag,                                // tagging the message type to notify peer
+                          bool notify_peer = false);                       // notify peer explicit or not
+
+        // unpin the user memory once the completion of its send/write is polled
+        void release_user_memory(const void *data);
+
         // poll a batch of completion events from this adapter
         int poll_cq_batch(struct ibv_wc *wc, // placeholder to recv polled cqe
                           int num_wqe);      // how many cqes expected to poll
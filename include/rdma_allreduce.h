@@ -0,0 +1,147 @@
+/******************************************************************
+ * RingAllReduce reduces a vector over the ranks of a ring in place,
+ * each rank writes to the next rank and hears from the previous one:
+ *      -- reduce-scatter: in n-1 steps each rank folds the segment
+ *         of the previous rank into its own copy, ending with one
+ *         fully reduced segment per rank
+ *      -- allgather: in n-1 more steps the reduced segments travel
+ *         once around the ring, overwriting the stale copies
+ *      -- each segment is cut into chunks, written over a StagingLink
+ *         to the next rank, so the chunks in flight overlap the
+ *         reduction of the received ones
+ * It is driven by the thread calling allreduce(), which polls the cqs
+ * of both channels, so no other thread may poll them meanwhile. Both
+ * may be the same channel, e.g., in a ring of 2 ranks. All
+ * ranks build it at the same point, the staging slots are swapped
+ * then.
+ * ****************************************************************/
+
+#ifndef __RDMA_COMM_CORE_RDMA_ALLREDUCE_H__
+#define __RDMA_COMM_CORE_RDMA_ALLREDUCE_H__
+
+#include "rdma_buffer.h"
+#include "rdma_channel.h"
+#include "rdma_reduce.h"
+#include "rdma_staging_link.h"
+#include "util/logging.h"
+
+#include <memory>
+#include <string>
+
+#define ALLREDUCE_CHUNK_SIZE (256 * 1024) // default bytes of a chunk, i.e., of a staging slot
+#define ALLREDUCE_PIPELINE_DEPTH 8        // default chunks in flight to the next rank
+#define ALLREDUCE_CHUNK_ALIGN 64          // the chunk size is a multiple of it, so of every element size
+
+namespace rdma_core
+{
+    class RDMAChannel;
+
+    class RingAllReduce
+    {
+    protected:
+        explicit RingAllReduce(          // construction function of the ring allreduce
+            RDMAChannel *send_channel,   // the connected channel to the next rank
+            RDMAChannel *recv_channel,   // the connected channel from the previous rank
+            uint32_t rank,               // the position of this rank in the ring
+            uint32_t num_ranks,          // how many ranks the ring holds
+            size_t max_bytes,            // bytes of the largest vector to reduce
+            uint32_t chunk_size,         // bytes of a chunk
+            uint32_t pipeline_depth,     // chunks in flight to the next rank
+            std::string allreduce_info); // the info of this allreduce
+
+    public:
+        virtual ~RingAllReduce();
+        inline static RingAllReduce *build_ring_allreduce(RDMAChannel *send_channel,
+                                                          RDMAChannel *recv_channel,
+                                                          uint32_t rank,
+                                                          uint32_t num_ranks,
+                                                          size_t max_bytes,
+                                                          uint32_t chunk_size = ALLREDUCE_CHUNK_SIZE,
+                                                          uint32_t pipeline_depth = ALLREDUCE_PIPELINE_DEPTH,
+                                                          std::string allreduce_info = "RingAllReduce")
+        {
+            return new RingAllReduce(send_channel, recv_channel, rank, num_ranks, max_bytes, chunk_size,
+                                     pipeline_depth, allreduce_info);
+        }
+
+    public:
+        // the vector to reduce, registered on the channels, it holds max_bytes
+        inline void *get_buffer()
+        {
+            return work_->data_ptr;
+        }
+
+        // reduce the first count elements of the buffer over all ranks in place, blocking until this rank is done;
+        // every rank calls it with the same count, type and op
+        void allreduce(size_t count,        // how many elements
+                       ReduceDataType type, // the type of the elements
+                       ReduceOp op);        // the reduction
+
+        inline uint32_t get_rank()
+        {
+            return rank_;
+        }
+        inline uint32_t get_num_ranks()
+        {
+            return num_ranks_;
+        }
+        inline uint64_t get_num_chunks() // chunks ever written to the next rank
+        {
+            return link_->get_num_sent();
+        }
+        inline uint64_t get_num_stalls() // times the next chunk waited for a credit of the next rank
+        {
+            return link_->get_num_stalls();
+        }
+        inline std::string info()
+        {
+            return "RingAllReduce(" + allreduce_info_ + ")";
+        }
+
+    private:
+        struct AllReduceHandshake
+        {
+            struct StagingLink::Descriptor link; // the slots and the credit word of the sender
+            uint32_t rank = 0;                   // the position in the ring
+            uint32_t num_ranks = 0;              // how many ranks the ring holds
+            uint32_t chunk_size = 0;             // bytes of a staging slot
+            uint32_t pipeline_depth = 0;         // how many staging slots
+        } __attribute__((packed));
+
+        // the plan of the current allreduce, a chunk is addressed by its index in the call
+        struct ChunkPlan
+        {
+            size_t count = 0;                              // elements to reduce
+            size_t element_size = 0;                       // bytes of one element
+            ReduceDataType type = ReduceDataType::FLOAT32; // the type of the elements
+            ReduceOp op = ReduceOp::SUM;                   // the reduction
+            uint64_t chunks_per_segment = 0;               // each segment is cut into so many chunks
+            uint64_t num_chunks = 0;                       // chunks sent (and received) by each rank
+        };
+
+        void chunk_range(uint64_t segment, // which segment of the vector
+                         uint64_t chunk,   // which chunk of the segment
+                         size_t *begin,    // the first element of the chunk
+                         size_t *length);  // how many elements of the chunk
+        void locate_send(uint64_t index, size_t *begin, size_t *length); // the chunk to send at this index
+        void locate_recv(uint64_t index, size_t *begin, size_t *length); // the chunk to receive at this index
+        bool try_send();                                                 // write the next chunk if it is ready
+        bool consume_next();                                             // reduce (or copy) the next arrived chunk of this call
+        void poll_channel(RDMAChannel *channel);                         // handle the cqes of a channel
+
+    private:
+        std::string allreduce_info_ = "";            // the info of this allreduce
+        RDMAChannel *send_channel_ = nullptr;        // the channel to the next rank
+        RDMAChannel *recv_channel_ = nullptr;        // the channel from the previous rank
+        uint32_t rank_ = 0;                          // the position of this rank in the ring
+        uint32_t num_ranks_ = 0;                     // how many ranks the ring holds
+        size_t max_bytes_ = 0;                       // bytes of the largest vector to reduce
+        uint32_t chunk_size_ = ALLREDUCE_CHUNK_SIZE; // bytes of a chunk
+        uint32_t depth_ = ALLREDUCE_PIPELINE_DEPTH;  // staging slots of each rank
+        std::unique_ptr<RDMABuffer> work_;           // the vector, registered on the send channel
+        std::unique_ptr<StagingLink> link_;          // chunks to the next rank, from the previous rank
+        struct ChunkPlan plan_;                      // the plan of the current allreduce
+        uint64_t base_ = 0;                          // chunks sent (and consumed) before the current allreduce
+    };
+}; // end namespace rdma_core
+#endif
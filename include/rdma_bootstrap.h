@@ -0,0 +1,114 @@
+/******************************************************************
+ * RDMABootstrap sets up the connections of a session for all peers
+ * at once, instead of one blocking handshake after another, i.e.,
+ *      -- a small worker pool runs the verbs work (creating the
+ *         endpoints, loading and connecting the qps)
+ *      -- one epoll loop exchanges the AdapterInfo and the final
+ *         sync byte of every peer over non-blocking sockets
+ * The bytes on the wire are the same as RDMAEndPoint::connecting(),
+ * so a bootstrapped peer can talk to one connecting sequentially.
+ * ****************************************************************/
+
+#ifndef __RDMA_COMM_CORE_RDMA_BOOTSTRAP_H__
+#define __RDMA_COMM_CORE_RDMA_BOOTSTRAP_H__
+
+#include "rdma_adapter.h"
+#include "rdma_endpoint.h"
+#include "util/logging.h"
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#define BOOTSTRAP_MAX_WORKERS 16 // the worker pool never grows beyond this
+
+namespace rdma_core
+{
+    class RDMAEndPoint;
+
+    class RDMABootstrap
+    {
+    protected:
+        explicit RDMABootstrap(          // construction function of the bootstrap
+            uint32_t num_workers,        // threads running the verbs work, 0 for the number of cores
+            std::string bootstrap_info); // the info of this bootstrap
+
+    public:
+        virtual ~RDMABootstrap();
+        inline static RDMABootstrap *build_bootstrap(uint32_t num_workers = 0,
+                                                     std::string bootstrap_info = "RDMABootstrap")
+        {
+            return new RDMABootstrap(num_workers, bootstrap_info);
+        }
+
+    public:
+        // run the task on the worker pool
+        void submit(std::function<void()> task);
+
+        // block until all submitted tasks are done
+        void wait_all();
+
+        // load, exchange and connect the channels of all endpoints concurrently
+        void connect_all(std::vector<RDMAEndPoint *> &endpoints);
+
+        inline uint32_t get_num_workers()
+        {
+            return workers_.size();
+        }
+        inline std::string info()
+        {
+            return "RDMABootstrap(" + bootstrap_info_ + ")";
+        }
+
+    private:
+        enum class HandshakeState : uint32_t
+        {
+            LOADING = 0,    // the channels are being loaded by a worker
+            EXCHANGING = 1, // sending/receiving the channel number and the AdapterInfo
+            CONNECTING = 2, // the qps are being connected by a worker
+            SYNCING = 3,    // sending/receiving the sync byte
+            DONE = 4        // the qps are connected on both sides
+        };
+
+        struct Handshake
+        {
+            RDMAEndPoint *endpoint = nullptr;               // whose channels are connected
+            int fd = -1;                                    // the socket of its TCPConnector
+            int socket_flags = 0;                           // the flags restored after the io
+            HandshakeState state = HandshakeState::LOADING; // where the handshake is
+            std::vector<char> out_data;                     // bytes to send in this state
+            size_t out_offset = 0;                          // bytes sent
+            std::vector<char> in_data;                      // bytes to receive in this state
+            size_t in_offset = 0;                           // bytes received
+            size_t in_expected = 0;                         // bytes to receive, grows once the header is received
+            std::vector<AdapterInfo> peer_infos;            // the AdapterInfo of the peer channels
+        };
+
+        void worker_loop();                       // the loop of a worker thread
+        void post_ready(uint32_t index);          // a worker is done with the handshake
+        void enter_io_state(Handshake &handshake, // prepare the bytes and watch the socket
+                            uint32_t index);      // index of the handshake
+        bool progress_io(Handshake &handshake,    // move the bytes, return true once the state is done
+                         uint32_t index);         // index of the handshake
+        void leave_io_state(Handshake &handshake, // unwatch the socket and move to the next state
+                            uint32_t index);      // index of the handshake
+
+    private:
+        std::string bootstrap_info_ = "";         // the info of this bootstrap
+        std::vector<std::thread> workers_;        // the worker pool
+        std::mutex task_lock_;                    // protect the tasks and the ready handshakes
+        std::condition_variable task_cond_;       // tasks are submitted or stopping
+        std::condition_variable idle_cond_;       // all tasks are done
+        std::deque<std::function<void()>> tasks_; // tasks waiting for a worker
+        uint32_t running_tasks_ = 0;              // tasks taken by the workers
+        bool stopping_ = false;                   // the workers should exit
+        std::vector<uint32_t> ready_handshakes_;  // handshakes finished by the workers
+        int epoll_fd_ = -1;                       // watching the sockets and the event fd
+        int event_fd_ = -1;                       // wake the epoll loop when a worker is done
+    };
+}; // end namespace rdma_core
+#endif
@@ -24,6 +24,8 @@
  * RDMABuffer is the abstraction of memory for rdma communication
  * it provides basic function as follows:
  *      -- allocate (pinned) physical memory with given size
+ *      -- or carve it from a pre-registered RDMAMemoryPool
+ *      -- optionally back it with hugepages bound to a numa node
  *      -- regisger/deregister the buffer into/from RDMAChannel
  *****************************************************************/
 
@@ -32,26 +34,50 @@
 
 #include "rdma_adapter.h"
 
+#include <atomic>
+
 namespace rdma_core
 {
     class RDMAAdapter;
+    class RDMAMemoryPool;
+
+    enum class HugePagePolicy : uint32_t
+    {
+        NONE = 0,     // normal pages
+        HUGE_2MB = 1, // 2 MB hugepages, falling back to normal pages
+        HUGE_1GB = 2  // 1 GB hugepages, falling back to 2 MB and then normal pages
+    };
+
+    struct AllocPolicy
+    {
+        HugePagePolicy huge_page = HugePagePolicy::NONE; // the pages backing the buffer
+        int numa_node = -1;                               // bind the buffer to this numa node, -1 for no binding
+    };
 
     class RDMABuffer
     {
     public:
         virtual ~RDMABuffer();
-        explicit RDMABuffer(                   // construction function of rdmabuffer
-            size_t buffer_size_in_byte,        // how many bytes to use in this buffer
-            uint32_t num_blocks,               // how many block buffer it would be
-            std::string buffer_info,           // buffer info
-            RDMABuffer *base_buffer = nullptr, // the base buffer
-            bool is_sub_buffer = false);       // whether the buffer is sub-buffer
+        explicit RDMABuffer(                     // construction function of rdmabuffer
+            size_t buffer_size_in_byte,          // how many bytes to use in this buffer
+            uint32_t num_blocks,                 // how many block buffer it would be
+            std::string buffer_info,             // buffer info
+            RDMABuffer *base_buffer = nullptr,   // the base buffer
+            bool is_sub_buffer = false,          // whether the buffer is sub-buffer
+            RDMAMemoryPool *pool = nullptr,      // carve the memory from the pool if set
+            AllocPolicy policy = AllocPolicy()); // how to allocate the memory if not carved from a pool
 
     public:
-        static RDMABuffer *allocate_buffer( // static method to allocate buffers
-            size_t buffer_size,             // how many bytes to use in this buffer
-            uint32_t num_blocks = 1,        // how many blocks of this buffer would be
-            std::string buffer_info = "");  // buffer info
+        static RDMABuffer *allocate_buffer(      // static method to allocate buffers
+            size_t buffer_size,                  // how many bytes to use in this buffer
+            uint32_t num_blocks = 1,             // how many blocks of this buffer would be
+            std::string buffer_info = "",        // buffer info
+            RDMAMemoryPool *pool = nullptr,      // if set, the buffer is already registered, and not zeroed
+            AllocPolicy policy = AllocPolicy()); // hugepages/numa binding, ignored for pooled buffers
+
+        // hugepages on the numa node of the NIC the adapter is using
+        static AllocPolicy device_local_policy(RDMAAdapter *adapter,
+                                               HugePagePolicy huge_page = HugePagePolicy::HUGE_2MB);
 
         // register the buffer into the channel,currently can only be accessed by one channel
         virtual bool register_in_channel(RDMAAdapter *channel_);
@@ -77,6 +103,12 @@ namespace rdma_core
             return owned_by_channel;
         }
 
+        // get the pool the buffer is carved from, nullptr if it owns its memory
+        inline RDMAMemoryPool *get_memory_pool()
+        {
+            return pool_;
+        }
+
         // fill in the buffer with given message
         bool fill_in(uint8_t *to_copyed_data, // to fillin the buffer data
                      uint32_t data_length);   // how many bytes the data length to copy
@@ -113,21 +145,63 @@ namespace rdma_core
             return buffer_mgr_.size();
         }
 
-        inline RDMABuffer *next()
+        // the blocks form a ring: producers take blocks by try_next()/next(),
+        // the consumer (e.g., the cq thread) gives them back in order by last()/release(n)
+
+        // take the next free block, nullptr if all blocks are in flight, safe for multiple producers
+        inline RDMABuffer *try_next()
         {
-            RDMABuffer *next_buf = base_buffer_->buffer_mgr_[(++base_buffer_->next_active) % base_buffer_->blocks_];
-            //CHECK(next_buf->in_used == false) << "In valid use for the next buffer " << buffer_name;
+            RDMABuffer *base = base_buffer_;
+            uint64_t head = base->ring_head_.load(std::memory_order_relaxed);
+            do
+            {
+                // acquire: the released blocks are no longer touched by the consumer
+                uint64_t tail = base->ring_tail_.load(std::memory_order_acquire);
+                if (head - tail >= base->blocks_)
+                    return nullptr;
+            } while (!base->ring_head_.compare_exchange_weak(head, head + 1,
+                                                             std::memory_order_acq_rel,
+                                                             std::memory_order_relaxed));
+            RDMABuffer *next_buf = base->buffer_mgr_[head % base->blocks_];
             next_buf->in_used = true;
             return next_buf;
         }
+        inline RDMABuffer *next()
+        {
+            RDMABuffer *next_buf = try_next();
+            CHECK(next_buf != nullptr) << "All " << base_buffer_->blocks_ << " blocks of "
+                                       << base_buffer_->info() << " are in flight";
+            return next_buf;
+        }
+
+        // give the oldest n blocks in flight back, by the single consumer
+        inline void release(uint32_t num_blocks)
+        {
+            RDMABuffer *base = base_buffer_;
+            uint64_t tail = base->ring_tail_.load(std::memory_order_relaxed);
+            uint64_t head = base->ring_head_.load(std::memory_order_acquire);
+            CHECK(tail + num_blocks <= head) << "Releasing " << num_blocks << " blocks of " << base->info()
+                                             << ", while only " << head - tail << " are in flight";
+            for (uint64_t index = tail; index < tail + num_blocks; index++)
+                base->buffer_mgr_[index % base->blocks_]->in_used = false;
+            // release: the producers see the blocks free only after the consumer is done with them
+            base->ring_tail_.store(tail + num_blocks, std::memory_order_release);
+        }
         inline RDMABuffer *last()
         {
-            RDMABuffer *last = base_buffer_->buffer_mgr_[(++base_buffer_->last_active) % base_buffer_->blocks_];
-            //CHECK(last->in_used == true) << "In valid use for the last buffer " << buffer_name;
-            last->in_used = false;
+            RDMABuffer *base = base_buffer_;
+            RDMABuffer *last = base->buffer_mgr_[base->ring_tail_.load(std::memory_order_relaxed) % base->blocks_];
+            release(1);
             return last;
         }
 
+        // how many blocks are taken but not released yet
+        inline uint32_t in_flight()
+        {
+            return base_buffer_->ring_head_.load(std::memory_order_acquire) -
+                   base_buffer_->ring_tail_.load(std::memory_order_acquire);
+        }
+
     public:
         std::string buffer_name = "";            // buffer info
         size_t buffer_size = 0u;                 // buffer size
@@ -135,8 +209,6 @@ namespace rdma_core
         RDMAAdapter *owned_by_channel = nullptr; // channel owning this buffer
         bool is_initialized = false;             // is initialized
         struct ibv_mr *mr_ = nullptr;            //register memory region
-        int next_active = -1;                    // the active index buffer
-        int last_active = -1;                    // the last_active index buffer
         bool in_used = false;                    // whether the buffer is in used
 
     private:
@@ -145,6 +217,12 @@ namespace rdma_core
         bool is_sub_buffer_ = false;           // whether the buffer is a sub-buffer
         size_t blocks_ = 1;                    // how many blocks the buffer owns
         RDMABuffer *base_buffer_ = nullptr;    // return the base buffer;
+        RDMAMemoryPool *pool_ = nullptr;       // the pool the memory is carved from
+        size_t mapped_size_ = 0;               // bytes mapped by mmap, 0 if allocated by posix_memalign
+
+        // the ring of blocks, on separate cache lines so producers and consumer do not false-share
+        alignas(64) std::atomic<uint64_t> ring_head_{0}; // blocks ever taken, advanced by producers
+        alignas(64) std::atomic<uint64_t> ring_tail_{0}; // blocks ever released, advanced by the consumer
     };
 
 }; // end namespace rdma_core
@@ -0,0 +1,169 @@
+/******************************************************************
+ * CompletionHandler is a CRTP base to dispatch completion queue
+ * events (cqe) by opcode, resolved at compile time, i.e.,
+ *      -- derived handlers hide on_xxx_done() to process an opcode
+ *      -- the polling loop calls them directly, so they can be inlined
+ *      -- CallbackCompletionHandler adapts the std::function callbacks
+ *         registered in RDMASession (the slow path)
+ * ****************************************************************/
+
+#ifndef __RDMA_COMM_CORE_RDMA_COMPLETION_H__
+#define __RDMA_COMM_CORE_RDMA_COMPLETION_H__
+
+#include "rdma_config.h"
+#include "util/logging.h"
+#include <infiniband/verbs.h>
+
+#include <functional>
+#include <vector>
+
+namespace rdma_core
+{
+    template <typename Derived>
+    class CompletionHandler
+    {
+    public:
+        // dispatch one cqe to the handler of its opcode
+        inline void dispatch(struct ibv_wc *wc)
+        {
+            Derived *handler = static_cast<Derived *>(this);
+            switch (wc->opcode)
+            {
+                case IBV_WC_SEND:
+                    handler->on_send_done(wc);
+                    break;
+                case IBV_WC_RECV:
+                    handler->on_recv_done(wc);
+                    break;
+                case IBV_WC_RDMA_WRITE:
+                    handler->on_write_done(wc);
+                    break;
+                case IBV_WC_RDMA_READ:
+                    handler->on_read_done(wc);
+                    break;
+                case IBV_WC_RECV_RDMA_WITH_IMM:
+                    handler->on_recv_write_with_imm_done(wc);
+                    break;
+                default:
+                    handler->on_unknown_opcode(wc);
+                    break;
+            }
+        }
+
+        // dispatch a batch of cqes polled from the cq of polled_channel
+        template <typename Channel>
+        inline void dispatch_batch(Channel *polled_channel, // which channel the cqes are polled from
+                                   struct ibv_wc *wc_list,  // the polled cqes
+                                   int num_wqe)             // how many cqes are polled
+        {
+            for (int wqe_index = 0; wqe_index < num_wqe; wqe_index++)
+            {
+                if (__builtin_expect(wc_list[wqe_index].status != IBV_WC_SUCCESS, 0))
+                {
+                    if (polled_channel != nullptr)
+                        polled_channel->show_qp_info();
+                    LOG(FATAL) << "[WARNING]: Encounting unsuccess wqe, for: "
+                               << ibv_wc_status_str(wc_list[wqe_index].status);
+                }
+                dispatch(&wc_list[wqe_index]);
+            }
+        }
+
+        // a loop to poll the cqs of the channels and dispatch the cqes, never returns
+        template <typename Channel>
+        void polling_CQ(std::vector<Channel *> &aggregated_channels)
+        {
+            struct ibv_wc global_wc[128];
+            do
+            {
+                for (auto *each_channel : aggregated_channels)
+                {
+                    int num_wqe = each_channel->poll_cq_batch(global_wc, 128);
+                    if (num_wqe == 0)
+                        continue;
+                    HOT_VLOG_EVERY_N(3, SHOWN_LOG_EVERN_N) << "The number of polled cqe is " << num_wqe;
+                    dispatch_batch(each_channel, global_wc, num_wqe);
+                }
+            } while (true);
+        }
+
+    public: // default handlers, hidden by the derived handler for the opcodes it expects
+        inline void on_send_done(struct ibv_wc *wc)
+        {
+            static_cast<Derived *>(this)->on_unknown_opcode(wc);
+        }
+        inline void on_recv_done(struct ibv_wc *wc)
+        {
+            static_cast<Derived *>(this)->on_unknown_opcode(wc);
+        }
+        inline void on_write_done(struct ibv_wc *wc)
+        {
+            static_cast<Derived *>(this)->on_unknown_opcode(wc);
+        }
+        inline void on_read_done(struct ibv_wc *wc)
+        {
+            static_cast<Derived *>(this)->on_unknown_opcode(wc);
+        }
+        inline void on_recv_write_with_imm_done(struct ibv_wc *wc)
+        {
+            static_cast<Derived *>(this)->on_unknown_opcode(wc);
+        }
+        void on_unknown_opcode(struct ibv_wc *wc)
+        {
+            LOG(FATAL) << "Unknown opcode (" << wc->opcode << ") from wr_id: 0x" << std::hex << wc->wr_id;
+        }
+
+    protected:
+        CompletionHandler() = default;
+        ~CompletionHandler() = default;
+    };
+
+    // the slow path: forward each opcode to the registered std::function callbacks
+    class CallbackCompletionHandler : public CompletionHandler<CallbackCompletionHandler>
+    {
+    public:
+        using EventCallback = std::function<void(struct ibv_wc *wc, void *args)>;
+
+        CallbackCompletionHandler(EventCallback &process_send_done,                // process when send data done
+                                  EventCallback &process_recv_done,                // process when recv data done
+                                  EventCallback &process_recv_write_with_imm_done, // process when recv_write_with_imm done
+                                  EventCallback &process_write_done,               // process when write data done
+                                  EventCallback &process_read_done) :              // process when read data done
+            process_send_done_(process_send_done),
+            process_recv_done_(process_recv_done),
+            process_recv_write_with_imm_done_(process_recv_write_with_imm_done),
+            process_write_done_(process_write_done),
+            process_read_done_(process_read_done)
+        {
+        }
+
+        inline void on_send_done(struct ibv_wc *wc)
+        {
+            process_send_done_(wc, 0);
+        }
+        inline void on_recv_done(struct ibv_wc *wc)
+        {
+            process_recv_done_(wc, 0);
+        }
+        inline void on_write_done(struct ibv_wc *wc)
+        {
+            process_write_done_(wc, 0);
+        }
+        inline void on_read_done(struct ibv_wc *wc)
+        {
+            process_read_done_(wc, 0);
+        }
+        inline void on_recv_write_with_imm_done(struct ibv_wc *wc)
+        {
+            process_recv_write_with_imm_done_(wc, 0);
+        }
+
+    private: // references, so that callbacks registered later are still picked up
+        EventCallback &process_send_done_;
+        EventCallback &process_recv_done_;
+        EventCallback &process_recv_write_with_imm_done_;
+        EventCallback &process_write_done_;
+        EventCallback &process_read_done_;
+    };
+}; // end namespace rdma_core
+#endif
@@ -0,0 +1,121 @@
+/******************************************************************
+ * CompletionEngine waits for the completions of a group of cqs
+ * in one thread, without burning a core when they are idle, i.e.,
+ *      -- BUSY_POLLING: spin on the cqs (the original behavior)
+ *      -- EVENT_DRIVEN: arm the cqs and block once they are drained
+ *      -- ADAPTIVE: busy-poll for a budget after the last activity,
+ *         then arm the cqs and block on their event channels
+ * All event channels are watched by one epoll fd, and the fetched
+ * events are acked in batches.
+ * ****************************************************************/
+
+#ifndef __RDMA_COMM_CORE_RDMA_COMPLETION_ENGINE_H__
+#define __RDMA_COMM_CORE_RDMA_COMPLETION_ENGINE_H__
+
+#include "rdma_adapter.h"
+#include "rdma_completion.h"
+#include "util/logging.h"
+#include <infiniband/verbs.h>
+
+#include <chrono>
+#include <string>
+#include <vector>
+
+namespace rdma_core
+{
+    class RDMAAdapter;
+
+    enum class CompletionMode : uint32_t
+    {
+        BUSY_POLLING = 0, // spin on the cqs, lowest latency, one core per engine
+        EVENT_DRIVEN = 1, // block on the event channels whenever the cqs are drained
+        ADAPTIVE = 2      // busy-poll for a budget after the last completion, then block
+    };
+
+    class CompletionEngine
+    {
+    protected:
+        explicit CompletionEngine(        // construction function of the completion engine
+            CompletionMode mode,          // how to wait for completions
+            uint32_t busy_poll_budget_us, // keep spinning so long after the last completion (ADAPTIVE)
+            uint32_t ack_batch,           // ack the fetched events once so many are pending per cq
+            std::string engine_info);     // the info of this engine
+
+    public:
+        virtual ~CompletionEngine();
+        inline static CompletionEngine *build_completion_engine(CompletionMode mode = CompletionMode::ADAPTIVE,
+                                                                uint32_t busy_poll_budget_us = 50,
+                                                                uint32_t ack_batch = 64,
+                                                                std::string engine_info = "CompletionEngine")
+        {
+            return new CompletionEngine(mode, busy_poll_budget_us, ack_batch, engine_info);
+        }
+
+    public:
+        // watch the cq (and its event channel) of the adapter, a shared cq is only watched once
+        bool attach(RDMAAdapter *adapter);
+
+        // wait until at least one cqe is polled, return how many cqes are polled
+        int poll_completions(struct ibv_wc *wc, // placeholder to recv polled cqe
+                             int num_wqe);      // how many cqes expected to poll
+
+        // a loop to wait for the cqes and dispatch them, never returns
+        template <typename Handler>
+        void polling_CQ(CompletionHandler<Handler> &handler)
+        {
+            struct ibv_wc global_wc[128];
+            do
+            {
+                int num_wqe = poll_completions(global_wc, 128);
+                HOT_VLOG_EVERY_N(3, SHOWN_LOG_EVERN_N) << "The number of polled cqe is " << num_wqe;
+                handler.dispatch_batch((RDMAAdapter *)nullptr, global_wc, num_wqe);
+            } while (true);
+        }
+
+        inline CompletionMode get_mode()
+        {
+            return mode_;
+        }
+        inline uint64_t get_num_sleeps() // how many times the engine blocked on the event channels
+        {
+            return num_sleeps_;
+        }
+        inline uint64_t get_num_events() // how many cq events are fetched
+        {
+            return num_events_;
+        }
+        inline std::string info()
+        {
+            return "CompletionEngine(" + engine_info_ + ")";
+        }
+
+    private:
+        struct WatchedCQ
+        {
+            struct ibv_cq *cq = nullptr;                // the watched completion queue
+            RDMAAdapter *adapter = nullptr;             // the first adapter attached with it, polls through its stats
+            struct ibv_comp_channel *channel = nullptr; // its event channel, nullptr in BUSY_POLLING
+            bool armed = false;                         // an event is requested but not fetched yet
+            uint32_t unacked_events = 0;                // fetched events waiting for ack
+        };
+
+        int poll_once(struct ibv_wc *wc, int num_wqe); // poll the cqs round-robin, without blocking
+        bool should_keep_spinning();                    // whether the busy-poll budget is left
+        void arm_all();                                 // request an event from every unarmed cq
+        void wait_for_events();                         // block on the epoll fd, fetch and ack events
+
+    private:
+        std::string engine_info_ = "";                        // the info of this engine
+        CompletionMode mode_ = CompletionMode::ADAPTIVE;      // how to wait for completions
+        std::chrono::microseconds busy_poll_budget_;          // spin budget after the last completion
+        uint32_t ack_batch_ = 64;                             // ack once so many events are pending
+        std::vector<WatchedCQ> watched_cqs_;                  // the cqs served by this engine
+        int epoll_fd_ = -1;                                   // watching all event channels
+        uint32_t next_cq_ = 0;                                // where the next round-robin poll starts
+        uint32_t idle_rounds_ = 0;                            // empty polls since the clock was read
+        std::chrono::steady_clock::time_point last_activity_; // when the last cqe was polled
+        uint64_t num_sleeps_ = 0;                             // how many times it blocked
+        uint64_t num_events_ = 0;                             // how many cq events are fetched
+    };
+}; // end namespace rdma_core
+#endif
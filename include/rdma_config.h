@@ -17,6 +17,18 @@ namespace rdma_core
         int gid_idx = 3;                                  /* gid index to use */
         uint32_t traffic_class = 0;                       /* traffic class*/
         bool use_event = false;                           /*If use completion channel (event driven)*/
+        uint32_t busy_poll_us = 50;                       /*busy-poll so long after the last cqe before blocking (event driven)*/
+        uint32_t num_data_channels = 1;                   /*data channels (qps) per endpoint, large writes are striped over them*/
+        bool use_ctrl_channel = false;                    /*an extra channel per endpoint, so small messages skip the bulk data*/
+        uint32_t bootstrap_workers = 0;                   /*threads setting up the connections, 0 for the number of cores*/
+        uint32_t eager_threshold = 8192;                  /*messages up to this size are copied through the bounce buffers, larger ones go by rendezvous*/
+        uint32_t bounce_buffer_size = 65536;              /*bytes of each pre-posted bounce buffer for the eager messages*/
+        uint32_t bench_iters = 1000;                      /*timed iterations of each latency test of the benchmarks*/
+        uint32_t bench_warmup = 100;                      /*untimed iterations before them*/
+        std::string latency_report = "";                  /*file the latency percentiles go to, JSON if it ends with .json, CSV otherwise*/
+        uint32_t rate_threads = 0;                        /*posting threads of the message-rate mode of the benchmarks, 0 to disable it*/
+        uint32_t rate_qps = 1;                            /*qps per peer each of the threads posts to*/
+        uint32_t rate_depth = 64;                         /*operations each qp keeps in flight*/
         int DATA_MSG_SIZE = 1000;                         /*default msg for DATA CHANNEL 10K*/
         int CTRL_MSG_SIZE = 4;                            /*default msg for ctrl channel 16 bytes*/
         int MSG_BLOCK_NUM = 2;                            /*default msg blk*/
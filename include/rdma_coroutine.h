@@ -0,0 +1,227 @@
+/******************************************************************
+ * RDMATask is a C++20 coroutine posting RDMA operations in sequence,
+ * e.g., wc = co_await scheduler->write_remote(channel, ...), i.e.,
+ *      -- each awaitable posts the work request through the future
+ *         table of the scheduler and suspends until its cqe arrives
+ *      -- RDMAScheduler polls the cqs on one thread and resumes the
+ *         coroutines whose cqes are polled
+ *      -- the coroutine frames are recycled by RDMAFramePool, so
+ *         thousands of transfers in flight cost no malloc per task
+ *      -- once max_pending operations are in flight, the next one
+ *         suspends its coroutine unposted, and is posted when a slot
+ *         of the table comes back
+ * All coroutines of a scheduler run on the thread calling run().
+ * ****************************************************************/
+
+#ifndef __RDMA_COMM_CORE_RDMA_COROUTINE_H__
+#define __RDMA_COMM_CORE_RDMA_COROUTINE_H__
+
+#include "rdma_adapter.h"
+#include "rdma_buffer.h"
+#include "rdma_future.h"
+#include "util/logging.h"
+#include <infiniband/verbs.h>
+
+#include <coroutine>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+#define FRAME_ALIGN 64              // frame sizes are rounded up to the cache line
+#define FRAME_SIZE_CLASSES 64       // frames up to FRAME_ALIGN * FRAME_SIZE_CLASSES bytes are recycled
+#define SCHEDULER_MAX_PENDING 4096  // default number of operations in flight per scheduler
+
+namespace rdma_core
+{
+    class RDMAScheduler;
+
+    // per-thread free lists of coroutine frames, one list per size class
+    class RDMAFramePool
+    {
+    public:
+        static void *allocate(size_t size_in_bytes);
+        static void release(void *frame, size_t size_in_bytes);
+        static size_t get_num_cached(); // frames cached by the calling thread
+    };
+
+    class RDMATask
+    {
+    public:
+        struct promise_type
+        {
+            RDMAScheduler *scheduler = nullptr; // set by RDMAScheduler::spawn()
+
+            inline RDMATask get_return_object()
+            {
+                return RDMATask(std::coroutine_handle<promise_type>::from_promise(*this));
+            }
+            inline std::suspend_always initial_suspend() noexcept // started by the scheduler
+            {
+                return {};
+            }
+            inline std::suspend_always final_suspend() noexcept // destroyed by the scheduler
+            {
+                return {};
+            }
+            inline void return_void()
+            {
+            }
+            inline void unhandled_exception()
+            {
+                LOG(FATAL) << "Unhandled exception in an RDMATask";
+            }
+            inline static void *operator new(size_t size_in_bytes)
+            {
+                return RDMAFramePool::allocate(size_in_bytes);
+            }
+            inline static void operator delete(void *frame, size_t size_in_bytes)
+            {
+                RDMAFramePool::release(frame, size_in_bytes);
+            }
+        };
+        typedef std::coroutine_handle<promise_type> Handle;
+
+        RDMATask(RDMATask &&other) :
+            handle_(other.handle_)
+        {
+            other.handle_ = nullptr;
+        }
+        RDMATask(const RDMATask &) = delete;
+        RDMATask &operator=(const RDMATask &) = delete;
+        ~RDMATask()
+        {
+            if (handle_) // never spawned
+                handle_.destroy();
+        }
+
+    private:
+        friend class RDMAScheduler;
+        explicit RDMATask(Handle handle) :
+            handle_(handle)
+        {
+        }
+        inline Handle release()
+        {
+            Handle handle = handle_;
+            handle_ = nullptr;
+            return handle;
+        }
+
+    private:
+        Handle handle_ = nullptr; // the coroutine, owned until it is spawned
+    };
+
+    // the awaitable of one work request, co_await returns its cqe
+    class RDMAAwaiter
+    {
+    public:
+        RDMAAwaiter(RDMAScheduler *scheduler, RDMAFuture &&future) :
+            scheduler_(scheduler),
+            future_(std::move(future))
+        {
+        }
+        // not posted yet, the scheduler posts it once the future table has a free slot
+        RDMAAwaiter(RDMAScheduler *scheduler, std::function<RDMAFuture()> &&post) :
+            scheduler_(scheduler),
+            post_(std::move(post))
+        {
+        }
+
+        inline bool await_ready()
+        {
+            return future_.valid() && future_.is_ready();
+        }
+        void await_suspend(RDMATask::Handle handle);
+        inline struct ibv_wc await_resume()
+        {
+            return future_.get();
+        }
+
+    private:
+        friend class RDMAScheduler;
+        RDMAScheduler *scheduler_ = nullptr; // who resumes the coroutine
+        RDMAFuture future_;                  // the future of the work request, invalid until it is posted
+        std::function<RDMAFuture()> post_;   // posts the work request, if it waits for a slot
+        RDMATask::Handle handle_ = nullptr;  // the coroutine waiting for a slot
+    };
+
+    class RDMAScheduler
+    {
+    protected:
+        explicit RDMAScheduler(          // construction function of the scheduler
+            uint32_t max_pending,        // how many operations may be in flight
+            std::string scheduler_info); // the info of this scheduler
+
+    public:
+        virtual ~RDMAScheduler();
+        inline static RDMAScheduler *build_scheduler(uint32_t max_pending = SCHEDULER_MAX_PENDING,
+                                                     std::string scheduler_info = "RDMAScheduler")
+        {
+            return new RDMAScheduler(max_pending, scheduler_info);
+        }
+
+    public:
+        // take the coroutine over, it starts running in the next run_once()
+        void spawn(RDMATask task);
+
+        // poll the cqs once and resume the ready coroutines, return how many are resumed
+        int run_once();
+
+        // run until all spawned coroutines are finished
+        void run();
+
+        // the awaitables posting the operations of RDMAAdapter, the cq of the adapter should carry them only
+        RDMAAwaiter send_remote(RDMAAdapter *adapter,          // the adapter to post on
+                                RDMABuffer *buffer,            // placeholder of the data to send
+                                uint32_t data_length_in_bytes, // data length to send
+                                uint32_t msg_tag = 0);         // tagging the message type to notify peer
+        RDMAAwaiter recv_remote(RDMAAdapter *adapter,           // the adapter to post on
+                                RDMABuffer *buffer,             // a placeholder that captures the recv data
+                                uint32_t data_length_in_bytes); // data length to recv
+        RDMAAwaiter read_remote(RDMAAdapter *adapter,                             // the adapter to post on
+                                RDMABuffer *buffer,                               // placeholder that cache the read data
+                                uint32_t data_length_in_bytes,                    // data length to read
+                                struct CommDescriptor *remote_buffer_descriptor); // remote buffer_describptor
+        RDMAAwaiter write_remote(RDMAAdapter *adapter,                            // the adapter to post on
+                                 RDMABuffer *buffer,                              // the buffer for data to write
+                                 uint32_t data_length_in_bytes,                   // data length to write
+                                 struct CommDescriptor *remote_buffer_descriptor, // remote buffer_describptor
+                                 uint32_t msg_tag,                                // tagging the message type to notify peer
+                                 bool notify_peer = false);                       // notify peer explicit or not
+
+        // await a future of the table of this scheduler, e.g., the result of when_all()
+        RDMAAwaiter wait_for(RDMAFuture future);
+
+        inline RDMAFutureTable *get_future_table()
+        {
+            return futures_.get();
+        }
+        inline uint32_t get_num_alive()
+        {
+            return num_alive_;
+        }
+        inline std::string info()
+        {
+            return "RDMAScheduler(" + scheduler_info_ + ")";
+        }
+
+    private:
+        friend class RDMAAwaiter;
+        static void on_ready(struct ibv_wc *wc, void *args); // the future callback, queue the coroutine
+        void attach_once(RDMAAdapter *adapter);               // poll the cq of the adapter from now on
+        RDMAAwaiter post_or_wait(std::function<RDMAFuture()> &&post); // post now, or once a slot is free
+        void post_waiting();                                  // post the waiting work requests the free slots allow
+
+    private:
+        std::string scheduler_info_ = "";                 // the info of this scheduler
+        std::unique_ptr<RDMAFutureTable> futures_;        // where the operations are posted
+        std::vector<struct ibv_cq *> attached_cqs_;       // cqs attached to the future table
+        std::vector<RDMATask::Handle> ready_coroutines_;  // to resume in the next run_once()
+        std::vector<RDMATask::Handle> resuming_;          // being resumed in this run_once()
+        std::deque<RDMAAwaiter *> slot_waiters_;          // suspended until a slot is free, in posting order
+        uint32_t num_alive_ = 0;                          // spawned and not finished
+    };
+}; // end namespace rdma_core
+#endif
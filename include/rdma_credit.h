@@ -0,0 +1,165 @@
+/******************************************************************
+ * CreditChannel adds credit-based flow control to the send/recv of
+ * an RDMAChannel, so a fast sender never meets an empty receive
+ * queue (RNR retries) on its peer, i.e.,
+ *      -- one credit is one receive posted by the peer, the sender
+ *         posts a send only if it holds a credit, or queues it
+ *      -- the receiver returns credits piggybacked in the 8 high bits
+ *         of the imm_data of its sends, the low 24 bits carry msg_tag
+ *      -- if it has nothing to send, it rdma-writes the number of its
+ *         posted receives into a credit word of the sender instead,
+ *         which consumes no receive on the sender
+ * It is driven by one thread, which feeds the cqes of the channel to
+ * on_send_done()/on_recv_done(). Both peers build it at the same
+ * point, the receive windows and the credit words are swapped then.
+ * It claims the receives of the channel, see claim_recv_queue().
+ * ****************************************************************/
+
+#ifndef __RDMA_COMM_CORE_RDMA_CREDIT_H__
+#define __RDMA_COMM_CORE_RDMA_CREDIT_H__
+
+#include "rdma_buffer.h"
+#include "rdma_channel.h"
+#include "util/logging.h"
+
+#include <deque>
+#include <memory>
+#include <string>
+
+#define CREDIT_MAX_WINDOW 127      // credits are piggybacked as a signed 8-bit distance
+#define CREDIT_TAG_BITS 24         // the low bits of imm_data carrying msg_tag
+#define CREDIT_TAG_MASK ((1u << CREDIT_TAG_BITS) - 1)
+#define CREDIT_MAX_QUEUED 1024     // default sends queued for credits
+
+namespace rdma_core
+{
+    class RDMAChannel;
+
+    class CreditChannel
+    {
+    protected:
+        explicit CreditChannel(       // construction function of the credit channel
+            RDMAChannel *channel,     // the connected channel to control
+            uint32_t window,          // receives kept posted, i.e., the credits of the peer
+            uint32_t max_msg_size,    // bytes of each receive block
+            uint32_t max_queued,      // sends queued when out of credits
+            std::string credit_info); // the info of this credit channel
+
+    public:
+        virtual ~CreditChannel();
+        inline static CreditChannel *build_credit_channel(RDMAChannel *channel,
+                                                          uint32_t window,
+                                                          uint32_t max_msg_size,
+                                                          uint32_t max_queued = CREDIT_MAX_QUEUED,
+                                                          std::string credit_info = "CreditChannel")
+        {
+            return new CreditChannel(channel, window, max_msg_size, max_queued, credit_info);
+        }
+
+    public:
+        // send now if a credit is held, otherwise queue it, return false if the queue is full
+        bool send_remote(RDMABuffer *buffer,            // placeholder of the data to send, kept until it is retired
+                         uint32_t data_length_in_bytes, // data length to send
+                         uint32_t msg_tag = 0);         // tagging the message type, at most CREDIT_TAG_BITS bits
+
+        // read from the peer in order with the sends, a read takes no credit
+        bool read_remote(RDMABuffer *buffer,                               // placeholder that cache the read data
+                         uint32_t data_length_in_bytes,                    // data length to read
+                         struct CommDescriptor *remote_buffer_descriptor); // remote buffer_describptor
+
+        // account a polled send-side cqe, return how many sends/reads of the user are retired (in posting order)
+        uint32_t on_send_done(struct ibv_wc *wc);
+
+        // account a polled recv cqe, strip the credits from wc->imm_data, return the block holding the message
+        RDMABuffer *on_recv_done(struct ibv_wc *wc);
+
+        // give the block back once the message is consumed, it is posted again as a new credit
+        void repost(RDMABuffer *block);
+
+        // post the queued sends the credits allow, and return the credits if none is piggybacked for long
+        uint32_t progress();
+
+        // whether nothing is queued or in flight on the send side
+        inline bool idle()
+        {
+            return pending_sends_.empty() && posted_sqes_.empty();
+        }
+        inline uint32_t get_credits() // sends that can be posted now
+        {
+            return granted_ - consumed_;
+        }
+        inline RDMAChannel *get_channel()
+        {
+            return channel_;
+        }
+        inline uint32_t get_peer_block_size() // sends must fit the receive blocks of the peer
+        {
+            return peer_max_msg_size_;
+        }
+        inline uint32_t get_num_queued()
+        {
+            return pending_sends_.size();
+        }
+        inline uint64_t get_num_stalls() // sends queued because no credit was held
+        {
+            return num_stalls_;
+        }
+        inline uint64_t get_num_credit_updates() // credit words written to the peer
+        {
+            return num_credit_updates_;
+        }
+        inline std::string info()
+        {
+            return "CreditChannel(" + credit_info_ + ")";
+        }
+
+    private:
+        enum class SqeKind : uint8_t
+        {
+            SEND = 0,        // a send of the user
+            READ = 1,        // a read of the user
+            CREDIT_WRITE = 2 // the credits written back to the peer
+        };
+
+        struct PendingSend
+        {
+            SqeKind kind = SqeKind::SEND;      // a send or a read
+            RDMABuffer *buffer = nullptr;      // the data to send, or the placeholder of the read
+            uint32_t data_length_in_bytes = 0; // data length to send/read
+            uint32_t msg_tag = 0;              // tagging the message type
+            struct CommDescriptor remote;      // where to read from
+        };
+
+        struct CreditHandshake
+        {
+            struct CommDescriptor credit_word; // where the peer writes its posted receives
+            uint32_t window = 0;               // receives the peer keeps posted
+            uint32_t max_msg_size = 0;         // bytes of each receive block of the peer
+        } __attribute__((packed));
+
+        void refresh_credits();              // fold the credit word written by the peer
+        void update_credits(uint8_t piggyback); // fold the credits piggybacked by the peer
+        void write_credits();                // write the posted receives into the credit word of the peer
+
+    private:
+        std::string credit_info_ = "";               // the info of this credit channel
+        RDMAChannel *channel_ = nullptr;             // the channel under control
+        uint32_t window_ = 0;                        // receives kept posted
+        uint32_t max_queued_ = CREDIT_MAX_QUEUED;    // sends queued when out of credits
+        uint32_t peer_max_msg_size_ = 0;             // sends must fit the receive blocks of the peer
+        std::unique_ptr<RDMABuffer> recv_blocks_;    // the receive blocks
+        std::deque<RDMABuffer *> posted_recvs_;      // receive blocks in posting order, RC consumes them in order
+        std::unique_ptr<RDMABuffer> credit_words_;   // [0] written by the peer, [1] the source of our credit writes
+        struct CommDescriptor peer_credit_word_;     // the credit word of the peer
+        std::deque<PendingSend> pending_sends_;      // sends waiting for credits, and the reads behind them
+        std::deque<SqeKind> posted_sqes_;            // the kind of each sqe in posting order
+        bool credit_write_inflight_ = false;         // one credit write is enough, it carries the latest count
+        uint64_t posted_total_ = 0;                  // receives ever posted
+        uint64_t advertised_ = 0;                    // receives the peer has been told about
+        uint64_t granted_ = 0;                       // receives the peer ever posted, as we know
+        uint64_t consumed_ = 0;                      // sends ever posted
+        uint64_t num_stalls_ = 0;                    // sends queued because no credit was held
+        uint64_t num_credit_updates_ = 0;            // credit words written to the peer
+    };
+}; // end namespace rdma_core
+#endif
@@ -38,9 +38,17 @@ namespace rdma_core
             std::string dev_name,                      //device name of this device
             RDMAAdapter *adapter);                     //device are queried by dev_name
 
-        struct ibv_comp_channel *create_event_channel(); // Completion channel
+        struct ibv_comp_channel *create_event_channel( // Completion channel
+            std::string channel_key = "");             // non-empty key means shared channel, e.g., for a shared cq
 
-        struct ibv_pd *create_protected_domain(); // Protection domain
+        struct ibv_pd *create_protected_domain( // Protection domain
+            std::string pd_key = "");           // non-empty key means shared pd with the same key
+
+        struct ibv_srq *create_shared_receive_queue( // Shared receive queue
+            std::string srq_key,                     // the srq_key, same key means shared srq
+            struct ibv_pd *pd,                       // the protection domain of the srq
+            uint32_t max_wr,                         // how many recv_wqe the srq can hold
+            uint32_t max_sge);                       // maximum sges per recv_wqe
 
         struct ibv_cq *create_completion_queue(
             std::string cq_key,               // the cq_key;
@@ -50,8 +58,8 @@ namespace rdma_core
             int comp_vector = 0);             // CQ will use comp_vector for signaling completion events;
 
         struct ibv_qp *create_queue_pair(
-            struct ibv_pd *pd,                  // the protection domain
-            struct ibv_qp_init_attr init_attr); // create queue pair for real RDMA connection
+            struct ibv_pd *pd,                   // the protection domain
+            struct ibv_qp_init_attr *init_attr); // create queue pair, the cap is updated with the real one
 
         inline struct ibv_device_attr *get_device_attr() // get the devide attributes
         {
@@ -76,6 +84,8 @@ namespace rdma_core
             uint8_t ib_port,
             uint8_t gid_index);
 
+        int get_numa_node(); // the numa node the NIC is attached to, -1 if unknown
+
         inline std::string info() // return the device info, i.e., dev_name
         {
             return "RDMADevice(" + dev_name_ + ")";
@@ -88,6 +98,15 @@ namespace rdma_core
             int access_flags = 0,         // access mode read/write
             std::string info = "");       //register the mm buffer info
 
+        // register with exactly access_flags, 0 is local read only, which also takes read-only memory;
+        // real_register_mem() above always grants local write and remote read/write
+        struct ibv_mr *real_register_mem_with_access(
+            struct ibv_pd *pd,      // protected domain
+            void *data_ptr,         // data ptr
+            size_t size_in_byte,    // buffer size
+            int access_flags,       // IBV_ACCESS_xxx, honoured as is
+            std::string info = ""); // register the mm buffer info
+
         bool real_deregister_mem(   // deregister memory for use
             struct ibv_mr *mr_,     // mr_ is the memory key
             std::string info = ""); //register the mm buffer info
@@ -103,7 +122,8 @@ namespace rdma_core
             void *buffer_addrr, // buffer that to recv data
             uint32_t msg_size,  // recv buffer size
             uint32_t imm_data,  // imm_data to notify peer
-            uint64_t key);      // key to indicate who send it
+            uint64_t key,       // key to indicate who send it
+            int send_flags = IBV_SEND_SIGNALED); // whether to signal a cqe for this wqe
 
         static bool real_recv_(
             struct ibv_qp *qp,  // the qp for rdma context
@@ -119,7 +139,8 @@ namespace rdma_core
             void *src_addr,         // the address to write
             uint64_t dest_addr,     // the dest address to write
             uint32_t size_in_bytes, // bytes to write
-            uint64_t wr_id);        // id of this workrequest
+            uint64_t wr_id,         // id of this workrequest
+            int send_flags = IBV_SEND_SIGNALED); // whether to signal a cqe for this wqe
 
         static bool real_write_remote_with_notify_(
             struct ibv_qp *qp,      // the qp for rdma context
@@ -129,7 +150,8 @@ namespace rdma_core
             uint64_t dest_addr,     // the dest address to write
             uint32_t size_in_bytes, // bytes to write
             uint32_t imm_data,      // imm data to notify peer
-            uint64_t wr_id);        // id of this workrequest
+            uint64_t wr_id,         // id of this workrequest
+            int send_flags = IBV_SEND_SIGNALED); // whether to signal a cqe for this wqe
 
         static bool real_read_remote_(
             struct ibv_qp *qp,      // the qp for rdma context
@@ -138,7 +160,45 @@ namespace rdma_core
             void *dest_addr,        // the address to read placeholder
             uint64_t src_addr,      // the  address to read source
             uint32_t size_in_bytes, // bytes to read
-            uint64_t wr_id);        // id of this workrequest
+            uint64_t wr_id,         // id of this workrequest
+            int send_flags = IBV_SEND_SIGNALED); // whether to signal a cqe for this wqe
+
+        static bool real_post_send_sge_(
+            struct ibv_qp *qp,                  // the qp for rdma context
+            enum ibv_wr_opcode opcode,          // send/write/read (with imm)
+            struct ibv_sge *sg_list,            // the gather list of local mem
+            int num_sge,                        // how many entries in sg_list
+            uint64_t remote_addr,               // the remote address for write/read
+            uint32_t rkey,                      // the key of remote mem
+            uint32_t imm_data,                  // imm data to notify peer
+            uint64_t wr_id,                     // id of this workrequest
+            int send_flags = IBV_SEND_SIGNALED); // whether to signal a cqe for this wqe
+
+        static bool real_post_recv_sge_(
+            struct ibv_qp *qp,       // the qp for rdma context
+            struct ibv_sge *sg_list, // the scatter list of local mem
+            int num_sge,             // how many entries in sg_list
+            uint64_t key);           // key to indicate who recv it
+
+        static bool real_post_srq_recv_batch_(
+            struct ibv_srq *srq,          // the shared receive queue
+            struct ibv_recv_wr *wr_list); // linked recv work requests, one doorbell for all
+
+        static bool real_post_send_batch_(
+            struct ibv_qp *qp,           // the qp for rdma context
+            struct ibv_send_wr *wr_list, // linked work requests, one doorbell for all
+            uint64_t key);               // key to indicate who send it
+
+        static bool real_req_notify_cq_( // arm the cq, the next cqe raises an event on its channel
+            struct ibv_cq *cq_,          // the completion queue to arm
+            int solicited_only = 0);     // only notify for solicited (or error) cqes
+
+        static struct ibv_cq *real_get_cq_event_( // fetch one event from a non-blocking channel
+            struct ibv_comp_channel *channel);    // the event channel, nullptr is returned if it is empty
+
+        static void real_ack_cq_events_( // ack events fetched from the cq, in a batch
+            struct ibv_cq *cq_,          // the completion queue of the events
+            uint32_t num_events);        // how many events to ack
         /*******************exposed API************************/
 
     protected:
@@ -163,6 +223,15 @@ namespace rdma_core
         std::unordered_map<std::string,                 // key
                            struct ibv_cq *>             //value
             reg_cqs_;                                   //completion_queue in this dev
+        std::unordered_map<std::string,                 // key
+                           struct ibv_pd *>             //value
+            reg_pds_;                                   //shared protection domain in this dev
+        std::unordered_map<std::string,                 // key
+                           struct ibv_srq *>            //value
+            reg_srqs_;                                  //shared receive queue in this dev
+        std::unordered_map<std::string,                 // key
+                           struct ibv_comp_channel *>   //value
+            reg_event_channels_;                        //shared event channel in this dev
         std::set<RDMAAdapter *> adapter_set_;           //adapter set that using this device
         std::string dev_name_ = "";                     // device name
         struct ibv_context *ib_ctx_ = 0;                /* device handle */
@@ -3,6 +3,10 @@
  * it owns two subhandlers, i.e., 
  *      --- TCPConnector: the tcp connection abstraction
  *      --- RDMAChannel: the RDMA communication abstraction
+ * An endpoint holds num_data_channels data channels (one qp each, in
+ * one pd) and an optional ctrl channel, all exchanged in one handshake.
+ * The session drives data channel 0, the others are driven by
+ * StripedChannel or by the user.
  * ********************************************************************/
 
 #ifndef __RDMA_COMM_CORE_RDMA_END_POINT_H__
@@ -13,6 +17,7 @@
 #include "tcp_connector.h"
 #include <memory>
 #include <string>
+#include <vector>
 #include "rdma_config.h"
 namespace rdma_core
 {
@@ -47,6 +52,12 @@ namespace rdma_core
 
         void sync_with_peer(std::string info = ""); //using TCP to sync with remote
 
+        // using TCP to swap a small blob with remote, both sides pass the same size
+        void exchange_with_peer(void *local_data,      // the bytes to send
+                                void *remote_data,     // placeholder of the bytes from remote
+                                uint32_t size_in_bytes, // bytes to swap
+                                std::string info = ""); // what is swapped, for the error log
+
         inline std::string info(); // return the detail information of this endpoint
 
         inline RDMASession *get_registered_session() // get the session of this endpoint registered in
@@ -56,13 +67,33 @@ namespace rdma_core
 
         void connecting(); // connecting to peer
 
+        // the steps of connecting(), to run the handshakes of many endpoints concurrently (see RDMABootstrap)
+        std::vector<AdapterInfo> load_channels();                   // load the channels, return their info
+        void connect_channels(std::vector<AdapterInfo> &peer_infos); // connect the channels to the peer ones
+        int get_socket();                                           // the socket of the TCPConnector
+        inline std::string get_peer_ip()                            // the address of the peer on the TCPConnector
+        {
+            return pre_connector_->get_peer_ip();
+        }
+
         std::string get_id(); // return the id of this endpoint
 
-        inline RDMAChannel *get_channel(uint32_t index = 0) // fetch the rdmachannel for this connection
+        inline RDMAChannel *get_channel(uint32_t index = 0) // fetch the index-th data channel for this connection
         {
-            CHECK(index == 0) << "Currently, we only support one channel in a endpoint";
+            CHECK(index < num_data_channels_) << "Invalid channel index: " << index
+                                              << ", the endpoint holds " << num_data_channels_ << " data channel(s)";
             return rdma_channel_mgr_[index].get();
         }
+        inline uint32_t get_num_channels() // how many data channels the endpoint holds
+        {
+            return num_data_channels_;
+        }
+        inline RDMAChannel *get_ctrl_channel() // fetch the channel for small control messages
+        {
+            CHECK(ctrl_channel_ != nullptr) << "No ctrl channel is created, set use_ctrl_channel in the config";
+            return ctrl_channel_;
+        }
+        std::vector<RDMAChannel *> get_all_channels(); // the data channels, followed by the ctrl channel if any
         void setup_index_in_session(int index);
 
         void reset();
@@ -76,6 +107,8 @@ namespace rdma_core
         Config work_env_;                                            // work env for params
         std::unique_ptr<TCPConnector> pre_connector_;                // a helper to setting up the rdma_channel
         std::vector<std::unique_ptr<RDMAChannel>> rdma_channel_mgr_; // a manager of RDMAChannel
+        uint32_t num_data_channels_ = 1;                             // the data channels are the first ones in the manager
+        RDMAChannel *ctrl_channel_ = nullptr;                        // the last one in the manager if created
         RDMASession *registered_session_ = nullptr;                  // the session of this endpoint registered in
     };
 
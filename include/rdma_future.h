@@ -0,0 +1,194 @@
+/******************************************************************
+ * RDMAFuture is a completion token of one posted work request, its
+ * state is set by the cq poller through the wr_id of the cqe, i.e.,
+ *      -- the wr_id packs (tag bit, slot index, slot generation),
+ *         the adapters are aligned, so their wr_ids never carry the tag
+ *      -- the slots are pooled in a fixed-size RDMAFutureTable,
+ *         nothing is allocated per operation
+ *      -- a future supports wait(), then() and when_all()
+ * A slot is held by the future and by the posted work request, it is
+ * recycled once both are gone, so a future can be dropped in flight.
+ * Posting without a free slot is fatal, check has_free_slot() first.
+ * ****************************************************************/
+
+#ifndef __RDMA_COMM_CORE_RDMA_FUTURE_H__
+#define __RDMA_COMM_CORE_RDMA_FUTURE_H__
+
+#include "rdma_adapter.h"
+#include "rdma_buffer.h"
+#include "util/logging.h"
+#include <infiniband/verbs.h>
+
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#define FUTURE_TABLE_SLOTS 1024 // default number of the pooled completion slots
+#define FUTURE_WR_TAG 1ULL      // the lowest bit tags the wr_ids owned by a future table
+
+namespace rdma_core
+{
+    class RDMAFutureTable;
+
+    // invoked once with the cqe of the completed future, it runs on the polling thread
+    typedef void (*FutureCallback)(struct ibv_wc *wc, void *args);
+
+    class RDMAFuture
+    {
+    public:
+        RDMAFuture() = default;
+        RDMAFuture(RDMAFuture &&other);
+        RDMAFuture &operator=(RDMAFuture &&other);
+        RDMAFuture(const RDMAFuture &) = delete;
+        RDMAFuture &operator=(const RDMAFuture &) = delete;
+        ~RDMAFuture();
+
+    public:
+        // whether the future holds a slot
+        inline bool valid()
+        {
+            return table_ != nullptr;
+        }
+
+        // whether the cqe of the work request is polled
+        bool is_ready();
+
+        // progress the pollers of the table until the future is ready, return true if the cqe is a success
+        bool wait();
+
+        // run the callback once the future is ready, immediately if it already is
+        void then(FutureCallback callback, // the callback to run
+                  void *args = nullptr);   // the args passed to the callback
+
+        // the cqe of the completed work request, only valid once the future is ready
+        struct ibv_wc &get();
+
+        // the wr_id the work request is posted with
+        uint64_t wr_id();
+
+        // give the slot back, the future is invalid afterwards
+        void reset();
+
+    private:
+        friend class RDMAFutureTable;
+        RDMAFuture(RDMAFutureTable *table, uint32_t slot_index, uint32_t generation);
+
+    private:
+        RDMAFutureTable *table_ = nullptr; // the table holding the slot
+        uint32_t slot_index_ = 0;          // index of the slot in the table
+        uint32_t generation_ = 0;          // generation of the slot when the future is created
+    };
+
+    class RDMAFutureTable
+    {
+    protected:
+        explicit RDMAFutureTable(     // construction function of the future table
+            uint32_t num_slots,       // how many futures may be alive at once
+            std::string table_info);  // the info of this table
+
+    public:
+        virtual ~RDMAFutureTable();
+        inline static RDMAFutureTable *build_future_table(uint32_t num_slots = FUTURE_TABLE_SLOTS,
+                                                          std::string table_info = "RDMAFutureTable")
+        {
+            return new RDMAFutureTable(num_slots, table_info);
+        }
+
+        // whether the wr_id is posted by a future table
+        inline static bool is_future_wr(uint64_t wr_id)
+        {
+            return (wr_id & FUTURE_WR_TAG) != 0;
+        }
+
+    public:
+        // poll the cq of the adapter in progress(), its cq should carry the cqes of futures only
+        void attach(RDMAAdapter *adapter);
+
+        // poll the attached cqs once, return how many futures are completed
+        int progress();
+
+        // complete the future of a polled cqe, return false if the cqe is not owned by this table
+        bool complete(struct ibv_wc *wc);
+
+        // a future completing once all of the futures complete, its cqe is the first failed one if any
+        RDMAFuture when_all(RDMAFuture *futures, // the futures to wait for
+                            uint32_t num_futures);
+        RDMAFuture when_all(std::vector<RDMAFuture> &futures);
+
+        // post the operations of RDMAAdapter, the work request is completed through the future
+        RDMAFuture send_remote(RDMAAdapter *adapter,          // the adapter to post on
+                               RDMABuffer *buffer,            // placeholder of the data to send
+                               uint32_t data_length_in_bytes, // data length to send
+                               uint32_t msg_tag = 0);         // tagging the message type to notify peer
+        RDMAFuture recv_remote(RDMAAdapter *adapter,           // the adapter to post on
+                               RDMABuffer *buffer,             // a placeholder that captures the recv data
+                               uint32_t data_length_in_bytes); // data length to recv
+        RDMAFuture read_remote(RDMAAdapter *adapter,                             // the adapter to post on
+                               RDMABuffer *buffer,                               // placeholder that cache the read data
+                               uint32_t data_length_in_bytes,                    // data length to read
+                               struct CommDescriptor *remote_buffer_descriptor); // remote buffer_describptor
+        RDMAFuture write_remote(RDMAAdapter *adapter,                            // the adapter to post on
+                                RDMABuffer *buffer,                              // the buffer for data to write
+                                uint32_t data_length_in_bytes,                   // data length to write
+                                struct CommDescriptor *remote_buffer_descriptor, // remote buffer_describptor
+                                uint32_t msg_tag,                                // tagging the message type to notify peer
+                                bool notify_peer = false);                       // notify peer explicit or not
+
+        // whether a slot is free for the next post, the slots come back as progress() polls their cqes
+        bool has_free_slot();
+
+        inline uint32_t get_num_slots()
+        {
+            return slots_.size();
+        }
+        inline std::string info()
+        {
+            return "RDMAFutureTable(" + table_info_ + ")";
+        }
+
+    private:
+        friend class RDMAFuture;
+
+        enum class SlotState : uint32_t
+        {
+            FREE = 0,    // in the free list
+            PENDING = 1, // the work request is in flight
+            READY = 2    // the cqe is polled
+        };
+
+        struct CompletionSlot
+        {
+            std::atomic<SlotState> state{SlotState::FREE}; // read without the lock by is_ready()
+            uint32_t generation = 0;                       // bumped on recycling, stale wr_ids are detected
+            uint32_t holders = 0;                          // the future and the in-flight work request
+            RDMAAdapter *adapter = nullptr;                // where the work request is posted, null for when_all
+            bool send_side = false;                        // whether the cqe retires sqes of the adapter
+            struct ibv_wc wc;                              // the cqe of the work request
+            FutureCallback callback = nullptr;             // run once the slot is ready
+            void *callback_args = nullptr;                 // the args passed to the callback
+            int32_t parent = -1;                           // the when_all slot waiting for this one
+            uint32_t pending_children = 0;                 // for a when_all slot, children not ready yet
+        };
+
+        inline uint64_t encode_wr_id(uint32_t slot_index, uint32_t generation)
+        {
+            return ((uint64_t)generation << 32) | ((uint64_t)slot_index << 1) | FUTURE_WR_TAG;
+        }
+
+        RDMAFuture acquire(RDMAAdapter *adapter, bool send_side); // take a free slot, with two holders
+        RDMAFuture posted(RDMAFuture future, bool success);       // fail the future if posting failed
+        void finish(uint32_t slot_index, struct ibv_wc *wc);      // mark the slot ready, run its callback and notify its parent
+        void release(uint32_t slot_index);                        // drop one holder, recycle the slot once none is left
+        CompletionSlot &slot_of(uint32_t slot_index, uint32_t generation); // the slot a future refers to
+
+    private:
+        std::string table_info_ = "";              // the info of this table
+        std::vector<CompletionSlot> slots_;        // the pooled completion slots
+        std::vector<uint32_t> free_slots_;         // indices of the free slots, reserved up front
+        std::recursive_mutex slot_lock_;           // protect the slots, callbacks may post new futures
+        std::mutex poll_lock_;                     // only one thread polls the attached cqs
+        std::vector<RDMAAdapter *> polled_adapters_; // one adapter per attached cq
+    };
+}; // end namespace rdma_core
+#endif
@@ -0,0 +1,115 @@
+/******************************************************************
+ * RDMAMemoryPool is a per-PD allocator of registered memory. It
+ * carves power-of-two slab classes out of large chunks that are
+ * registered only once, i.e.,
+ *      -- a block is handed out with the (lkey, rkey) of its chunk
+ *      -- each thread caches free blocks per class, the central
+ *         free list is only locked to refill/spill a batch
+ *      -- chunks stay registered until the process exits, the
+ *         pool is shared by all adapters on the pd (like RDMADevice)
+ * ****************************************************************/
+
+#ifndef __RDMA_COMM_CORE_RDMA_MEMORY_POOL_H__
+#define __RDMA_COMM_CORE_RDMA_MEMORY_POOL_H__
+
+#include "rdma_adapter.h"
+#include "rdma_device.h"
+#include "util/logging.h"
+#include <infiniband/verbs.h>
+
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#define POOL_MIN_CLASS_SHIFT 6       // the smallest slab class holds 64 bytes
+#define POOL_MAX_CLASS_SHIFT 40      // the largest slab class holds 1 TB
+#define POOL_CHUNK_SIZE (32UL << 20) // bytes registered per chunk, larger classes get a chunk per block
+#define POOL_CACHE_BATCH 32          // blocks moved between a thread cache and the central free list at once
+
+namespace rdma_core
+{
+    class RDMAAdapter;
+    class RDMADevice;
+
+    class RDMAMemoryPool
+    {
+    public:
+        struct PoolBlock
+        {
+            uint8_t *addr = nullptr;      // the address of the block
+            struct ibv_mr *mr_ = nullptr; // the memory region of the chunk holding the block
+        };
+
+    protected:
+        explicit RDMAMemoryPool(                // construction function of the memory pool
+            std::shared_ptr<RDMADevice> device, // the device the pd belongs to
+            struct ibv_pd *pd,                  // all chunks are registered in this pd
+            std::string pool_info);             // the info of this pool
+
+    public:
+        virtual ~RDMAMemoryPool();
+
+        // the pool of the pd the adapter is using, created at the first query
+        static RDMAMemoryPool *get_memory_pool(RDMAAdapter *adapter);
+
+    public:
+        // hand out a registered block of at least size_in_byte bytes, its content is undefined
+        PoolBlock allocate(size_t size_in_byte);
+
+        // give the block back, size_in_byte is the size passed to allocate()
+        void deallocate(PoolBlock block, size_t size_in_byte);
+
+        inline struct ibv_pd *get_protected_domain()
+        {
+            return pd_;
+        }
+        inline size_t get_registered_bytes() // how many bytes are registered by this pool
+        {
+            return registered_bytes_;
+        }
+        inline std::string info()
+        {
+            return "RDMAMemoryPool(" + pool_info_ + ")";
+        }
+
+        // the slab class serving size_in_byte, i.e., ceil(log2(size_in_byte))
+        static inline uint32_t size_to_class(size_t size_in_byte)
+        {
+            if (size_in_byte <= (1UL << POOL_MIN_CLASS_SHIFT))
+                return POOL_MIN_CLASS_SHIFT;
+            return 64 - __builtin_clzl(size_in_byte - 1);
+        }
+
+    private:
+        struct ThreadCache // free blocks cached by one thread, accessed without lock
+        {
+            RDMAMemoryPool *pool = nullptr;                              // the pool the blocks belong to
+            std::vector<PoolBlock> free_blocks[POOL_MAX_CLASS_SHIFT + 1]; // free blocks per slab class
+            ~ThreadCache();                                              // give the cached blocks back at thread exit
+        };
+
+        ThreadCache *local_cache();                           // the cache of the calling thread
+        void refill(uint32_t slab_class, ThreadCache *cache); // move a batch from the central list to the cache
+        void spill(uint32_t slab_class, ThreadCache *cache,   // move blocks from the cache to the central list
+                   size_t num_blocks);                        // how many blocks to move
+        void carve_chunk(uint32_t slab_class);                // register a new chunk and split it, locked by caller
+
+    private:
+        std::string pool_info_ = "";                                      // the info of this pool
+        std::shared_ptr<RDMADevice> device_ = nullptr;                    // the device the pd belongs to
+        struct ibv_pd *pd_ = nullptr;                                     // all chunks are registered in this pd
+        std::mutex central_lock_;                                         // protect the central free lists and chunks
+        std::vector<PoolBlock> central_blocks_[POOL_MAX_CLASS_SHIFT + 1]; // free blocks shared by all threads
+        std::vector<PoolBlock> chunks_;                                   // the registered chunks
+        size_t registered_bytes_ = 0;                                     // how many bytes are registered
+
+        // global resources
+        static std::mutex pool_global_lock_;                       // protect pool_map_
+        static std::unordered_map<struct ibv_pd *,                 // key
+                                  std::unique_ptr<RDMAMemoryPool>> // value
+            pool_map_;                                             // pd -> pool
+    };
+}; // end namespace rdma_core
+#endif
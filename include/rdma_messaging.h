@@ -0,0 +1,184 @@
+/******************************************************************
+ * MessageEngine sends messages of any size over a CreditChannel and
+ * picks the protocol by the message size, i.e.,
+ *      -- eager: a message up to the eager threshold is copied into
+ *         a staging block behind its header, and lands in one of the
+ *         receive blocks (bounce buffers) posted by the peer
+ *      -- rendezvous: a larger message only sends an RTS carrying the
+ *         descriptor of the source buffer, the receiver reads it into
+ *         its destination by read_remote and answers with a FIN
+ *      -- the receives are matched with the destinations posted by
+ *         post_recv() in order, early messages wait in an unexpected
+ *         queue, an unexpected eager message keeps its bounce buffer
+ * It is driven by one thread, which feeds all cqes of the channel to
+ * on_completion(), the finished messages are taken by
+ * next_completion(). The eager threshold may differ on both sides.
+ * ****************************************************************/
+
+#ifndef __RDMA_COMM_CORE_RDMA_MESSAGING_H__
+#define __RDMA_COMM_CORE_RDMA_MESSAGING_H__
+
+#include "rdma_buffer.h"
+#include "rdma_credit.h"
+#include "util/logging.h"
+#include <infiniband/verbs.h>
+
+#include <deque>
+#include <memory>
+#include <string>
+
+#define MESSAGE_STAGING_SLOTS 64     // default headers and eager copies in flight
+#define MESSAGE_EAGER_THRESHOLD 8192 // default bytes up to which a message is sent eagerly
+
+namespace rdma_core
+{
+    enum class ProtocolType : uint32_t
+    {
+        EAGER = 1, // the header and the payload
+        RTS = 2,   // ready to send, the header carries the source buffer
+        FIN = 3    // the source buffer of the rendezvous is read
+    };
+
+    // a finished message, reported once per send_message() and per post_recv()
+    struct MessageCompletion
+    {
+        uint64_t msg_id = 0;          // the id returned by send_message(), or the id of the peer for a receive
+        uint32_t msg_tag = 0;         // tagging the message type
+        size_t length = 0;            // bytes of the message
+        RDMABuffer *buffer = nullptr; // the source of a send, or the destination of a receive
+        bool is_send = false;         // whether the message is sent by this side
+        bool eager = false;           // whether the message went by the eager protocol
+    };
+
+    class MessageEngine
+    {
+    protected:
+        explicit MessageEngine(         // construction function of the message engine
+            CreditChannel *credit,      // the flow-controlled channel carrying the messages
+            uint32_t eager_threshold,   // bytes up to which a message is sent eagerly
+            uint32_t staging_slots,     // headers and eager copies in flight
+            std::string engine_info);   // the info of this engine
+
+    public:
+        virtual ~MessageEngine();
+        inline static MessageEngine *build_message_engine(CreditChannel *credit,
+                                                          uint32_t eager_threshold = MESSAGE_EAGER_THRESHOLD,
+                                                          uint32_t staging_slots = MESSAGE_STAGING_SLOTS,
+                                                          std::string engine_info = "MessageEngine")
+        {
+            return new MessageEngine(credit, eager_threshold, staging_slots, engine_info);
+        }
+
+    public:
+        // send the message by the protocol its size picks, return its msg_id, or 0 if all staging blocks are in flight;
+        // the buffer of a rendezvous must be registered on the channel and kept until the send is completed
+        uint64_t send_message(RDMABuffer *buffer,   // the data to send
+                              size_t length,        // data length to send
+                              uint32_t msg_tag = 0); // tagging the message type
+
+        // post a destination for the next message of the peer, registered on the channel
+        void post_recv(RDMABuffer *buffer, // where the message lands
+                       size_t capacity);   // bytes the destination holds
+
+        // handle one polled cqe of the channel
+        void on_completion(struct ibv_wc *wc);
+
+        // post the operations deferred for room, and the queued sends of the credit channel
+        void progress();
+
+        // take one finished message, return false if there is none
+        bool next_completion(struct MessageCompletion *completion);
+
+        // whether no op of ours is in flight or deferred, and no rendezvous waits for its FIN
+        inline bool idle()
+        {
+            return deferred_.empty() && posted_ops_.empty() && pending_fins_.empty() && rendezvous_sends_.empty();
+        }
+
+        // the eager threshold is bounded by the receive blocks of the peer
+        void set_eager_threshold(uint32_t eager_threshold);
+        inline uint32_t get_eager_threshold()
+        {
+            return eager_threshold_;
+        }
+        inline uint32_t get_max_eager_threshold()
+        {
+            return credit_->get_peer_block_size() - sizeof(MessageHeader);
+        }
+        inline uint64_t get_num_eager()
+        {
+            return num_eager_;
+        }
+        inline uint64_t get_num_rendezvous()
+        {
+            return num_rendezvous_;
+        }
+        inline std::string info()
+        {
+            return "MessageEngine(" + engine_info_ + ")";
+        }
+
+    private:
+        struct MessageHeader
+        {
+            uint64_t msg_id = 0;          // the id of the message on the sender
+            uint32_t msg_tag = 0;         // tagging the message type
+            uint64_t length = 0;          // bytes of the message
+            struct CommDescriptor source; // the source buffer of a rendezvous
+        } __attribute__((packed));
+
+        enum class OpKind : uint8_t
+        {
+            STAGED_SEND = 0, // a header (and an eager payload) in a staging block
+            READ = 1         // the read of a rendezvous
+        };
+
+        struct PostedOp
+        {
+            OpKind kind = OpKind::STAGED_SEND;
+            ProtocolType type = ProtocolType::EAGER; // what a staged send carries
+            RDMABuffer *buffer = nullptr;          // the staging block, or the destination of the read
+            uint32_t wire_length = 0;              // bytes to send or to read
+            struct CommDescriptor remote;          // the source of the read
+            struct MessageCompletion completion;   // reported once the op is retired, if msg_id is set
+        };
+
+        struct UnexpectedMessage
+        {
+            ProtocolType type = ProtocolType::EAGER;
+            struct MessageHeader header;  // a copy of the header
+            RDMABuffer *block = nullptr;  // the bounce buffer holding an eager payload, not reposted yet
+        };
+
+        struct PostedRecv
+        {
+            RDMABuffer *buffer = nullptr; // where the message lands
+            size_t capacity = 0;          // bytes the destination holds
+        };
+
+        RDMABuffer *stage(struct MessageHeader &header);            // take a staging block with the header
+        void submit(PostedOp &op);                                  // hand the op to the credit channel in order
+        void flush_deferred();                                      // retry the ops the credit channel refused
+        void send_fin(uint64_t msg_id);                             // answer a finished read
+        void on_recv(struct ibv_wc *wc);                            // a message of the peer
+        void deliver(UnexpectedMessage &message, PostedRecv &dest); // match a message with a destination
+        void on_retired(PostedOp &op);                              // an op of ours is done
+
+    private:
+        std::string engine_info_ = "";                          // the info of this engine
+        CreditChannel *credit_ = nullptr;                       // the flow-controlled channel
+        uint32_t eager_threshold_ = MESSAGE_EAGER_THRESHOLD;    // bytes up to which a message is sent eagerly
+        std::unique_ptr<RDMABuffer> staging_;                   // the ring of the staging blocks
+        std::deque<PostedOp> deferred_;                         // ops waiting for room in the credit channel
+        std::deque<PostedOp> posted_ops_;                       // ops in the credit channel, in posting order
+        std::deque<uint64_t> pending_fins_;                     // FINs waiting for a staging block
+        std::deque<struct MessageCompletion> rendezvous_sends_; // sends waiting for their FIN, in order
+        std::deque<UnexpectedMessage> unexpected_;              // messages arrived before their destinations
+        std::deque<PostedRecv> posted_dests_;                   // destinations waiting for messages
+        std::deque<struct MessageCompletion> completions_;      // finished messages
+        uint64_t next_msg_id_ = 1;                              // 0 reports a failed send_message()
+        uint64_t num_eager_ = 0;                                // messages sent eagerly
+        uint64_t num_rendezvous_ = 0;                           // messages sent by rendezvous
+    };
+}; // end namespace rdma_core
+#endif
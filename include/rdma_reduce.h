@@ -0,0 +1,85 @@
+/******************************************************************
+ * The element-wise reductions of the collectives, i.e.,
+ *      -- dst[i] = op(dst[i], src[i]) for float32, float16, bfloat16,
+ *         int8, int32 and int64 elements, op is sum, prod, max or min
+ *      -- float16/bfloat16 are widened to float32 for the op and
+ *         rounded back to the nearest even, the integers wrap around
+ *      -- AVX2 and AVX-512 kernels, picked once by cpuid at startup,
+ *         the scalar loop covers the tails and the rest of the cpus
+ *      -- reduce_copy_buffers() also stores the result into a second
+ *         buffer, e.g., the slot of the next send, in the same pass
+ *         with streaming stores for large buffers, else in two passes
+ * The collectives reduce each received chunk into their vector with
+ * reduce_buffers(), while the next chunks are still in flight.
+ * ****************************************************************/
+
+#ifndef __RDMA_COMM_CORE_RDMA_REDUCE_H__
+#define __RDMA_COMM_CORE_RDMA_REDUCE_H__
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+
+namespace rdma_core
+{
+    enum class ReduceDataType : uint32_t
+    {
+        FLOAT32 = 0,
+        FLOAT16 = 1,
+        BFLOAT16 = 2,
+        INT32 = 3,
+        INT8 = 4,
+        INT64 = 5
+    };
+
+    enum class ReduceOp : uint32_t
+    {
+        SUM = 0,
+        MAX = 1,
+        MIN = 2,
+        PROD = 3
+    };
+
+    enum class ReduceIsa : uint32_t
+    {
+        SCALAR = 0, // plain loops, vectorized by the compiler at best
+        AVX2 = 1,   // 256-bit kernels, with F16C for float16
+        AVX512 = 2  // 512-bit kernels, needs AVX-512 F/BW/DQ
+    };
+
+    // bytes of one element of the type
+    size_t reduce_type_size(ReduceDataType type);
+
+    // the names shown in the logs
+    std::string reduce_type_to_str(ReduceDataType type);
+    std::string reduce_op_to_str(ReduceOp op);
+    std::string reduce_isa_to_str(ReduceIsa isa);
+
+    // the kernels reduce_buffers() runs, the widest one the cpu supports unless set_reduce_isa() narrowed it
+    ReduceIsa get_reduce_isa();
+    bool reduce_isa_supported(ReduceIsa isa);
+    void set_reduce_isa(ReduceIsa isa); // e.g., to compare the kernels, it must be supported by the cpu
+
+    // dst[i] = op(dst[i], src[i]) for count elements, the buffers must not overlap
+    void reduce_buffers(void *dst,           // the accumulated elements
+                        const void *src,     // the elements to fold in
+                        size_t count,        // how many elements
+                        ReduceDataType type, // the type of the elements
+                        ReduceOp op);        // the reduction
+
+    // dst[i] = copy[i] = op(dst[i], src[i]), in one pass when the buffers outgrow the cache, as it saves reading
+    // dst back; below 1 MiB, or without vector kernels, it is reduce_buffers() plus a memcpy
+    void reduce_copy_buffers(void *dst,           // the accumulated elements
+                             void *copy,          // receives the result as well
+                             const void *src,     // the elements to fold in
+                             size_t count,        // how many elements
+                             ReduceDataType type, // the type of the elements
+                             ReduceOp op);        // the reduction
+
+    // the conversions of the 16-bit floats, rounding to the nearest even
+    float half_to_float(uint16_t value);
+    uint16_t float_to_half(float value);
+    float bfloat16_to_float(uint16_t value);
+    uint16_t float_to_bfloat16(float value);
+}; // end namespace rdma_core
+#endif
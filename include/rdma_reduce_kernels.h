@@ -0,0 +1,33 @@
+/******************************************************************
+ * The kernels behind reduce_buffers(), one translation unit per ISA:
+ *      -- rdma_reduce.cc: the scalar loops, built for any cpu
+ *      -- rdma_reduce_avx2.cc: built with -mavx2 -mf16c
+ *      -- rdma_reduce_avx512.cc: built with -mavx512f/bw/dq
+ * A vector kernel handles the whole vectors at the head of the buffers
+ * and leaves the tail to the scalar loop. The copy of a fused pass is
+ * streamed past the cache when it is aligned. The vector units only run
+ * the kernel get_reduce_isa() picked, so nothing else may be defined
+ * in them, not even inline helpers shared with other units.
+ * ****************************************************************/
+
+#ifndef __RDMA_COMM_CORE_RDMA_REDUCE_KERNELS_H__
+#define __RDMA_COMM_CORE_RDMA_REDUCE_KERNELS_H__
+
+#include "rdma_reduce.h"
+
+#define REDUCE_FUSED_MIN_BYTES (1 << 20) // below it reduce_copy_buffers() reduces, then copies in a second pass
+#define REDUCE_STREAM_ALIGN 64           // the vector kernels stream the copy once it is aligned to their vectors
+
+namespace rdma_core
+{
+    // dst[i] = op(dst[i], src[i]) (and copy[i] too, unless copy is nullptr) for any type and op
+    void reduce_scalar(void *dst, void *copy, const void *src, size_t count, ReduceDataType type, ReduceOp op);
+
+    // reduce the leading whole vectors, *done returns how many elements;
+    // false if the type and op have no vector kernel, nothing is touched then
+    bool reduce_avx2(void *dst, void *copy, const void *src, size_t count, ReduceDataType type, ReduceOp op,
+                     size_t *done);
+    bool reduce_avx512(void *dst, void *copy, const void *src, size_t count, ReduceDataType type, ReduceOp op,
+                       size_t *done);
+}; // end namespace rdma_core
+#endif
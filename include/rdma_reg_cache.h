@@ -0,0 +1,129 @@
+/******************************************************************
+ * RDMARegistrationCache is a per-PD pin-down cache, which lets
+ * user-supplied memory be sent/written without copying it into
+ * an RDMABuffer, i.e.,
+ *      -- registered regions are kept in an interval map, a hit
+ *         costs a lookup instead of an ibv_reg_mr
+ *      -- a miss registers the union with the overlapping regions
+ *         of the same access, so growing buffers extend the existing
+ *         registration, but no byte ever gains access by a merge
+ *      -- memory is registered with the access it is acquired for,
+ *         local read only for send/write sources, so read-only memory
+ *         is accepted and nothing of it is reachable by the peer
+ *      -- unpinned regions are evicted in LRU order once the
+ *         pinned bytes exceed the budget
+ * A region is pinned by acquire() until the matching release().
+ * Freeing/unmapping cached memory must be reported by invalidate(),
+ * otherwise a new mapping at the same address would be served by
+ * the stale registration.
+ * ****************************************************************/
+
+#ifndef __RDMA_COMM_CORE_RDMA_REG_CACHE_H__
+#define __RDMA_COMM_CORE_RDMA_REG_CACHE_H__
+
+#include "rdma_adapter.h"
+#include "rdma_device.h"
+#include "util/logging.h"
+#include <infiniband/verbs.h>
+
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+#define REG_CACHE_DEFAULT_BUDGET (1UL << 30) // pin at most 1 GB of user memory per pd by default
+#define REMOTE_ACCESS_FLAGS (IBV_ACCESS_REMOTE_READ | IBV_ACCESS_REMOTE_WRITE | IBV_ACCESS_REMOTE_ATOMIC)
+
+namespace rdma_core
+{
+    class RDMAAdapter;
+    class RDMADevice;
+
+    class RDMARegistrationCache
+    {
+    protected:
+        explicit RDMARegistrationCache(         // construction function of the registration cache
+            std::shared_ptr<RDMADevice> device, // the device the pd belongs to
+            struct ibv_pd *pd,                  // all regions are registered in this pd
+            std::string cache_info);            // the info of this cache
+
+    public:
+        virtual ~RDMARegistrationCache();
+
+        // the cache of the pd the adapter is using, created at the first query
+        static RDMARegistrationCache *get_registration_cache(RDMAAdapter *adapter);
+
+    public:
+        // the mr covering [addr, addr + size_in_byte), pinned until release(addr); with remote access only
+        // these bytes are registered, otherwise the pages holding them
+        struct ibv_mr *acquire(const void *addr,      // the user memory
+                               size_t size_in_byte,   // bytes to access
+                               int access_flags = 0); // IBV_ACCESS_xxx, 0 to post it as a local source
+
+        // drop one pin taken by acquire(addr, ..., access_flags)
+        void release(const void *addr,        // the user memory
+                     int access_flags = 0); // as it is acquired
+
+        // the user memory is freed/unmapped, drop the regions overlapping it
+        void invalidate(const void *addr,     // the user memory
+                        size_t size_in_byte); // bytes freed
+
+        // how many bytes can stay registered, unpinned regions beyond it are evicted
+        void set_pinned_budget(size_t budget_in_byte);
+
+        inline size_t get_pinned_bytes()
+        {
+            return pinned_bytes_;
+        }
+        inline uint64_t get_hits()
+        {
+            return hits_;
+        }
+        inline uint64_t get_misses()
+        {
+            return misses_;
+        }
+        inline std::string info()
+        {
+            return "RDMARegistrationCache(" + cache_info_ + ")";
+        }
+
+    private:
+        struct CachedRegion
+        {
+            uintptr_t start = 0;                              // start of the region, page-aligned for local access
+            uintptr_t end = 0;                                // end of the region, page-aligned for local access
+            int access_flags = 0;                             // what the mr allows, the key of its regions_
+            struct ibv_mr *mr_ = nullptr;                     // the registration of the region
+            uint32_t pin_count = 0;                           // acquired but not released yet
+            bool retired = false;                             // out of the map, deregistered at the last release
+            std::list<CachedRegion *>::iterator lru_position; // where it is in lru_
+        };
+
+        void retire(CachedRegion *region);  // take the region out of the map, locked by caller
+        void destroy(CachedRegion *region); // deregister and delete the region, locked by caller
+        void evict();                       // evict unpinned regions until under the budget, locked by caller
+
+    private:
+        std::string cache_info_ = "";                                          // the info of this cache
+        std::shared_ptr<RDMADevice> device_ = nullptr;                         // the device the pd belongs to
+        struct ibv_pd *pd_ = nullptr;                                          // all regions are registered in this pd
+        std::mutex cache_lock_;                                                // protect everything below
+        std::map<int, std::map<uintptr_t, CachedRegion *>> regions_;           // access -> start -> region, non-overlapping
+        std::list<CachedRegion *> lru_;                                        // cached regions, the most recent first
+        std::unordered_multimap<const void *, CachedRegion *> pinned_regions_; // which region each acquire() pinned
+        size_t pinned_bytes_ = 0;                                              // bytes of registered regions
+        size_t pinned_budget_ = REG_CACHE_DEFAULT_BUDGET;                      // evict beyond this
+        uint64_t hits_ = 0;                                                    // acquire() served by the cache
+        uint64_t misses_ = 0;                                                  // acquire() that registered memory
+
+        // global resources
+        static std::mutex cache_global_lock_;                             // protect cache_map_
+        static std::unordered_map<struct ibv_pd *,                        // key
+                                  std::unique_ptr<RDMARegistrationCache>> // value
+            cache_map_;                                                   // pd -> cache
+    };
+}; // end namespace rdma_core
+#endif
@@ -0,0 +1,185 @@
+/******************************************************************
+ * RingChannel sends variable-length messages by writing them straight
+ * into a ring buffer of the peer with RDMA write-with-imm, i.e.,
+ *      -- each message is one frame (a header and the payload) at a
+ *         cache-line aligned offset of the ring, a frame never wraps,
+ *         the tail of the ring is skipped instead
+ *      -- the imm_data carries the offset and the size of the frame,
+ *         a message costs one receive without buffer on the peer
+ *      -- the receiver advances a head over the released frames, the
+ *         sender learns it piggybacked in the frames of the peer, or
+ *         reads it back lazily once the ring (or the receives) is full
+ * It is driven by one thread, which feeds the cqes of the channel to
+ * on_send_done()/on_recv_done(). Both peers build it at the same
+ * point, the rings are swapped then. It claims the receives of the
+ * channel, see claim_recv_queue().
+ * ****************************************************************/
+
+#ifndef __RDMA_COMM_CORE_RDMA_RING_H__
+#define __RDMA_COMM_CORE_RDMA_RING_H__
+
+#include "rdma_buffer.h"
+#include "rdma_channel.h"
+#include "util/logging.h"
+
+#include <deque>
+#include <memory>
+#include <string>
+
+#define RING_FRAME_ALIGN 64        // frames start at cache-line aligned offsets of the ring
+#define RING_UNIT_BITS 16          // the imm_data carries (offset, size) of the frame, in RING_FRAME_ALIGN units
+#define RING_UNIT_MASK ((1u << RING_UNIT_BITS) - 1)
+#define RING_MAX_SIZE (RING_FRAME_ALIGN << RING_UNIT_BITS)
+#define RING_NOTIFY_WINDOW 128     // default receives kept posted for the notifications
+#define RING_MAX_QUEUED 1024       // default sends queued when the ring of the peer is full
+
+namespace rdma_core
+{
+    class RDMAChannel;
+
+    // a message in the ring, valid until it is released
+    struct RingMessage
+    {
+        char *data = nullptr; // the payload in the ring
+        uint32_t length = 0;  // bytes of the payload
+        uint32_t msg_tag = 0; // tagging the message type
+    };
+
+    class RingChannel
+    {
+    protected:
+        explicit RingChannel(         // construction function of the ring channel
+            RDMAChannel *channel,     // the connected channel to send on
+            uint32_t ring_size,       // bytes of the ring the peer writes into
+            uint32_t notify_window,   // receives kept posted for the notifications
+            uint32_t max_queued,      // sends queued when the ring of the peer is full
+            std::string ring_info);   // the info of this ring channel
+
+    public:
+        virtual ~RingChannel();
+        inline static RingChannel *build_ring_channel(RDMAChannel *channel,
+                                                      uint32_t ring_size,
+                                                      uint32_t notify_window = RING_NOTIFY_WINDOW,
+                                                      uint32_t max_queued = RING_MAX_QUEUED,
+                                                      std::string ring_info = "RingChannel")
+        {
+            return new RingChannel(channel, ring_size, notify_window, max_queued, ring_info);
+        }
+
+    public:
+        // write now if the ring of the peer has room, otherwise queue it, return false if the queue is full;
+        // the buffer is gathered behind the frame header (max_send_sge >= 2) and kept until it is retired
+        bool send_remote(RDMABuffer *buffer,            // placeholder of the data to send
+                         uint32_t data_length_in_bytes, // data length to send
+                         uint32_t msg_tag = 0);         // tagging the message type
+
+        // account a polled send-side cqe, return how many sends of the user are retired (in posting order)
+        uint32_t on_send_done(struct ibv_wc *wc);
+
+        // account a polled write-with-imm cqe, the message points into the ring until it is released
+        void on_recv_done(struct ibv_wc *wc, struct RingMessage *message);
+
+        // give the oldest received message back, its frame is free for the peer again
+        void release();
+
+        // post the queued sends the ring of the peer has room for, and read its head back if none has
+        uint32_t progress();
+
+        // whether nothing is queued or in flight on the send side
+        inline bool idle()
+        {
+            return pending_sends_.empty() && posted_sqes_.empty();
+        }
+        inline uint64_t get_free_bytes() // bytes of the ring of the peer known to be free
+        {
+            return peer_ring_size_ - (tail_ - peer_head_);
+        }
+        inline uint32_t get_num_queued()
+        {
+            return pending_sends_.size();
+        }
+        inline uint64_t get_num_stalls() // sends queued because the ring of the peer was full
+        {
+            return num_stalls_;
+        }
+        inline uint64_t get_num_head_reads() // heads read back from the peer
+        {
+            return num_head_reads_;
+        }
+        inline std::string info()
+        {
+            return "RingChannel(" + ring_info_ + ")";
+        }
+
+    private:
+        enum class SqeKind : uint8_t
+        {
+            WRITE = 0,    // a frame of the user
+            HEAD_READ = 1 // the head of the peer read back
+        };
+
+        struct PendingSend
+        {
+            RDMABuffer *buffer = nullptr;      // the data to send
+            uint32_t data_length_in_bytes = 0; // data length to send
+            uint32_t msg_tag = 0;              // tagging the message type
+        };
+
+        struct FrameHeader
+        {
+            uint32_t length = 0;       // bytes of the payload
+            uint32_t msg_tag = 0;      // tagging the message type
+            uint64_t ack_bytes = 0;    // bytes of our ring released, piggybacked
+            uint64_t ack_notifies = 0; // notification receives we ever posted, piggybacked
+        } __attribute__((packed));
+
+        struct RingHandshake
+        {
+            struct CommDescriptor ring;   // where the peer writes its frames
+            struct CommDescriptor status; // where the peer reads our head back
+            uint32_t notify_window = 0;   // receives the peer keeps posted
+        } __attribute__((packed));
+
+        enum StatusWord : uint32_t
+        {
+            LOCAL_HEAD = 0,     // bytes of our ring released, read by the peer
+            LOCAL_NOTIFIES = 1, // notification receives we ever posted, read by the peer
+            PEER_HEAD = 2,      // where the head of the peer is read back
+            PEER_NOTIFIES = 3,  // where the receives of the peer are read back
+            NUM_STATUS_WORDS = 4
+        };
+
+        inline uint64_t frame_size(uint32_t data_length_in_bytes) // a frame covers whole RING_FRAME_ALIGN units
+        {
+            return (sizeof(FrameHeader) + data_length_in_bytes + RING_FRAME_ALIGN - 1) / RING_FRAME_ALIGN * RING_FRAME_ALIGN;
+        }
+        bool try_write(PendingSend &pending);                    // write the frame if the peer has room
+        void read_head();                                        // read the head of the peer back
+        void fold_peer_status(uint64_t head, uint64_t notifies); // learn the head and the receives of the peer
+
+    private:
+        std::string ring_info_ = "";               // the info of this ring channel
+        RDMAChannel *channel_ = nullptr;           // the channel to send on
+        uint32_t max_queued_ = RING_MAX_QUEUED;    // sends queued when the ring of the peer is full
+        std::unique_ptr<RDMABuffer> ring_;         // the ring the peer writes into
+        std::unique_ptr<RDMABuffer> status_words_; // the StatusWords
+        std::unique_ptr<RDMABuffer> headers_;      // the frame headers in flight, one per sqe of the channel
+        uint32_t num_header_slots_ = 0;            // the max_send_wr of the channel
+        struct CommDescriptor peer_ring_;          // the ring of the peer
+        struct CommDescriptor peer_status_;        // the status words of the peer
+        uint64_t peer_ring_size_ = 0;              // bytes of the ring of the peer
+        std::deque<PendingSend> pending_sends_;    // sends waiting for room in the ring of the peer
+        std::deque<SqeKind> posted_sqes_;          // the kind of each sqe in posting order
+        bool head_read_inflight_ = false;          // one head read at a time
+        uint64_t tail_ = 0;                        // bytes of the ring of the peer ever written, with the skipped tails
+        uint64_t peer_head_ = 0;                   // bytes of the ring of the peer released, as we know
+        uint64_t frames_written_ = 0;              // frames ever written, each consumes a receive of the peer
+        uint64_t peer_notifies_ = 0;               // receives the peer ever posted, as we know
+        uint64_t recv_tail_ = 0;                   // bytes of our ring ever received, with the skipped tails
+        uint64_t notifies_posted_ = 0;             // receives ever posted for the notifications
+        std::deque<uint64_t> received_frames_;     // the end of each received frame not released yet
+        uint64_t num_stalls_ = 0;                  // sends queued because the ring of the peer was full
+        uint64_t num_head_reads_ = 0;              // heads read back from the peer
+    };
+}; // end namespace rdma_core
+#endif
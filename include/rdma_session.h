@@ -4,14 +4,22 @@
  * of different roles.
  *      -- ClientSession for 'Client side'
  *      -- ServerSession for "Server side"
+ * snapshot_stats() scrapes the counters of all its channels, while
+ * they keep running, see rdma_stats.h for the text/json output.
+ * process_CQ() dispatches the cqes to default_process_xxx_done()
+ * by the compile-time CompletionHandler, and through the std::function
+ * callbacks only once register_event_callback() has replaced them.
  * ***************************************************************/
 
 #ifndef __RDMA_COMM_CORE_RDMA_SESSION_H__
 #define __RDMA_COMM_CORE_RDMA_SESSION_H__
 #include "config.h"
 #include "rdma_channel.h"
+#include "rdma_completion.h"
 #include "rdma_endpoint.h"
+#include "rdma_stats.h"
 #include <functional>
+#include <mutex>
 #include <vector>
 #include "rdma_config.h"
 
@@ -49,6 +57,8 @@ namespace rdma_core
 
         void connecting(); // real connecting for each endpoint
 
+        std::vector<ChannelStatsSnapshot> snapshot_stats(); // the counters of every channel of every endpoint
+
     protected:
         virtual void process_CQ(std::vector<RDMAChannel *> aggregated_channels); // a loop to processing complement queue events
         virtual void lazy_config_hca() = 0;                                      // hook before the connecting endpoint
@@ -67,6 +77,43 @@ namespace rdma_core
         virtual void default_process_recv_write_with_imm_done(struct ibv_wc *wc, void *args);
         void real_connecting();
 
+        // the default path of process_CQ(): calls the default handlers of the session, no std::function between
+        class DefaultCompletionHandler : public CompletionHandler<DefaultCompletionHandler>
+        {
+        public:
+            explicit DefaultCompletionHandler(RDMASession *session) :
+                session_(session)
+            {
+            }
+            inline void on_send_done(struct ibv_wc *wc)
+            {
+                session_->default_process_send_done(wc, 0);
+            }
+            inline void on_recv_done(struct ibv_wc *wc)
+            {
+                session_->default_process_recv_done(wc, 0);
+            }
+            inline void on_write_done(struct ibv_wc *wc)
+            {
+                session_->default_process_write_done(wc, 0);
+            }
+            inline void on_read_done(struct ibv_wc *wc)
+            {
+                session_->default_process_read_done(wc, 0);
+            }
+            inline void on_recv_write_with_imm_done(struct ibv_wc *wc)
+            {
+                session_->default_process_recv_write_with_imm_done(wc, 0);
+            }
+
+        private:
+            RDMASession *session_;
+        };
+
+    private:
+        template <typename Handler> // poll the cqs of the channels (by the event engine with use_event), never returns
+        void dispatch_CQ(std::vector<RDMAChannel *> &aggregated_channels, CompletionHandler<Handler> &handler);
+
     protected:
         //std::string session_id_ = "BaseSession";                   // identify of the object
         Config work_env_;                                          // environment of this session
@@ -74,6 +121,7 @@ namespace rdma_core
         std::function<void()> before_processing_cb_;               // callback when connection is established
         bool is_connected_ = false;                                // the connection has been set up
         int socket_fd = 0;                                         //socket for connection
+        std::mutex endpoint_lock_;                                 // protect end_point_mgr_ while endpoints are created concurrently
 
         // event processing functions
         std::function<void(std::vector<RDMAChannel *> g_channels)> established_done_ = nullptr;         // establish is done before start rdma services
@@ -82,6 +130,7 @@ namespace rdma_core
         std::function<void(struct ibv_wc *wc, void *args)> process_recv_write_with_imm_done_ = nullptr; // process when recv_write_with_imm done
         std::function<void(struct ibv_wc *wc, void *args)> process_write_done_ = nullptr;               // process when write data done
         std::function<void(struct ibv_wc *wc, void *args)> process_read_done_ = nullptr;                // process when read data done
+        bool callbacks_registered_ = false;                                                             // any cqe callback is replaced
     };
 
 }; // end namespace rdma_core
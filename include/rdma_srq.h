@@ -0,0 +1,93 @@
+/******************************************************************
+ * RDMASharedRecvQueue is the refill engine of a shared receive
+ * queue (SRQ), which is shared by all adapters configured with
+ * the same srq_key. It owns a bounded receive pool, i.e.,
+ *      -- blocks are posted to the SRQ instead of each qp
+ *      -- consumed blocks are re-posted in batches (one doorbell)
+ *      -- the source adapter of a recv cqe is resolved by qp_num
+ * ****************************************************************/
+
+#ifndef __RDMA_COMM_CORE_RDMA_SRQ_H__
+#define __RDMA_COMM_CORE_RDMA_SRQ_H__
+
+#include "rdma_adapter.h"
+#include "rdma_buffer.h"
+#include "util/logging.h"
+#include <infiniband/verbs.h>
+
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace rdma_core
+{
+    class RDMAAdapter;
+    class RDMABuffer;
+
+    class RDMASharedRecvQueue
+    {
+    protected:
+        explicit RDMASharedRecvQueue( // construction function of the srq refill engine
+            RDMAAdapter *owner,       // an adapter attached to the srq, the pool is registered in it
+            uint32_t block_size,      // bytes of each receive block
+            uint32_t num_blocks,      // how many blocks in the receive pool
+            uint32_t refill_batch,    // re-post the consumed blocks once so many are released
+            std::string pool_info);   // the info of the receive pool
+
+    public:
+        virtual ~RDMASharedRecvQueue();
+        inline static RDMASharedRecvQueue *build_shared_recv_queue(RDMAAdapter *owner,
+                                                                   uint32_t block_size,
+                                                                   uint32_t num_blocks,
+                                                                   uint32_t refill_batch = 32,
+                                                                   std::string pool_info = "SharedRecvPool")
+        {
+            return new RDMASharedRecvQueue(owner, block_size, num_blocks, refill_batch, pool_info);
+        }
+
+    public:
+        // map the qp of the adapter to itself, so that its recv cqes can be resolved
+        bool attach(RDMAAdapter *adapter);
+
+        // which adapter the recv cqe comes from
+        inline RDMAAdapter *resolve_source(struct ibv_wc *wc)
+        {
+            auto iter = source_map_.find(wc->qp_num);
+            CHECK(iter != source_map_.end()) << "Unknown source qp (0x" << std::hex << wc->qp_num
+                                             << ") for " << info();
+            return iter->second;
+        }
+
+        // the receive block holding the data of the recv cqe
+        RDMABuffer *fetch_block(struct ibv_wc *wc);
+
+        // give the block back to the pool, it is re-posted with the next refill
+        void release(RDMABuffer *block);
+
+        // post all released blocks to the srq as one chain
+        bool refill();
+
+        inline int64_t get_posted() // how many blocks are posted in the srq
+        {
+            return posted_;
+        }
+        inline std::string info()
+        {
+            return "RDMASharedRecvQueue(" + pool_info_ + ")";
+        }
+
+    private:
+        std::string pool_info_ = "";                           // the info of the receive pool
+        struct ibv_srq *srq_ = nullptr;                        // the srq shared by the attached adapters
+        std::unique_ptr<RDMABuffer> recv_pool_;                // the bounded receive pool
+        std::unordered_map<uint32_t, RDMAAdapter *> source_map_; // qp_num -> adapter
+        std::vector<RDMABuffer *> released_blocks_;            // consumed blocks waiting for re-post
+        std::vector<struct ibv_recv_wr> wr_list_;              // pre-allocated recv work requests
+        std::vector<struct ibv_sge> sge_list_;                 // pre-allocated scatter/gather entries
+        uint32_t refill_batch_ = 32;                           // re-post once so many blocks are released
+        uint32_t low_watermark_ = 0;                           // re-post immediately below so many posted blocks
+        int64_t posted_ = 0;                                   // how many blocks are posted in the srq
+    };
+}; // end namespace rdma_core
+#endif
@@ -0,0 +1,135 @@
+/******************************************************************
+ * StagingLink is the credited chunk link the allreduce engines are
+ * built on, between this rank and a peer rank:
+ *      -- outbound, a chunk is written with notify into the next
+ *         staging slot of the peer, the imm_data names the chunk
+ *      -- inbound, the peer writes into our staging slots, each
+ *         arrival consumes a receive without buffer, given back at
+ *         once
+ *      -- the peer writes how many chunks it has consumed into a
+ *         credit word of ours, a slot is never overwritten early
+ * The outbound and the inbound half may run on different channels,
+ * e.g., the two neighbors of a ring, or on the same one. The engine
+ * swaps the descriptor() of both ends in its handshake and feeds the
+ * cqes of the channels to on_cqe().
+ * ****************************************************************/
+
+#ifndef __RDMA_COMM_CORE_RDMA_STAGING_LINK_H__
+#define __RDMA_COMM_CORE_RDMA_STAGING_LINK_H__
+
+#include "rdma_buffer.h"
+#include "rdma_channel.h"
+#include "util/logging.h"
+
+#include <deque>
+#include <memory>
+#include <string>
+
+namespace rdma_core
+{
+    class RDMAChannel;
+
+    class StagingLink
+    {
+    public:
+        // where the peer writes its chunks and its credits, swapped in the handshake of the engine
+        struct Descriptor
+        {
+            struct CommDescriptor staging; // where the peer writes its chunks
+            struct CommDescriptor credit;  // where the peer writes the chunks it consumed
+        } __attribute__((packed));
+
+        explicit StagingLink(          // construction function of the staging link
+            RDMAChannel *out_channel,  // the connected channel the chunks are written on
+            RDMAChannel *in_channel,   // the connected channel the chunks arrive on, may be out_channel
+            uint32_t chunk_size,       // bytes of a staging slot
+            uint32_t pipeline_depth,   // how many staging slots
+            std::string link_info);    // the info of this link
+        virtual ~StagingLink();
+
+        // the slots and the credit word of this end, to swap with the peers
+        struct Descriptor descriptor();
+        // learn the slots of the peer of the outbound half and the credit word of the peer of the inbound half
+        void connect(const struct Descriptor &out_peer, const struct Descriptor &in_peer);
+
+        // write the slice into the next slot of the peer, false if the peer holds no free slot or the sq is full
+        bool write_chunk(const BufferSlice *slice, uint32_t chunk_id);
+        // tell the peer what we consumed, if it changed and no credit write is in flight
+        void write_credit();
+        // handle a cqe of one of its channels
+        void on_cqe(struct ibv_wc *wc);
+
+        inline bool has_arrival() // whether a chunk arrived and was not consumed
+        {
+            return !arrivals_.empty();
+        }
+        inline uint32_t next_arrival() // the id of the next arrived chunk
+        {
+            return arrivals_.front();
+        }
+        inline uint8_t *next_slot() // the staging slot holding the next arrived chunk
+        {
+            return (uint8_t *)staging_->data_ptr + (consumed_ % depth_) * chunk_size_;
+        }
+        inline void release_slot() // the next arrived chunk is consumed, its slot is free again
+        {
+            arrivals_.pop_front();
+            consumed_++;
+        }
+        inline bool idle() // whether no sqe of this link is in flight
+        {
+            return out_sqes_.empty() && in_sqes_.empty();
+        }
+
+        inline uint64_t get_num_sent() // chunks ever written to the peer
+        {
+            return sent_;
+        }
+        inline uint64_t get_num_consumed() // chunks of the peer ever consumed
+        {
+            return consumed_;
+        }
+        inline uint64_t get_num_stalls() // times the next chunk waited for a credit of the peer
+        {
+            return num_stalls_;
+        }
+        inline std::string info()
+        {
+            return "StagingLink(" + link_info_ + ")";
+        }
+
+    private:
+        enum class SqeKind : uint8_t
+        {
+            CHUNK_WRITE = 0, // a chunk to the peer
+            CREDIT_WRITE = 1 // the consumed chunks to the peer
+        };
+
+        inline std::deque<SqeKind> &posted_sqes(RDMAChannel *channel) // the sqes posted on the channel
+        {
+            return channel == out_channel_ ? out_sqes_ : in_sqes_;
+        }
+
+    private:
+        std::string link_info_ = "";               // the info of this link
+        RDMAChannel *out_channel_ = nullptr;       // the channel the chunks are written on
+        RDMAChannel *in_channel_ = nullptr;        // the channel the chunks arrive on
+        uint32_t chunk_size_ = 0;                  // bytes of a staging slot
+        uint32_t depth_ = 0;                       // staging slots of each end
+        std::unique_ptr<RDMABuffer> staging_;      // the slots the peer writes into
+        std::unique_ptr<RDMABuffer> peer_credit_;  // the chunks the peer consumed, written by it
+        std::unique_ptr<RDMABuffer> local_credit_; // the chunks we consumed, the source of the credit write
+        struct CommDescriptor peer_staging_;       // the slots of the peer
+        struct CommDescriptor remote_credit_;      // the credit word of the peer
+        std::deque<uint32_t> arrivals_;            // chunk ids arrived and not consumed
+        std::deque<SqeKind> out_sqes_;             // the kind of each sqe on the out channel, in posting order
+        std::deque<SqeKind> in_sqes_;              // the kind of each sqe on the in channel, if it is another one
+        uint64_t sent_ = 0;                        // chunks ever written to the peer
+        uint64_t consumed_ = 0;                    // chunks of the peer ever consumed
+        uint64_t credit_written_ = 0;              // chunks consumed as the peer was told
+        bool credit_inflight_ = false;             // one credit write at a time
+        bool stalled_ = false;                     // the next chunk is waiting for a credit
+        uint64_t num_stalls_ = 0;                  // times the next chunk waited for a credit
+    };
+}; // end namespace rdma_core
+#endif
@@ -0,0 +1,105 @@
+/******************************************************************
+ * ChannelStats counts what flows through one RDMAAdapter, updated
+ * in its post and poll paths, and scraped by snapshot() at any time.
+ *      -- posted work requests and bytes per opcode, max sq depth
+ *      -- completions and received bytes per opcode, error cqes
+ *      -- polls of the cq, and how many of them came back empty
+ * The post and the poll counters live on their own cache lines,
+ * each written by one thread only (the one posting to, resp. polling
+ * the channel), so an update is a relaxed load and store: no lock,
+ * no atomic read-modify-write, and a reader never stops the writer.
+ * ****************************************************************/
+
+#ifndef __RDMA_COMM_CORE_RDMA_STATS_H__
+#define __RDMA_COMM_CORE_RDMA_STATS_H__
+
+#include <infiniband/verbs.h>
+
+#include <atomic>
+#include <string>
+#include <vector>
+
+namespace rdma_core
+{
+    enum class StatsOpcode : uint32_t
+    {
+        SEND = 0,          // send with imm
+        WRITE = 1,         // rdma write, with imm or not
+        READ = 2,          // rdma read
+        RECV = 3,          // a posted receive, or the receive of a send
+        RECV_WITH_IMM = 4, // the receive consumed by a write with imm, completion only
+        NUM_OPCODES = 5
+    };
+#define NUM_STATS_OPCODES (static_cast<uint32_t>(StatsOpcode::NUM_OPCODES))
+
+    std::string stats_opcode_to_str(StatsOpcode opcode);
+
+    // the counters of a channel at one moment, plain values to format or diff
+    struct ChannelStatsSnapshot
+    {
+        std::string channel;                       // id of the channel
+        std::string peer;                          // address of the peer of its endpoint
+        uint64_t posted[NUM_STATS_OPCODES] = {};    // work requests posted per opcode
+        uint64_t posted_bytes[NUM_STATS_OPCODES] = {};
+        uint64_t completed[NUM_STATS_OPCODES] = {}; // cqes polled per opcode, unsignaled sqes have none
+        uint64_t received_bytes = 0;               // byte_len of the receive cqes
+        uint64_t max_sq_depth = 0;                 // most sqes in flight at once
+        uint64_t polls = 0;                        // calls of poll_cq_batch()
+        uint64_t empty_polls = 0;                  // of which returned no cqe
+        uint64_t error_wcs = 0;                    // cqes with a status other than success
+
+        inline double poll_empty_ratio() const
+        {
+            return polls == 0 ? 0 : (double)empty_polls / polls;
+        }
+    };
+
+    class ChannelStats
+    {
+    public:
+        // a work request of bytes is posted, leaving sq_depth sqes in flight (0 for a receive)
+        inline void count_post(StatsOpcode opcode, uint64_t bytes, int64_t sq_depth = 0)
+        {
+            uint32_t index = static_cast<uint32_t>(opcode);
+            add(post_.posted[index], 1);
+            add(post_.posted_bytes[index], bytes);
+            if (sq_depth > 0 && (uint64_t)sq_depth > post_.max_sq_depth.load(std::memory_order_relaxed))
+                post_.max_sq_depth.store(sq_depth, std::memory_order_relaxed);
+        }
+        // a poll of the cq returned the num_wqe cqes in wc
+        void count_poll(const struct ibv_wc *wc, int num_wqe);
+
+        // consistent per counter, not across them, as the data path keeps running
+        ChannelStatsSnapshot snapshot() const;
+
+    private:
+        static inline void add(std::atomic<uint64_t> &counter, uint64_t value) // single writer, so no rmw
+        {
+            counter.store(counter.load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+        }
+
+        struct alignas(64) PostCounters // written by the posting thread
+        {
+            std::atomic<uint64_t> posted[NUM_STATS_OPCODES] = {};
+            std::atomic<uint64_t> posted_bytes[NUM_STATS_OPCODES] = {};
+            std::atomic<uint64_t> max_sq_depth{0};
+        };
+        struct alignas(64) PollCounters // written by the polling thread
+        {
+            std::atomic<uint64_t> completed[NUM_STATS_OPCODES] = {};
+            std::atomic<uint64_t> received_bytes{0};
+            std::atomic<uint64_t> polls{0};
+            std::atomic<uint64_t> empty_polls{0};
+            std::atomic<uint64_t> error_wcs{0};
+        };
+
+        PostCounters post_;
+        PollCounters poll_;
+    };
+
+    // one line per channel with traffic, for the logs
+    std::string stats_to_text(const std::vector<ChannelStatsSnapshot> &snapshots);
+    // an array of one object per channel, for the scrapers
+    std::string stats_to_json(const std::vector<ChannelStatsSnapshot> &snapshots);
+}; // end namespace rdma_core
+#endif
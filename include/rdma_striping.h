@@ -0,0 +1,102 @@
+/******************************************************************
+ * StripedChannel splits large writes over the data channels of an
+ * RDMAEndPoint, so one transfer is not capped by one qp, i.e.,
+ *      -- a write is cut into stripes of at least min_stripe_size
+ *         bytes, posted round-robin on the data channels
+ *      -- a transfer completes when all of its stripes complete,
+ *         the peer is notified (write_with_imm) only after that
+ *      -- small messages should go through the ctrl channel of the
+ *         endpoint, which never queues behind the stripes
+ * It is driven by one thread, which posts the writes and feeds the
+ * write cqes of the data channels to on_write_done().
+ * ****************************************************************/
+
+#ifndef __RDMA_COMM_CORE_RDMA_STRIPING_H__
+#define __RDMA_COMM_CORE_RDMA_STRIPING_H__
+
+#include "rdma_buffer.h"
+#include "rdma_channel.h"
+#include "rdma_endpoint.h"
+#include "util/logging.h"
+
+#include <deque>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#define STRIPE_MIN_SIZE (64 * 1024) // transfers below this are not split
+#define STRIPE_ALIGN 64             // stripe boundaries are aligned to the cache line
+
+namespace rdma_core
+{
+    class RDMAChannel;
+    class RDMAEndPoint;
+
+    class StripedChannel
+    {
+    protected:
+        explicit StripedChannel(        // construction function of the striped channel
+            RDMAEndPoint *endpoint,     // the endpoint holding the data channels
+            uint32_t min_stripe_size,   // stripes are at least so many bytes
+            std::string striping_info); // the info of this striped channel
+
+    public:
+        virtual ~StripedChannel();
+        inline static StripedChannel *build_striped_channel(RDMAEndPoint *endpoint,
+                                                            uint32_t min_stripe_size = STRIPE_MIN_SIZE,
+                                                            std::string striping_info = "StripedChannel")
+        {
+            return new StripedChannel(endpoint, min_stripe_size, striping_info);
+        }
+
+    public:
+        // split the write over the data channels, return the id of the transfer
+        uint64_t write_remote(RDMABuffer *buffer,                              // the buffer for data to write
+                              size_t data_length_in_bytes,                     // data length to write
+                              struct CommDescriptor *remote_buffer_descriptor, // remote buffer_describptor
+                              uint32_t msg_tag,                                // tagging the message type to notify peer
+                              bool notify_peer = false);                       // notify peer once all stripes land
+
+        // account a polled write cqe of a data channel, return how many transfers it completes
+        uint32_t on_write_done(RDMAChannel *channel);
+
+        // whether all stripes of the transfer are completed
+        bool is_done(uint64_t transfer_id);
+
+        // poll the data channels until the transfer completes, only if the caller owns their cqs
+        void wait(uint64_t transfer_id);
+
+        inline uint32_t get_num_channels()
+        {
+            return data_channels_.size();
+        }
+        inline std::string info()
+        {
+            return "StripedChannel(" + striping_info_ + ")";
+        }
+
+    private:
+        struct StripedTransfer
+        {
+            RDMABuffer *buffer = nullptr;                   // the buffer the stripes are written from
+            uint32_t pending_stripes = 0;                   // stripes not completed yet
+            bool notify_peer = false;                       // write_with_imm once the stripes complete
+            uint32_t msg_tag = 0;                           // the imm data of the notification
+            struct CommDescriptor remote_buffer_descriptor; // where the notification is written
+        };
+
+        int32_t channel_index(RDMAChannel *channel); // the index of the data channel, -1 if not found
+        void finish(uint64_t transfer_id);           // the last stripe is completed
+
+    private:
+        std::string striping_info_ = "";                                  // the info of this striped channel
+        RDMAEndPoint *endpoint_ = nullptr;                                // the endpoint holding the data channels
+        uint32_t min_stripe_size_ = STRIPE_MIN_SIZE;                      // stripes are at least so many bytes
+        std::vector<RDMAChannel *> data_channels_;                        // the channels the stripes are posted on
+        std::vector<std::deque<uint64_t>> posted_stripes_;                // per channel, the transfer of each sqe in order
+        std::unordered_map<uint64_t, StripedTransfer> pending_transfers_; // transfers with stripes in flight
+        uint64_t next_transfer_id_ = 1;                                   // 0 tags the sqes of the notifications
+        uint32_t next_channel_ = 0;                                       // where the next transfer starts striping
+    };
+}; // end namespace rdma_core
+#endif
@@ -0,0 +1,228 @@
+/******************************************************************
+ * TreeAllReduce reduces a vector over the ranks along trees, so the
+ * latency grows with the height of a tree instead of the ring size:
+ *      -- k-ary tree: rank r hangs below rank (r-1)/k, the whole
+ *         vector is reduced up to rank 0 and broadcast down again
+ *      -- double binary tree: two complementary binary trees, each
+ *         reduces half of the vector, a rank is a leaf in at least
+ *         one of them, so the links are loaded evenly
+ *      -- the chunks are pipelined, a rank forwards a chunk up once
+ *         all its children delivered it, and down once it arrived
+ *      -- each link to a tree neighbor is a StagingLink, the chunks
+ *         are written into its slots, bounded by its credits
+ * select_allreduce_algorithm() weighs the hops of the tree against
+ * the bandwidth of the ring for the size and the number of ranks.
+ * It is driven by the thread calling allreduce(), which polls the cqs
+ * of the links. The links share one pd, so the vector is registered
+ * once. All ranks build it at the same point, after RingAllReduce if
+ * both are used.
+ * ****************************************************************/
+
+#ifndef __RDMA_COMM_CORE_RDMA_TREE_ALLREDUCE_H__
+#define __RDMA_COMM_CORE_RDMA_TREE_ALLREDUCE_H__
+
+#include "rdma_allreduce.h"
+#include "rdma_buffer.h"
+#include "rdma_channel.h"
+#include "rdma_reduce.h"
+#include "rdma_staging_link.h"
+#include "util/logging.h"
+
+#include <deque>
+#include <map>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#define TREE_MAX_TREES 2             // the double binary tree
+#define ALLREDUCE_HOP_LATENCY_US 3.0 // default latency of a chunk over one link, for the selection
+#define ALLREDUCE_LINK_GBPS 100.0    // default bandwidth of a link, for the selection
+
+namespace rdma_core
+{
+    class RDMAChannel;
+
+    enum class TreeShape : uint32_t
+    {
+        KARY = 0,         // one tree, tree_width children per rank
+        DOUBLE_BINARY = 1 // two complementary binary trees
+    };
+
+    enum class AllReduceAlgorithm : uint32_t
+    {
+        RING = 0,
+        TREE = 1
+    };
+
+    // the position of a rank in a tree
+    struct TreeNode
+    {
+        int32_t parent = -1;            // -1 for the root
+        std::vector<uint32_t> children; // ranks below this one
+    };
+
+    // the trees of the shape seen from the rank, one for KARY, two for DOUBLE_BINARY
+    std::vector<TreeNode> build_tree_nodes(uint32_t rank,       // the position of this rank
+                                           uint32_t num_ranks,  // how many ranks the trees hold
+                                           TreeShape shape,     // which trees
+                                           uint32_t tree_width); // children per rank of the k-ary tree
+
+    // compare 2(n-1) hops plus 2(n-1)/n of the bytes per link for the ring with two tree heights of hops plus
+    // the bytes a parent sends to its children for the tree
+    AllReduceAlgorithm select_allreduce_algorithm(size_t bytes,         // bytes of the vector
+                                                  uint32_t num_ranks,   // how many ranks reduce it
+                                                  TreeShape shape,      // the trees in use
+                                                  uint32_t tree_width,  // children per rank of the k-ary tree
+                                                  double hop_latency_us = ALLREDUCE_HOP_LATENCY_US,
+                                                  double link_gbps = ALLREDUCE_LINK_GBPS);
+    std::string allreduce_algorithm_to_str(AllReduceAlgorithm algorithm);
+
+    class TreeAllReduce
+    {
+    protected:
+        explicit TreeAllReduce(                      // construction function of the tree allreduce
+            std::map<uint32_t, RDMAChannel *> links, // the connected channel to each peer rank, at least the tree neighbors
+            uint32_t rank,                           // the position of this rank
+            uint32_t num_ranks,                      // how many ranks the trees hold
+            TreeShape shape,                         // which trees
+            uint32_t tree_width,                     // children per rank of the k-ary tree
+            size_t max_bytes,                        // bytes of the largest vector to reduce
+            uint32_t chunk_size,                     // bytes of a chunk
+            uint32_t pipeline_depth,                 // chunks in flight on each link
+            std::string allreduce_info);             // the info of this allreduce
+
+    public:
+        virtual ~TreeAllReduce();
+        inline static TreeAllReduce *build_tree_allreduce(std::map<uint32_t, RDMAChannel *> links,
+                                                          uint32_t rank,
+                                                          uint32_t num_ranks,
+                                                          TreeShape shape,
+                                                          uint32_t tree_width,
+                                                          size_t max_bytes,
+                                                          uint32_t chunk_size = ALLREDUCE_CHUNK_SIZE,
+                                                          uint32_t pipeline_depth = ALLREDUCE_PIPELINE_DEPTH,
+                                                          std::string allreduce_info = "TreeAllReduce")
+        {
+            return new TreeAllReduce(links, rank, num_ranks, shape, tree_width, max_bytes, chunk_size,
+                                     pipeline_depth, allreduce_info);
+        }
+
+    public:
+        // the vector to reduce, registered on the links, it holds max_bytes
+        inline void *get_buffer()
+        {
+            return work_->data_ptr;
+        }
+
+        // reduce the first count elements of the buffer over all ranks in place, blocking until this rank is done;
+        // every rank calls it with the same count, type and op
+        void allreduce(size_t count,        // how many elements
+                       ReduceDataType type, // the type of the elements
+                       ReduceOp op);        // the reduction
+
+        inline uint32_t get_rank()
+        {
+            return rank_;
+        }
+        inline uint32_t get_num_ranks()
+        {
+            return num_ranks_;
+        }
+        inline uint32_t get_num_trees()
+        {
+            return trees_.size();
+        }
+        inline uint32_t get_height() // the hops from the farthest rank to the root, the highest tree counts
+        {
+            return height_;
+        }
+        uint64_t get_num_chunks(); // chunks ever written to the neighbors
+        uint64_t get_num_stalls(); // times a chunk waited for a credit of a neighbor
+        inline std::string info()
+        {
+            return "TreeAllReduce(" + allreduce_info_ + ")";
+        }
+
+    private:
+        enum class LinkRole : uint8_t
+        {
+            NONE = 0,   // not adjacent in the tree
+            PARENT = 1, // the neighbor is the parent, its chunks are copied
+            CHILD = 2   // the neighbor is a child, its chunks are reduced
+        };
+
+        struct TreeHandshake
+        {
+            struct StagingLink::Descriptor link; // the slots and the credit word of the sender
+            uint32_t rank = 0;                   // the position of the sender
+            uint32_t num_ranks = 0;              // how many ranks the trees hold
+            uint32_t shape = 0;                  // which trees
+            uint32_t tree_width = 0;             // children per rank of the k-ary tree
+            uint32_t chunk_size = 0;             // bytes of a staging slot
+            uint32_t pipeline_depth = 0;         // how many staging slots
+        } __attribute__((packed));
+
+        // a chunk is named by its tree and its index in the tree, imm_data carries it
+        static inline uint32_t chunk_id(uint32_t tree, uint32_t chunk)
+        {
+            return tree << 31 | chunk;
+        }
+
+        // a channel to a tree neighbor, with its own staging slots and credits
+        struct TreeLink
+        {
+            uint32_t peer_rank = 0;                // the neighbor
+            RDMAChannel *channel = nullptr;        // the channel to the neighbor
+            LinkRole roles[TREE_MAX_TREES];        // what the neighbor is in each tree
+            std::unique_ptr<StagingLink> staging;  // the chunks both ways
+            std::deque<uint32_t> pending_sends;    // chunk ids waiting for a credit or room in the sq
+            uint64_t base = 0;                     // chunks consumed before the current allreduce
+            uint64_t expected = 0;                 // chunks of the neighbor in the current allreduce
+        };
+
+        // a tree seen from this rank, with the plan of the current allreduce
+        struct Tree
+        {
+            struct TreeNode node;                 // the parent and the children of this rank
+            TreeLink *parent_link = nullptr;      // nullptr for the root
+            std::vector<TreeLink *> child_links;  // one per child
+            size_t begin = 0;                     // the first element reduced along this tree
+            size_t length = 0;                    // elements reduced along this tree
+            uint32_t num_chunks = 0;              // the elements are cut into so many chunks
+            std::vector<uint32_t> missing;        // contributions of the children each chunk still waits for
+        };
+
+        void chunk_range(Tree &tree,      // the tree of the chunk
+                         uint32_t chunk,  // which chunk of the tree
+                         size_t *begin,   // the first element of the chunk
+                         size_t *length); // how many elements of the chunk
+        void on_reduced(uint32_t tree, uint32_t chunk);     // the subtree of this rank has reduced the chunk
+        void on_final(uint32_t tree, uint32_t chunk);       // the chunk holds the reduction of all ranks
+        void flush_sends(TreeLink *link);                   // write the queued chunks the credits allow
+        bool consume_next(TreeLink *link);                  // reduce (or copy) the next arrived chunk of this call
+        void poll_channel(RDMAChannel *channel);            // handle the cqes of a channel
+        bool done();                                        // whether this rank finished the current allreduce
+
+    private:
+        std::string allreduce_info_ = "";                         // the info of this allreduce
+        uint32_t rank_ = 0;                                       // the position of this rank
+        uint32_t num_ranks_ = 0;                                  // how many ranks the trees hold
+        TreeShape shape_ = TreeShape::DOUBLE_BINARY;              // which trees
+        uint32_t tree_width_ = 0;                                 // children per rank of the k-ary tree
+        size_t max_bytes_ = 0;                                    // bytes of the largest vector to reduce
+        uint32_t chunk_size_ = ALLREDUCE_CHUNK_SIZE;              // bytes of a chunk
+        uint32_t depth_ = ALLREDUCE_PIPELINE_DEPTH;               // staging slots on each link
+        uint32_t height_ = 0;                                     // hops from the farthest rank to the root
+        std::vector<Tree> trees_;                                 // the trees seen from this rank
+        std::vector<std::unique_ptr<TreeLink>> links_;            // the links to the tree neighbors, by rank
+        std::unordered_map<uint64_t, TreeLink *> link_of_channel_; // the wr_id (channel) of a cqe to its link
+        std::vector<RDMAChannel *> pollers_;                      // one channel per distinct cq of the links
+        std::unique_ptr<RDMABuffer> work_;                        // the vector, registered on every link
+        size_t element_size_ = 0;                                 // bytes of one element of the current allreduce
+        ReduceDataType type_ = ReduceDataType::FLOAT32;           // the type of the current allreduce
+        ReduceOp op_ = ReduceOp::SUM;                             // the reduction of the current allreduce
+        uint64_t final_left_ = 0;                                 // chunks of the current allreduce not final yet
+    };
+}; // end namespace rdma_core
+#endif
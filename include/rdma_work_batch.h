@@ -0,0 +1,90 @@
+/******************************************************************
+ * WorkBatch collects a group of send/write/read work requests
+ * and hands them to RDMAAdapter::post_batch() as one linked
+ * ibv_send_wr chain, i.e., one doorbell for the whole batch.
+ *      -- the wr/sge slots are pre-allocated, no malloc per post
+ *      -- a batch targets one QP, the adapter fills in the wr_id
+ * ****************************************************************/
+
+#ifndef __RDMA_COMM_CORE_RDMA_WORK_BATCH_H__
+#define __RDMA_COMM_CORE_RDMA_WORK_BATCH_H__
+
+#include "rdma_adapter.h"
+#include "rdma_buffer.h"
+#include "util/logging.h"
+#include <infiniband/verbs.h>
+
+#include <string>
+#include <vector>
+
+namespace rdma_core
+{
+    class RDMAAdapter;
+    class RDMABuffer;
+
+    class WorkBatch
+    {
+    public:
+        explicit WorkBatch(                       // construction function of a work batch
+            uint32_t max_batch_size = 64,         // how many work requests the batch can hold
+            std::string batch_info = "WorkBatch"); // the info of this batch
+        virtual ~WorkBatch();
+
+    public:
+        // append a send_with_imm work request, return false if the batch is full
+        bool add_send(RDMABuffer *buffer,            // placeholder of the data to send
+                      uint32_t data_length_in_bytes, // data length to send
+                      uint32_t msg_tag = 0);         // tagging the message type to notify peer
+
+        // append an rdma write (with imm if notify_peer) work request
+        bool add_write(RDMABuffer *buffer,                              // the buffer for data to write
+                       uint32_t data_length_in_bytes,                   // data length to write
+                       struct CommDescriptor *remote_buffer_descriptor, // remote buffer_describptor
+                       uint32_t msg_tag,                                // tagging the message type to notify peer
+                       bool notify_peer = false);                       // notify peer explicit or not
+
+        // append an rdma read work request
+        bool add_read(RDMABuffer *buffer,                               // placeholder that cache the read data
+                      uint32_t data_length_in_bytes,                    // data length to read
+                      struct CommDescriptor *remote_buffer_descriptor); // remote buffer_describptor
+
+        // link the collected work requests into one chain, stamping each with wr_id
+        struct ibv_send_wr *build_chain(uint64_t wr_id);
+
+        void clear(); // drop all collected work requests, the batch can be reused
+
+        inline uint32_t size() // how many work requests are collected
+        {
+            return num_wr_;
+        }
+        inline uint32_t capacity() // the maximum work requests this batch can hold
+        {
+            return max_batch_size_;
+        }
+        inline bool empty()
+        {
+            return num_wr_ == 0;
+        }
+        inline bool full()
+        {
+            return num_wr_ >= max_batch_size_;
+        }
+        inline std::string info()
+        {
+            return "WorkBatch(" + batch_info_ + ")";
+        }
+
+    private:
+        // take the next free wr slot and fill in its sge, return nullptr if full
+        struct ibv_send_wr *prepare_wr(RDMABuffer *buffer,
+                                       uint32_t data_length_in_bytes);
+
+    private:
+        std::string batch_info_ = "";              // batch info
+        uint32_t max_batch_size_ = 0;              // how many wrs the batch can hold
+        uint32_t num_wr_ = 0;                      // how many wrs are collected
+        std::vector<struct ibv_send_wr> wr_list_; // pre-allocated work requests
+        std::vector<struct ibv_sge> sge_list_;    // pre-allocated scatter/gather entries
+    };
+}; // end namespace rdma_core
+#endif
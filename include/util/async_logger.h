@@ -0,0 +1,243 @@
+#ifndef __NEWPLAN_ASYNC_LOGGER_H__
+#define __NEWPLAN_ASYNC_LOGGER_H__
+
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <ostream>
+#include <streambuf>
+#include <thread>
+
+namespace newplan
+{
+    // a logger whose producers never block: a line is copied into a slot of a bounded lock-free ring
+    // (Vyukov's mpmc queue, with one consumer), and a background thread writes the slots to stderr;
+    // when the ring is full the line is dropped and counted, instead of waiting for the writer;
+    // the singleton is never deleted, as in glog, so the static destructors can still log, synchronously,
+    // once the writer is stopped at exit
+    class AsyncLogger
+    {
+    public:
+        static constexpr uint32_t RING_SLOTS = 4096;   // a power of 2
+        static constexpr uint32_t MAX_LINE_BYTES = 220; // longer lines are cut off, so a slot fills 4 cache lines
+
+        static AsyncLogger *get_instance()
+        {
+            static AsyncLogger *logger = new AsyncLogger();
+            return logger;
+        }
+
+        // false if the line is dropped, as the ring is full
+        bool push(const char *file, int line, const char *text, uint32_t length)
+        {
+            // counted before running_ is checked, so stop() waits for the ones that see it still running
+            producers_.fetch_add(1);
+            if (!running_.load())
+            { // the writer is stopped at exit, nothing else is writing then
+                producers_.fetch_sub(1, std::memory_order_release);
+                write_line(now_us(), this_tid(), file, line, text, length);
+                return true;
+            }
+            bool pushed = claim_and_write(file, line, text, length);
+            producers_.fetch_sub(1, std::memory_order_release);
+            return pushed;
+        }
+
+        uint64_t get_dropped() const
+        {
+            return dropped_.load(std::memory_order_relaxed);
+        }
+
+    private:
+        bool claim_and_write(const char *file, int line, const char *text, uint32_t length)
+        {
+            uint64_t position = tail_.load(std::memory_order_relaxed);
+            Slot *slot = nullptr;
+            for (;;)
+            {
+                slot = &slots_[position & (RING_SLOTS - 1)];
+                uint64_t sequence = slot->sequence.load(std::memory_order_acquire);
+                int64_t diff = (int64_t)sequence - (int64_t)position;
+                if (diff == 0)
+                {
+                    if (tail_.compare_exchange_weak(position, position + 1, std::memory_order_relaxed))
+                        break;
+                }
+                else if (diff < 0)
+                {
+                    dropped_.fetch_add(1, std::memory_order_relaxed);
+                    return false;
+                }
+                else
+                {
+                    position = tail_.load(std::memory_order_relaxed);
+                }
+            }
+            slot->timestamp_us = now_us();
+            slot->tid = this_tid();
+            slot->file = file;
+            slot->line = line;
+            slot->length = length < MAX_LINE_BYTES ? length : MAX_LINE_BYTES;
+            memcpy(slot->text, text, slot->length);
+            slot->sequence.store(position + 1, std::memory_order_release);
+            return true;
+        }
+
+        struct alignas(64) Slot
+        {
+            std::atomic<uint64_t> sequence{0}; // == position when free, position + 1 once written
+            uint64_t timestamp_us = 0;
+            const char *file = nullptr;        // __FILE__, a literal that outlives the slot
+            uint32_t line = 0;
+            uint32_t tid = 0;
+            uint32_t length = 0;
+            char text[MAX_LINE_BYTES];
+        };
+
+        AsyncLogger()
+        {
+            for (uint64_t index = 0; index < RING_SLOTS; index++)
+                slots_[index].sequence.store(index, std::memory_order_relaxed);
+            running_.store(true, std::memory_order_release);
+            writer_ = std::thread(&AsyncLogger::drain_loop, this);
+            std::atexit([]
+                        { get_instance()->stop(); });
+        }
+
+        // at exit: the later lines are written synchronously, the ones pushed so far are all written out
+        void stop()
+        {
+            running_.store(false);
+            writer_.join();
+            while (producers_.load() != 0 || head_ != tail_.load(std::memory_order_acquire))
+            { // a producer still fills the slot it has claimed
+                if (drain() == 0)
+                    std::this_thread::yield();
+            }
+            if (get_dropped() != 0)
+                fprintf(stderr, "AsyncLogger dropped %lu line(s), the ring of %u slots was full\n",
+                        (unsigned long)get_dropped(), RING_SLOTS);
+        }
+
+        void drain_loop()
+        {
+            while (running_.load(std::memory_order_acquire))
+            {
+                if (drain() == 0) // never wakes up the producers, so it polls
+                    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            }
+        }
+        uint32_t drain() // only the writer thread, or stop() after it is joined
+        {
+            uint32_t num_lines = 0;
+            for (;;)
+            {
+                Slot *slot = &slots_[head_ & (RING_SLOTS - 1)];
+                if (slot->sequence.load(std::memory_order_acquire) != head_ + 1)
+                    break;
+                write_line(slot->timestamp_us, slot->tid, slot->file, slot->line, slot->text, slot->length);
+                slot->sequence.store(head_ + RING_SLOTS, std::memory_order_release);
+                head_++;
+                num_lines++;
+            }
+            if (num_lines != 0)
+                fflush(stderr);
+            return num_lines;
+        }
+
+        // in the layout of glog, I<mmdd hh:mm:ss.uuuuuu> tid file:line] text
+        static void write_line(uint64_t timestamp_us, uint32_t tid, const char *file, uint32_t line,
+                               const char *text, uint32_t length)
+        {
+            time_t seconds = timestamp_us / 1000000;
+            struct tm local_time;
+            localtime_r(&seconds, &local_time);
+            const char *base_name = strrchr(file, '/');
+            fprintf(stderr, "I%02d%02d %02d:%02d:%02d.%06u %u %s:%u] %.*s\n",
+                    local_time.tm_mon + 1, local_time.tm_mday, local_time.tm_hour, local_time.tm_min,
+                    local_time.tm_sec, (uint32_t)(timestamp_us % 1000000), tid,
+                    base_name != nullptr ? base_name + 1 : file, line, (int)length, text);
+        }
+        static inline uint64_t now_us()
+        {
+            return std::chrono::duration_cast<std::chrono::microseconds>(
+                       std::chrono::system_clock::now().time_since_epoch())
+                .count();
+        }
+        static inline uint32_t this_tid()
+        {
+            static thread_local uint32_t tid = (uint32_t)syscall(SYS_gettid);
+            return tid;
+        }
+
+    private:
+        Slot slots_[RING_SLOTS];
+        alignas(64) std::atomic<uint64_t> tail_{0}; // the next position to claim, by the producers
+        alignas(64) uint64_t head_ = 0;             // the next position to write, by the writer
+        std::atomic<uint64_t> dropped_{0};
+        std::atomic<uint32_t> producers_{0}; // inside push()
+        std::atomic<bool> running_{false};
+        std::thread writer_;
+    };
+
+    // one line built on the stack of the caller, and pushed to the AsyncLogger when it goes out of scope
+    class AsyncLogLine
+    {
+    public:
+        AsyncLogLine(const char *file, int line) :
+            stream_(&buffer_), file_(file), line_(line)
+        {
+        }
+        ~AsyncLogLine()
+        {
+            AsyncLogger::get_instance()->push(file_, line_, buffer_.data(), buffer_.size());
+        }
+        std::ostream &stream()
+        {
+            return stream_;
+        }
+
+    private:
+        class LineBuffer : public std::streambuf // a fixed buffer, what does not fit is cut off
+        {
+        public:
+            LineBuffer()
+            {
+                setp(text_, text_ + sizeof(text_));
+            }
+            const char *data() const
+            {
+                return pbase();
+            }
+            uint32_t size() const
+            {
+                return pptr() - pbase();
+            }
+
+        private:
+            char text_[AsyncLogger::MAX_LINE_BYTES];
+        };
+
+        LineBuffer buffer_; // before stream_, which writes into it
+        std::ostream stream_;
+        const char *file_;
+        int line_;
+    };
+
+    // turns the stream of an AsyncLogLine into void, so a log is the second operand of ?: as in glog
+    class AsyncLogVoidify
+    {
+    public:
+        void operator&(std::ostream &)
+        {
+        }
+    };
+} // namespace newplan
+#endif
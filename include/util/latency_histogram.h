@@ -0,0 +1,111 @@
+#ifndef __NEWPLAN_LATENCY_HISTOGRAM_H__
+#define __NEWPLAN_LATENCY_HISTOGRAM_H__
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+namespace newplan
+{
+    // a log-linear (HDR-style) histogram of latencies in nanoseconds: the values below 2^SUB_BUCKET_BITS are
+    // counted exactly, above that each power of 2 is split into 2^(SUB_BUCKET_BITS-1) linear buckets, so a
+    // percentile is off by less than 1/2^(SUB_BUCKET_BITS-1) of its value, whatever the range of the samples
+    class LatencyHistogram
+    {
+    public:
+        static constexpr uint32_t SUB_BUCKET_BITS = 8; // <0.8% relative error
+        static constexpr uint64_t SUB_BUCKETS = 1ULL << SUB_BUCKET_BITS;
+        static constexpr uint64_t HALF_BUCKETS = SUB_BUCKETS / 2;
+
+        LatencyHistogram() :
+            counts_(bucket_of(UINT64_MAX) + 1, 0)
+        {
+        }
+
+        void record(uint64_t nanoseconds)
+        {
+            counts_[bucket_of(nanoseconds)]++;
+            count_++;
+            sum_ += nanoseconds;
+            min_ = std::min(min_, nanoseconds);
+            max_ = std::max(max_, nanoseconds);
+        }
+        void merge(const LatencyHistogram &other)
+        {
+            for (size_t index = 0; index < counts_.size(); index++)
+                counts_[index] += other.counts_[index];
+            count_ += other.count_;
+            sum_ += other.sum_;
+            min_ = std::min(min_, other.min_);
+            max_ = std::max(max_, other.max_);
+        }
+        void reset()
+        {
+            std::fill(counts_.begin(), counts_.end(), 0);
+            count_ = sum_ = max_ = 0;
+            min_ = UINT64_MAX;
+        }
+
+        uint64_t count() const
+        {
+            return count_;
+        }
+        uint64_t min() const
+        {
+            return count_ == 0 ? 0 : min_;
+        }
+        uint64_t max() const
+        {
+            return max_;
+        }
+        double mean() const
+        {
+            return count_ == 0 ? 0 : (double)sum_ / count_;
+        }
+        // the smallest value at least percentile% of the samples are equal to (within the bucket error), 0 if empty
+        uint64_t percentile(double percentile) const
+        {
+            if (count_ == 0)
+                return 0;
+            uint64_t rank = (uint64_t)(percentile / 100.0 * count_ + 0.5);
+            rank = std::min(std::max<uint64_t>(rank, 1), count_);
+            uint64_t seen = 0;
+            for (size_t index = 0; index < counts_.size(); index++)
+            {
+                seen += counts_[index];
+                if (seen >= rank) // the top of the bucket, but never beyond what was recorded
+                    return std::max(std::min(highest_of(index), max_), min_);
+            }
+            return max_;
+        }
+
+    private:
+        static inline uint32_t magnitude(uint64_t value) // the index of the highest set bit
+        {
+            return 63 - __builtin_clzll(value);
+        }
+        static inline size_t bucket_of(uint64_t value)
+        {
+            if (value < SUB_BUCKETS)
+                return value;
+            uint32_t shift = magnitude(value) - SUB_BUCKET_BITS + 1; // value >> shift is in [HALF_BUCKETS, SUB_BUCKETS)
+            return shift * HALF_BUCKETS + (value >> shift);
+        }
+        static inline uint64_t highest_of(size_t bucket)
+        {
+            if (bucket < SUB_BUCKETS)
+                return bucket;
+            uint64_t shift = bucket / HALF_BUCKETS - 1;
+            uint64_t sub_bucket = bucket - shift * HALF_BUCKETS;
+            return ((sub_bucket + 1) << shift) - 1;
+        }
+
+    private:
+        std::vector<uint64_t> counts_; // samples per bucket
+        uint64_t count_ = 0;           // samples recorded
+        uint64_t sum_ = 0;             // for the mean
+        uint64_t min_ = UINT64_MAX;
+        uint64_t max_ = 0;
+    };
+} // namespace newplan
+#endif
@@ -295,4 +295,54 @@ private:
     } while (0);
 #endif
 
-#endif
\ No newline at end of file
+/****************************below is the hot path*************************************/
+// the logs in the post/poll path of each work request go through HOT_VLOG/HOT_VLOG_EVERY_N/HOT_TRACE_IN/HOT_TRACE_OUT:
+// above RCL_HOT_PATH_VLOG_LEVEL, a cmake option, they compile to nothing, neither a level check nor a counter;
+// at or below it they are checked against the runtime level as VLOG, and handed to the async logger, so the
+// posting thread never takes a lock or waits for stderr
+#include "async_logger.h"
+
+#ifndef RCL_HOT_PATH_VLOG_LEVEL
+#define RCL_HOT_PATH_VLOG_LEVEL -1 // all of them are compiled out
+#endif
+
+#define HOT_VLOG_IS_ON(level) ((level) <= RCL_HOT_PATH_VLOG_LEVEL)
+
+// both are single expressions in the way of glog, !(on) ? (void)0 : voidify & stream, so an else after them
+// binds to the if of the caller
+#if RCL_HOT_PATH_VLOG_LEVEL < 0
+// the operands are still parsed, so the logs keep compiling, but no code or counter is emitted for them
+#define HOT_VLOG(level) \
+    true ? (void)0 : newplan::AsyncLogVoidify() & newplan::AsyncLogLine(__FILE__, __LINE__).stream()
+
+#define HOT_VLOG_EVERY_N(level, n) HOT_VLOG(level)
+#else
+#define HOT_VLOG(level)                             \
+    !(HOT_VLOG_IS_ON(level) && VLOG_IS_ON(level))   \
+        ? (void)0                                   \
+        : newplan::AsyncLogVoidify() & newplan::AsyncLogLine(__FILE__, __LINE__).stream()
+
+// the first of every n calls, the counter is only touched when the level is on
+#define HOT_VLOG_EVERY_N(level, n)                                                                  \
+    !(HOT_VLOG_IS_ON(level) && VLOG_IS_ON(level) && [](uint64_t every) {                            \
+        static std::atomic<uint64_t> occurrences{0};                                                \
+        return occurrences.fetch_add(1, std::memory_order_relaxed) % every == 0;                    \
+    }(n))                                                                                           \
+        ? (void)0                                                                                   \
+        : newplan::AsyncLogVoidify() & newplan::AsyncLogLine(__FILE__, __LINE__).stream()
+#endif
+
+#if defined(DEBUGING_TRACING) && RCL_HOT_PATH_VLOG_LEVEL >= TRACING_LOG_LEVEL
+#define HOT_TRACE_IN HOT_VLOG(TRACING_LOG_LEVEL) << "[TRACING] in function \"" << __FUNCTION__ << "\"";
+#define HOT_TRACE_OUT HOT_VLOG(TRACING_LOG_LEVEL) << "[TRACING] out function \"" << __FUNCTION__ << "\"";
+#else
+#define HOT_TRACE_IN \
+    do {             \
+    } while (0);
+
+#define HOT_TRACE_OUT \
+    do {              \
+    } while (0);
+#endif
+
+#endif
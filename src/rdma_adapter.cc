@@ -1,5 +1,7 @@
 #include "rdma_adapter.h"
 #include "rdma_device.h"
+#include "rdma_reg_cache.h"
+#include "rdma_work_batch.h"
 #include "util/logging.h"
 #include <errno.h>
 extern int errno;
@@ -44,12 +46,18 @@ namespace rdma_core
             _adapter_config_.cq_key = info();
             VLOG(3) << info() << " would not use shared_cq, the cq is: " << _adapter_config_.cq_key;
         }
+        if (_adapter_config_.using_shared_rq)
+        {
+            CHECK(_adapter_config_.srq_key.length() != 0) << "Configure ERROR: " << info()
+                                                          << " is expected to use shared rq, but the srq_key is not set";
+        }
         VLOG(3) << "Preparing the resources of " << this->info();
 
         rdma_device_ = RDMADevice::get_device(_adapter_config_.dev_name, this);
         create_pd();
         create_compt_channel();
         create_cq();
+        create_srq();
         create_qp();
         update_my_adapter_info();
         vadapt_status_ = AdapterState::RESOURCE_ALLOCATED;
@@ -75,17 +83,47 @@ namespace rdma_core
         else
             LOG(WARNING) << "CQ@" << info() << " would not generate a signal for sqe";
 
+        if (_adapter_config_.signal_policy == SignalPolicy::SIGNAL_EVERY_N)
+        {
+            CHECK(_adapter_config_.signal_interval >= 1 && _adapter_config_.signal_interval <= _adapter_config_.max_send_wr)
+                << "Invalid signal_interval: " << _adapter_config_.signal_interval
+                << ", it should be in [1, " << _adapter_config_.max_send_wr << "]";
+        }
+        // at most max_send_wr sqes are in flight, so is the signaled ones
+        signaled_spans_.assign(_adapter_config_.max_send_wr, 0);
+        span_head_ = span_tail_ = 0;
+        unsignaled_sqe_ = 0;
+
+        {
+            uint32_t device_max_sge = std::min(rdma_device_->get_device_attr()->max_sge, MAX_SGE_PER_WR);
+            if (_adapter_config_.max_send_sge > device_max_sge || _adapter_config_.max_recv_sge > device_max_sge)
+            {
+                LOG(WARNING) << RLOG::make_string("The device supports at most %u sges, reset the config (send: %u, recv: %u)",
+                                                  device_max_sge, _adapter_config_.max_send_sge, _adapter_config_.max_recv_sge);
+                _adapter_config_.max_send_sge = std::min(_adapter_config_.max_send_sge, device_max_sge);
+                _adapter_config_.max_recv_sge = std::min(_adapter_config_.max_recv_sge, device_max_sge);
+            }
+        }
+
         qp_init_attr.send_cq = used_cq_;
         qp_init_attr.recv_cq = used_cq_;
         qp_init_attr.cap.max_send_wr = _adapter_config_.max_send_wr;
         qp_init_attr.cap.max_recv_wr = _adapter_config_.max_recv_wr;
         qp_init_attr.cap.max_send_sge = _adapter_config_.max_send_sge;
         qp_init_attr.cap.max_recv_sge = _adapter_config_.max_recv_sge;
-        qp_init_attr.cap.max_inline_data = 0;
-        qp_init_attr.srq = NULL;
+        qp_init_attr.cap.max_inline_data = _adapter_config_.max_inline_data;
+        qp_init_attr.srq = srq_;
         CHECK(qp_ == 0) << "queue pair has been instanced";
-        qp_ = rdma_device_->create_queue_pair(pd_, qp_init_attr);
-        VLOG(3) << "[OK]: Successfully create queue_pair(" << qp_ << ") for " << info();
+        qp_ = rdma_device_->create_queue_pair(pd_, &qp_init_attr);
+        if (qp_init_attr.cap.max_inline_data < _adapter_config_.max_inline_data)
+        {
+            LOG(WARNING) << RLOG::make_string("The negotiated max_inline_data(%u) is less than the config (%u), reset it",
+                                              qp_init_attr.cap.max_inline_data, _adapter_config_.max_inline_data);
+            _adapter_config_.max_inline_data = qp_init_attr.cap.max_inline_data;
+        }
+        inline_threshold_ = _adapter_config_.max_inline_data;
+        VLOG(3) << "[OK]: Successfully create queue_pair(" << qp_ << ") for " << info()
+                << ", inlining payloads up to " << inline_threshold_ << " bytes";
         TRACE_OUT;
     }
     void RDMAAdapter::create_pd()
@@ -93,7 +131,9 @@ namespace rdma_core
         TRACE_IN;
         // created protection domain
         CHECK(pd_ == 0) << "Protected has been instanced";
-        pd_ = rdma_device_->create_protected_domain();
+        // qps attached to one srq must be in the pd of the srq
+        pd_ = rdma_device_->create_protected_domain(_adapter_config_.using_shared_rq ? _adapter_config_.srq_key
+                                                                                     : _adapter_config_.pd_key);
         VLOG(3) << "Creating protection domain(" << pd_
                 << ") for " << info();
         TRACE_OUT;
@@ -134,6 +174,30 @@ namespace rdma_core
         return;
     }
 
+    void RDMAAdapter::create_srq()
+    {
+        TRACE_IN;
+        if (!_adapter_config_.using_shared_rq)
+        {
+            VLOG(3) << info() << " uses its own receive queue";
+            TRACE_OUT;
+            return;
+        }
+        CHECK(srq_ == nullptr) << "shared receive queue has been instanced";
+        srq_ = rdma_device_->create_shared_receive_queue(_adapter_config_.srq_key,
+                                                         pd_,
+                                                         _adapter_config_.srq_size,
+                                                         _adapter_config_.max_recv_sge);
+        VLOG(3) << RLOG::make_string("The SRQ@%s (@%p, named %s) is shared",
+                                     info().c_str(), srq_, _adapter_config_.srq_key.c_str());
+        TRACE_OUT;
+    }
+
+    void RDMAAdapter::claim_recv_queue(const std::string &user)
+    {
+        CHECK(srq_ == nullptr) << info() << " is attached to a shared receive queue, its receives cannot serve " << user;
+    }
+
     void RDMAAdapter::show_qp_info(std::string info)
     {
         auto ret = rdma_device_->get_qp_attr(qp_, &qp_init_attr);
@@ -176,7 +240,8 @@ namespace rdma_core
         std::string compt_info = info();
         if (_adapter_config_.use_event_channel)
         {
-            event_channel = rdma_device_->create_event_channel();
+            // adapters sharing a cq must share its event channel as well
+            event_channel = rdma_device_->create_event_channel(_adapter_config_.cq_key);
             compt_info += RLOG::make_string(" works in passive model, "
                                             "creating the event channel (%p)",
                                             event_channel);
@@ -399,6 +464,80 @@ namespace rdma_core
         return rdma_device_->real_deregister_mem(mr_, info);
     }
 
+    void RDMAAdapter::set_signal_policy(SignalPolicy policy, uint32_t signal_interval)
+    {
+        CHECK(unsignaled_sqe_ == 0) << "Cannot switch the signal policy of " << info()
+                                    << " with " << unsignaled_sqe_ << " unsignaled sqe(s) pending";
+        CHECK(policy != SignalPolicy::SIGNAL_EVERY_N || (signal_interval >= 1 && signal_interval <= _adapter_config_.max_send_wr))
+            << "Invalid signal_interval: " << signal_interval;
+        _adapter_config_.signal_policy = policy;
+        _adapter_config_.signal_interval = signal_interval;
+        VLOG(3) << info() << " switches the signal policy to " << static_cast<uint32_t>(policy)
+                << ", interval: " << signal_interval;
+    }
+
+    int RDMAAdapter::acquire_send_flags(uint32_t unsignaled_sqe, bool batch_tail) const
+    {
+        if ((signal_next_wr_ && batch_tail) || !tracks_spans())
+            return IBV_SEND_SIGNALED; // a tagged wr_id, whose owner waits for its cqe, or a flush
+        bool signaled = true;
+        switch (_adapter_config_.signal_policy)
+        {
+            case SignalPolicy::SIGNAL_EVERY_N:
+                signaled = (unsignaled_sqe + 1 >= _adapter_config_.signal_interval);
+                break;
+            case SignalPolicy::SIGNAL_BATCH_TAIL:
+                signaled = batch_tail;
+                break;
+            default:
+                break;
+        }
+        // unsignaled sqes hold their slots until a later signaled one completes
+        if (unsignaled_sqe + 1 >= _adapter_config_.max_send_wr)
+            signaled = true;
+        return signaled ? IBV_SEND_SIGNALED : 0;
+    }
+
+    void RDMAAdapter::commit_send_flags(int send_flags)
+    {
+        if (!(send_flags & IBV_SEND_SIGNALED))
+        {
+            unsignaled_sqe_++;
+            return;
+        }
+        if (!tracks_spans() && span_head_ == span_tail_ && unsignaled_sqe_ == 0)
+            return; // covers itself only, retire_sqe() returns 1 for it
+        CHECK(span_tail_ - span_head_ < signaled_spans_.size())
+            << "Too many signaled sqes in flight for " << info();
+        signaled_spans_[span_tail_++ % signaled_spans_.size()] = unsignaled_sqe_ + 1;
+        unsignaled_sqe_ = 0;
+    }
+
+    // the posters of RDMADevice LOG(FATAL) on a failed post, so here the sqe is on the sq
+    bool RDMAAdapter::finish_post(bool posted, int send_flags)
+    {
+        signal_next_wr_ = false;
+        commit_send_flags(send_flags);
+        return posted;
+    }
+
+    int64_t RDMAAdapter::retire_sqe()
+    {
+        if (span_head_ == span_tail_)
+        {
+            if (!tracks_spans())
+            { // a signaled sqe of its own
+                sq_inflight--;
+                return 1;
+            }
+            LOG(WARNING) << "No signaled sqe is in flight for " << info();
+            return 0;
+        }
+        int64_t retired = signaled_spans_[span_head_++ % signaled_spans_.size()];
+        sq_inflight -= retired;
+        return retired;
+    }
+
     bool RDMAAdapter::send_remote(RDMABuffer *buffer,            // placeholder for data to send
                                   uint32_t data_length_in_bytes, // data length to send
                                   uint32_t msg_tag)              // signal to notify peer
@@ -410,17 +549,22 @@ namespace rdma_core
                                                            << ", exceeding the maximum buffer size: "
                                                            << buffer->buffer_size;
         this->increase_sqe();
-        return RDMADevice::real_send_(this->qp_, buffer->mr_,
-                                      buffer->data_ptr,
-                                      data_length_in_bytes,
-                                      msg_tag,
-                                      (uint64_t)this);
+        stats_.count_post(StatsOpcode::SEND, data_length_in_bytes, sq_inflight);
+        int send_flags = acquire_send_flags(unsignaled_sqe_);
+        return finish_post(RDMADevice::real_send_(this->qp_, buffer->mr_,
+                                                  buffer->data_ptr,
+                                                  data_length_in_bytes,
+                                                  msg_tag,
+                                                  take_wr_id(),
+                                                  send_flags | inline_flags(data_length_in_bytes)),
+                           send_flags);
     }
 
     bool RDMAAdapter::recv_remote(RDMABuffer *buffer,            // placeholder for data to recv
                                   uint32_t data_length_in_bytes) // data length to recv
 
     {
+        CHECK(srq_ == nullptr) << info() << " is attached to a shared receive queue, post recv to the srq instead";
         CHECK(buffer != 0) << "RDMABuffer has not been initialized";
         buffer->security_check();
 
@@ -429,10 +573,11 @@ namespace rdma_core
                                                            << ", exceeding the maximum buffer size: "
                                                            << buffer->buffer_size;
         this->increase_rqe();
+        stats_.count_post(StatsOpcode::RECV, data_length_in_bytes);
         return RDMADevice::real_recv_(this->qp_, buffer->mr_,
                                       buffer->data_ptr,
                                       data_length_in_bytes,
-                                      (uint64_t)this);
+                                      take_wr_id(false));
     }
 
     // using the adapter to read data from its peer adapter
@@ -446,13 +591,17 @@ namespace rdma_core
         CHECK((data_length_in_bytes <= buffer->buffer_size && data_length_in_bytes <= remote_buffer_descriptor->buffer_length_))
             << "Invalid data length to read";
         this->increase_sqe();
-        return RDMADevice::real_read_remote_(this->qp_,
-                                             remote_buffer_descriptor->rkey_,
-                                             buffer->mr_->lkey,
-                                             buffer->data_ptr,
-                                             remote_buffer_descriptor->buffer_addr_,
-                                             data_length_in_bytes,
-                                             (uint64_t)this);
+        stats_.count_post(StatsOpcode::READ, data_length_in_bytes, sq_inflight);
+        int send_flags = acquire_send_flags(unsignaled_sqe_);
+        return finish_post(RDMADevice::real_read_remote_(this->qp_,
+                                                         remote_buffer_descriptor->rkey_,
+                                                         buffer->mr_->lkey,
+                                                         buffer->data_ptr,
+                                                         remote_buffer_descriptor->buffer_addr_,
+                                                         data_length_in_bytes,
+                                                         take_wr_id(),
+                                                         send_flags),
+                           send_flags);
         return true;
     }
 
@@ -470,39 +619,270 @@ namespace rdma_core
             << "Invalid data length to write: " << data_length_in_bytes << ", my buffer size: "
             << buffer->buffer_size << ", peer buffer size: " << remote_buffer_descriptor->buffer_length_;
         this->increase_sqe();
+        stats_.count_post(StatsOpcode::WRITE, data_length_in_bytes, sq_inflight);
+        int send_flags = acquire_send_flags(unsignaled_sqe_);
 
         if (notify_peer)
         {
-            return RDMADevice::real_write_remote_with_notify_(this->qp_,
+            return finish_post(RDMADevice::real_write_remote_with_notify_(this->qp_,
+                                                                          remote_buffer_descriptor->rkey_,
+                                                                          buffer->mr_->lkey,
+                                                                          buffer->data_ptr,
+                                                                          remote_buffer_descriptor->buffer_addr_,
+                                                                          data_length_in_bytes,
+                                                                          msg_tag,
+                                                                          take_wr_id(),
+                                                                          send_flags | inline_flags(data_length_in_bytes)),
+                               send_flags);
+        }
+        else
+        {
+            return finish_post(RDMADevice::real_write_remote_(this->qp_,
                                                               remote_buffer_descriptor->rkey_,
                                                               buffer->mr_->lkey,
                                                               buffer->data_ptr,
                                                               remote_buffer_descriptor->buffer_addr_,
                                                               data_length_in_bytes,
-                                                              msg_tag,
-                                                              (uint64_t)this);
+                                                              take_wr_id(),
+                                                              send_flags | inline_flags(data_length_in_bytes)),
+                               send_flags);
         }
-        else
-        {
-            return RDMADevice::real_write_remote_(this->qp_,
-                                                  remote_buffer_descriptor->rkey_,
-                                                  buffer->mr_->lkey,
-                                                  buffer->data_ptr,
-                                                  remote_buffer_descriptor->buffer_addr_,
+        return true;
+    }
+
+    bool RDMAAdapter::send_remote(const void *data,              // the user memory to send
+                                  uint32_t data_length_in_bytes, // data length to send
+                                  uint32_t msg_tag)              // tagging the message type to notify peer
+    {
+        CHECK(data != 0) << "Empty user memory to send";
+        if (reg_cache_ == nullptr)
+            reg_cache_ = RDMARegistrationCache::get_registration_cache(this);
+        struct ibv_mr *mr = reg_cache_->acquire(data, data_length_in_bytes, 0); // local read only
+        this->increase_sqe();
+        stats_.count_post(StatsOpcode::SEND, data_length_in_bytes, sq_inflight);
+        int send_flags = acquire_send_flags(unsignaled_sqe_);
+        return finish_post(RDMADevice::real_send_(this->qp_, mr,
+                                                  (void *)data,
                                                   data_length_in_bytes,
-                                                  (uint64_t)this);
+                                                  msg_tag,
+                                                  take_wr_id(),
+                                                  send_flags | inline_flags(data_length_in_bytes)),
+                           send_flags);
+    }
+
+    bool RDMAAdapter::write_remote(const void *data,                                // the user memory to write
+                                   uint32_t data_length_in_bytes,                   // data length to write
+                                   struct CommDescriptor *remote_buffer_descriptor, // remote buffer_describptor
+                                   uint32_t msg_tag,                                // tagging the message type to notify peer
+                                   bool notify_peer)                                // notify peer explicit or not
+    {
+        CHECK(data != 0) << "Empty user memory to write";
+        CHECK(remote_buffer_descriptor != 0) << "Invalid remote buffer descriptor";
+        CHECK(data_length_in_bytes <= remote_buffer_descriptor->buffer_length_)
+            << "Invalid data length to write: " << data_length_in_bytes
+            << ", peer buffer size: " << remote_buffer_descriptor->buffer_length_;
+        if (reg_cache_ == nullptr)
+            reg_cache_ = RDMARegistrationCache::get_registration_cache(this);
+        struct ibv_mr *mr = reg_cache_->acquire(data, data_length_in_bytes, 0); // local read only
+        this->increase_sqe();
+        stats_.count_post(StatsOpcode::WRITE, data_length_in_bytes, sq_inflight);
+        int send_flags = acquire_send_flags(unsignaled_sqe_);
+
+        if (notify_peer)
+        {
+            return finish_post(RDMADevice::real_write_remote_with_notify_(this->qp_,
+                                                                          remote_buffer_descriptor->rkey_,
+                                                                          mr->lkey,
+                                                                          (void *)data,
+                                                                          remote_buffer_descriptor->buffer_addr_,
+                                                                          data_length_in_bytes,
+                                                                          msg_tag,
+                                                                          take_wr_id(),
+                                                                          send_flags | inline_flags(data_length_in_bytes)),
+                               send_flags);
         }
-        return true;
+        return finish_post(RDMADevice::real_write_remote_(this->qp_,
+                                                          remote_buffer_descriptor->rkey_,
+                                                          mr->lkey,
+                                                          (void *)data,
+                                                          remote_buffer_descriptor->buffer_addr_,
+                                                          data_length_in_bytes,
+                                                          take_wr_id(),
+                                                          send_flags | inline_flags(data_length_in_bytes)),
+                           send_flags);
+    }
+
+    void RDMAAdapter::release_user_memory(const void *data)
+    {
+        CHECK(reg_cache_ != nullptr) << "No user memory has been sent/written by " << info();
+        reg_cache_->release(data);
+    }
+
+    uint32_t RDMAAdapter::fill_sge_list(const BufferSlice *slices, // map the slices to a scatter/gather list
+                                        uint32_t num_slices,       // how many slices to map
+                                        uint32_t max_sge,          // how many sges the qp supports
+                                        struct ibv_sge *sge_list)  // placeholder of the mapped sges
+    {
+        CHECK(slices != 0) << "The slices have not been initialized";
+        CHECK(num_slices >= 1 && num_slices <= max_sge)
+            << "Invalid number of slices: " << num_slices << ", " << info()
+            << " supports at most " << max_sge << " sge(s) per work request, see max_send_sge/max_recv_sge";
+
+        uint64_t total_bytes = 0;
+        for (uint32_t index = 0; index < num_slices; index++)
+        {
+            const BufferSlice &slice = slices[index];
+            CHECK(slice.buffer != 0) << "RDMABuffer of the " << index << "th slice has not been initialized";
+            slice.buffer->security_check();
+            CHECK((uint64_t)slice.offset + slice.length <= slice.buffer->buffer_size)
+                << "Invalid slice (offset: " << slice.offset << ", length: " << slice.length
+                << ") exceeding the buffer size: " << slice.buffer->buffer_size;
+
+            sge_list[index].addr = (uintptr_t)(slice.buffer->data_ptr + slice.offset);
+            sge_list[index].length = slice.length;
+            sge_list[index].lkey = slice.buffer->mr_->lkey;
+            total_bytes += slice.length;
+        }
+        CHECK(total_bytes <= UINT32_MAX) << "Invalid data length of the slices: " << total_bytes;
+        return (uint32_t)total_bytes;
+    }
+
+    bool RDMAAdapter::send_remote(const BufferSlice *slices, // the slices of data to send
+                                  uint32_t num_slices,       // how many slices
+                                  uint32_t msg_tag)          // tagging the message type to notify peer
+    {
+        struct ibv_sge sge_list[MAX_SGE_PER_WR];
+        uint32_t data_length_in_bytes = fill_sge_list(slices, num_slices,
+                                                      _adapter_config_.max_send_sge, sge_list);
+        this->increase_sqe();
+        stats_.count_post(StatsOpcode::SEND, data_length_in_bytes, sq_inflight);
+        int send_flags = acquire_send_flags(unsignaled_sqe_);
+        return finish_post(RDMADevice::real_post_send_sge_(this->qp_, IBV_WR_SEND_WITH_IMM,
+                                                           sge_list, num_slices,
+                                                           0, 0, msg_tag,
+                                                           take_wr_id(),
+                                                           send_flags | inline_flags(data_length_in_bytes)),
+                           send_flags);
+    }
+
+    bool RDMAAdapter::recv_remote(const BufferSlice *slices, // the slices that capture the recv data
+                                  uint32_t num_slices)       // how many slices
+    {
+        CHECK(srq_ == nullptr) << info() << " is attached to a shared receive queue, post recv to the srq instead";
+        struct ibv_sge sge_list[MAX_SGE_PER_WR];
+        uint32_t data_length_in_bytes = fill_sge_list(slices, num_slices, _adapter_config_.max_recv_sge, sge_list);
+        this->increase_rqe();
+        stats_.count_post(StatsOpcode::RECV, data_length_in_bytes);
+        return RDMADevice::real_post_recv_sge_(this->qp_, sge_list, num_slices,
+                                               take_wr_id(false));
+    }
+
+    bool RDMAAdapter::recv_notification()
+    {
+        CHECK(srq_ == nullptr) << info() << " is attached to a shared receive queue, post recv to the srq instead";
+        this->increase_rqe();
+        stats_.count_post(StatsOpcode::RECV, 0);
+        return RDMADevice::real_post_recv_sge_(this->qp_, nullptr, 0, take_wr_id(false));
+    }
+
+    bool RDMAAdapter::read_remote(const BufferSlice *slices,                       // the slices that cache the read data
+                                  uint32_t num_slices,                             // how many slices
+                                  struct CommDescriptor *remote_buffer_descriptor) // remote buffer_describptor
+    {
+        struct ibv_sge sge_list[MAX_SGE_PER_WR];
+        uint32_t data_length_in_bytes = fill_sge_list(slices, num_slices,
+                                                      _adapter_config_.max_send_sge, sge_list);
+        CHECK(remote_buffer_descriptor != 0) << "Invalid remote buffer descriptor";
+        CHECK(data_length_in_bytes <= remote_buffer_descriptor->buffer_length_)
+            << "Invalid data length to read: " << data_length_in_bytes
+            << ", peer buffer size: " << remote_buffer_descriptor->buffer_length_;
+        this->increase_sqe();
+        stats_.count_post(StatsOpcode::READ, data_length_in_bytes, sq_inflight);
+        int send_flags = acquire_send_flags(unsignaled_sqe_);
+        return finish_post(RDMADevice::real_post_send_sge_(this->qp_, IBV_WR_RDMA_READ,
+                                                           sge_list, num_slices,
+                                                           remote_buffer_descriptor->buffer_addr_,
+                                                           remote_buffer_descriptor->rkey_, 0,
+                                                           take_wr_id(),
+                                                           send_flags),
+                           send_flags);
+    }
+
+    bool RDMAAdapter::write_remote(const BufferSlice *slices,                       // the slices of data to write
+                                   uint32_t num_slices,                             // how many slices
+                                   struct CommDescriptor *remote_buffer_descriptor, // remote buffer_describptor
+                                   uint32_t msg_tag,                                // tagging the message type to notify peer
+                                   bool notify_peer)                                // notify peer explicit or not
+    {
+        struct ibv_sge sge_list[MAX_SGE_PER_WR];
+        uint32_t data_length_in_bytes = fill_sge_list(slices, num_slices,
+                                                      _adapter_config_.max_send_sge, sge_list);
+        CHECK(remote_buffer_descriptor != 0) << "Invalid remote buffer descriptor";
+        CHECK(data_length_in_bytes <= remote_buffer_descriptor->buffer_length_)
+            << "Invalid data length to write: " << data_length_in_bytes
+            << ", peer buffer size: " << remote_buffer_descriptor->buffer_length_;
+        this->increase_sqe();
+        stats_.count_post(StatsOpcode::WRITE, data_length_in_bytes, sq_inflight);
+        int send_flags = acquire_send_flags(unsignaled_sqe_);
+        return finish_post(RDMADevice::real_post_send_sge_(this->qp_,
+                                                           notify_peer ? IBV_WR_RDMA_WRITE_WITH_IMM : IBV_WR_RDMA_WRITE,
+                                                           sge_list, num_slices,
+                                                           remote_buffer_descriptor->buffer_addr_,
+                                                           remote_buffer_descriptor->rkey_,
+                                                           msg_tag,
+                                                           take_wr_id(),
+                                                           send_flags | inline_flags(data_length_in_bytes)),
+                           send_flags);
+    }
+
+    // post all work requests of the batch as one linked chain
+    bool RDMAAdapter::post_batch(WorkBatch *batch) // the collected send/write/read work requests
+    {
+        CHECK(batch != 0) << "WorkBatch has not been initialized";
+        if (batch->empty())
+        {
+            LOG(WARNING) << "Nothing to post in " << batch->info() << " for " << info();
+            return false;
+        }
+        CHECK(batch->size() <= _adapter_config_.max_send_wr)
+            << "Invalid batch size: " << batch->size()
+            << ", exceeding the maximum send_wr: " << _adapter_config_.max_send_wr;
+
+        CHECK(tagged_wr_id_ == 0) << "A batch posted by " << info() << " cannot carry a tagged wr_id";
+        struct ibv_send_wr *wr_list = batch->build_chain((uint64_t)this);
+        this->increase_sqe(batch->size());
+        uint32_t unsignaled_sqe = unsignaled_sqe_;
+        for (struct ibv_send_wr *wr = wr_list; wr != NULL; wr = wr->next)
+        {
+            wr->send_flags = acquire_send_flags(unsignaled_sqe, wr->next == NULL);
+            unsignaled_sqe = (wr->send_flags & IBV_SEND_SIGNALED) ? 0 : unsignaled_sqe + 1;
+            uint32_t wr_length = 0;
+            for (int sge_index = 0; sge_index < wr->num_sge; sge_index++)
+                wr_length += wr->sg_list[sge_index].length;
+            if (wr->opcode != IBV_WR_RDMA_READ)
+                wr->send_flags |= inline_flags(wr_length);
+            StatsOpcode opcode = wr->opcode == IBV_WR_RDMA_READ ? StatsOpcode::READ
+                                 : wr->opcode == IBV_WR_SEND_WITH_IMM ? StatsOpcode::SEND
+                                                                      : StatsOpcode::WRITE;
+            stats_.count_post(opcode, wr_length, sq_inflight);
+        }
+        bool ret = RDMADevice::real_post_send_batch_(this->qp_, wr_list, (uint64_t)this);
+        signal_next_wr_ = false;
+        for (struct ibv_send_wr *wr = wr_list; wr != NULL; wr = wr->next) // the chain is posted, or fatal
+            commit_send_flags(wr->send_flags);
+        batch->clear();
+        return ret;
     }
 
     // poll a batch of completion events from this adapter
     int RDMAAdapter::poll_cq_batch(struct ibv_wc *wc, // placeholder to recv polled cqe
                                    int num_wqe)       // how many cqes expected to poll
     {
-        return RDMADevice::real_poll_completion_queue(this->used_cq_,
-                                                      num_wqe,
-                                                      wc);
-        return 0;
+        int num_polled = RDMADevice::real_poll_completion_queue(this->used_cq_,
+                                                                num_wqe,
+                                                                wc);
+        stats_.count_poll(wc, num_polled); // by the poller, so a shared cq counts for the channel polling it
+        return num_polled;
     }
 
 }; // end namespace rdma_core
\ No newline at end of file
@@ -0,0 +1,202 @@
+#include "rdma_allreduce.h"
+#include "util/logging.h"
+
+#include <algorithm>
+#include <string.h>
+
+#define ALLREDUCE_POLL_BATCH 32 // cqes polled at once
+
+namespace rdma_core
+{
+    RingAllReduce::RingAllReduce(RDMAChannel *send_channel,
+                                 RDMAChannel *recv_channel,
+                                 uint32_t rank,
+                                 uint32_t num_ranks,
+                                 size_t max_bytes,
+                                 uint32_t chunk_size,
+                                 uint32_t pipeline_depth,
+                                 std::string allreduce_info) :
+        allreduce_info_(allreduce_info),
+        send_channel_(send_channel),
+        recv_channel_(recv_channel),
+        rank_(rank),
+        num_ranks_(num_ranks),
+        max_bytes_(max_bytes),
+        chunk_size_(chunk_size),
+        depth_(pipeline_depth)
+    {
+        TRACE_IN;
+        CHECK(send_channel_ != nullptr && recv_channel_ != nullptr)
+            << "Cannot build " << info() << " over an empty channel";
+        CHECK(num_ranks_ >= 2 && rank_ < num_ranks_)
+            << "Invalid rank of " << info() << ": " << rank_ << "/" << num_ranks_ << ", a ring holds at least 2 ranks";
+        CHECK(max_bytes_ > 0 && max_bytes_ <= UINT32_MAX)
+            << "Invalid vector size of " << info() << ": " << max_bytes_ << ", it should be in (0, 4GB)";
+        CHECK(chunk_size_ > 0 && chunk_size_ % ALLREDUCE_CHUNK_ALIGN == 0)
+            << "Invalid chunk size of " << info() << ": " << chunk_size_ << ", it should be a multiple of "
+            << ALLREDUCE_CHUNK_ALIGN;
+
+        work_.reset(RDMABuffer::allocate_buffer(max_bytes_, 1, allreduce_info_ + "_work", nullptr,
+                                                RDMABuffer::device_local_policy(send_channel_)));
+        send_channel_->register_buffer(work_.get());
+        // the chunks go to the next rank, those of the previous rank arrive
+        link_.reset(new StagingLink(send_channel_, recv_channel_, chunk_size_, depth_, allreduce_info_ + "_link"));
+
+        AllReduceHandshake local, from_next, from_prev;
+        local.link = link_->descriptor();
+        local.rank = rank_;
+        local.num_ranks = num_ranks_;
+        local.chunk_size = chunk_size_;
+        local.pipeline_depth = depth_;
+        // a swap blocks until the peer swaps too, so rank 0 hears from the previous rank first to break the cycle
+        RDMAEndPoint *next_endpoint = send_channel_->get_registered_endpoint();
+        RDMAEndPoint *prev_endpoint = recv_channel_->get_registered_endpoint();
+        if (rank_ == 0)
+            prev_endpoint->exchange_with_peer(&local, &from_prev, sizeof(AllReduceHandshake),
+                                              "the handshake with the previous rank of " + info());
+        next_endpoint->exchange_with_peer(&local, &from_next, sizeof(AllReduceHandshake),
+                                          "the handshake with the next rank of " + info());
+        if (rank_ != 0)
+            prev_endpoint->exchange_with_peer(&local, &from_prev, sizeof(AllReduceHandshake),
+                                              "the handshake with the previous rank of " + info());
+        CHECK(from_next.num_ranks == num_ranks_ && from_prev.num_ranks == num_ranks_)
+            << info() << " holds " << num_ranks_ << " ranks, while the next rank holds " << from_next.num_ranks
+            << " and the previous rank holds " << from_prev.num_ranks;
+        CHECK(from_next.rank == (rank_ + 1) % num_ranks_ && from_prev.rank == (rank_ + num_ranks_ - 1) % num_ranks_)
+            << info() << " is rank " << rank_ << ", while its next rank is " << from_next.rank
+            << " and its previous rank is " << from_prev.rank << ", check the order of the ring";
+        CHECK(from_next.chunk_size == chunk_size_ && from_next.pipeline_depth == depth_)
+            << info() << " cuts " << chunk_size_ << "-byte chunks " << depth_ << " deep, while the next rank cuts "
+            << from_next.chunk_size << "-byte chunks " << from_next.pipeline_depth << " deep";
+        link_->connect(from_next.link, from_prev.link);
+        VLOG(3) << "Creating " << info() << " as rank " << rank_ << "/" << num_ranks_ << " over "
+                << send_channel_->info() << " (to next) and " << recv_channel_->info() << " (from previous), "
+                << chunk_size_ << "-byte chunks, " << depth_ << " in flight";
+        TRACE_OUT;
+    }
+
+    RingAllReduce::~RingAllReduce()
+    {
+        TRACE_IN;
+        VLOG(3) << "Releasing " << info() << ", wrote " << get_num_chunks() << " chunk(s), stalled "
+                << get_num_stalls() << " time(s) for the credits";
+        TRACE_OUT;
+    }
+
+    void RingAllReduce::allreduce(size_t count,        // how many elements
+                                  ReduceDataType type, // the type of the elements
+                                  ReduceOp op)         // the reduction
+    {
+        size_t element_size = reduce_type_size(type);
+        CHECK(count >= num_ranks_) << info() << " cuts the vector into " << num_ranks_
+                                   << " segments, it cannot reduce " << count << " element(s)";
+        CHECK(count * element_size <= max_bytes_) << info() << " holds " << max_bytes_ << " bytes, it cannot reduce "
+                                                  << count << " " << reduce_type_to_str(type) << " elements";
+        CHECK(link_->get_num_sent() == link_->get_num_consumed()) << info() << " is reentered before the last allreduce is done";
+
+        uint64_t max_segment_bytes = (count + num_ranks_ - 1) / num_ranks_ * element_size;
+        plan_.count = count;
+        plan_.element_size = element_size;
+        plan_.type = type;
+        plan_.op = op;
+        plan_.chunks_per_segment = std::max<uint64_t>(1, (max_segment_bytes + chunk_size_ - 1) / chunk_size_);
+        plan_.num_chunks = 2 * (num_ranks_ - 1) * plan_.chunks_per_segment;
+        base_ = link_->get_num_sent();
+        HOT_VLOG_EVERY_N(3, SHOWN_LOG_EVERN_N) << info() << " reduces " << count << " " << reduce_type_to_str(type)
+                                           << " elements by " << reduce_op_to_str(op) << " in " << plan_.num_chunks
+                                           << " chunks";
+
+        bool shared_cq = send_channel_->get_completQ() == recv_channel_->get_completQ();
+        while (link_->get_num_sent() - base_ < plan_.num_chunks || link_->get_num_consumed() - base_ < plan_.num_chunks ||
+               !link_->idle())
+        {
+            poll_channel(send_channel_);
+            if (!shared_cq)
+                poll_channel(recv_channel_);
+            do { // the ready chunks go out before the next arrived one is reduced, so the wire is kept busy
+                while (try_send())
+                    ;
+                link_->write_credit();
+            } while (consume_next());
+        }
+    }
+
+    void RingAllReduce::chunk_range(uint64_t segment, // which segment of the vector
+                                    uint64_t chunk,   // which chunk of the segment
+                                    size_t *begin,    // the first element of the chunk
+                                    size_t *length)   // how many elements of the chunk
+    {
+        size_t segment_begin = segment * plan_.count / num_ranks_;
+        size_t segment_length = (segment + 1) * plan_.count / num_ranks_ - segment_begin;
+        size_t chunk_begin = chunk * segment_length / plan_.chunks_per_segment;
+        size_t chunk_end = (chunk + 1) * segment_length / plan_.chunks_per_segment;
+        *begin = segment_begin + chunk_begin;
+        *length = chunk_end - chunk_begin;
+    }
+
+    void RingAllReduce::locate_send(uint64_t index, size_t *begin, size_t *length)
+    {
+        uint64_t step = index / plan_.chunks_per_segment;
+        uint64_t segment = step < num_ranks_ - 1
+                               ? (rank_ + num_ranks_ - step) % num_ranks_                      // reduce-scatter
+                               : (rank_ + 1 + num_ranks_ - (step - num_ranks_ + 1)) % num_ranks_; // allgather
+        chunk_range(segment, index % plan_.chunks_per_segment, begin, length);
+    }
+
+    void RingAllReduce::locate_recv(uint64_t index, size_t *begin, size_t *length)
+    {
+        uint64_t step = index / plan_.chunks_per_segment;
+        uint64_t segment = step < num_ranks_ - 1
+                               ? (rank_ + 2 * num_ranks_ - step - 1) % num_ranks_             // reduce-scatter
+                               : (rank_ + num_ranks_ - (step - num_ranks_ + 1)) % num_ranks_; // allgather
+        chunk_range(segment, index % plan_.chunks_per_segment, begin, length);
+    }
+
+    bool RingAllReduce::try_send()
+    {
+        uint64_t index = link_->get_num_sent() - base_;
+        if (index >= plan_.num_chunks)
+            return false;
+        // past the first step, a chunk carries what the previous rank sent one step earlier
+        if (index >= plan_.chunks_per_segment && link_->get_num_consumed() - base_ <= index - plan_.chunks_per_segment)
+            return false;
+
+        size_t begin, length;
+        locate_send(index, &begin, &length);
+        BufferSlice slice;
+        slice.buffer = work_.get();
+        slice.offset = begin * plan_.element_size;
+        slice.length = length * plan_.element_size;
+        return link_->write_chunk(&slice, (uint32_t)link_->get_num_sent());
+    }
+
+    bool RingAllReduce::consume_next()
+    {
+        uint64_t consumed = link_->get_num_consumed();
+        if (!link_->has_arrival() || consumed - base_ >= plan_.num_chunks)
+            return false;
+        CHECK(link_->next_arrival() == (uint32_t)consumed) << "Chunk " << link_->next_arrival() << " arrived in "
+                                                            << info() << ", while chunk " << (uint32_t)consumed
+                                                            << " is expected";
+        uint64_t index = consumed - base_;
+        size_t begin, length;
+        locate_recv(index, &begin, &length);
+        uint8_t *dst = (uint8_t *)work_->data_ptr + begin * plan_.element_size;
+        uint8_t *src = link_->next_slot();
+        if (index / plan_.chunks_per_segment < num_ranks_ - 1)
+            reduce_buffers(dst, src, length, plan_.type, plan_.op);
+        else
+            memcpy(dst, src, length * plan_.element_size);
+        link_->release_slot();
+        return true;
+    }
+
+    void RingAllReduce::poll_channel(RDMAChannel *channel)
+    {
+        struct ibv_wc wc[ALLREDUCE_POLL_BATCH];
+        int num_cqes = channel->poll_cq_batch(wc, ALLREDUCE_POLL_BATCH);
+        for (int index = 0; index < num_cqes; index++)
+            link_->on_cqe(&wc[index]);
+    }
+
+}; // end namespace rdma_core
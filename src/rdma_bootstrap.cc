@@ -0,0 +1,284 @@
+#include "rdma_bootstrap.h"
+#include "util/logging.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+namespace rdma_core
+{
+#define EVENT_FD_TAG (~0ULL) // epoll data of the event fd, the sockets carry the handshake index
+#define MAX_EPOLL_EVENTS 64
+
+    RDMABootstrap::RDMABootstrap(uint32_t num_workers, std::string bootstrap_info) :
+        bootstrap_info_(bootstrap_info)
+    {
+        TRACE_IN;
+        if (num_workers == 0)
+            num_workers = std::thread::hardware_concurrency();
+        num_workers = std::max(1u, std::min(num_workers, (uint32_t)BOOTSTRAP_MAX_WORKERS));
+
+        epoll_fd_ = epoll_create1(EPOLL_CLOEXEC);
+        CHECK(epoll_fd_ >= 0) << "Failed to create epoll fd for " << info() << ", because: " << strerror(errno);
+        event_fd_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        CHECK(event_fd_ >= 0) << "Failed to create event fd for " << info() << ", because: " << strerror(errno);
+        struct epoll_event ev;
+        memset(&ev, 0, sizeof(ev));
+        ev.events = EPOLLIN;
+        ev.data.u64 = EVENT_FD_TAG;
+        CHECK(epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, event_fd_, &ev) == 0)
+            << "Failed to watch the event fd of " << info() << ", because: " << strerror(errno);
+
+        for (uint32_t worker_index = 0; worker_index < num_workers; worker_index++)
+            workers_.push_back(std::thread(&RDMABootstrap::worker_loop, this));
+        VLOG(3) << "Creating " << info() << " with " << num_workers << " worker(s)";
+        TRACE_OUT;
+    }
+
+    RDMABootstrap::~RDMABootstrap()
+    {
+        TRACE_IN;
+        {
+            std::lock_guard<std::mutex> lock(task_lock_);
+            stopping_ = true;
+        }
+        task_cond_.notify_all();
+        for (auto &worker : workers_)
+            worker.join();
+        close(event_fd_);
+        close(epoll_fd_);
+        VLOG(3) << "Releasing " << info();
+        TRACE_OUT;
+    }
+
+    void RDMABootstrap::submit(std::function<void()> task)
+    {
+        {
+            std::lock_guard<std::mutex> lock(task_lock_);
+            tasks_.push_back(std::move(task));
+        }
+        task_cond_.notify_one();
+    }
+
+    void RDMABootstrap::wait_all()
+    {
+        std::unique_lock<std::mutex> lock(task_lock_);
+        idle_cond_.wait(lock, [this]
+                        { return tasks_.empty() && running_tasks_ == 0; });
+    }
+
+    void RDMABootstrap::worker_loop()
+    {
+        std::unique_lock<std::mutex> lock(task_lock_);
+        do
+        {
+            task_cond_.wait(lock, [this]
+                            { return stopping_ || !tasks_.empty(); });
+            if (tasks_.empty()) // stopping
+                break;
+            std::function<void()> task = std::move(tasks_.front());
+            tasks_.pop_front();
+            running_tasks_++;
+            lock.unlock();
+            task();
+            lock.lock();
+            if (--running_tasks_ == 0 && tasks_.empty())
+                idle_cond_.notify_all();
+        } while (true);
+    }
+
+    void RDMABootstrap::post_ready(uint32_t index)
+    {
+        {
+            std::lock_guard<std::mutex> lock(task_lock_);
+            ready_handshakes_.push_back(index);
+        }
+        uint64_t one = 1;
+        CHECK(write(event_fd_, &one, sizeof(one)) == sizeof(one))
+            << "Failed to wake up " << info() << ", because: " << strerror(errno);
+    }
+
+    void RDMABootstrap::connect_all(std::vector<RDMAEndPoint *> &endpoints)
+    {
+        TRACE_IN;
+        uint32_t num_endpoints = endpoints.size();
+        std::vector<Handshake> handshakes(num_endpoints);
+        for (uint32_t index = 0; index < num_endpoints; index++)
+        {
+            Handshake &handshake = handshakes[index];
+            handshake.endpoint = endpoints[index];
+            handshake.fd = endpoints[index]->get_socket();
+            submit([this, &handshake, index]
+                   {
+                       std::vector<AdapterInfo> local_infos = handshake.endpoint->load_channels();
+                       uint32_t num_channels = local_infos.size();
+                       handshake.out_data.resize(sizeof(num_channels) + sizeof(AdapterInfo) * num_channels);
+                       memcpy(handshake.out_data.data(), &num_channels, sizeof(num_channels));
+                       memcpy(handshake.out_data.data() + sizeof(num_channels), local_infos.data(),
+                              sizeof(AdapterInfo) * num_channels);
+                       post_ready(index);
+                   });
+        }
+
+        uint32_t num_done = 0;
+        struct epoll_event events[MAX_EPOLL_EVENTS];
+        while (num_done < num_endpoints)
+        {
+            int num_ready = epoll_wait(epoll_fd_, events, MAX_EPOLL_EVENTS, -1);
+            if (num_ready < 0 && errno == EINTR)
+                continue;
+            CHECK(num_ready >= 0) << "Failed to wait for the handshakes in " << info() << ", because: " << strerror(errno);
+
+            for (int ready_index = 0; ready_index < num_ready; ready_index++)
+            {
+                if (events[ready_index].data.u64 == EVENT_FD_TAG)
+                { // the workers are done with some handshakes, move them to the epoll loop
+                    uint64_t num_events = 0;
+                    if (read(event_fd_, &num_events, sizeof(num_events)) < 0 && errno != EAGAIN)
+                        LOG(FATAL) << "Failed to read the event fd of " << info() << ", because: " << strerror(errno);
+                    std::vector<uint32_t> ready_handshakes;
+                    {
+                        std::lock_guard<std::mutex> lock(task_lock_);
+                        ready_handshakes.swap(ready_handshakes_);
+                    }
+                    for (uint32_t index : ready_handshakes)
+                    {
+                        Handshake &handshake = handshakes[index];
+                        handshake.state = (handshake.state == HandshakeState::LOADING) ? HandshakeState::EXCHANGING
+                                                                                       : HandshakeState::SYNCING;
+                        enter_io_state(handshake, index);
+                    }
+                    continue;
+                }
+
+                uint32_t index = events[ready_index].data.u64;
+                Handshake &handshake = handshakes[index];
+                if (!progress_io(handshake, index))
+                    continue;
+                leave_io_state(handshake, index);
+                if (handshake.state == HandshakeState::CONNECTING)
+                {
+                    submit([this, &handshake, index]
+                           {
+                               handshake.endpoint->connect_channels(handshake.peer_infos);
+                               post_ready(index);
+                           });
+                }
+                else
+                {
+                    num_done++;
+                    VLOG(3) << "The channels of " << handshake.endpoint->get_id() << " are connected, "
+                            << num_done << "/" << num_endpoints;
+                }
+            }
+        }
+        wait_all();
+        TRACE_OUT;
+    }
+
+    void RDMABootstrap::enter_io_state(Handshake &handshake, uint32_t index)
+    {
+        if (handshake.state == HandshakeState::SYNCING)
+        {
+            handshake.out_data.assign(1, 'Q');
+            handshake.in_expected = 1;
+        }
+        else // EXCHANGING, the out_data is packed by the worker, the number of the peer channels comes first
+        {
+            handshake.in_expected = sizeof(uint32_t);
+        }
+        handshake.out_offset = 0;
+        handshake.in_data.resize(handshake.in_expected);
+        handshake.in_offset = 0;
+
+        handshake.socket_flags = fcntl(handshake.fd, F_GETFL);
+        CHECK(fcntl(handshake.fd, F_SETFL, handshake.socket_flags | O_NONBLOCK) == 0)
+            << "Failed to set the socket of " << handshake.endpoint->get_id() << " non-blocking";
+        struct epoll_event ev;
+        memset(&ev, 0, sizeof(ev));
+        ev.events = EPOLLIN | EPOLLOUT;
+        ev.data.u64 = index;
+        CHECK(epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, handshake.fd, &ev) == 0)
+            << "Failed to watch the socket of " << handshake.endpoint->get_id() << ", because: " << strerror(errno);
+    }
+
+    bool RDMABootstrap::progress_io(Handshake &handshake, uint32_t index)
+    {
+        size_t out_length = handshake.out_data.size();
+        if (handshake.out_offset < out_length)
+        {
+            while (handshake.out_offset < out_length)
+            {
+                ssize_t sent = send(handshake.fd, handshake.out_data.data() + handshake.out_offset,
+                                    out_length - handshake.out_offset, MSG_NOSIGNAL);
+                if (sent < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+                    break;
+                CHECK(sent >= 0) << "Failed to send the handshake of " << handshake.endpoint->get_id()
+                                 << ", because: " << strerror(errno);
+                handshake.out_offset += sent;
+            }
+            if (handshake.out_offset == out_length)
+            { // nothing left to send, stop watching for writability
+                struct epoll_event ev;
+                memset(&ev, 0, sizeof(ev));
+                ev.events = EPOLLIN;
+                ev.data.u64 = index;
+                CHECK(epoll_ctl(epoll_fd_, EPOLL_CTL_MOD, handshake.fd, &ev) == 0)
+                    << "Failed to watch the socket of " << handshake.endpoint->get_id() << ", because: " << strerror(errno);
+            }
+        }
+
+        while (handshake.in_offset < handshake.in_expected)
+        {
+            ssize_t received = recv(handshake.fd, handshake.in_data.data() + handshake.in_offset,
+                                    handshake.in_expected - handshake.in_offset, 0);
+            if (received < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+                break;
+            CHECK(received > 0) << "Failed to receive the handshake of " << handshake.endpoint->get_id()
+                                << ", because: " << (received == 0 ? "the peer is closed" : strerror(errno));
+            handshake.in_offset += received;
+
+            if (handshake.state == HandshakeState::EXCHANGING && handshake.in_expected == sizeof(uint32_t) &&
+                handshake.in_offset == sizeof(uint32_t))
+            { // the number of the peer channels is known, so is the length of their AdapterInfo
+                uint32_t num_channels = 0, peer_num_channels = 0;
+                memcpy(&num_channels, handshake.out_data.data(), sizeof(num_channels));
+                memcpy(&peer_num_channels, handshake.in_data.data(), sizeof(peer_num_channels));
+                CHECK(num_channels == peer_num_channels)
+                    << handshake.endpoint->get_id() << " holds " << num_channels << " channel(s), while its peer holds "
+                    << peer_num_channels << ", check num_data_channels/use_ctrl_channel on both sides";
+                handshake.in_expected += sizeof(AdapterInfo) * peer_num_channels;
+                handshake.in_data.resize(handshake.in_expected);
+            }
+        }
+        return handshake.out_offset == out_length && handshake.in_offset == handshake.in_expected;
+    }
+
+    void RDMABootstrap::leave_io_state(Handshake &handshake, uint32_t index)
+    {
+        CHECK(epoll_ctl(epoll_fd_, EPOLL_CTL_DEL, handshake.fd, nullptr) == 0)
+            << "Failed to unwatch the socket of " << handshake.endpoint->get_id() << ", because: " << strerror(errno);
+        // TCPConnector works on blocking sockets
+        CHECK(fcntl(handshake.fd, F_SETFL, handshake.socket_flags) == 0)
+            << "Failed to restore the socket of " << handshake.endpoint->get_id();
+
+        if (handshake.state == HandshakeState::EXCHANGING)
+        {
+            uint32_t num_channels = (handshake.in_expected - sizeof(uint32_t)) / sizeof(AdapterInfo);
+            handshake.peer_infos.resize(num_channels);
+            memcpy(handshake.peer_infos.data(), handshake.in_data.data() + sizeof(uint32_t),
+                   sizeof(AdapterInfo) * num_channels);
+            handshake.state = HandshakeState::CONNECTING;
+        }
+        else // SYNCING
+        {
+            handshake.state = HandshakeState::DONE;
+        }
+        VLOG(3) << "Handshake " << index << " of " << info() << " moves to state " << static_cast<uint32_t>(handshake.state);
+    }
+
+}; // end namespace rdma_core
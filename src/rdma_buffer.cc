@@ -4,25 +4,101 @@
 #include "util/logging.h"
 
 #include "rdma_buffer.h"
+#include "rdma_device.h"
+#include "rdma_memory_pool.h"
 
+#include <errno.h>
 #include <stdlib.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
 
 // https://libs.garden/cpp/search?q=rdma&page=2
 
 #define HUGEPAGE_ALIGN (2 * 1024 * 1024)
+#define GIGA_HUGEPAGE_ALIGN (1024 * 1024 * 1024)
+#define MAP_HUGE_SHIFT_BITS 26 // MAP_HUGE_SHIFT, the log2 of the page size is encoded from this bit
+#define MPOL_BIND_MODE 2       // MPOL_BIND in <numaif.h>, without linking libnuma
 #define SHMAT_ADDR (void *)(0x0UL)
 #define SHMAT_FLAGS (0)
 // hugepage configure: https://docs.01.org/clearlinux/latest/guides/maintenance/configure-hugepages.html
 
 namespace rdma_core
 {
+    static inline size_t align_up(size_t size, size_t alignment)
+    {
+        return (size + alignment - 1) / alignment * alignment;
+    }
+
+    // map anonymous memory with the hugepages of the policy, falling back to smaller pages
+    static void *map_memory(size_t buffer_size, AllocPolicy policy, size_t &mapped_size, std::string buffer_name)
+    {
+        void *addr = MAP_FAILED;
+        if (policy.huge_page == HugePagePolicy::HUGE_1GB)
+        {
+            mapped_size = align_up(buffer_size, GIGA_HUGEPAGE_ALIGN);
+            addr = mmap(nullptr, mapped_size, PROT_READ | PROT_WRITE,
+                        MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB | (30 << MAP_HUGE_SHIFT_BITS), -1, 0);
+            if (addr == MAP_FAILED)
+                LOG(WARNING) << "No 1GB hugepages for (" << buffer_name << "): " << strerror(errno)
+                             << ", falling back to 2MB hugepages";
+        }
+        if (addr == MAP_FAILED && policy.huge_page != HugePagePolicy::NONE)
+        {
+            mapped_size = align_up(buffer_size, HUGEPAGE_ALIGN);
+            addr = mmap(nullptr, mapped_size, PROT_READ | PROT_WRITE,
+                        MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB | (21 << MAP_HUGE_SHIFT_BITS), -1, 0);
+            if (addr == MAP_FAILED)
+                LOG(WARNING) << "No 2MB hugepages for (" << buffer_name << "): " << strerror(errno)
+                             << ", falling back to normal pages";
+        }
+        if (addr == MAP_FAILED)
+        {
+            mapped_size = align_up(buffer_size, policy.huge_page == HugePagePolicy::NONE ? sysconf(_SC_PAGESIZE)
+                                                                                         : HUGEPAGE_ALIGN);
+            addr = mmap(nullptr, mapped_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+            CHECK(addr != MAP_FAILED) << "Failed to map mem for (" << buffer_name << "): " << strerror(errno);
+            if (policy.huge_page != HugePagePolicy::NONE) // transparent hugepages, if enabled by the kernel
+                madvise(addr, mapped_size, MADV_HUGEPAGE);
+        }
+
+        if (policy.numa_node >= 0)
+        { // bind before the first touch, so the pages are faulted on that node
+            unsigned long node_mask[16] = {0};
+            CHECK(policy.numa_node < (int)(sizeof(node_mask) * 8)) << "Invalid numa node: " << policy.numa_node;
+            node_mask[policy.numa_node / 64] |= 1UL << (policy.numa_node % 64);
+            if (syscall(SYS_mbind, addr, mapped_size, MPOL_BIND_MODE, node_mask, sizeof(node_mask) * 8, 0) != 0)
+                LOG(WARNING) << "Failed to bind (" << buffer_name << ") to numa node " << policy.numa_node
+                             << ": " << strerror(errno);
+        }
+        return addr;
+    }
+
+    AllocPolicy RDMABuffer::device_local_policy(RDMAAdapter *adapter, HugePagePolicy huge_page)
+    {
+        CHECK(adapter != nullptr) << "Cannot query the numa node of an empty adapter";
+        CHECK(adapter->get_device() != nullptr) << adapter->info() << " has not opened its device";
+        AllocPolicy policy;
+        policy.huge_page = huge_page;
+        policy.numa_node = adapter->get_device()->get_numa_node();
+        return policy;
+    }
+
     bool RDMABuffer::register_in_channel(RDMAAdapter *channel_)
     {
         TRACING("");
         CHECK(!is_sub_buffer_) << "[Error]: sub-buffer cannot register in channel";
         owned_by_channel = channel_;
-        this->mr_ = channel_->register_mem(data_ptr, buffer_size,
-                                           0, buffer_name);
+        if (pool_ != nullptr)
+        { // already registered in the chunk of the pool, which is valid for any channel on the same pd
+            CHECK(channel_->get_protected_domain() == pool_->get_protected_domain())
+                << info() << " is carved from " << pool_->info() << ", which is not on the pd of " << channel_->info();
+        }
+        else
+        {
+            this->mr_ = channel_->register_mem(data_ptr, buffer_size,
+                                               0, buffer_name);
+        }
         for (auto *each_block : buffer_mgr_) //update the buffer mgr
         {
             each_block->owned_by_channel = owned_by_channel;
@@ -42,11 +118,13 @@ namespace rdma_core
         CHECK(!is_sub_buffer_) << "Subbuffer cannot register in channel";
 
         CHECK(mr_ != nullptr) << "Illegal mr for " << buffer_name;
-        channel_->deregister_mem(mr_, buffer_name);
+        if (pool_ == nullptr) // the mr of a pooled buffer belongs to the pool
+            channel_->deregister_mem(mr_, buffer_name);
         channel_->remove_buffer(this);
 
         owned_by_channel = nullptr;
-        mr_ = nullptr;
+        if (pool_ == nullptr)
+            mr_ = nullptr;
         TRACE_OUT;
         //VLOG(3) << "[TRACING-OUT] function \"" << __FUNCTION__ << "\"";
         return false;
@@ -104,7 +182,21 @@ namespace rdma_core
                 each_buff->mr_ = nullptr;
                 each_buff->is_initialized = false;
             }
-            free((void *)data_ptr);
+            if (pool_ != nullptr)
+            {
+                RDMAMemoryPool::PoolBlock block;
+                block.addr = data_ptr;
+                block.mr_ = mr_;
+                pool_->deallocate(block, buffer_size);
+            }
+            else if (mapped_size_ > 0)
+            {
+                munmap((void *)data_ptr, mapped_size_);
+            }
+            else
+            {
+                free((void *)data_ptr);
+            }
             this->data_ptr = nullptr;
             this->mr_ = nullptr;
             this->is_initialized = false;
@@ -116,10 +208,11 @@ namespace rdma_core
 
     RDMABuffer::RDMABuffer(size_t buffer_size_in_byte, uint32_t num_blocks,
                            std::string buffer_info, RDMABuffer *base_buffer,
-                           bool is_sub_buffer) :
+                           bool is_sub_buffer, RDMAMemoryPool *pool,
+                           AllocPolicy policy) :
         buffer_name(buffer_info),
         buffer_size((size_t)buffer_size_in_byte * (size_t)num_blocks),
-        is_sub_buffer_(is_sub_buffer), blocks_(num_blocks)
+        is_sub_buffer_(is_sub_buffer), blocks_(num_blocks), pool_(pool)
     {
         TRACING("Creating RDMABuffer");
         if (is_sub_buffer_)
@@ -140,12 +233,29 @@ namespace rdma_core
             CHECK(buffer_size > 0) << "Error of allocating mem buf with size: "
                                    << buffer_size;
 
-            int ret = 0;
-            if (0 != (ret = posix_memalign((void **)&data_ptr, sysconf(_SC_PAGESIZE), buffer_size)))
-                LOG(FATAL) << "[error] posix_memalign: " << strerror(ret);
+            if (pool_ != nullptr)
+            { // no syscall, the block is carved from a registered chunk
+                RDMAMemoryPool::PoolBlock block = pool_->allocate(buffer_size);
+                data_ptr = block.addr;
+                mr_ = block.mr_;
+                VLOG(3) << RLOG::make_string("[OK] carving mem for (%s) from %s:  @%p, with size: %lu",
+                                             buffer_name.c_str(), pool_->info().c_str(), data_ptr, buffer_size);
+            }
+            else if (policy.huge_page != HugePagePolicy::NONE || policy.numa_node >= 0)
+            {
+                data_ptr = (uint8_t *)map_memory(buffer_size, policy, mapped_size_, buffer_name);
+                LOG(INFO) << RLOG::make_string("[OK] mapping mem for (%s):  @%p, with size: %lu (%lu mapped), numa node: %d",
+                                               buffer_name.c_str(), data_ptr, buffer_size, mapped_size_, policy.numa_node);
+            }
+            else
+            {
+                int ret = 0;
+                if (0 != (ret = posix_memalign((void **)&data_ptr, sysconf(_SC_PAGESIZE), buffer_size)))
+                    LOG(FATAL) << "[error] posix_memalign: " << strerror(ret);
 
-            LOG(INFO) << RLOG::make_string("[OK] allocating mem for (%s):  @%p, with size: %lu",
-                                           buffer_name.c_str(), data_ptr, buffer_size);
+                LOG(INFO) << RLOG::make_string("[OK] allocating mem for (%s):  @%p, with size: %lu",
+                                               buffer_name.c_str(), data_ptr, buffer_size);
+            }
 
             { // split the buffer
                 VLOG(3) << "Spliting the buffer " << buffer_name << " into "
@@ -161,7 +271,8 @@ namespace rdma_core
                 }
             }
 
-            memset(data_ptr, 0, buffer_size_in_byte); //clean all the mem buf
+            if (pool_ == nullptr)
+                memset(data_ptr, 0, buffer_size_in_byte); //clean all the mem buf
             base_buffer_ = this;
         }
 
@@ -171,9 +282,11 @@ namespace rdma_core
 
     RDMABuffer *RDMABuffer::allocate_buffer(size_t buffer_size,
                                             uint32_t num_blocks,
-                                            std::string buffer_info)
+                                            std::string buffer_info,
+                                            RDMAMemoryPool *pool,
+                                            AllocPolicy policy)
     {
-        return new RDMABuffer(buffer_size, num_blocks, buffer_info);
+        return new RDMABuffer(buffer_size, num_blocks, buffer_info, nullptr, false, pool, policy);
     }
 
     std::string RDMABuffer::to_string()
@@ -208,7 +321,7 @@ namespace rdma_core
                              uint32_t data_length)
     {
         TRACE_IN;
-        VLOG_EVERY_N(3, SHOWN_LOG_EVERN_N) << "fill_in the buffer with length: " << data_length;
+        HOT_VLOG_EVERY_N(3, SHOWN_LOG_EVERN_N) << "fill_in the buffer with length: " << data_length;
         CHECK(data_length <= buffer_size)
             << "Error, the data length cannot be larger than the whole buffer size."
             << ", Data length = " << data_length << ", Buffer info: " << info();
@@ -220,7 +333,7 @@ namespace rdma_core
     bool RDMABuffer::clear() //clear the buffer
     {
         TRACE_IN;
-        VLOG_EVERY_N(3, SHOWN_LOG_EVERN_N) << "Clear the buffer";
+        HOT_VLOG_EVERY_N(3, SHOWN_LOG_EVERN_N) << "Clear the buffer";
         memset(data_ptr, 0, buffer_size);
         TRACE_OUT;
         return true;
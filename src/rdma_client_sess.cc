@@ -61,9 +61,13 @@ namespace rdma_core
         VLOG(3) << "RDMAClientSession is reconfiguring the channel&adapter";
         for (auto &each_endpoint : end_point_mgr_)
         {
-            auto &a_config = each_endpoint->get_channel()->get_config();
-            a_config.using_shared_cq = false;
-            //a_config.traffic_class = 64;
+            for (auto *each_channel : each_endpoint->get_all_channels())
+            {
+                auto &a_config = each_channel->get_config();
+                a_config.using_shared_cq = false;
+                a_config.use_event_channel = work_env_.use_event;
+                //a_config.traffic_class = 64;
+            }
         }
     }
     void RDMAClientSession::post_connecting()
@@ -0,0 +1,211 @@
+#include "rdma_completion_engine.h"
+#include "rdma_config.h"
+#include "rdma_device.h"
+#include "util/logging.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <unistd.h>
+
+namespace rdma_core
+{
+#define IDLE_ROUNDS_PER_CLOCK_CHECK 64 // read the clock once per so many empty polls
+#define MAX_EPOLL_EVENTS 64
+
+    CompletionEngine::CompletionEngine(CompletionMode mode,
+                                       uint32_t busy_poll_budget_us,
+                                       uint32_t ack_batch,
+                                       std::string engine_info) :
+        engine_info_(engine_info),
+        mode_(mode),
+        busy_poll_budget_(busy_poll_budget_us),
+        ack_batch_(ack_batch)
+    {
+        TRACE_IN;
+        CHECK(ack_batch_ > 0) << "The ack batch of " << info() << " should be > 0";
+        if (mode_ != CompletionMode::BUSY_POLLING)
+        {
+            epoll_fd_ = epoll_create1(EPOLL_CLOEXEC);
+            CHECK(epoll_fd_ >= 0) << "Failed to create epoll fd for " << info()
+                                  << ", because: " << strerror(errno);
+        }
+        last_activity_ = std::chrono::steady_clock::now();
+        VLOG(3) << "Creating " << info() << " in mode " << static_cast<uint32_t>(mode_)
+                << ", busy-poll budget: " << busy_poll_budget_us << " us, ack batch: " << ack_batch_;
+        TRACE_OUT;
+    }
+
+    CompletionEngine::~CompletionEngine()
+    {
+        TRACE_IN;
+        // all fetched events must be acked before the cq can be destroyed
+        for (auto &watched : watched_cqs_)
+        {
+            RDMADevice::real_ack_cq_events_(watched.cq, watched.unacked_events);
+            watched.unacked_events = 0;
+        }
+        if (epoll_fd_ >= 0)
+            close(epoll_fd_);
+        VLOG(3) << "Releasing " << info() << ", slept " << num_sleeps_ << " times, fetched "
+                << num_events_ << " events";
+        TRACE_OUT;
+    }
+
+    bool CompletionEngine::attach(RDMAAdapter *adapter)
+    {
+        TRACE_IN;
+        CHECK(adapter != nullptr) << "Cannot attach an empty adapter to " << info();
+        struct ibv_cq *cq = adapter->get_completQ();
+        CHECK(cq != nullptr) << adapter->info() << " has not created its completion queue";
+        for (auto &watched : watched_cqs_)
+        {
+            if (watched.cq == cq)
+            {
+                VLOG(3) << "The cq of " << adapter->info() << " is already watched by " << info();
+                TRACE_OUT;
+                return false;
+            }
+        }
+
+        WatchedCQ watched;
+        watched.cq = cq;
+        watched.adapter = adapter;
+        if (mode_ != CompletionMode::BUSY_POLLING)
+        {
+            watched.channel = adapter->get_event_channel();
+            CHECK(watched.channel != nullptr) << "[ConfigError], " << adapter->info()
+                                              << " works in active mode, set use_event_channel to wait for events";
+
+            bool channel_is_watched = false;
+            for (auto &each : watched_cqs_)
+                channel_is_watched |= (each.channel == watched.channel);
+            if (!channel_is_watched)
+            {
+                int flags = fcntl(watched.channel->fd, F_GETFL);
+                CHECK(fcntl(watched.channel->fd, F_SETFL, flags | O_NONBLOCK) == 0)
+                    << "Failed to set the event channel of " << adapter->info() << " non-blocking";
+
+                struct epoll_event ev;
+                memset(&ev, 0, sizeof(ev));
+                ev.events = EPOLLIN;
+                ev.data.ptr = watched.channel;
+                CHECK(epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, watched.channel->fd, &ev) == 0)
+                    << "Failed to watch the event channel of " << adapter->info()
+                    << ", because: " << strerror(errno);
+            }
+        }
+        watched_cqs_.push_back(watched);
+        VLOG(3) << "Attach the cq (" << cq << ") of " << adapter->info() << " to " << info();
+        TRACE_OUT;
+        return true;
+    }
+
+    int CompletionEngine::poll_once(struct ibv_wc *wc, int num_wqe)
+    {
+        uint32_t num_cqs = watched_cqs_.size();
+        for (uint32_t round = 0; round < num_cqs; round++)
+        {
+            WatchedCQ &watched = watched_cqs_[next_cq_];
+            next_cq_ = (next_cq_ + 1 == num_cqs) ? 0 : next_cq_ + 1;
+            int num_polled = watched.adapter->poll_cq_batch(wc, num_wqe);
+            CHECK(num_polled >= 0) << "Failed to poll the cq (" << watched.cq << ") in " << info();
+            if (num_polled > 0)
+                return num_polled;
+        }
+        return 0;
+    }
+
+    bool CompletionEngine::should_keep_spinning()
+    {
+        if (mode_ == CompletionMode::BUSY_POLLING)
+            return true;
+        if (mode_ == CompletionMode::EVENT_DRIVEN)
+            return false;
+        if (++idle_rounds_ < IDLE_ROUNDS_PER_CLOCK_CHECK)
+            return true;
+        idle_rounds_ = 0;
+        return std::chrono::steady_clock::now() - last_activity_ < busy_poll_budget_;
+    }
+
+    void CompletionEngine::arm_all()
+    {
+        for (auto &watched : watched_cqs_)
+        {
+            if (watched.armed)
+                continue;
+            RDMADevice::real_req_notify_cq_(watched.cq);
+            watched.armed = true;
+        }
+    }
+
+    void CompletionEngine::wait_for_events()
+    {
+        struct epoll_event events[MAX_EPOLL_EVENTS];
+        int num_ready = 0;
+        do
+        {
+            num_ready = epoll_wait(epoll_fd_, events, MAX_EPOLL_EVENTS, -1);
+        } while (num_ready < 0 && errno == EINTR);
+        CHECK(num_ready >= 0) << "Failed to wait for cq events in " << info() << ", because: " << strerror(errno);
+        num_sleeps_++;
+
+        for (int ready_index = 0; ready_index < num_ready; ready_index++)
+        {
+            struct ibv_comp_channel *channel = (struct ibv_comp_channel *)events[ready_index].data.ptr;
+            struct ibv_cq *ev_cq = nullptr;
+            while ((ev_cq = RDMADevice::real_get_cq_event_(channel)) != nullptr)
+            {
+                num_events_++;
+                for (auto &watched : watched_cqs_)
+                {
+                    if (watched.cq != ev_cq)
+                        continue;
+                    watched.armed = false; // an event is raised only once per arming
+                    if (++watched.unacked_events >= ack_batch_)
+                    {
+                        RDMADevice::real_ack_cq_events_(watched.cq, watched.unacked_events);
+                        watched.unacked_events = 0;
+                    }
+                    break;
+                }
+            }
+        }
+    }
+
+    int CompletionEngine::poll_completions(struct ibv_wc *wc, int num_wqe)
+    {
+        CHECK(!watched_cqs_.empty()) << "No cq is attached to " << info();
+        do
+        {
+            int num_polled = poll_once(wc, num_wqe);
+            if (num_polled > 0)
+            {
+                if (mode_ == CompletionMode::ADAPTIVE)
+                {
+                    last_activity_ = std::chrono::steady_clock::now();
+                    idle_rounds_ = 0;
+                }
+                return num_polled;
+            }
+            if (should_keep_spinning())
+                continue;
+
+            // the cqes arriving between the last poll and arming raise no event, so poll once more
+            arm_all();
+            num_polled = poll_once(wc, num_wqe);
+            if (num_polled > 0)
+            {
+                last_activity_ = std::chrono::steady_clock::now();
+                return num_polled;
+            }
+
+            wait_for_events();
+            last_activity_ = std::chrono::steady_clock::now(); // busy-poll a budget after waking up
+            idle_rounds_ = 0;
+        } while (true);
+        return 0;
+    }
+
+}; // end namespace rdma_core
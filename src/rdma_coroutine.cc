@@ -0,0 +1,229 @@
+#include "rdma_coroutine.h"
+#include "util/logging.h"
+
+#include <algorithm>
+#include <new>
+
+namespace rdma_core
+{
+    namespace
+    {
+        struct FreeFrame
+        {
+            FreeFrame *next = nullptr; // the next free frame of the same size class
+        };
+
+        struct FrameFreeLists
+        {
+            FreeFrame *heads[FRAME_SIZE_CLASSES] = {nullptr}; // one list per size class
+            size_t num_cached = 0;                            // frames in all lists
+
+            ~FrameFreeLists()
+            {
+                for (auto *&head : heads)
+                {
+                    while (head != nullptr)
+                    {
+                        FreeFrame *frame = head;
+                        head = frame->next;
+                        ::operator delete(frame);
+                    }
+                }
+            }
+        };
+
+        thread_local FrameFreeLists frame_free_lists;
+
+        inline size_t size_class_of(size_t size_in_bytes) // FRAME_SIZE_CLASSES for the frames not pooled
+        {
+            return std::min<size_t>((size_in_bytes + FRAME_ALIGN - 1) / FRAME_ALIGN, FRAME_SIZE_CLASSES + 1) - 1;
+        }
+    }; // end anonymous namespace
+
+    void *RDMAFramePool::allocate(size_t size_in_bytes)
+    {
+        size_t size_class = size_class_of(size_in_bytes);
+        if (size_class >= FRAME_SIZE_CLASSES)
+            return ::operator new(size_in_bytes);
+
+        FreeFrame *&head = frame_free_lists.heads[size_class];
+        if (head == nullptr)
+            return ::operator new((size_class + 1) * FRAME_ALIGN);
+        FreeFrame *frame = head;
+        head = frame->next;
+        frame_free_lists.num_cached--;
+        return frame;
+    }
+
+    void RDMAFramePool::release(void *frame, size_t size_in_bytes)
+    {
+        size_t size_class = size_class_of(size_in_bytes);
+        if (size_class >= FRAME_SIZE_CLASSES)
+        {
+            ::operator delete(frame);
+            return;
+        }
+        FreeFrame *free_frame = new (frame) FreeFrame();
+        free_frame->next = frame_free_lists.heads[size_class];
+        frame_free_lists.heads[size_class] = free_frame;
+        frame_free_lists.num_cached++;
+    }
+
+    size_t RDMAFramePool::get_num_cached()
+    {
+        return frame_free_lists.num_cached;
+    }
+
+    void RDMAAwaiter::await_suspend(RDMATask::Handle handle)
+    {
+        CHECK(handle.promise().scheduler == scheduler_)
+            << "Awaiting an operation of " << scheduler_->info() << " in a coroutine spawned elsewhere";
+        if (future_.valid())
+        {
+            future_.then(&RDMAScheduler::on_ready, handle.address());
+            return;
+        }
+        handle_ = handle;
+        scheduler_->slot_waiters_.push_back(this);
+    }
+
+    RDMAScheduler::RDMAScheduler(uint32_t max_pending, std::string scheduler_info) :
+        scheduler_info_(scheduler_info)
+    {
+        TRACE_IN;
+        futures_.reset(RDMAFutureTable::build_future_table(max_pending, scheduler_info));
+        ready_coroutines_.reserve(max_pending);
+        resuming_.reserve(max_pending);
+        VLOG(3) << "Creating " << info() << " with " << max_pending << " operation(s) in flight at most";
+        TRACE_OUT;
+    }
+
+    RDMAScheduler::~RDMAScheduler()
+    {
+        TRACE_IN;
+        if (num_alive_ != 0)
+            LOG(WARNING) << "Releasing " << info() << " with " << num_alive_ << " coroutine(s) not finished, "
+                         << slot_waiters_.size() << " of them waiting for a slot";
+        VLOG(3) << "Releasing " << info();
+        TRACE_OUT;
+    }
+
+    void RDMAScheduler::spawn(RDMATask task)
+    {
+        RDMATask::Handle handle = task.release();
+        CHECK(handle) << "Spawning an empty task in " << info();
+        handle.promise().scheduler = this;
+        ready_coroutines_.push_back(handle);
+        num_alive_++;
+    }
+
+    int RDMAScheduler::run_once()
+    {
+        futures_->progress(); // the callbacks queue the coroutines of the polled cqes
+        resuming_.swap(ready_coroutines_);
+        for (auto handle : resuming_)
+        {
+            handle.resume();
+            if (handle.done())
+            {
+                handle.destroy();
+                num_alive_--;
+            }
+        }
+        int num_resumed = resuming_.size();
+        resuming_.clear();
+        post_waiting(); // the resumed coroutines dropped the futures they awaited
+        return num_resumed;
+    }
+
+    void RDMAScheduler::run()
+    {
+        TRACE_IN;
+        while (num_alive_ > 0)
+            run_once();
+        TRACE_OUT;
+    }
+
+    RDMAAwaiter RDMAScheduler::send_remote(RDMAAdapter *adapter,          // the adapter to post on
+                                           RDMABuffer *buffer,            // placeholder of the data to send
+                                           uint32_t data_length_in_bytes, // data length to send
+                                           uint32_t msg_tag)              // tagging the message type to notify peer
+    {
+        attach_once(adapter);
+        return post_or_wait([=, this]()
+                            { return futures_->send_remote(adapter, buffer, data_length_in_bytes, msg_tag); });
+    }
+
+    RDMAAwaiter RDMAScheduler::recv_remote(RDMAAdapter *adapter,          // the adapter to post on
+                                           RDMABuffer *buffer,            // a placeholder that captures the recv data
+                                           uint32_t data_length_in_bytes) // data length to recv
+    {
+        attach_once(adapter);
+        return post_or_wait([=, this]()
+                            { return futures_->recv_remote(adapter, buffer, data_length_in_bytes); });
+    }
+
+    RDMAAwaiter RDMAScheduler::read_remote(RDMAAdapter *adapter,                            // the adapter to post on
+                                           RDMABuffer *buffer,                              // placeholder that cache the read data
+                                           uint32_t data_length_in_bytes,                   // data length to read
+                                           struct CommDescriptor *remote_buffer_descriptor) // remote buffer_describptor
+    {
+        attach_once(adapter);
+        return post_or_wait([=, this]()
+                            { return futures_->read_remote(adapter, buffer, data_length_in_bytes, remote_buffer_descriptor); });
+    }
+
+    RDMAAwaiter RDMAScheduler::write_remote(RDMAAdapter *adapter,                            // the adapter to post on
+                                            RDMABuffer *buffer,                              // the buffer for data to write
+                                            uint32_t data_length_in_bytes,                   // data length to write
+                                            struct CommDescriptor *remote_buffer_descriptor, // remote buffer_describptor
+                                            uint32_t msg_tag,                                // tagging the message type to notify peer
+                                            bool notify_peer)                                // notify peer explicit or not
+    {
+        attach_once(adapter);
+        return post_or_wait([=, this]()
+                            { return futures_->write_remote(adapter, buffer, data_length_in_bytes,
+                                                            remote_buffer_descriptor, msg_tag, notify_peer); });
+    }
+
+    RDMAAwaiter RDMAScheduler::wait_for(RDMAFuture future)
+    {
+        CHECK(future.valid()) << "Awaiting an invalid future in " << info();
+        return RDMAAwaiter(this, std::move(future));
+    }
+
+    RDMAAwaiter RDMAScheduler::post_or_wait(std::function<RDMAFuture()> &&post)
+    {
+        // the waiting ones go first, so the work requests are posted in the order they are awaited
+        if (slot_waiters_.empty() && futures_->has_free_slot())
+            return wait_for(post());
+        return RDMAAwaiter(this, std::move(post));
+    }
+
+    void RDMAScheduler::post_waiting()
+    {
+        while (!slot_waiters_.empty() && futures_->has_free_slot())
+        {
+            RDMAAwaiter *awaiter = slot_waiters_.front();
+            slot_waiters_.pop_front();
+            awaiter->future_ = awaiter->post_();
+            awaiter->future_.then(&RDMAScheduler::on_ready, awaiter->handle_.address());
+        }
+    }
+
+    void RDMAScheduler::attach_once(RDMAAdapter *adapter)
+    {
+        struct ibv_cq *completion_queue = adapter->get_completQ();
+        if (std::find(attached_cqs_.begin(), attached_cqs_.end(), completion_queue) != attached_cqs_.end())
+            return;
+        attached_cqs_.push_back(completion_queue);
+        futures_->attach(adapter);
+    }
+
+    void RDMAScheduler::on_ready(struct ibv_wc *, void *args)
+    {
+        RDMATask::Handle handle = RDMATask::Handle::from_address(args);
+        handle.promise().scheduler->ready_coroutines_.push_back(handle);
+    }
+
+}; // end namespace rdma_core
@@ -0,0 +1,221 @@
+#include "rdma_credit.h"
+#include "util/logging.h"
+
+namespace rdma_core
+{
+    CreditChannel::CreditChannel(RDMAChannel *channel,
+                                 uint32_t window,
+                                 uint32_t max_msg_size,
+                                 uint32_t max_queued,
+                                 std::string credit_info) :
+        credit_info_(credit_info),
+        channel_(channel),
+        window_(window),
+        max_queued_(max_queued)
+    {
+        TRACE_IN;
+        CHECK(channel_ != nullptr) << "Cannot control an empty channel in " << info();
+        channel_->claim_recv_queue(info());
+        CHECK(window_ > 0 && window_ <= CREDIT_MAX_WINDOW)
+            << "Invalid window of " << info() << ": " << window_ << ", it should be in (0, " << CREDIT_MAX_WINDOW << "]";
+        CHECK(window_ <= channel_->get_config().max_recv_wr)
+            << "The window of " << info() << " exceeds the max_recv_wr of " << channel_->info();
+
+        recv_blocks_.reset(RDMABuffer::allocate_buffer(max_msg_size, window_, credit_info_ + "_recv_blocks", nullptr,
+                                                       RDMABuffer::device_local_policy(channel_)));
+        channel_->register_buffer(recv_blocks_.get());
+        credit_words_.reset(RDMABuffer::allocate_buffer(2 * sizeof(uint64_t), 1, credit_info_ + "_credit_words"));
+        channel_->register_buffer(credit_words_.get());
+        uint64_t *credit_words = (uint64_t *)credit_words_->data_ptr;
+        credit_words[0] = credit_words[1] = 0;
+
+        for (uint32_t block_index = 0; block_index < window_; block_index++)
+        { // posted before the handshake, so the peer never sends ahead of them
+            RDMABuffer *block = recv_blocks_->at(block_index);
+            channel_->recv_remote(block, block->buffer_size);
+            posted_recvs_.push_back(block);
+        }
+        posted_total_ = advertised_ = window_;
+
+        CreditHandshake local, remote;
+        local.credit_word.buffer_addr_ = (uint64_t)credit_words_->data_ptr;
+        local.credit_word.buffer_length_ = sizeof(uint64_t);
+        local.credit_word.rkey_ = credit_words_->mr_->rkey;
+        local.credit_word.fd_ = 0;
+        local.window = window_;
+        local.max_msg_size = max_msg_size;
+        channel_->get_registered_endpoint()->exchange_with_peer(&local, &remote, sizeof(CreditHandshake),
+                                                                 "the credit handshake of " + info());
+        peer_credit_word_ = remote.credit_word;
+        peer_max_msg_size_ = remote.max_msg_size;
+        granted_ = remote.window;
+        VLOG(3) << "Creating " << info() << " over " << channel_->info() << ", window: " << window_
+                << ", peer window: " << remote.window << ", peer block size: " << peer_max_msg_size_;
+        TRACE_OUT;
+    }
+
+    CreditChannel::~CreditChannel()
+    {
+        TRACE_IN;
+        if (!idle())
+            LOG(WARNING) << "Releasing " << info() << " with " << pending_sends_.size() << " send(s) queued and "
+                         << posted_sqes_.size() << " sqe(s) in flight";
+        VLOG(3) << "Releasing " << info() << ", stalled " << num_stalls_ << " time(s), written "
+                << num_credit_updates_ << " credit update(s)";
+        TRACE_OUT;
+    }
+
+    bool CreditChannel::send_remote(RDMABuffer *buffer,            // placeholder of the data to send
+                                    uint32_t data_length_in_bytes, // data length to send
+                                    uint32_t msg_tag)              // tagging the message type
+    {
+        CHECK(buffer != 0) << "RDMABuffer has not been initialized";
+        CHECK(msg_tag <= CREDIT_TAG_MASK) << "The msg_tag " << msg_tag << " of " << info()
+                                          << " exceeds " << CREDIT_TAG_BITS << " bits";
+        CHECK(data_length_in_bytes <= peer_max_msg_size_)
+            << "Invalid data length to send: " << data_length_in_bytes
+            << ", exceeding the receive block of the peer: " << peer_max_msg_size_;
+        if (pending_sends_.size() >= max_queued_)
+            return false;
+
+        PendingSend pending;
+        pending.kind = SqeKind::SEND;
+        pending.buffer = buffer;
+        pending.data_length_in_bytes = data_length_in_bytes;
+        pending.msg_tag = msg_tag;
+        pending_sends_.push_back(pending);
+        if (get_credits() == 0)
+            num_stalls_++;
+        progress();
+        return true;
+    }
+
+    bool CreditChannel::read_remote(RDMABuffer *buffer,                              // placeholder that cache the read data
+                                    uint32_t data_length_in_bytes,                   // data length to read
+                                    struct CommDescriptor *remote_buffer_descriptor) // remote buffer_describptor
+    {
+        CHECK(buffer != 0) << "RDMABuffer has not been initialized";
+        CHECK(remote_buffer_descriptor != 0) << "Invalid remote buffer descriptor";
+        if (pending_sends_.size() >= max_queued_)
+            return false;
+
+        PendingSend pending;
+        pending.kind = SqeKind::READ;
+        pending.buffer = buffer;
+        pending.data_length_in_bytes = data_length_in_bytes;
+        pending.remote = *remote_buffer_descriptor;
+        pending_sends_.push_back(pending);
+        progress();
+        return true;
+    }
+
+    uint32_t CreditChannel::on_send_done(struct ibv_wc *wc)
+    {
+        CHECK(wc->status == IBV_WC_SUCCESS) << "Failed to send with error " << ibv_wc_status_str(wc->status)
+                                            << " in " << info();
+        int64_t retired = channel_->retire_sqe();
+        CHECK((size_t)retired <= posted_sqes_.size()) << channel_->info() << " retires " << retired
+                                                      << " sqes, while " << info() << " only posted " << posted_sqes_.size();
+        uint32_t num_retired = 0;
+        for (int64_t index = 0; index < retired; index++)
+        {
+            if (posted_sqes_.front() == SqeKind::CREDIT_WRITE)
+                credit_write_inflight_ = false;
+            else
+                num_retired++;
+            posted_sqes_.pop_front();
+        }
+        progress(); // the sq has room again
+        return num_retired;
+    }
+
+    RDMABuffer *CreditChannel::on_recv_done(struct ibv_wc *wc)
+    {
+        CHECK(wc->status == IBV_WC_SUCCESS) << "Failed to recv with error " << ibv_wc_status_str(wc->status)
+                                            << " in " << info();
+        CHECK(!posted_recvs_.empty()) << "Unexpected recv cqe in " << info();
+        channel_->decrease_rqe();
+        RDMABuffer *block = posted_recvs_.front();
+        posted_recvs_.pop_front();
+
+        update_credits(wc->imm_data >> CREDIT_TAG_BITS);
+        wc->imm_data &= CREDIT_TAG_MASK;
+        progress(); // the piggybacked credits may release the queued sends
+        return block;
+    }
+
+    void CreditChannel::repost(RDMABuffer *block)
+    {
+        CHECK(block != nullptr) << "Reposting an empty block in " << info();
+        channel_->recv_remote(block, block->buffer_size);
+        posted_recvs_.push_back(block);
+        posted_total_++;
+        progress();
+    }
+
+    uint32_t CreditChannel::progress()
+    {
+        refresh_credits();
+        uint32_t num_posted = 0;
+        while (!pending_sends_.empty() && channel_->sq_has_room(1))
+        {
+            PendingSend &pending = pending_sends_.front();
+            if (pending.kind == SqeKind::READ)
+            {
+                channel_->read_remote(pending.buffer, pending.data_length_in_bytes, &pending.remote);
+            }
+            else
+            {
+                if (get_credits() == 0)
+                    break;
+                advertised_ = posted_total_; // the piggybacked credits
+                uint32_t imm_data = ((uint32_t)(advertised_ & 0xFF) << CREDIT_TAG_BITS) | pending.msg_tag;
+                channel_->send_remote(pending.buffer, pending.data_length_in_bytes, imm_data);
+                consumed_++;
+            }
+            posted_sqes_.push_back(pending.kind);
+            pending_sends_.pop_front();
+            num_posted++;
+        }
+
+        // nothing to piggyback on, e.g., the traffic is one-way, so write the credits back once half a window is owed
+        if (posted_total_ - advertised_ >= (window_ + 1) / 2 && !credit_write_inflight_ && channel_->sq_has_room())
+            write_credits();
+        return num_posted;
+    }
+
+    void CreditChannel::refresh_credits()
+    {
+        volatile uint64_t *credit_word = (volatile uint64_t *)credit_words_->data_ptr;
+        uint64_t peer_posted = *credit_word;
+        if (peer_posted > granted_)
+            granted_ = peer_posted;
+    }
+
+    void CreditChannel::update_credits(uint8_t piggyback)
+    {
+        // the piggybacked count is the low byte of the posted receives of the peer when it sent,
+        // it is at most a window ahead of (or, if a credit write overtook it, behind) what we know
+        int8_t distance = (int8_t)(piggyback - (uint8_t)(granted_ & 0xFF));
+        if (distance > 0)
+            granted_ += distance;
+    }
+
+    void CreditChannel::write_credits()
+    {
+        uint64_t *credit_words = (uint64_t *)credit_words_->data_ptr;
+        advertised_ = posted_total_;
+        credit_words[1] = advertised_;
+
+        BufferSlice slice;
+        slice.buffer = credit_words_.get();
+        slice.offset = sizeof(uint64_t);
+        slice.length = sizeof(uint64_t);
+        channel_->write_remote(&slice, 1, &peer_credit_word_, 0, false);
+        posted_sqes_.push_back(SqeKind::CREDIT_WRITE);
+        credit_write_inflight_ = true;
+        num_credit_updates_++;
+        HOT_VLOG_EVERY_N(3, SHOWN_LOG_EVERN_N) << info() << " writes back " << advertised_ << " credit(s)";
+    }
+
+}; // end namespace rdma_core
@@ -8,6 +8,22 @@
 extern int errno;
 namespace rdma_core
 {
+    // the wr_ids tagged by RDMAFutureTable (the lowest bit) do not point to the posting channel
+    static std::string poster_info(uint64_t wr_id)
+    {
+        if (wr_id & 1)
+            return "future wr_id " + std::to_string(wr_id);
+        return ((RDMAChannel *)wr_id)->info();
+    }
+    static int64_t posted_sqe(uint64_t wr_id)
+    {
+        return (wr_id & 1) ? -1 : ((RDMAChannel *)wr_id)->get_sqe();
+    }
+    static int64_t posted_rqe(uint64_t wr_id)
+    {
+        return (wr_id & 1) ? -1 : ((RDMAChannel *)wr_id)->get_rqe();
+    }
+
     static int get_cache_line_size()
     {
         int size = 0;
@@ -234,13 +250,25 @@ namespace rdma_core
         return true;
     }
 
-    struct ibv_comp_channel *RDMADevice::create_event_channel()
+    struct ibv_comp_channel *RDMADevice::create_event_channel(std::string channel_key)
     {
         TRACE_IN;
         struct ibv_comp_channel *event_channel = nullptr;
         {
             std::lock_guard<std::mutex> lock(device_local_lock_);
+            if (channel_key.length() != 0)
+            {
+                auto iter = reg_event_channels_.find(channel_key);
+                if (iter != reg_event_channels_.end())
+                {
+                    VLOG(3) << "Event channel, named " << channel_key << " is already registered in " << info();
+                    TRACE_OUT;
+                    return iter->second;
+                }
+            }
             event_channel = ibv_create_comp_channel(ib_ctx_);
+            if (event_channel && channel_key.length() != 0)
+                reg_event_channels_[channel_key] = event_channel;
         }
         if (!event_channel)
         {
@@ -249,13 +277,25 @@ namespace rdma_core
         TRACE_OUT;
         return event_channel;
     }
-    struct ibv_pd *RDMADevice::create_protected_domain()
+    struct ibv_pd *RDMADevice::create_protected_domain(std::string pd_key)
     {
         TRACE_IN;
         struct ibv_pd *pd;
         {
             std::lock_guard<std::mutex> lock(device_local_lock_);
+            if (pd_key.length() != 0)
+            {
+                auto iter = reg_pds_.find(pd_key);
+                if (iter != reg_pds_.end())
+                {
+                    VLOG(3) << "PD, named " << pd_key << " is already registered in " << info();
+                    TRACE_OUT;
+                    return iter->second;
+                }
+            }
             pd = ibv_alloc_pd(ib_ctx_);
+            if (pd && pd_key.length() != 0)
+                reg_pds_[pd_key] = pd;
         }
         if (!pd)
         {
@@ -264,6 +304,43 @@ namespace rdma_core
         TRACE_OUT;
         return pd;
     }
+
+    struct ibv_srq *RDMADevice::create_shared_receive_queue(std::string srq_key,
+                                                            struct ibv_pd *pd,
+                                                            uint32_t max_wr,
+                                                            uint32_t max_sge)
+    {
+        TRACE_IN;
+        CHECK(pd != 0) << "protect domain should not be empty for the SRQ: " << srq_key;
+        VLOG(3) << "Trying to find the shared receive queue(SRQ), named " << srq_key << " in " << info();
+        struct ibv_srq *srq;
+        {
+            std::lock_guard<std::mutex> lock(device_local_lock_);
+            auto iter = reg_srqs_.find(srq_key);
+            if (iter != reg_srqs_.end())
+            {
+                VLOG(3) << "SRQ, named " << srq_key << " is already registered in " << info();
+                TRACE_OUT;
+                return iter->second;
+            }
+            struct ibv_srq_init_attr srq_init_attr;
+            memset(&srq_init_attr, 0, sizeof(srq_init_attr));
+            srq_init_attr.attr.max_wr = max_wr;
+            srq_init_attr.attr.max_sge = max_sge;
+            srq_init_attr.attr.srq_limit = 0;
+            srq = ibv_create_srq(pd, &srq_init_attr);
+            if (srq)
+                reg_srqs_[srq_key] = srq;
+            VLOG(3) << "SRQ, named " << srq_key << " is not found in " << info()
+                    << ", create one (" << srq << ") with " << max_wr << " wqes now!";
+        }
+        if (!srq)
+        {
+            LOG(FATAL) << "Failed to create shared receive queue, because: " << strerror(errno);
+        }
+        TRACE_OUT;
+        return srq;
+    }
     bool RDMADevice::has_created_cq(std::string key)
     {
         std::lock_guard<std::mutex> lock(device_local_lock_);
@@ -330,13 +407,14 @@ namespace rdma_core
         return cq;
     }
     struct ibv_qp *RDMADevice::create_queue_pair(struct ibv_pd *pd,
-                                                 struct ibv_qp_init_attr init_attr)
+                                                 struct ibv_qp_init_attr *init_attr)
     {
         TRACE_IN;
+        CHECK(init_attr != 0) << "Invalid init qp_attr";
         struct ibv_qp *qp;
         {
             std::lock_guard<std::mutex> lock(device_local_lock_);
-            qp = ibv_create_qp(pd, &init_attr);
+            qp = ibv_create_qp(pd, init_attr);
         }
         if (!qp)
         {
@@ -365,6 +443,24 @@ namespace rdma_core
         return my_gid;
     }
 
+    int RDMADevice::get_numa_node()
+    {
+        TRACE_IN;
+        int numa_node = -1;
+        std::string file_name = "/sys/class/infiniband/" + dev_name_ + "/device/numa_node";
+        FILE *fp = fopen(file_name.c_str(), "r");
+        if (fp == nullptr || fscanf(fp, "%d", &numa_node) != 1)
+        {
+            LOG(WARNING) << "Failed to read the numa node of " << info() << " from " << file_name;
+            numa_node = -1;
+        }
+        if (fp != nullptr)
+            fclose(fp);
+        VLOG(3) << info() << " is attached to numa node " << numa_node;
+        TRACE_OUT;
+        return numa_node; // the kernel reports -1 on single-node machines
+    }
+
     int RDMADevice::real_poll_completion_queue(struct ibv_cq *cq_,
                                                int expected,
                                                struct ibv_wc *wcs)
@@ -380,7 +476,7 @@ namespace rdma_core
         }
         if (num_wcqe != 0)
         {
-            VLOG_EVERY_N(3, SHOWN_LOG_EVERN_N + 1) << "polled wqe: " << num_wcqe;
+            HOT_VLOG_EVERY_N(3, SHOWN_LOG_EVERN_N + 1) << "polled wqe: " << num_wcqe;
         }
         // TRACE_OUT;
         return num_wcqe;
@@ -388,10 +484,11 @@ namespace rdma_core
 
     bool RDMADevice::real_send_(struct ibv_qp *qp, struct ibv_mr *mr_,
                                 void *buffer_addrr, uint32_t msg_size,
-                                uint32_t imm_data, uint64_t key)
+                                uint32_t imm_data, uint64_t key,
+                                int send_flags)
     {
-        TRACE_IN;
-        VLOG_EVERY_N(3, SHOWN_LOG_EVERN_N) << "Post send request to SQ ";
+        HOT_TRACE_IN;
+        HOT_VLOG_EVERY_N(3, SHOWN_LOG_EVERN_N) << "Post send request to SQ ";
 
         struct ibv_send_wr sr;
         struct ibv_sge sge;
@@ -415,16 +512,15 @@ namespace rdma_core
         sr.opcode = IBV_WR_SEND_WITH_IMM;
         sr.imm_data = imm_data; // do not considering the byte order
 
-        sr.send_flags = IBV_SEND_SIGNALED;
+        sr.send_flags = send_flags;
 
         /* there is a Receive Request in the responder side, so we won't get any into RNR flow */
         if (ibv_post_send(qp, &sr, &bad_wr))
         {
-            RDMAChannel *channel = (RDMAChannel *)key;
-            LOG(FATAL) << "[error] failed to post send_request to Channel (" << channel->info()
-                       << "), Error: " << strerror(errno) << ", sq: " << channel->get_sqe();
+            LOG(FATAL) << "[error] failed to post send_request to Channel (" << poster_info(key)
+                       << "), Error: " << strerror(errno) << ", sq: " << posted_sqe(key);
         }
-        TRACE_OUT;
+        HOT_TRACE_OUT;
         return true;
     }
 
@@ -432,9 +528,9 @@ namespace rdma_core
                                 void *buffer_addrr, uint32_t msg_size,
                                 uint64_t key)
     {
-        TRACE_IN;
+        HOT_TRACE_IN;
 
-        VLOG_EVERY_N(3, SHOWN_LOG_EVERN_N) << "Post receive request to RQ ";
+        HOT_VLOG_EVERY_N(3, SHOWN_LOG_EVERN_N) << "Post receive request to RQ ";
         struct ibv_recv_wr rr;
         struct ibv_sge sge;
         struct ibv_recv_wr *bad_wr;
@@ -458,13 +554,12 @@ namespace rdma_core
         /* post the Receive Request to the RQ */
         if (ibv_post_recv(qp, &rr, &bad_wr))
         {
-            RDMAChannel *channel = (RDMAChannel *)key;
             LOG(FATAL) << "[error] failed to post RR to Channel ("
-                       << channel->info()
+                       << poster_info(key)
                        << "), Error: " << strerror(errno)
-                       << ", rq: " << channel->get_rqe();
+                       << ", rq: " << posted_rqe(key);
         }
-        TRACE_OUT;
+        HOT_TRACE_OUT;
         return true;
     }
 
@@ -474,10 +569,10 @@ namespace rdma_core
                                         void *src_addr,         // the address to write
                                         uint64_t dest_addr,     // the dest address to write
                                         uint32_t size_in_bytes, // bytes to write
-                                        uint64_t wr_id)         // id of this workrequest
-
+                                        uint64_t wr_id,         // id of this workrequest
+                                        int send_flags)         // whether to signal a cqe
     {
-        TRACE_IN;
+        HOT_TRACE_IN;
         struct ibv_sge list;
         list.addr = (uintptr_t)(src_addr);
         list.length = size_in_bytes;
@@ -489,7 +584,7 @@ namespace rdma_core
         wr.sg_list = &list;
         wr.num_sge = 1;
         wr.opcode = IBV_WR_RDMA_WRITE;
-        wr.send_flags = IBV_SEND_SIGNALED;
+        wr.send_flags = send_flags;
         wr.wr.rdma.remote_addr = dest_addr;
         wr.wr.rdma.rkey = rkey;
 
@@ -499,13 +594,12 @@ namespace rdma_core
 
         if (ret_value)
         {
-            RDMAChannel *channel = (RDMAChannel *)wr_id;
             LOG(FATAL) << "[error] failed to post SR to Channel ("
-                       << channel->info()
+                       << poster_info(wr_id)
                        << "), Error: " << strerror(ret_value)
-                       << ", sq: " << channel->get_sqe();
+                       << ", sq: " << posted_sqe(wr_id);
         }
-        TRACE_OUT;
+        HOT_TRACE_OUT;
         return true;
     }
 
@@ -516,9 +610,10 @@ namespace rdma_core
                                                     uint64_t dest_addr,     // the dest address to write
                                                     uint32_t size_in_bytes, // bytes to write
                                                     uint32_t imm_data,      // imm data to notify peer
-                                                    uint64_t wr_id)         // id of this workrequest
+                                                    uint64_t wr_id,         // id of this workrequest
+                                                    int send_flags)         // whether to signal a cqe
     {
-        TRACE_IN;
+        HOT_TRACE_IN;
         struct ibv_sge list;
         list.addr = (uintptr_t)(src_addr);
         list.length = size_in_bytes;
@@ -530,7 +625,7 @@ namespace rdma_core
         wr.sg_list = &list;
         wr.num_sge = 1;
         wr.opcode = IBV_WR_RDMA_WRITE_WITH_IMM;
-        wr.send_flags = IBV_SEND_SIGNALED;
+        wr.send_flags = send_flags;
         wr.wr.rdma.remote_addr = dest_addr;
         wr.wr.rdma.rkey = rkey;
         wr.imm_data = imm_data;
@@ -540,13 +635,12 @@ namespace rdma_core
 
         if (ibv_post_send(qp, &wr, &bad_wr))
         {
-            RDMAChannel *channel = (RDMAChannel *)wr_id;
             LOG(FATAL) << "[error] failed to post SR to Channel ("
-                       << channel->info()
+                       << poster_info(wr_id)
                        << "), Error: " << strerror(errno)
-                       << ", sq: " << channel->get_sqe();
+                       << ", sq: " << posted_sqe(wr_id);
         }
-        TRACE_OUT;
+        HOT_TRACE_OUT;
         return true;
     }
 
@@ -554,9 +648,10 @@ namespace rdma_core
                                        uint32_t rkey, uint32_t lkey,
                                        void *dest_addr, uint64_t src_addr,
                                        uint32_t size_in_bytes,
-                                       uint64_t wr_id)
+                                       uint64_t wr_id,
+                                       int send_flags)
     {
-        TRACE_IN;
+        HOT_TRACE_IN;
         struct ibv_sge list;
         list.addr = (uintptr_t)(dest_addr);
         list.length = size_in_bytes;
@@ -568,7 +663,7 @@ namespace rdma_core
         wr.sg_list = &list;
         wr.num_sge = 1;
         wr.opcode = IBV_WR_RDMA_READ;
-        wr.send_flags = IBV_SEND_SIGNALED;
+        wr.send_flags = send_flags;
         wr.wr.rdma.remote_addr = src_addr;
         wr.wr.rdma.rkey = rkey;
 
@@ -577,13 +672,151 @@ namespace rdma_core
 
         if (ibv_post_send(qp, &wr, &bad_wr))
         {
-            RDMAChannel *channel = (RDMAChannel *)wr_id;
             LOG(FATAL) << "[error] failed to post SR to Channel ("
-                       << channel->info()
+                       << poster_info(wr_id)
                        << "), Error: " << strerror(errno)
-                       << ", sq: " << channel->get_sqe();
+                       << ", sq: " << posted_sqe(wr_id);
         }
-        TRACE_OUT;
+        HOT_TRACE_OUT;
+        return true;
+    }
+
+    bool RDMADevice::real_post_send_sge_(struct ibv_qp *qp,         // the qp for rdma context
+                                         enum ibv_wr_opcode opcode, // send/write/read (with imm)
+                                         struct ibv_sge *sg_list,   // the gather list of local mem
+                                         int num_sge,               // how many entries in sg_list
+                                         uint64_t remote_addr,      // the remote address for write/read
+                                         uint32_t rkey,             // the key of remote mem
+                                         uint32_t imm_data,         // imm data to notify peer
+                                         uint64_t wr_id,            // id of this workrequest
+                                         int send_flags)            // whether to signal a cqe
+    {
+        HOT_TRACE_IN;
+        struct ibv_send_wr wr;
+        memset(&wr, 0, sizeof(wr)); // the unused members of the unions, e.g., xrc/bind_mw/tso, must be zero
+        wr.next = NULL;
+        wr.wr_id = wr_id;
+        wr.sg_list = sg_list;
+        wr.num_sge = num_sge;
+        wr.opcode = opcode;
+        wr.send_flags = send_flags;
+        wr.imm_data = imm_data;
+        wr.wr.rdma.remote_addr = remote_addr;
+        wr.wr.rdma.rkey = rkey;
+
+        struct ibv_send_wr *bad_wr;
+        int ret_value = ibv_post_send(qp, &wr, &bad_wr);
+        if (ret_value)
+        {
+            LOG(FATAL) << "[error] failed to post SR with " << num_sge << " sge(s) to Channel ("
+                       << poster_info(wr_id)
+                       << "), Error: " << strerror(ret_value)
+                       << ", sq: " << posted_sqe(wr_id);
+        }
+        HOT_TRACE_OUT;
+        return true;
+    }
+
+    bool RDMADevice::real_post_recv_sge_(struct ibv_qp *qp,       // the qp for rdma context
+                                         struct ibv_sge *sg_list, // the scatter list of local mem
+                                         int num_sge,             // how many entries in sg_list
+                                         uint64_t key)            // key to indicate who recv it
+    {
+        HOT_TRACE_IN;
+        struct ibv_recv_wr rr;
+        memset(&rr, 0, sizeof(rr));
+        rr.next = NULL;
+        rr.wr_id = key;
+        rr.sg_list = sg_list;
+        rr.num_sge = num_sge;
+
+        struct ibv_recv_wr *bad_wr;
+        int ret_value = ibv_post_recv(qp, &rr, &bad_wr);
+        if (ret_value)
+        {
+            LOG(FATAL) << "[error] failed to post RR with " << num_sge << " sge(s) to Channel ("
+                       << poster_info(key)
+                       << "), Error: " << strerror(ret_value)
+                       << ", rq: " << posted_rqe(key);
+        }
+        HOT_TRACE_OUT;
+        return true;
+    }
+
+    bool RDMADevice::real_post_srq_recv_batch_(struct ibv_srq *srq,         // the shared receive queue
+                                               struct ibv_recv_wr *wr_list) // linked recv work requests
+    {
+        HOT_TRACE_IN;
+        CHECK(srq != NULL) << "The shared receive queue is empty!";
+        CHECK(wr_list != NULL) << "Empty recv request chain to post";
+        HOT_VLOG_EVERY_N(3, SHOWN_LOG_EVERN_N) << "Post a batch of receive requests to SRQ ";
+
+        struct ibv_recv_wr *bad_wr = NULL;
+        int ret_value = ibv_post_srq_recv(srq, wr_list, &bad_wr);
+        if (ret_value)
+        {
+            LOG(FATAL) << "[error] failed to post RR to SRQ (" << srq
+                       << "), Error: " << strerror(ret_value);
+        }
+        HOT_TRACE_OUT;
+        return true;
+    }
+
+    bool RDMADevice::real_req_notify_cq_(struct ibv_cq *cq_, int solicited_only)
+    {
+        CHECK(cq_ != 0) << "The completion queue is empty!";
+        int ret_value = ibv_req_notify_cq(cq_, solicited_only);
+        if (ret_value)
+        {
+            LOG(FATAL) << "[error] failed to arm the completion queue (" << cq_
+                       << "), Error: " << strerror(ret_value);
+        }
+        return true;
+    }
+
+    struct ibv_cq *RDMADevice::real_get_cq_event_(struct ibv_comp_channel *channel)
+    {
+        CHECK(channel != 0) << "The event channel is empty!";
+        struct ibv_cq *ev_cq = nullptr;
+        void *ev_ctx = nullptr;
+        if (ibv_get_cq_event(channel, &ev_cq, &ev_ctx))
+        {
+            if (errno != EAGAIN && errno != EWOULDBLOCK)
+                LOG(FATAL) << "[error] failed to get cq event from channel (" << channel
+                           << "), Error: " << strerror(errno);
+            return nullptr;
+        }
+        return ev_cq;
+    }
+
+    void RDMADevice::real_ack_cq_events_(struct ibv_cq *cq_, uint32_t num_events)
+    {
+        CHECK(cq_ != 0) << "The completion queue is empty!";
+        if (num_events != 0)
+            ibv_ack_cq_events(cq_, num_events);
+    }
+
+    bool RDMADevice::real_post_send_batch_(struct ibv_qp *qp,           // the qp for rdma context
+                                           struct ibv_send_wr *wr_list, // linked work requests
+                                           uint64_t key)                // key to indicate who send it
+    {
+        HOT_TRACE_IN;
+        CHECK(wr_list != NULL) << "Empty work request chain to post";
+        HOT_VLOG_EVERY_N(3, SHOWN_LOG_EVERN_N) << "Post a batch of send requests to SQ ";
+
+        struct ibv_send_wr *bad_wr = NULL;
+        int ret_value = ibv_post_send(qp, wr_list, &bad_wr);
+        if (ret_value)
+        {
+            int failed_index = 0;
+            for (struct ibv_send_wr *wr = wr_list; wr != NULL && wr != bad_wr; wr = wr->next)
+                failed_index++;
+            LOG(FATAL) << "[error] failed to post the " << failed_index
+                       << "th SR of a batch to Channel (" << poster_info(key)
+                       << "), Error: " << strerror(ret_value)
+                       << ", sq: " << posted_sqe(key);
+        }
+        HOT_TRACE_OUT;
         return true;
     }
 
@@ -601,7 +834,17 @@ namespace rdma_core
         }
 
         access_flags = IBV_ACCESS_LOCAL_WRITE | IBV_ACCESS_REMOTE_READ | IBV_ACCESS_REMOTE_WRITE;
+        struct ibv_mr *tmp_mr = real_register_mem_with_access(pd, data_ptr, size_in_byte, access_flags, info);
+        TRACE_OUT;
+        return tmp_mr;
+    }
 
+    struct ibv_mr *RDMADevice::real_register_mem_with_access(struct ibv_pd *pd,
+                                                             void *data_ptr, size_t size_in_byte,
+                                                             int access_flags, std::string info)
+    {
+        TRACE_IN;
+        CHECK(pd != 0) << "protect domain should not be empty for register mem: " << info;
         CHECK(size_in_byte > 0) << "Error of register mem buf with size: " << size_in_byte;
 
         CHECK(data_ptr != 0) << "Error of data_ptr";
@@ -28,7 +28,15 @@ namespace rdma_core
         this->sync_with_peer("Test Connection for TCPConnector");
         VLOG(3) << "Connection Test OK for TCPConnector"
                 << "@" << this->info();
-        setup_rdma_channel("DataChannel");
+        num_data_channels_ = work_env_.num_data_channels;
+        CHECK(num_data_channels_ >= 1) << "At least one data channel is required for " << this->info();
+        for (uint32_t chan_index = 0; chan_index < num_data_channels_; chan_index++)
+            setup_rdma_channel("DataChannel-" + std::to_string(chan_index));
+        if (work_env_.use_ctrl_channel)
+        {
+            setup_rdma_channel("CtrlChannel");
+            ctrl_channel_ = rdma_channel_mgr_.back().get();
+        }
         TRACE_OUT;
     }
 
@@ -43,27 +51,67 @@ namespace rdma_core
         TRACE_OUT;
     }
 
+    void RDMAEndPoint::exchange_with_peer(void *local_data,      // the bytes to send
+                                          void *remote_data,     // placeholder of the bytes from remote
+                                          uint32_t size_in_bytes, // bytes to swap
+                                          std::string info_)      // what is swapped, for the error log
+    {
+        TRACE_IN;
+        if (pre_connector_->sock_sync_data(size_in_bytes, (char *)local_data, (char *)remote_data))
+            LOG(FATAL) << "exchange error for " << info_;
+        TRACE_OUT;
+    }
+
     void RDMAEndPoint::connecting()
     {
-        for (auto &channel : rdma_channel_mgr_)
-        { // now, we are connecting to remote
-            // AdapterConfig adapt_conf;
-            // // adapt_conf.cq_key = "SharedGlobalCQ";
-            // adapt_conf.using_shared_cq = false;
-            auto adapt_info = channel->loading();
-            AdapterInfo peer_info;
-            pre_connector_->sock_sync_data(sizeof(peer_info),
-                                           (char *)&adapt_info,
-                                           (char *)&peer_info);
-            channel->connecting(peer_info);
-            {
-                char temp_char;
-                if (pre_connector_->sock_sync_data(1, (char *)"Q", &temp_char))
-                    LOG(FATAL) << "sync error after QPs are connected";
-            }
+        // now, we are connecting to remote, the infos of all channels are exchanged at once
+        std::vector<AdapterInfo> local_infos = load_channels();
+
+        uint32_t num_channels = local_infos.size();
+        uint32_t peer_num_channels = 0;
+        if (pre_connector_->sock_sync_data(sizeof(num_channels),
+                                           (char *)&num_channels,
+                                           (char *)&peer_num_channels))
+            LOG(FATAL) << "sync error when exchanging the number of channels";
+        CHECK(num_channels == peer_num_channels)
+            << info() << " holds " << num_channels << " channel(s), while its peer holds " << peer_num_channels
+            << ", check num_data_channels/use_ctrl_channel on both sides";
+
+        std::vector<AdapterInfo> peer_infos(num_channels);
+        if (pre_connector_->sock_sync_data(sizeof(AdapterInfo) * num_channels,
+                                           (char *)local_infos.data(),
+                                           (char *)peer_infos.data()))
+            LOG(FATAL) << "sync error when exchanging the adapter info";
+        connect_channels(peer_infos);
+        {
+            char temp_char;
+            if (pre_connector_->sock_sync_data(1, (char *)"Q", &temp_char))
+                LOG(FATAL) << "sync error after QPs are connected";
         }
     }
 
+    std::vector<AdapterInfo> RDMAEndPoint::load_channels()
+    {
+        std::vector<AdapterInfo> local_infos;
+        for (auto &channel : rdma_channel_mgr_)
+            local_infos.push_back(channel->loading());
+        return local_infos;
+    }
+
+    void RDMAEndPoint::connect_channels(std::vector<AdapterInfo> &peer_infos)
+    {
+        CHECK(peer_infos.size() == rdma_channel_mgr_.size())
+            << "Invalid number of peer channels: " << peer_infos.size() << " for " << info();
+        for (uint32_t chan_index = 0; chan_index < peer_infos.size(); chan_index++)
+            rdma_channel_mgr_[chan_index]->connecting(peer_infos[chan_index]);
+    }
+
+    int RDMAEndPoint::get_socket()
+    {
+        CHECK(pre_connector_ != nullptr) << "TCPConnector is not initialized";
+        return pre_connector_->get_or_build_socket();
+    }
+
     void RDMAEndPoint::reset()
     {
         VLOG(3) << "Would reset the RDMAEndPoint";
@@ -90,12 +138,23 @@ namespace rdma_core
     {
         VLOG(3) << "creating&preparing an rdma channel for " << info_;
         RDMAChannel *channel = RDMAChannel::build_rdma_channel(work_env_, info_, this);
+        // all channels of the endpoint share one pd, so a registered buffer works on any of them
+        channel->get_config().pd_key = "PD@" + id_;
         rdma_channel_mgr_.push_back(std::move(std::unique_ptr<RDMAChannel>(channel)));
     }
 
     void RDMAEndPoint::setup_index_in_session(int index)
     {
-        rdma_channel_mgr_[0]->setup_index_in_session(index);
+        for (auto &channel : rdma_channel_mgr_)
+            channel->setup_index_in_session(index);
+    }
+
+    std::vector<RDMAChannel *> RDMAEndPoint::get_all_channels()
+    {
+        std::vector<RDMAChannel *> all_channels;
+        for (auto &channel : rdma_channel_mgr_)
+            all_channels.push_back(channel.get());
+        return all_channels;
     }
 
     std::string RDMAEndPoint::info() // return the detail information of this endpoint
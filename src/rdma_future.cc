@@ -0,0 +1,349 @@
+#include "rdma_future.h"
+#include "util/logging.h"
+
+#include <string.h>
+
+namespace rdma_core
+{
+#define FUTURE_POLL_BATCH 16 // cqes polled from one attached cq per progress()
+
+    RDMAFuture::RDMAFuture(RDMAFutureTable *table, uint32_t slot_index, uint32_t generation) :
+        table_(table),
+        slot_index_(slot_index),
+        generation_(generation)
+    {
+    }
+
+    RDMAFuture::RDMAFuture(RDMAFuture &&other) :
+        table_(other.table_),
+        slot_index_(other.slot_index_),
+        generation_(other.generation_)
+    {
+        other.table_ = nullptr;
+    }
+
+    RDMAFuture &RDMAFuture::operator=(RDMAFuture &&other)
+    {
+        if (this != &other)
+        {
+            reset();
+            table_ = other.table_;
+            slot_index_ = other.slot_index_;
+            generation_ = other.generation_;
+            other.table_ = nullptr;
+        }
+        return *this;
+    }
+
+    RDMAFuture::~RDMAFuture()
+    {
+        reset();
+    }
+
+    bool RDMAFuture::is_ready()
+    {
+        CHECK(valid()) << "Querying an invalid future";
+        return table_->slot_of(slot_index_, generation_).state.load(std::memory_order_acquire) ==
+               RDMAFutureTable::SlotState::READY;
+    }
+
+    bool RDMAFuture::wait()
+    {
+        while (!is_ready())
+            table_->progress();
+        return get().status == IBV_WC_SUCCESS;
+    }
+
+    void RDMAFuture::then(FutureCallback callback, void *args)
+    {
+        CHECK(valid()) << "Chaining a callback to an invalid future";
+        CHECK(callback != nullptr) << "Chaining an empty callback to the future of " << table_->info();
+        std::unique_lock<std::recursive_mutex> lock(table_->slot_lock_);
+        RDMAFutureTable::CompletionSlot &slot = table_->slot_of(slot_index_, generation_);
+        if (slot.state.load(std::memory_order_acquire) == RDMAFutureTable::SlotState::READY)
+        {
+            lock.unlock();
+            callback(&slot.wc, args);
+            return;
+        }
+        CHECK(slot.callback == nullptr) << "The future " << wr_id() << " of " << table_->info()
+                                        << " already has a callback";
+        slot.callback = callback;
+        slot.callback_args = args;
+    }
+
+    struct ibv_wc &RDMAFuture::get()
+    {
+        CHECK(is_ready()) << "The future " << wr_id() << " of " << table_->info() << " is not ready";
+        return table_->slot_of(slot_index_, generation_).wc;
+    }
+
+    uint64_t RDMAFuture::wr_id()
+    {
+        CHECK(valid()) << "Querying an invalid future";
+        return table_->encode_wr_id(slot_index_, generation_);
+    }
+
+    void RDMAFuture::reset()
+    {
+        if (table_ == nullptr)
+            return;
+        std::lock_guard<std::recursive_mutex> lock(table_->slot_lock_);
+        table_->slot_of(slot_index_, generation_); // check the slot is not recycled under the future
+        table_->release(slot_index_);
+        table_ = nullptr;
+    }
+
+    RDMAFutureTable::RDMAFutureTable(uint32_t num_slots, std::string table_info) :
+        table_info_(table_info)
+    {
+        TRACE_IN;
+        CHECK(num_slots > 0 && num_slots < (1u << 31)) << "Invalid number of slots for " << info() << ": " << num_slots;
+        slots_ = std::vector<CompletionSlot>(num_slots);
+        free_slots_.reserve(num_slots);
+        for (uint32_t slot_index = num_slots; slot_index > 0; slot_index--)
+            free_slots_.push_back(slot_index - 1);
+        VLOG(3) << "Creating " << info() << " with " << num_slots << " slot(s)";
+        TRACE_OUT;
+    }
+
+    RDMAFutureTable::~RDMAFutureTable()
+    {
+        TRACE_IN;
+        if (free_slots_.size() != slots_.size())
+            LOG(WARNING) << "Releasing " << info() << " with " << slots_.size() - free_slots_.size() << " slot(s) in use";
+        VLOG(3) << "Releasing " << info();
+        TRACE_OUT;
+    }
+
+    void RDMAFutureTable::attach(RDMAAdapter *adapter)
+    {
+        CHECK(adapter != nullptr) << "Attaching an empty adapter to " << info();
+        std::lock_guard<std::mutex> lock(poll_lock_);
+        for (auto *polled_adapter : polled_adapters_)
+        {
+            if (polled_adapter->get_completQ() == adapter->get_completQ())
+                return; // the cq is polled already
+        }
+        polled_adapters_.push_back(adapter);
+    }
+
+    int RDMAFutureTable::progress()
+    {
+        std::unique_lock<std::mutex> lock(poll_lock_, std::try_to_lock);
+        if (!lock.owns_lock()) // another thread is polling
+            return 0;
+
+        struct ibv_wc global_wc[FUTURE_POLL_BATCH];
+        int num_completed = 0;
+        for (auto *polled_adapter : polled_adapters_)
+        {
+            int num_wqe = polled_adapter->poll_cq_batch(global_wc, FUTURE_POLL_BATCH);
+            for (int wc_index = 0; wc_index < num_wqe; wc_index++)
+            {
+                CHECK(complete(&global_wc[wc_index]))
+                    << "The cqe " << global_wc[wc_index].wr_id << " polled from " << polled_adapter->info()
+                    << " is not owned by " << info() << ", the attached cqs should carry the futures only";
+            }
+            num_completed += num_wqe;
+        }
+        return num_completed;
+    }
+
+    bool RDMAFutureTable::complete(struct ibv_wc *wc)
+    {
+        if (!is_future_wr(wc->wr_id))
+            return false;
+        uint32_t slot_index = (wc->wr_id >> 1) & 0x7fffffff;
+        uint32_t generation = wc->wr_id >> 32;
+
+        std::lock_guard<std::recursive_mutex> lock(slot_lock_);
+        CompletionSlot &slot = slot_of(slot_index, generation);
+        CHECK(slot.state.load(std::memory_order_relaxed) == SlotState::PENDING && slot.adapter != nullptr)
+            << "The cqe " << wc->wr_id << " does not match a pending work request in " << info();
+        if (slot.send_side)
+            slot.adapter->retire_sqe();
+        else
+            slot.adapter->decrease_rqe();
+        finish(slot_index, wc);
+        release(slot_index); // the work request is gone
+        return true;
+    }
+
+    RDMAFuture RDMAFutureTable::when_all(RDMAFuture *futures, uint32_t num_futures)
+    {
+        std::lock_guard<std::recursive_mutex> lock(slot_lock_);
+        RDMAFuture all_future = acquire(nullptr, false); // the children hold the slot instead of a work request
+        CompletionSlot &all_slot = slots_[all_future.slot_index_];
+        all_slot.wc.wr_id = all_future.wr_id();
+        all_slot.wc.status = IBV_WC_SUCCESS;
+
+        for (uint32_t index = 0; index < num_futures; index++)
+        {
+            RDMAFuture &child = futures[index];
+            CHECK(child.valid() && child.table_ == this) << "The future " << index << " is not created by " << info();
+            CompletionSlot &child_slot = slot_of(child.slot_index_, child.generation_);
+            if (child_slot.state.load(std::memory_order_relaxed) == SlotState::READY)
+            {
+                if (child_slot.wc.status != IBV_WC_SUCCESS && all_slot.wc.status == IBV_WC_SUCCESS)
+                    all_slot.wc = child_slot.wc;
+                continue;
+            }
+            CHECK(child_slot.parent < 0) << "The future " << child.wr_id() << " is already waited by another when_all";
+            child_slot.parent = all_future.slot_index_;
+            all_slot.pending_children++;
+        }
+
+        if (all_slot.pending_children == 0)
+        {
+            finish(all_future.slot_index_, &all_slot.wc);
+            release(all_future.slot_index_);
+        }
+        return all_future;
+    }
+
+    RDMAFuture RDMAFutureTable::when_all(std::vector<RDMAFuture> &futures)
+    {
+        return when_all(futures.data(), futures.size());
+    }
+
+    RDMAFuture RDMAFutureTable::send_remote(RDMAAdapter *adapter,          // the adapter to post on
+                                            RDMABuffer *buffer,            // placeholder of the data to send
+                                            uint32_t data_length_in_bytes, // data length to send
+                                            uint32_t msg_tag)              // tagging the message type to notify peer
+    {
+        RDMAFuture future = acquire(adapter, true);
+        adapter->tag_next_wr(future.wr_id());
+        bool success = adapter->send_remote(buffer, data_length_in_bytes, msg_tag);
+        return posted(std::move(future), success);
+    }
+
+    RDMAFuture RDMAFutureTable::recv_remote(RDMAAdapter *adapter,          // the adapter to post on
+                                            RDMABuffer *buffer,            // a placeholder that captures the recv data
+                                            uint32_t data_length_in_bytes) // data length to recv
+    {
+        RDMAFuture future = acquire(adapter, false);
+        adapter->tag_next_wr(future.wr_id());
+        bool success = adapter->recv_remote(buffer, data_length_in_bytes);
+        return posted(std::move(future), success);
+    }
+
+    RDMAFuture RDMAFutureTable::read_remote(RDMAAdapter *adapter,                            // the adapter to post on
+                                            RDMABuffer *buffer,                              // placeholder that cache the read data
+                                            uint32_t data_length_in_bytes,                   // data length to read
+                                            struct CommDescriptor *remote_buffer_descriptor) // remote buffer_describptor
+    {
+        RDMAFuture future = acquire(adapter, true);
+        adapter->tag_next_wr(future.wr_id());
+        bool success = adapter->read_remote(buffer, data_length_in_bytes, remote_buffer_descriptor);
+        return posted(std::move(future), success);
+    }
+
+    RDMAFuture RDMAFutureTable::write_remote(RDMAAdapter *adapter,                            // the adapter to post on
+                                             RDMABuffer *buffer,                              // the buffer for data to write
+                                             uint32_t data_length_in_bytes,                   // data length to write
+                                             struct CommDescriptor *remote_buffer_descriptor, // remote buffer_describptor
+                                             uint32_t msg_tag,                                // tagging the message type to notify peer
+                                             bool notify_peer)                                // notify peer explicit or not
+    {
+        RDMAFuture future = acquire(adapter, true);
+        adapter->tag_next_wr(future.wr_id());
+        bool success = adapter->write_remote(buffer, data_length_in_bytes, remote_buffer_descriptor, msg_tag, notify_peer);
+        return posted(std::move(future), success);
+    }
+
+    RDMAFuture RDMAFutureTable::acquire(RDMAAdapter *adapter, bool send_side)
+    {
+        std::lock_guard<std::recursive_mutex> lock(slot_lock_);
+        // polling here would complete futures whose holders cannot run before this post returns, e.g., the
+        // coroutines of RDMAScheduler, so the caller checks has_free_slot() first
+        CHECK(!free_slots_.empty()) << info() << " runs out of its " << slots_.size()
+                                    << " slots, wait for the futures in flight before posting more";
+        uint32_t slot_index = free_slots_.back();
+        free_slots_.pop_back();
+
+        CompletionSlot &slot = slots_[slot_index];
+        slot.state.store(SlotState::PENDING, std::memory_order_relaxed);
+        slot.holders = 2;
+        slot.adapter = adapter;
+        slot.send_side = send_side;
+        memset(&slot.wc, 0, sizeof(slot.wc));
+        return RDMAFuture(this, slot_index, slot.generation);
+    }
+
+    bool RDMAFutureTable::has_free_slot()
+    {
+        std::lock_guard<std::recursive_mutex> lock(slot_lock_);
+        return !free_slots_.empty();
+    }
+
+    RDMAFuture RDMAFutureTable::posted(RDMAFuture future, bool success)
+    {
+        if (success)
+            return future;
+        LOG(WARNING) << "Failed to post the work request of future " << future.wr_id() << " in " << info();
+        std::lock_guard<std::recursive_mutex> lock(slot_lock_);
+        struct ibv_wc wc;
+        memset(&wc, 0, sizeof(wc));
+        wc.wr_id = future.wr_id();
+        wc.status = IBV_WC_GENERAL_ERR;
+        finish(future.slot_index_, &wc);
+        release(future.slot_index_); // no cqe will come for the work request
+        return future;
+    }
+
+    void RDMAFutureTable::finish(uint32_t slot_index, struct ibv_wc *wc)
+    {
+        CompletionSlot &slot = slots_[slot_index];
+        if (wc != &slot.wc)
+            slot.wc = *wc;
+        slot.state.store(SlotState::READY, std::memory_order_release);
+
+        if (slot.callback != nullptr)
+        {
+            FutureCallback callback = slot.callback;
+            slot.callback = nullptr;
+            callback(&slot.wc, slot.callback_args);
+        }
+
+        if (slot.parent >= 0)
+        {
+            uint32_t parent_index = slot.parent;
+            CompletionSlot &parent = slots_[parent_index];
+            if (slot.wc.status != IBV_WC_SUCCESS && parent.wc.status == IBV_WC_SUCCESS)
+                parent.wc = slot.wc;
+            if (--parent.pending_children == 0)
+            {
+                finish(parent_index, &parent.wc);
+                release(parent_index); // the children are gone
+            }
+        }
+    }
+
+    void RDMAFutureTable::release(uint32_t slot_index)
+    {
+        CompletionSlot &slot = slots_[slot_index];
+        CHECK(slot.holders > 0) << "Releasing the free slot " << slot_index << " of " << info();
+        if (--slot.holders > 0)
+            return;
+        slot.state.store(SlotState::FREE, std::memory_order_relaxed);
+        slot.generation++;
+        slot.adapter = nullptr;
+        slot.callback = nullptr;
+        slot.callback_args = nullptr;
+        slot.parent = -1;
+        slot.pending_children = 0;
+        free_slots_.push_back(slot_index);
+    }
+
+    RDMAFutureTable::CompletionSlot &RDMAFutureTable::slot_of(uint32_t slot_index, uint32_t generation)
+    {
+        CHECK(slot_index < slots_.size()) << "Invalid slot " << slot_index << " of " << info();
+        CompletionSlot &slot = slots_[slot_index];
+        CHECK(slot.generation == generation && slot.state.load(std::memory_order_relaxed) != SlotState::FREE)
+            << "The slot " << slot_index << " of " << info() << " is recycled, generation "
+            << generation << " vs " << slot.generation;
+        return slot;
+    }
+
+}; // end namespace rdma_core
@@ -0,0 +1,164 @@
+#include "rdma_memory_pool.h"
+#include "rdma_config.h"
+#include "util/logging.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+namespace rdma_core
+{
+    std::mutex RDMAMemoryPool::pool_global_lock_;
+    std::unordered_map<struct ibv_pd *, std::unique_ptr<RDMAMemoryPool>> RDMAMemoryPool::pool_map_;
+
+    RDMAMemoryPool::RDMAMemoryPool(std::shared_ptr<RDMADevice> device,
+                                   struct ibv_pd *pd,
+                                   std::string pool_info) :
+        pool_info_(pool_info),
+        device_(device),
+        pd_(pd)
+    {
+        TRACE_IN;
+        CHECK(device_ != nullptr) << "The device of " << info() << " should not be empty";
+        CHECK(pd_ != nullptr) << "The protection domain of " << info() << " should not be empty";
+        VLOG(2) << "Creating " << info() << " on pd (" << pd_ << "), chunk size: " << POOL_CHUNK_SIZE;
+        TRACE_OUT;
+    }
+
+    RDMAMemoryPool::~RDMAMemoryPool()
+    {
+        TRACE_IN;
+        for (auto &chunk : chunks_)
+        {
+            device_->real_deregister_mem(chunk.mr_, info());
+            free((void *)chunk.addr);
+        }
+        VLOG(2) << "Releasing " << info() << ", " << registered_bytes_ << " bytes were registered";
+        TRACE_OUT;
+    }
+
+    RDMAMemoryPool::ThreadCache::~ThreadCache()
+    {
+        for (uint32_t slab_class = POOL_MIN_CLASS_SHIFT; slab_class <= POOL_MAX_CLASS_SHIFT; slab_class++)
+            pool->spill(slab_class, this, free_blocks[slab_class].size());
+    }
+
+    RDMAMemoryPool *RDMAMemoryPool::get_memory_pool(RDMAAdapter *adapter)
+    {
+        TRACE_IN;
+        CHECK(adapter != nullptr) << "Cannot query the memory pool of an empty adapter";
+        struct ibv_pd *pd = adapter->get_protected_domain();
+        CHECK(pd != nullptr) << adapter->info() << " has not created its protection domain, load it first";
+
+        std::lock_guard<std::mutex> lock(pool_global_lock_);
+        auto iter = pool_map_.find(pd);
+        if (iter != pool_map_.end())
+        {
+            TRACE_OUT;
+            return iter->second.get();
+        }
+        RDMAMemoryPool *pool = new RDMAMemoryPool(adapter->get_device(), pd,
+                                                  RLOG::make_string("%p@", pd) + adapter->get_config().dev_name);
+        pool_map_[pd] = std::unique_ptr<RDMAMemoryPool>(pool);
+        TRACE_OUT;
+        return pool;
+    }
+
+    RDMAMemoryPool::ThreadCache *RDMAMemoryPool::local_cache()
+    {
+        // a thread touches few pools, so a small map per thread is enough
+        thread_local std::unordered_map<RDMAMemoryPool *, std::unique_ptr<ThreadCache>> thread_caches;
+        auto iter = thread_caches.find(this);
+        if (__builtin_expect(iter != thread_caches.end(), 1))
+            return iter->second.get();
+
+        ThreadCache *cache = new ThreadCache();
+        cache->pool = this;
+        thread_caches[this] = std::unique_ptr<ThreadCache>(cache);
+        return cache;
+    }
+
+    RDMAMemoryPool::PoolBlock RDMAMemoryPool::allocate(size_t size_in_byte)
+    {
+        CHECK(size_in_byte > 0) << "Cannot allocate an empty block from " << info();
+        uint32_t slab_class = size_to_class(size_in_byte);
+        CHECK(slab_class <= POOL_MAX_CLASS_SHIFT) << "Too large block (" << size_in_byte << " bytes) for " << info();
+
+        ThreadCache *cache = local_cache();
+        std::vector<PoolBlock> &free_blocks = cache->free_blocks[slab_class];
+        if (__builtin_expect(free_blocks.empty(), 0))
+            refill(slab_class, cache);
+
+        PoolBlock block = free_blocks.back();
+        free_blocks.pop_back();
+        return block;
+    }
+
+    void RDMAMemoryPool::deallocate(PoolBlock block, size_t size_in_byte)
+    {
+        CHECK(block.addr != nullptr && block.mr_ != nullptr) << "Invalid block to give back to " << info();
+        uint32_t slab_class = size_to_class(size_in_byte);
+
+        ThreadCache *cache = local_cache();
+        std::vector<PoolBlock> &free_blocks = cache->free_blocks[slab_class];
+        free_blocks.push_back(block);
+        if (__builtin_expect(free_blocks.size() >= 2 * POOL_CACHE_BATCH, 0))
+            spill(slab_class, cache, POOL_CACHE_BATCH);
+    }
+
+    void RDMAMemoryPool::refill(uint32_t slab_class, ThreadCache *cache)
+    {
+        std::lock_guard<std::mutex> lock(central_lock_);
+        std::vector<PoolBlock> &central = central_blocks_[slab_class];
+        if (central.empty())
+            carve_chunk(slab_class);
+
+        size_t num_blocks = std::min<size_t>(POOL_CACHE_BATCH, central.size());
+        std::vector<PoolBlock> &free_blocks = cache->free_blocks[slab_class];
+        free_blocks.insert(free_blocks.end(), central.end() - num_blocks, central.end());
+        central.resize(central.size() - num_blocks);
+    }
+
+    void RDMAMemoryPool::spill(uint32_t slab_class, ThreadCache *cache, size_t num_blocks)
+    {
+        std::vector<PoolBlock> &free_blocks = cache->free_blocks[slab_class];
+        num_blocks = std::min(num_blocks, free_blocks.size());
+        if (num_blocks == 0)
+            return;
+
+        std::lock_guard<std::mutex> lock(central_lock_);
+        std::vector<PoolBlock> &central = central_blocks_[slab_class];
+        central.insert(central.end(), free_blocks.end() - num_blocks, free_blocks.end());
+        free_blocks.resize(free_blocks.size() - num_blocks);
+    }
+
+    void RDMAMemoryPool::carve_chunk(uint32_t slab_class)
+    {
+        TRACE_IN;
+        size_t block_size = 1UL << slab_class;
+        size_t chunk_size = std::max<size_t>(POOL_CHUNK_SIZE, block_size);
+
+        PoolBlock chunk;
+        int ret = 0;
+        if (0 != (ret = posix_memalign((void **)&chunk.addr, sysconf(_SC_PAGESIZE), chunk_size)))
+            LOG(FATAL) << "[error] posix_memalign for " << info() << ": " << strerror(ret);
+        chunk.mr_ = device_->real_register_mem(pd_, chunk.addr, chunk_size,
+                                               IBV_ACCESS_LOCAL_WRITE | IBV_ACCESS_REMOTE_READ | IBV_ACCESS_REMOTE_WRITE,
+                                               info() + RLOG::make_string("-chunk-%u", slab_class));
+        chunks_.push_back(chunk);
+        registered_bytes_ += chunk_size;
+
+        std::vector<PoolBlock> &central = central_blocks_[slab_class];
+        for (size_t offset = 0; offset + block_size <= chunk_size; offset += block_size)
+        {
+            PoolBlock block;
+            block.addr = chunk.addr + offset;
+            block.mr_ = chunk.mr_;
+            central.push_back(block);
+        }
+        VLOG(3) << info() << " carves a chunk of " << chunk_size << " bytes into "
+                << chunk_size / block_size << " blocks of " << block_size << " bytes";
+        TRACE_OUT;
+    }
+
+}; // end namespace rdma_core
@@ -0,0 +1,309 @@
+#include "rdma_messaging.h"
+#include "util/logging.h"
+
+#include <string.h>
+
+namespace rdma_core
+{
+    MessageEngine::MessageEngine(CreditChannel *credit,
+                                 uint32_t eager_threshold,
+                                 uint32_t staging_slots,
+                                 std::string engine_info) :
+        engine_info_(engine_info),
+        credit_(credit)
+    {
+        TRACE_IN;
+        CHECK(credit_ != nullptr) << "Cannot send messages without a credit channel in " << info();
+        CHECK(staging_slots > 0) << "Invalid staging slots of " << info() << ": " << staging_slots;
+        uint32_t block_size = credit_->get_peer_block_size();
+        CHECK(block_size > sizeof(MessageHeader))
+            << "The receive blocks of the peer (" << block_size << " bytes) cannot hold a message header in " << info();
+        if (eager_threshold > get_max_eager_threshold())
+        {
+            LOG(WARNING) << "The eager threshold of " << info() << " (" << eager_threshold << " bytes) is lowered to "
+                         << get_max_eager_threshold() << " bytes, the payload the receive blocks of the peer hold";
+            eager_threshold = get_max_eager_threshold();
+        }
+        set_eager_threshold(eager_threshold);
+
+        RDMAChannel *channel = credit_->get_channel();
+        staging_.reset(RDMABuffer::allocate_buffer(block_size, staging_slots, engine_info_ + "_staging", nullptr,
+                                                   RDMABuffer::device_local_policy(channel)));
+        channel->register_buffer(staging_.get());
+        VLOG(3) << "Creating " << info() << " over " << credit_->info() << ", eager threshold: " << eager_threshold_
+                << " bytes, staging slots: " << staging_slots;
+        TRACE_OUT;
+    }
+
+    MessageEngine::~MessageEngine()
+    {
+        TRACE_IN;
+        if (!posted_ops_.empty() || !deferred_.empty() || !rendezvous_sends_.empty())
+            LOG(WARNING) << "Releasing " << info() << " with " << posted_ops_.size() + deferred_.size()
+                         << " op(s) in flight and " << rendezvous_sends_.size() << " rendezvous waiting for FIN";
+        if (!unexpected_.empty())
+            LOG(WARNING) << "Releasing " << info() << " with " << unexpected_.size() << " unexpected message(s)";
+        VLOG(3) << "Releasing " << info() << ", sent " << num_eager_ << " eager and " << num_rendezvous_
+                << " rendezvous message(s)";
+        TRACE_OUT;
+    }
+
+    uint64_t MessageEngine::send_message(RDMABuffer *buffer, // the data to send
+                                         size_t length,      // data length to send
+                                         uint32_t msg_tag)   // tagging the message type
+    {
+        CHECK(buffer != 0) << "RDMABuffer has not been initialized";
+        CHECK(length <= buffer->buffer_size) << "Invalid data length to send: " << length
+                                             << ", exceeding the buffer size: " << buffer->buffer_size;
+        CHECK(length <= UINT32_MAX) << "Invalid data length to send: " << length << " in " << info();
+
+        bool eager = length <= eager_threshold_;
+        MessageHeader header;
+        header.msg_id = next_msg_id_;
+        header.msg_tag = msg_tag;
+        header.length = length;
+        memset(&header.source, 0, sizeof(header.source));
+        if (!eager)
+        {
+            CHECK(buffer->mr_ != nullptr) << "The rendezvous buffer of " << info() << " is not registered";
+            header.source.buffer_addr_ = (uint64_t)buffer->data_ptr;
+            header.source.buffer_length_ = length;
+            header.source.rkey_ = buffer->mr_->rkey;
+        }
+        RDMABuffer *block = stage(header);
+        if (block == nullptr)
+            return 0;
+
+        MessageCompletion completion;
+        completion.msg_id = next_msg_id_;
+        completion.msg_tag = msg_tag;
+        completion.length = length;
+        completion.buffer = buffer;
+        completion.is_send = true;
+        completion.eager = eager;
+
+        PostedOp op;
+        op.kind = OpKind::STAGED_SEND;
+        op.type = eager ? ProtocolType::EAGER : ProtocolType::RTS;
+        op.buffer = block;
+        op.wire_length = sizeof(MessageHeader);
+        if (eager)
+        { // the source is free once copied, the send is reported when the copy is retired
+            memcpy((char *)block->data_ptr + sizeof(MessageHeader), buffer->data_ptr, length);
+            op.wire_length += length;
+            op.completion = completion;
+            num_eager_++;
+        }
+        else
+        { // reported when the FIN arrives
+            rendezvous_sends_.push_back(completion);
+            num_rendezvous_++;
+        }
+        submit(op);
+        return next_msg_id_++;
+    }
+
+    void MessageEngine::post_recv(RDMABuffer *buffer, // where the message lands
+                                  size_t capacity)    // bytes the destination holds
+    {
+        CHECK(buffer != 0) << "RDMABuffer has not been initialized";
+        PostedRecv dest;
+        dest.buffer = buffer;
+        dest.capacity = capacity;
+        if (unexpected_.empty())
+        {
+            posted_dests_.push_back(dest);
+            return;
+        }
+        deliver(unexpected_.front(), dest);
+        unexpected_.pop_front();
+        flush_deferred();
+    }
+
+    void MessageEngine::on_completion(struct ibv_wc *wc)
+    {
+        if (wc->opcode & IBV_WC_RECV)
+        {
+            on_recv(wc);
+        }
+        else
+        {
+            uint32_t retired = credit_->on_send_done(wc);
+            CHECK(retired <= posted_ops_.size()) << credit_->info() << " retires " << retired
+                                                 << " ops, while " << info() << " only posted " << posted_ops_.size();
+            for (uint32_t index = 0; index < retired; index++)
+            {
+                PostedOp op = posted_ops_.front();
+                posted_ops_.pop_front();
+                on_retired(op);
+            }
+        }
+        flush_deferred();
+    }
+
+    void MessageEngine::progress()
+    {
+        flush_deferred();
+        credit_->progress();
+    }
+
+    bool MessageEngine::next_completion(struct MessageCompletion *completion)
+    {
+        if (completions_.empty())
+            return false;
+        *completion = completions_.front();
+        completions_.pop_front();
+        return true;
+    }
+
+    void MessageEngine::set_eager_threshold(uint32_t eager_threshold)
+    {
+        CHECK(eager_threshold <= get_max_eager_threshold())
+            << "Invalid eager threshold of " << info() << ": " << eager_threshold
+            << ", the receive blocks of the peer hold " << get_max_eager_threshold() << " bytes of payload";
+        eager_threshold_ = eager_threshold;
+    }
+
+    RDMABuffer *MessageEngine::stage(struct MessageHeader &header)
+    {
+        RDMABuffer *block = staging_->try_next();
+        if (block == nullptr)
+            return nullptr;
+        memcpy(block->data_ptr, &header, sizeof(MessageHeader));
+        return block;
+    }
+
+    void MessageEngine::submit(PostedOp &op)
+    {
+        deferred_.push_back(op);
+        flush_deferred();
+    }
+
+    void MessageEngine::flush_deferred()
+    {
+        while (!pending_fins_.empty())
+        {
+            MessageHeader header;
+            header.msg_id = pending_fins_.front();
+            memset(&header.source, 0, sizeof(header.source));
+            RDMABuffer *block = stage(header);
+            if (block == nullptr)
+                break;
+            pending_fins_.pop_front();
+
+            PostedOp op;
+            op.kind = OpKind::STAGED_SEND;
+            op.type = ProtocolType::FIN;
+            op.buffer = block;
+            op.wire_length = sizeof(MessageHeader);
+            deferred_.push_back(op);
+        }
+
+        while (!deferred_.empty())
+        {
+            PostedOp &op = deferred_.front();
+            bool accepted = op.kind == OpKind::READ
+                                ? credit_->read_remote(op.buffer, op.wire_length, &op.remote)
+                                : credit_->send_remote(op.buffer, op.wire_length, static_cast<uint32_t>(op.type));
+            if (!accepted) // the queue of the credit channel is full, retry once its ops retire
+                break;
+            posted_ops_.push_back(op);
+            deferred_.pop_front();
+        }
+    }
+
+    void MessageEngine::send_fin(uint64_t msg_id)
+    {
+        pending_fins_.push_back(msg_id);
+        flush_deferred();
+    }
+
+    void MessageEngine::on_recv(struct ibv_wc *wc)
+    {
+        RDMABuffer *block = credit_->on_recv_done(wc);
+        CHECK(wc->byte_len >= sizeof(MessageHeader))
+            << "Invalid message of " << wc->byte_len << " bytes in " << info();
+        UnexpectedMessage message;
+        message.type = static_cast<ProtocolType>(wc->imm_data);
+        memcpy(&message.header, block->data_ptr, sizeof(MessageHeader));
+
+        switch (message.type)
+        {
+            case ProtocolType::FIN:
+            {
+                CHECK(!rendezvous_sends_.empty() && rendezvous_sends_.front().msg_id == message.header.msg_id)
+                    << "Unexpected FIN of message " << message.header.msg_id << " in " << info();
+                completions_.push_back(rendezvous_sends_.front());
+                rendezvous_sends_.pop_front();
+                credit_->repost(block);
+                return;
+            }
+            case ProtocolType::EAGER:
+            {
+                CHECK(wc->byte_len == sizeof(MessageHeader) + message.header.length)
+                    << "Truncated eager message " << message.header.msg_id << " in " << info();
+                message.block = block; // the payload stays in the bounce buffer until it is matched
+                break;
+            }
+            case ProtocolType::RTS:
+            {
+                credit_->repost(block);
+                break;
+            }
+            default:
+                LOG(FATAL) << "Unknown message type " << wc->imm_data << " in " << info();
+        }
+
+        if (posted_dests_.empty())
+        {
+            unexpected_.push_back(message);
+            return;
+        }
+        deliver(message, posted_dests_.front());
+        posted_dests_.pop_front();
+    }
+
+    void MessageEngine::deliver(UnexpectedMessage &message, PostedRecv &dest)
+    {
+        CHECK(message.header.length <= dest.capacity)
+            << "Message " << message.header.msg_id << " of " << message.header.length
+            << " bytes overflows the destination of " << dest.capacity << " bytes in " << info();
+        MessageCompletion completion;
+        completion.msg_id = message.header.msg_id;
+        completion.msg_tag = message.header.msg_tag;
+        completion.length = message.header.length;
+        completion.buffer = dest.buffer;
+        completion.is_send = false;
+        completion.eager = message.type == ProtocolType::EAGER;
+
+        if (message.type == ProtocolType::EAGER)
+        {
+            memcpy(dest.buffer->data_ptr, (char *)message.block->data_ptr + sizeof(MessageHeader), message.header.length);
+            credit_->repost(message.block);
+            completions_.push_back(completion);
+            return;
+        }
+
+        PostedOp op;
+        op.kind = OpKind::READ;
+        op.buffer = dest.buffer;
+        op.wire_length = message.header.length;
+        op.remote = message.header.source;
+        op.completion = completion;
+        submit(op);
+    }
+
+    void MessageEngine::on_retired(PostedOp &op)
+    {
+        if (op.kind == OpKind::READ)
+        { // the source of the peer is read, it may be reused once the FIN arrives
+            send_fin(op.completion.msg_id);
+            completions_.push_back(op.completion);
+            return;
+        }
+        staging_->release(1); // staged sends retire in the order of their blocks
+        if (op.type == ProtocolType::EAGER)
+            completions_.push_back(op.completion);
+    }
+
+}; // end namespace rdma_core
@@ -0,0 +1,364 @@
+#include "rdma_reduce.h"
+#include "rdma_reduce_kernels.h"
+#include "util/logging.h"
+
+#include <algorithm>
+#include <atomic>
+#include <string.h>
+#include <type_traits>
+
+namespace rdma_core
+{
+    namespace
+    {
+        // the integers wrap around instead of overflowing, like the vector kernels do
+        template <typename T>
+        inline T wrapping_add(T accumulated, T value)
+        {
+            typedef typename std::make_unsigned<T>::type U;
+            return (T)(U)((U)accumulated + (U)value);
+        }
+
+        template <typename T>
+        inline T wrapping_mul(T accumulated, T value)
+        {
+            typedef typename std::make_unsigned<T>::type U;
+            return (T)(U)((U)accumulated * (U)value);
+        }
+
+        // min/max keep the second operand on a nan, as the vector min/max instructions do
+        template <ReduceOp op, typename T>
+        inline T apply(T accumulated, T value)
+        {
+            if constexpr (op == ReduceOp::SUM)
+            {
+                if constexpr (std::is_integral<T>::value)
+                    return wrapping_add<T>(accumulated, value);
+                else
+                    return accumulated + value;
+            }
+            else if constexpr (op == ReduceOp::PROD)
+            {
+                if constexpr (std::is_integral<T>::value)
+                    return wrapping_mul<T>(accumulated, value);
+                else
+                    return accumulated * value;
+            }
+            else if constexpr (op == ReduceOp::MAX)
+                return accumulated > value ? accumulated : value;
+            else
+                return accumulated < value ? accumulated : value;
+        }
+
+        template <ReduceOp op, typename T>
+        void reduce_native(T *dst, T *copy, const T *src, size_t count)
+        {
+            if (copy == nullptr)
+            {
+                for (size_t index = 0; index < count; index++)
+                    dst[index] = apply<op, T>(dst[index], src[index]);
+                return;
+            }
+            for (size_t index = 0; index < count; index++)
+                copy[index] = dst[index] = apply<op, T>(dst[index], src[index]);
+        }
+
+        template <ReduceOp op, float (*to_float)(uint16_t), uint16_t (*from_float)(float)>
+        void reduce_widened(uint16_t *dst, uint16_t *copy, const uint16_t *src, size_t count)
+        {
+            for (size_t index = 0; index < count; index++)
+            {
+                dst[index] = from_float(apply<op, float>(to_float(dst[index]), to_float(src[index])));
+                if (copy != nullptr)
+                    copy[index] = dst[index];
+            }
+        }
+
+        template <ReduceOp op>
+        void reduce_typed(void *dst, void *copy, const void *src, size_t count, ReduceDataType type)
+        {
+            switch (type)
+            {
+                case ReduceDataType::FLOAT32:
+                    reduce_native<op, float>((float *)dst, (float *)copy, (const float *)src, count);
+                    break;
+                case ReduceDataType::INT8:
+                    reduce_native<op, int8_t>((int8_t *)dst, (int8_t *)copy, (const int8_t *)src, count);
+                    break;
+                case ReduceDataType::INT32:
+                    reduce_native<op, int32_t>((int32_t *)dst, (int32_t *)copy, (const int32_t *)src, count);
+                    break;
+                case ReduceDataType::INT64:
+                    reduce_native<op, int64_t>((int64_t *)dst, (int64_t *)copy, (const int64_t *)src, count);
+                    break;
+                case ReduceDataType::FLOAT16:
+                    reduce_widened<op, half_to_float, float_to_half>((uint16_t *)dst, (uint16_t *)copy,
+                                                                     (const uint16_t *)src, count);
+                    break;
+                case ReduceDataType::BFLOAT16:
+                    reduce_widened<op, bfloat16_to_float, float_to_bfloat16>((uint16_t *)dst, (uint16_t *)copy,
+                                                                             (const uint16_t *)src, count);
+                    break;
+                default:
+                    LOG(FATAL) << "Unknown reduce data type: " << static_cast<uint32_t>(type);
+            }
+        }
+
+        ReduceIsa detect_reduce_isa()
+        {
+#if defined(__x86_64__) && defined(__GNUC__)
+            __builtin_cpu_init(); // cpuid, also checks that the os saves the wide registers
+            if (__builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512bw") &&
+                __builtin_cpu_supports("avx512dq"))
+                return ReduceIsa::AVX512;
+            if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("f16c"))
+                return ReduceIsa::AVX2;
+#endif
+            return ReduceIsa::SCALAR;
+        }
+
+        // the widest supported kernels, detected once
+        const ReduceIsa supported_isa = detect_reduce_isa();
+        std::atomic<ReduceIsa> active_isa(supported_isa);
+    }; // end anonymous namespace
+
+    size_t reduce_type_size(ReduceDataType type)
+    {
+        switch (type)
+        {
+            case ReduceDataType::FLOAT32:
+                return sizeof(float);
+            case ReduceDataType::FLOAT16:
+            case ReduceDataType::BFLOAT16:
+                return sizeof(uint16_t);
+            case ReduceDataType::INT8:
+                return sizeof(int8_t);
+            case ReduceDataType::INT32:
+                return sizeof(int32_t);
+            case ReduceDataType::INT64:
+                return sizeof(int64_t);
+        }
+        LOG(FATAL) << "Unknown reduce data type: " << static_cast<uint32_t>(type);
+        return 0;
+    }
+
+    std::string reduce_type_to_str(ReduceDataType type)
+    {
+        switch (type)
+        {
+            case ReduceDataType::FLOAT32:
+                return "float32";
+            case ReduceDataType::FLOAT16:
+                return "float16";
+            case ReduceDataType::BFLOAT16:
+                return "bfloat16";
+            case ReduceDataType::INT8:
+                return "int8";
+            case ReduceDataType::INT32:
+                return "int32";
+            case ReduceDataType::INT64:
+                return "int64";
+        }
+        return "unknown";
+    }
+
+    std::string reduce_op_to_str(ReduceOp op)
+    {
+        switch (op)
+        {
+            case ReduceOp::SUM:
+                return "sum";
+            case ReduceOp::PROD:
+                return "prod";
+            case ReduceOp::MAX:
+                return "max";
+            case ReduceOp::MIN:
+                return "min";
+        }
+        return "unknown";
+    }
+
+    std::string reduce_isa_to_str(ReduceIsa isa)
+    {
+        switch (isa)
+        {
+            case ReduceIsa::SCALAR:
+                return "scalar";
+            case ReduceIsa::AVX2:
+                return "avx2";
+            case ReduceIsa::AVX512:
+                return "avx512";
+        }
+        return "unknown";
+    }
+
+    ReduceIsa get_reduce_isa()
+    {
+        return active_isa.load(std::memory_order_relaxed);
+    }
+
+    bool reduce_isa_supported(ReduceIsa isa)
+    {
+        return static_cast<uint32_t>(isa) <= static_cast<uint32_t>(supported_isa);
+    }
+
+    void set_reduce_isa(ReduceIsa isa)
+    {
+        CHECK(reduce_isa_supported(isa)) << "The cpu does not support the " << reduce_isa_to_str(isa)
+                                         << " kernels, " << reduce_isa_to_str(supported_isa) << " at most";
+        active_isa.store(isa, std::memory_order_relaxed);
+    }
+
+    void reduce_buffers(void *dst,           // the accumulated elements
+                        const void *src,     // the elements to fold in
+                        size_t count,        // how many elements
+                        ReduceDataType type, // the type of the elements
+                        ReduceOp op)         // the reduction
+    {
+        reduce_copy_buffers(dst, nullptr, src, count, type, op);
+    }
+
+    void reduce_copy_buffers(void *dst,           // the accumulated elements
+                             void *copy,          // receives the result as well
+                             const void *src,     // the elements to fold in
+                             size_t count,        // how many elements
+                             ReduceDataType type, // the type of the elements
+                             ReduceOp op)         // the reduction
+    {
+        size_t element_size = reduce_type_size(type);
+        ReduceIsa isa = get_reduce_isa();
+        if (copy != nullptr && (isa == ReduceIsa::SCALAR || count * element_size < REDUCE_FUSED_MIN_BYTES))
+        { // the fused pass loses to reduce + memcpy while the buffers fit in the cache, or without vectors
+            reduce_copy_buffers(dst, nullptr, src, count, type, op);
+            memcpy(copy, dst, count * element_size);
+            return;
+        }
+        if (copy != nullptr && (uintptr_t)copy % element_size == 0)
+        { // the head up to an aligned copy, so the vector kernels stream the rest of it
+            size_t head = std::min(count, (REDUCE_STREAM_ALIGN - (uintptr_t)copy % REDUCE_STREAM_ALIGN) %
+                                              REDUCE_STREAM_ALIGN / element_size);
+            reduce_scalar(dst, copy, src, head, type, op);
+            size_t offset = head * element_size;
+            dst = (uint8_t *)dst + offset;
+            copy = (uint8_t *)copy + offset;
+            src = (const uint8_t *)src + offset;
+            count -= head;
+        }
+        size_t done = 0;
+        bool vectorized = false;
+        if (isa == ReduceIsa::AVX512)
+            vectorized = reduce_avx512(dst, copy, src, count, type, op, &done);
+        if (!vectorized && isa != ReduceIsa::SCALAR) // e.g., the products of int8, which no isa multiplies
+            vectorized = reduce_avx2(dst, copy, src, count, type, op, &done);
+        if (done == count)
+            return;
+        size_t offset = done * element_size;
+        reduce_scalar((uint8_t *)dst + offset, copy == nullptr ? nullptr : (uint8_t *)copy + offset,
+                      (const uint8_t *)src + offset, count - done, type, op);
+    }
+
+    void reduce_scalar(void *dst, void *copy, const void *src, size_t count, ReduceDataType type, ReduceOp op)
+    {
+        switch (op)
+        {
+            case ReduceOp::SUM:
+                reduce_typed<ReduceOp::SUM>(dst, copy, src, count, type);
+                break;
+            case ReduceOp::PROD:
+                reduce_typed<ReduceOp::PROD>(dst, copy, src, count, type);
+                break;
+            case ReduceOp::MAX:
+                reduce_typed<ReduceOp::MAX>(dst, copy, src, count, type);
+                break;
+            case ReduceOp::MIN:
+                reduce_typed<ReduceOp::MIN>(dst, copy, src, count, type);
+                break;
+            default:
+                LOG(FATAL) << "Unknown reduce op: " << static_cast<uint32_t>(op);
+        }
+    }
+
+    float half_to_float(uint16_t value)
+    {
+        uint32_t sign = (uint32_t)(value & 0x8000) << 16;
+        uint32_t exponent = (value >> 10) & 0x1F;
+        uint32_t mantissa = value & 0x3FF;
+        uint32_t bits;
+        if (exponent == 0x1F) // inf or nan
+        {
+            bits = sign | 0x7F800000 | (mantissa << 13);
+        }
+        else if (exponent != 0)
+        {
+            bits = sign | ((exponent + 127 - 15) << 23) | (mantissa << 13);
+        }
+        else if (mantissa == 0)
+        {
+            bits = sign;
+        }
+        else
+        { // subnormal, normalized in float32
+            exponent = 127 - 15 + 1;
+            while (!(mantissa & 0x400))
+            {
+                mantissa <<= 1;
+                exponent--;
+            }
+            bits = sign | (exponent << 23) | ((mantissa & 0x3FF) << 13);
+        }
+        float result;
+        memcpy(&result, &bits, sizeof(result));
+        return result;
+    }
+
+    uint16_t float_to_half(float value)
+    {
+        uint32_t bits;
+        memcpy(&bits, &value, sizeof(bits));
+        uint32_t sign = (bits >> 16) & 0x8000;
+        uint32_t exponent = (bits >> 23) & 0xFF;
+        uint32_t mantissa = bits & 0x7FFFFF;
+        if (exponent == 0xFF) // inf or nan, a nan stays a nan
+            return sign | 0x7C00 | (mantissa != 0 ? 0x200 : 0);
+
+        int32_t half_exponent = (int32_t)exponent - 127 + 15;
+        if (half_exponent >= 0x1F) // overflow
+            return sign | 0x7C00;
+        if (half_exponent <= 0)
+        { // subnormal or zero
+            if (half_exponent < -10)
+                return sign;
+            mantissa |= 0x800000;
+            uint32_t shift = 14 - half_exponent;
+            uint32_t half_mantissa = mantissa >> shift;
+            uint32_t remainder = mantissa & ((1u << shift) - 1);
+            uint32_t halfway = 1u << (shift - 1);
+            if (remainder > halfway || (remainder == halfway && (half_mantissa & 1)))
+                half_mantissa++;
+            return sign | half_mantissa;
+        }
+        uint32_t half = sign | ((uint32_t)half_exponent << 10) | (mantissa >> 13);
+        uint32_t remainder = mantissa & 0x1FFF;
+        if (remainder > 0x1000 || (remainder == 0x1000 && (half & 1)))
+            half++; // a carry into the exponent is still the right rounding
+        return half;
+    }
+
+    float bfloat16_to_float(uint16_t value)
+    {
+        uint32_t bits = (uint32_t)value << 16;
+        float result;
+        memcpy(&result, &bits, sizeof(result));
+        return result;
+    }
+
+    uint16_t float_to_bfloat16(float value)
+    {
+        uint32_t bits;
+        memcpy(&bits, &value, sizeof(bits));
+        if ((bits & 0x7F800000) == 0x7F800000 && (bits & 0x7FFFFF) != 0) // a nan stays a nan
+            return (bits >> 16) | 0x40;
+        return (bits + 0x7FFF + ((bits >> 16) & 1)) >> 16;
+    }
+
+}; // end namespace rdma_core
@@ -0,0 +1,281 @@
+#include "rdma_reduce_kernels.h"
+
+#if defined(__AVX2__) && defined(__F16C__)
+#include <immintrin.h>
+
+namespace rdma_core
+{
+    namespace
+    {
+        template <ReduceOp op>
+        inline __m256 apply_ps(__m256 accumulated, __m256 value)
+        {
+            if constexpr (op == ReduceOp::SUM)
+                return _mm256_add_ps(accumulated, value);
+            else if constexpr (op == ReduceOp::PROD)
+                return _mm256_mul_ps(accumulated, value);
+            else if constexpr (op == ReduceOp::MAX)
+                return _mm256_max_ps(accumulated, value);
+            else
+                return _mm256_min_ps(accumulated, value);
+        }
+
+        template <ReduceOp op>
+        inline __m256i apply_epi8(__m256i accumulated, __m256i value) // no prod, x86 does not multiply bytes
+        {
+            if constexpr (op == ReduceOp::SUM)
+                return _mm256_add_epi8(accumulated, value);
+            else if constexpr (op == ReduceOp::MAX)
+                return _mm256_max_epi8(accumulated, value);
+            else
+                return _mm256_min_epi8(accumulated, value);
+        }
+
+        template <ReduceOp op>
+        inline __m256i apply_epi32(__m256i accumulated, __m256i value)
+        {
+            if constexpr (op == ReduceOp::SUM)
+                return _mm256_add_epi32(accumulated, value);
+            else if constexpr (op == ReduceOp::PROD)
+                return _mm256_mullo_epi32(accumulated, value);
+            else if constexpr (op == ReduceOp::MAX)
+                return _mm256_max_epi32(accumulated, value);
+            else
+                return _mm256_min_epi32(accumulated, value);
+        }
+
+        template <ReduceOp op>
+        inline __m256i apply_epi64(__m256i accumulated, __m256i value) // no prod, AVX2 has no 64-bit multiply
+        {
+            if constexpr (op == ReduceOp::SUM)
+                return _mm256_add_epi64(accumulated, value);
+            else if constexpr (op == ReduceOp::MAX)
+                return _mm256_blendv_epi8(value, accumulated, _mm256_cmpgt_epi64(accumulated, value));
+            else
+                return _mm256_blendv_epi8(accumulated, value, _mm256_cmpgt_epi64(accumulated, value));
+        }
+
+        inline __m256 load_bf16(const uint16_t *src)
+        {
+            __m256i widened = _mm256_cvtepu16_epi32(_mm_loadu_si128((const __m128i *)src));
+            return _mm256_castsi256_ps(_mm256_slli_epi32(widened, 16));
+        }
+
+        // rounds to the nearest even and keeps a nan a nan, as float_to_bfloat16() does
+        inline __m128i round_bf16(__m256 value)
+        {
+            __m256i bits = _mm256_castps_si256(value);
+            __m256i lsb = _mm256_and_si256(_mm256_srli_epi32(bits, 16), _mm256_set1_epi32(1));
+            __m256i rounded = _mm256_add_epi32(bits, _mm256_add_epi32(lsb, _mm256_set1_epi32(0x7FFF)));
+            __m256i is_nan = _mm256_cmpgt_epi32(_mm256_and_si256(bits, _mm256_set1_epi32(0x7FFFFFFF)),
+                                                _mm256_set1_epi32(0x7F800000));
+            __m256i quiet = _mm256_or_si256(bits, _mm256_set1_epi32(0x400000));
+            __m256i shifted = _mm256_srli_epi32(_mm256_blendv_epi8(rounded, quiet, is_nan), 16);
+            // packing works per 128-bit lane, the even quadwords hold the 8 results
+            __m256i packed = _mm256_permute4x64_epi64(_mm256_packus_epi32(shifted, shifted), 0x08);
+            return _mm256_castsi256_si128(packed);
+        }
+
+        // the kernel of a type, Result is what reduce() hands to store()
+        template <ReduceOp op>
+        struct Float32Kernel
+        {
+            typedef float Element;
+            typedef __m256 Result;
+            static constexpr size_t lanes = 8;
+            static inline Result reduce(const float *dst, const float *src)
+            {
+                return apply_ps<op>(_mm256_loadu_ps(dst), _mm256_loadu_ps(src));
+            }
+            static inline void store(float *dst, Result result)
+            {
+                _mm256_storeu_ps(dst, result);
+            }
+            static inline void stream(float *dst, Result result) // dst is aligned to Result
+            {
+                _mm256_stream_ps(dst, result);
+            }
+        };
+
+        template <ReduceOp op>
+        struct Float16Kernel
+        {
+            typedef uint16_t Element;
+            typedef __m128i Result;
+            static constexpr size_t lanes = 8;
+            static inline Result reduce(const uint16_t *dst, const uint16_t *src)
+            {
+                __m256 accumulated = _mm256_cvtph_ps(_mm_loadu_si128((const __m128i *)dst));
+                __m256 value = _mm256_cvtph_ps(_mm_loadu_si128((const __m128i *)src));
+                return _mm256_cvtps_ph(apply_ps<op>(accumulated, value), _MM_FROUND_TO_NEAREST_INT);
+            }
+            static inline void store(uint16_t *dst, Result result)
+            {
+                _mm_storeu_si128((__m128i *)dst, result);
+            }
+            static inline void stream(uint16_t *dst, Result result) // dst is aligned to Result
+            {
+                _mm_stream_si128((__m128i *)dst, result);
+            }
+        };
+
+        template <ReduceOp op>
+        struct BFloat16Kernel
+        {
+            typedef uint16_t Element;
+            typedef __m128i Result;
+            static constexpr size_t lanes = 8;
+            static inline Result reduce(const uint16_t *dst, const uint16_t *src)
+            {
+                return round_bf16(apply_ps<op>(load_bf16(dst), load_bf16(src)));
+            }
+            static inline void store(uint16_t *dst, Result result)
+            {
+                _mm_storeu_si128((__m128i *)dst, result);
+            }
+            static inline void stream(uint16_t *dst, Result result) // dst is aligned to Result
+            {
+                _mm_stream_si128((__m128i *)dst, result);
+            }
+        };
+
+        template <__m256i (*apply)(__m256i, __m256i), typename T>
+        struct IntegerKernel
+        {
+            typedef T Element;
+            typedef __m256i Result;
+            static constexpr size_t lanes = sizeof(__m256i) / sizeof(T);
+            static inline Result reduce(const T *dst, const T *src)
+            {
+                return apply(_mm256_loadu_si256((const __m256i *)dst), _mm256_loadu_si256((const __m256i *)src));
+            }
+            static inline void store(T *dst, Result result)
+            {
+                _mm256_storeu_si256((__m256i *)dst, result);
+            }
+            static inline void stream(T *dst, Result result) // dst is aligned to Result
+            {
+                _mm256_stream_si256((__m256i *)dst, result);
+            }
+        };
+
+        // reduce the whole vectors at the head into dst and copy, returns how many elements
+        template <typename Kernel, bool streaming>
+        size_t copy_loop(typename Kernel::Element *dst, typename Kernel::Element *copy,
+                         const typename Kernel::Element *src, size_t count)
+        {
+            constexpr size_t lanes = Kernel::lanes;
+            size_t index = 0;
+            // the stores to dst and copy go in groups, alternating them vector by vector slows both down
+            for (; index + 4 * lanes <= count; index += 4 * lanes)
+            {
+                typename Kernel::Result results[4];
+                for (size_t vector = 0; vector < 4; vector++)
+                    results[vector] = Kernel::reduce(dst + index + vector * lanes, src + index + vector * lanes);
+                for (size_t vector = 0; vector < 4; vector++)
+                    Kernel::store(dst + index + vector * lanes, results[vector]);
+                for (size_t vector = 0; vector < 4; vector++)
+                {
+                    if constexpr (streaming)
+                        Kernel::stream(copy + index + vector * lanes, results[vector]);
+                    else
+                        Kernel::store(copy + index + vector * lanes, results[vector]);
+                }
+            }
+            for (; index + lanes <= count; index += lanes)
+            {
+                typename Kernel::Result result = Kernel::reduce(dst + index, src + index);
+                Kernel::store(dst + index, result);
+                if constexpr (streaming)
+                    Kernel::stream(copy + index, result);
+                else
+                    Kernel::store(copy + index, result);
+            }
+            return index;
+        }
+
+        // the whole vectors at the head, returns how many elements
+        template <typename Kernel>
+        size_t reduce_loop(void *dst_buffer, void *copy_buffer, const void *src_buffer, size_t count)
+        {
+            typedef typename Kernel::Element Element;
+            constexpr size_t lanes = Kernel::lanes;
+            Element *dst = (Element *)dst_buffer, *copy = (Element *)copy_buffer;
+            const Element *src = (const Element *)src_buffer;
+            size_t index = 0;
+            if (copy == nullptr)
+            {
+                for (; index + lanes <= count; index += lanes)
+                    Kernel::store(dst + index, Kernel::reduce(dst + index, src + index));
+                return index;
+            }
+            if ((uintptr_t)copy % sizeof(typename Kernel::Result) != 0)
+                return copy_loop<Kernel, false>(dst, copy, src, count);
+            // the copy is not read back here, so it streams past the cache instead of evicting dst and src
+            index = copy_loop<Kernel, true>(dst, copy, src, count);
+            _mm_sfence();
+            return index;
+        }
+
+        template <ReduceOp op>
+        bool reduce_typed(void *dst, void *copy, const void *src, size_t count, ReduceDataType type, size_t *done)
+        {
+            switch (type)
+            {
+                case ReduceDataType::FLOAT32:
+                    *done = reduce_loop<Float32Kernel<op>>(dst, copy, src, count);
+                    return true;
+                case ReduceDataType::FLOAT16:
+                    *done = reduce_loop<Float16Kernel<op>>(dst, copy, src, count);
+                    return true;
+                case ReduceDataType::BFLOAT16:
+                    *done = reduce_loop<BFloat16Kernel<op>>(dst, copy, src, count);
+                    return true;
+                case ReduceDataType::INT8:
+                    if constexpr (op == ReduceOp::PROD)
+                        return false;
+                    else
+                        *done = reduce_loop<IntegerKernel<apply_epi8<op>, int8_t>>(dst, copy, src, count);
+                    return true;
+                case ReduceDataType::INT32:
+                    *done = reduce_loop<IntegerKernel<apply_epi32<op>, int32_t>>(dst, copy, src, count);
+                    return true;
+                case ReduceDataType::INT64:
+                    if constexpr (op == ReduceOp::PROD)
+                        return false;
+                    else
+                        *done = reduce_loop<IntegerKernel<apply_epi64<op>, int64_t>>(dst, copy, src, count);
+                    return true;
+            }
+            return false;
+        }
+    }; // end anonymous namespace
+
+    bool reduce_avx2(void *dst, void *copy, const void *src, size_t count, ReduceDataType type, ReduceOp op,
+                     size_t *done)
+    {
+        switch (op)
+        {
+            case ReduceOp::SUM:
+                return reduce_typed<ReduceOp::SUM>(dst, copy, src, count, type, done);
+            case ReduceOp::PROD:
+                return reduce_typed<ReduceOp::PROD>(dst, copy, src, count, type, done);
+            case ReduceOp::MAX:
+                return reduce_typed<ReduceOp::MAX>(dst, copy, src, count, type, done);
+            case ReduceOp::MIN:
+                return reduce_typed<ReduceOp::MIN>(dst, copy, src, count, type, done);
+        }
+        return false;
+    }
+}; // end namespace rdma_core
+
+#else // built without -mavx2 -mf16c, e.g., not on x86, get_reduce_isa() never picks it then
+
+namespace rdma_core
+{
+    bool reduce_avx2(void *, void *, const void *, size_t, ReduceDataType, ReduceOp, size_t *)
+    {
+        return false;
+    }
+}; // end namespace rdma_core
+#endif
@@ -0,0 +1,277 @@
+#include "rdma_reduce_kernels.h"
+
+#if defined(__AVX512F__) && defined(__AVX512BW__) && defined(__AVX512DQ__)
+#include <immintrin.h>
+
+namespace rdma_core
+{
+    namespace
+    {
+        template <ReduceOp op>
+        inline __m512 apply_ps(__m512 accumulated, __m512 value)
+        {
+            if constexpr (op == ReduceOp::SUM)
+                return _mm512_add_ps(accumulated, value);
+            else if constexpr (op == ReduceOp::PROD)
+                return _mm512_mul_ps(accumulated, value);
+            else if constexpr (op == ReduceOp::MAX)
+                return _mm512_max_ps(accumulated, value);
+            else
+                return _mm512_min_ps(accumulated, value);
+        }
+
+        template <ReduceOp op>
+        inline __m512i apply_epi8(__m512i accumulated, __m512i value) // no prod, x86 does not multiply bytes
+        {
+            if constexpr (op == ReduceOp::SUM)
+                return _mm512_add_epi8(accumulated, value);
+            else if constexpr (op == ReduceOp::MAX)
+                return _mm512_max_epi8(accumulated, value);
+            else
+                return _mm512_min_epi8(accumulated, value);
+        }
+
+        template <ReduceOp op>
+        inline __m512i apply_epi32(__m512i accumulated, __m512i value)
+        {
+            if constexpr (op == ReduceOp::SUM)
+                return _mm512_add_epi32(accumulated, value);
+            else if constexpr (op == ReduceOp::PROD)
+                return _mm512_mullo_epi32(accumulated, value);
+            else if constexpr (op == ReduceOp::MAX)
+                return _mm512_max_epi32(accumulated, value);
+            else
+                return _mm512_min_epi32(accumulated, value);
+        }
+
+        template <ReduceOp op>
+        inline __m512i apply_epi64(__m512i accumulated, __m512i value)
+        {
+            if constexpr (op == ReduceOp::SUM)
+                return _mm512_add_epi64(accumulated, value);
+            else if constexpr (op == ReduceOp::PROD)
+                return _mm512_mullo_epi64(accumulated, value);
+            else if constexpr (op == ReduceOp::MAX)
+                return _mm512_max_epi64(accumulated, value);
+            else
+                return _mm512_min_epi64(accumulated, value);
+        }
+
+        inline __m512 load_bf16(const uint16_t *src)
+        {
+            __m512i widened = _mm512_cvtepu16_epi32(_mm256_loadu_si256((const __m256i *)src));
+            return _mm512_castsi512_ps(_mm512_slli_epi32(widened, 16));
+        }
+
+        // rounds to the nearest even and keeps a nan a nan, as float_to_bfloat16() does
+        inline __m256i round_bf16(__m512 value)
+        {
+            __m512i bits = _mm512_castps_si512(value);
+            __m512i lsb = _mm512_and_si512(_mm512_srli_epi32(bits, 16), _mm512_set1_epi32(1));
+            __m512i rounded = _mm512_add_epi32(bits, _mm512_add_epi32(lsb, _mm512_set1_epi32(0x7FFF)));
+            __mmask16 is_nan = _mm512_cmpgt_epi32_mask(_mm512_and_si512(bits, _mm512_set1_epi32(0x7FFFFFFF)),
+                                                       _mm512_set1_epi32(0x7F800000));
+            __m512i quiet = _mm512_or_si512(bits, _mm512_set1_epi32(0x400000));
+            return _mm512_cvtepi32_epi16(_mm512_srli_epi32(_mm512_mask_blend_epi32(is_nan, rounded, quiet), 16));
+        }
+
+        // the kernel of a type, Result is what reduce() hands to store()
+        template <ReduceOp op>
+        struct Float32Kernel
+        {
+            typedef float Element;
+            typedef __m512 Result;
+            static constexpr size_t lanes = 16;
+            static inline Result reduce(const float *dst, const float *src)
+            {
+                return apply_ps<op>(_mm512_loadu_ps(dst), _mm512_loadu_ps(src));
+            }
+            static inline void store(float *dst, Result result)
+            {
+                _mm512_storeu_ps(dst, result);
+            }
+            static inline void stream(float *dst, Result result) // dst is aligned to Result
+            {
+                _mm512_stream_ps(dst, result);
+            }
+        };
+
+        template <ReduceOp op>
+        struct Float16Kernel
+        {
+            typedef uint16_t Element;
+            typedef __m256i Result;
+            static constexpr size_t lanes = 16;
+            static inline Result reduce(const uint16_t *dst, const uint16_t *src)
+            {
+                __m512 accumulated = _mm512_cvtph_ps(_mm256_loadu_si256((const __m256i *)dst));
+                __m512 value = _mm512_cvtph_ps(_mm256_loadu_si256((const __m256i *)src));
+                return _mm512_cvtps_ph(apply_ps<op>(accumulated, value), _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC);
+            }
+            static inline void store(uint16_t *dst, Result result)
+            {
+                _mm256_storeu_si256((__m256i *)dst, result);
+            }
+            static inline void stream(uint16_t *dst, Result result) // dst is aligned to Result
+            {
+                _mm256_stream_si256((__m256i *)dst, result);
+            }
+        };
+
+        template <ReduceOp op>
+        struct BFloat16Kernel
+        {
+            typedef uint16_t Element;
+            typedef __m256i Result;
+            static constexpr size_t lanes = 16;
+            static inline Result reduce(const uint16_t *dst, const uint16_t *src)
+            {
+                return round_bf16(apply_ps<op>(load_bf16(dst), load_bf16(src)));
+            }
+            static inline void store(uint16_t *dst, Result result)
+            {
+                _mm256_storeu_si256((__m256i *)dst, result);
+            }
+            static inline void stream(uint16_t *dst, Result result) // dst is aligned to Result
+            {
+                _mm256_stream_si256((__m256i *)dst, result);
+            }
+        };
+
+        template <__m512i (*apply)(__m512i, __m512i), typename T>
+        struct IntegerKernel
+        {
+            typedef T Element;
+            typedef __m512i Result;
+            static constexpr size_t lanes = sizeof(__m512i) / sizeof(T);
+            static inline Result reduce(const T *dst, const T *src)
+            {
+                return apply(_mm512_loadu_si512(dst), _mm512_loadu_si512(src));
+            }
+            static inline void store(T *dst, Result result)
+            {
+                _mm512_storeu_si512(dst, result);
+            }
+            static inline void stream(T *dst, Result result) // dst is aligned to Result
+            {
+                _mm512_stream_si512((__m512i *)dst, result);
+            }
+        };
+
+        // reduce the whole vectors at the head into dst and copy, returns how many elements
+        template <typename Kernel, bool streaming>
+        size_t copy_loop(typename Kernel::Element *dst, typename Kernel::Element *copy,
+                         const typename Kernel::Element *src, size_t count)
+        {
+            constexpr size_t lanes = Kernel::lanes;
+            size_t index = 0;
+            // the stores to dst and copy go in groups, alternating them vector by vector slows both down
+            for (; index + 4 * lanes <= count; index += 4 * lanes)
+            {
+                typename Kernel::Result results[4];
+                for (size_t vector = 0; vector < 4; vector++)
+                    results[vector] = Kernel::reduce(dst + index + vector * lanes, src + index + vector * lanes);
+                for (size_t vector = 0; vector < 4; vector++)
+                    Kernel::store(dst + index + vector * lanes, results[vector]);
+                for (size_t vector = 0; vector < 4; vector++)
+                {
+                    if constexpr (streaming)
+                        Kernel::stream(copy + index + vector * lanes, results[vector]);
+                    else
+                        Kernel::store(copy + index + vector * lanes, results[vector]);
+                }
+            }
+            for (; index + lanes <= count; index += lanes)
+            {
+                typename Kernel::Result result = Kernel::reduce(dst + index, src + index);
+                Kernel::store(dst + index, result);
+                if constexpr (streaming)
+                    Kernel::stream(copy + index, result);
+                else
+                    Kernel::store(copy + index, result);
+            }
+            return index;
+        }
+
+        // the whole vectors at the head, returns how many elements
+        template <typename Kernel>
+        size_t reduce_loop(void *dst_buffer, void *copy_buffer, const void *src_buffer, size_t count)
+        {
+            typedef typename Kernel::Element Element;
+            constexpr size_t lanes = Kernel::lanes;
+            Element *dst = (Element *)dst_buffer, *copy = (Element *)copy_buffer;
+            const Element *src = (const Element *)src_buffer;
+            size_t index = 0;
+            if (copy == nullptr)
+            {
+                for (; index + lanes <= count; index += lanes)
+                    Kernel::store(dst + index, Kernel::reduce(dst + index, src + index));
+                return index;
+            }
+            if ((uintptr_t)copy % sizeof(typename Kernel::Result) != 0)
+                return copy_loop<Kernel, false>(dst, copy, src, count);
+            // the copy is not read back here, so it streams past the cache instead of evicting dst and src
+            index = copy_loop<Kernel, true>(dst, copy, src, count);
+            _mm_sfence();
+            return index;
+        }
+
+        template <ReduceOp op>
+        bool reduce_typed(void *dst, void *copy, const void *src, size_t count, ReduceDataType type, size_t *done)
+        {
+            switch (type)
+            {
+                case ReduceDataType::FLOAT32:
+                    *done = reduce_loop<Float32Kernel<op>>(dst, copy, src, count);
+                    return true;
+                case ReduceDataType::FLOAT16:
+                    *done = reduce_loop<Float16Kernel<op>>(dst, copy, src, count);
+                    return true;
+                case ReduceDataType::BFLOAT16:
+                    *done = reduce_loop<BFloat16Kernel<op>>(dst, copy, src, count);
+                    return true;
+                case ReduceDataType::INT8:
+                    if constexpr (op == ReduceOp::PROD)
+                        return false;
+                    else
+                        *done = reduce_loop<IntegerKernel<apply_epi8<op>, int8_t>>(dst, copy, src, count);
+                    return true;
+                case ReduceDataType::INT32:
+                    *done = reduce_loop<IntegerKernel<apply_epi32<op>, int32_t>>(dst, copy, src, count);
+                    return true;
+                case ReduceDataType::INT64:
+                    *done = reduce_loop<IntegerKernel<apply_epi64<op>, int64_t>>(dst, copy, src, count);
+                    return true;
+            }
+            return false;
+        }
+    }; // end anonymous namespace
+
+    bool reduce_avx512(void *dst, void *copy, const void *src, size_t count, ReduceDataType type, ReduceOp op,
+                       size_t *done)
+    {
+        switch (op)
+        {
+            case ReduceOp::SUM:
+                return reduce_typed<ReduceOp::SUM>(dst, copy, src, count, type, done);
+            case ReduceOp::PROD:
+                return reduce_typed<ReduceOp::PROD>(dst, copy, src, count, type, done);
+            case ReduceOp::MAX:
+                return reduce_typed<ReduceOp::MAX>(dst, copy, src, count, type, done);
+            case ReduceOp::MIN:
+                return reduce_typed<ReduceOp::MIN>(dst, copy, src, count, type, done);
+        }
+        return false;
+    }
+}; // end namespace rdma_core
+
+#else // built without -mavx512f/bw/dq, e.g., not on x86, get_reduce_isa() never picks it then
+
+namespace rdma_core
+{
+    bool reduce_avx512(void *, void *, const void *, size_t, ReduceDataType, ReduceOp, size_t *)
+    {
+        return false;
+    }
+}; // end namespace rdma_core
+#endif
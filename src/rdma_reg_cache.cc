@@ -0,0 +1,225 @@
+#include "rdma_reg_cache.h"
+#include "rdma_config.h"
+#include "util/logging.h"
+
+#include <set>
+#include <unistd.h>
+
+namespace rdma_core
+{
+    std::mutex RDMARegistrationCache::cache_global_lock_;
+    std::unordered_map<struct ibv_pd *, std::unique_ptr<RDMARegistrationCache>> RDMARegistrationCache::cache_map_;
+
+    static inline uintptr_t page_align_down(uintptr_t addr)
+    {
+        static const uintptr_t page_size = sysconf(_SC_PAGESIZE);
+        return addr & ~(page_size - 1);
+    }
+    static inline uintptr_t page_align_up(uintptr_t addr)
+    {
+        static const uintptr_t page_size = sysconf(_SC_PAGESIZE);
+        return (addr + page_size - 1) & ~(page_size - 1);
+    }
+
+    RDMARegistrationCache::RDMARegistrationCache(std::shared_ptr<RDMADevice> device,
+                                                 struct ibv_pd *pd,
+                                                 std::string cache_info) :
+        cache_info_(cache_info),
+        device_(device),
+        pd_(pd)
+    {
+        TRACE_IN;
+        CHECK(device_ != nullptr) << "The device of " << info() << " should not be empty";
+        CHECK(pd_ != nullptr) << "The protection domain of " << info() << " should not be empty";
+        VLOG(2) << "Creating " << info() << " on pd (" << pd_ << "), pinned budget: " << pinned_budget_;
+        TRACE_OUT;
+    }
+
+    RDMARegistrationCache::~RDMARegistrationCache()
+    {
+        TRACE_IN;
+        std::lock_guard<std::mutex> lock(cache_lock_);
+        std::set<CachedRegion *> retired_regions; // only reachable from the pins
+        for (auto &each : pinned_regions_)
+        {
+            if (each.second->retired)
+                retired_regions.insert(each.second);
+        }
+        for (auto *region : retired_regions)
+            destroy(region);
+        for (auto &each_class : regions_)
+        {
+            for (auto &each : each_class.second)
+                destroy(each.second);
+        }
+        VLOG(2) << "Releasing " << info() << ", hits: " << hits_ << ", misses: " << misses_;
+        TRACE_OUT;
+    }
+
+    RDMARegistrationCache *RDMARegistrationCache::get_registration_cache(RDMAAdapter *adapter)
+    {
+        TRACE_IN;
+        CHECK(adapter != nullptr) << "Cannot query the registration cache of an empty adapter";
+        struct ibv_pd *pd = adapter->get_protected_domain();
+        CHECK(pd != nullptr) << adapter->info() << " has not created its protection domain, load it first";
+
+        std::lock_guard<std::mutex> lock(cache_global_lock_);
+        auto iter = cache_map_.find(pd);
+        if (iter != cache_map_.end())
+        {
+            TRACE_OUT;
+            return iter->second.get();
+        }
+        RDMARegistrationCache *cache = new RDMARegistrationCache(adapter->get_device(), pd,
+                                                                 RLOG::make_string("%p@", pd) + adapter->get_config().dev_name);
+        cache_map_[pd] = std::unique_ptr<RDMARegistrationCache>(cache);
+        TRACE_OUT;
+        return cache;
+    }
+
+    struct ibv_mr *RDMARegistrationCache::acquire(const void *addr, size_t size_in_byte, int access_flags)
+    {
+        CHECK(addr != nullptr && size_in_byte > 0) << "Invalid user memory to register in " << info();
+        uintptr_t start = (uintptr_t)addr;
+        uintptr_t end = (uintptr_t)addr + size_in_byte;
+        if ((access_flags & REMOTE_ACCESS_FLAGS) == 0)
+        { // only this process reaches the pages, rounding them up exposes nothing and merges more
+            start = page_align_down(start);
+            end = page_align_up(end);
+        }
+
+        std::lock_guard<std::mutex> lock(cache_lock_);
+        // regions of other access are never used or merged, so no byte gets more access than it was acquired with
+        std::map<uintptr_t, CachedRegion *> &regions = regions_[access_flags];
+        // the last region starting at or before start is the only candidate covering it
+        auto iter = regions.upper_bound(start);
+        if (iter != regions.begin())
+        {
+            CachedRegion *region = std::prev(iter)->second;
+            if (region->end >= end)
+            {
+                hits_++;
+                region->pin_count++;
+                lru_.splice(lru_.begin(), lru_, region->lru_position);
+                pinned_regions_.insert({addr, region});
+                return region->mr_;
+            }
+            if (region->end > start)
+                iter = std::prev(iter);
+        }
+
+        // miss: merge with every overlapping region, so the new registration replaces them
+        misses_++;
+        while (iter != regions.end() && iter->second->start < end)
+        {
+            CachedRegion *region = iter->second;
+            ++iter;
+            start = std::min(start, region->start);
+            end = std::max(end, region->end);
+            retire(region);
+            if (region->pin_count == 0) // a pinned one is destroyed by its last release()
+                destroy(region);
+        }
+
+        CachedRegion *region = new CachedRegion();
+        region->start = start;
+        region->end = end;
+        region->access_flags = access_flags;
+        region->mr_ = device_->real_register_mem_with_access(pd_, (void *)start, end - start, access_flags, info());
+        region->pin_count = 1;
+        lru_.push_front(region);
+        region->lru_position = lru_.begin();
+        regions[start] = region;
+        pinned_regions_.insert({addr, region});
+        pinned_bytes_ += end - start;
+        evict();
+        return region->mr_;
+    }
+
+    void RDMARegistrationCache::release(const void *addr, int access_flags)
+    {
+        std::lock_guard<std::mutex> lock(cache_lock_);
+        auto pins = pinned_regions_.equal_range(addr);
+        auto iter = pins.first;
+        while (iter != pins.second && iter->second->access_flags != access_flags)
+            ++iter;
+        CHECK(iter != pins.second) << "The user memory (" << addr << ") is not acquired with access 0x" << std::hex
+                                   << access_flags << " from " << info();
+        CachedRegion *region = iter->second;
+        pinned_regions_.erase(iter);
+
+        CHECK(region->pin_count > 0) << "Unbalanced release of the user memory (" << addr << ") in " << info();
+        if (--region->pin_count == 0)
+        {
+            if (region->retired)
+                destroy(region);
+            else
+                evict();
+        }
+    }
+
+    void RDMARegistrationCache::invalidate(const void *addr, size_t size_in_byte)
+    {
+        uintptr_t start = page_align_down((uintptr_t)addr);
+        uintptr_t end = page_align_up((uintptr_t)addr + size_in_byte);
+
+        std::lock_guard<std::mutex> lock(cache_lock_);
+        for (auto &each_class : regions_)
+        {
+            std::map<uintptr_t, CachedRegion *> &regions = each_class.second;
+            auto iter = regions.upper_bound(start);
+            if (iter != regions.begin() && std::prev(iter)->second->end > start)
+                iter = std::prev(iter);
+            while (iter != regions.end() && iter->second->start < end)
+            {
+                CachedRegion *region = iter->second;
+                ++iter;
+                retire(region);
+                if (region->pin_count == 0)
+                    destroy(region);
+                else
+                    LOG(WARNING) << "Invalidating the user memory (" << (void *)region->start
+                                 << ") in " << info() << " while it is pinned " << region->pin_count << " time(s)";
+            }
+        }
+    }
+
+    void RDMARegistrationCache::set_pinned_budget(size_t budget_in_byte)
+    {
+        std::lock_guard<std::mutex> lock(cache_lock_);
+        pinned_budget_ = budget_in_byte;
+        evict();
+    }
+
+    void RDMARegistrationCache::retire(CachedRegion *region)
+    {
+        regions_[region->access_flags].erase(region->start);
+        lru_.erase(region->lru_position);
+        region->retired = true;
+    }
+
+    void RDMARegistrationCache::destroy(CachedRegion *region)
+    {
+        device_->real_deregister_mem(region->mr_, info());
+        pinned_bytes_ -= region->end - region->start;
+        delete region;
+    }
+
+    void RDMARegistrationCache::evict()
+    {
+        auto iter = lru_.end();
+        while (pinned_bytes_ > pinned_budget_ && iter != lru_.begin())
+        {
+            CachedRegion *region = *(--iter);
+            if (region->pin_count != 0)
+                continue;
+            iter = lru_.erase(iter);
+            regions_[region->access_flags].erase(region->start);
+            destroy(region);
+        }
+        if (pinned_bytes_ > pinned_budget_)
+            VLOG_EVERY_N(2, SHOWN_LOG_EVERN_N) << info() << " pins " << pinned_bytes_
+                                               << " bytes, exceeding the budget " << pinned_budget_;
+    }
+
+}; // end namespace rdma_core
@@ -0,0 +1,246 @@
+#include "rdma_ring.h"
+#include "util/logging.h"
+
+#include <algorithm>
+#include <string.h>
+
+namespace rdma_core
+{
+    RingChannel::RingChannel(RDMAChannel *channel,
+                             uint32_t ring_size,
+                             uint32_t notify_window,
+                             uint32_t max_queued,
+                             std::string ring_info) :
+        ring_info_(ring_info),
+        channel_(channel),
+        max_queued_(max_queued)
+    {
+        TRACE_IN;
+        CHECK(channel_ != nullptr) << "Cannot write into the ring of an empty channel in " << info();
+        channel_->claim_recv_queue(info());
+        CHECK(ring_size >= RING_FRAME_ALIGN && ring_size <= RING_MAX_SIZE && ring_size % RING_FRAME_ALIGN == 0)
+            << "Invalid ring size of " << info() << ": " << ring_size << ", it should be a multiple of "
+            << RING_FRAME_ALIGN << " in [" << RING_FRAME_ALIGN << ", " << RING_MAX_SIZE << "]";
+        CHECK(notify_window > 0 && notify_window <= channel_->get_config().max_recv_wr)
+            << "Invalid notify window of " << info() << ": " << notify_window
+            << ", it should be in (0, max_recv_wr of " << channel_->info() << "]";
+
+        ring_.reset(RDMABuffer::allocate_buffer(ring_size, 1, ring_info_ + "_ring", nullptr,
+                                                RDMABuffer::device_local_policy(channel_)));
+        channel_->register_buffer(ring_.get());
+        status_words_.reset(RDMABuffer::allocate_buffer(NUM_STATUS_WORDS * sizeof(uint64_t), 1,
+                                                        ring_info_ + "_status_words"));
+        channel_->register_buffer(status_words_.get());
+        memset(status_words_->data_ptr, 0, NUM_STATUS_WORDS * sizeof(uint64_t));
+        num_header_slots_ = channel_->get_config().max_send_wr;
+        headers_.reset(RDMABuffer::allocate_buffer(sizeof(FrameHeader), num_header_slots_, ring_info_ + "_headers"));
+        channel_->register_buffer(headers_.get());
+
+        for (uint32_t index = 0; index < notify_window; index++)
+        { // posted before the handshake, so the peer never writes ahead of them
+            channel_->recv_notification();
+        }
+        notifies_posted_ = notify_window;
+        ((volatile uint64_t *)status_words_->data_ptr)[LOCAL_NOTIFIES] = notifies_posted_;
+
+        RingHandshake local, remote;
+        local.ring.buffer_addr_ = (uint64_t)ring_->data_ptr;
+        local.ring.buffer_length_ = ring_size;
+        local.ring.rkey_ = ring_->mr_->rkey;
+        local.ring.fd_ = 0;
+        local.status.buffer_addr_ = (uint64_t)status_words_->data_ptr;
+        local.status.buffer_length_ = (LOCAL_NOTIFIES + 1) * sizeof(uint64_t);
+        local.status.rkey_ = status_words_->mr_->rkey;
+        local.status.fd_ = 0;
+        local.notify_window = notify_window;
+        channel_->get_registered_endpoint()->exchange_with_peer(&local, &remote, sizeof(RingHandshake),
+                                                                 "the ring handshake of " + info());
+        peer_ring_ = remote.ring;
+        peer_ring_size_ = remote.ring.buffer_length_;
+        peer_status_ = remote.status;
+        peer_notifies_ = remote.notify_window;
+        VLOG(3) << "Creating " << info() << " over " << channel_->info() << ", ring: " << ring_size
+                << " bytes, peer ring: " << peer_ring_size_ << " bytes, notify window: " << notify_window;
+        TRACE_OUT;
+    }
+
+    RingChannel::~RingChannel()
+    {
+        TRACE_IN;
+        if (!idle())
+            LOG(WARNING) << "Releasing " << info() << " with " << pending_sends_.size() << " send(s) queued and "
+                         << posted_sqes_.size() << " sqe(s) in flight";
+        if (!received_frames_.empty())
+            LOG(WARNING) << "Releasing " << info() << " with " << received_frames_.size() << " message(s) not released";
+        VLOG(3) << "Releasing " << info() << ", stalled " << num_stalls_ << " time(s), read the head back "
+                << num_head_reads_ << " time(s)";
+        TRACE_OUT;
+    }
+
+    bool RingChannel::send_remote(RDMABuffer *buffer,            // placeholder of the data to send
+                                  uint32_t data_length_in_bytes, // data length to send
+                                  uint32_t msg_tag)              // tagging the message type
+    {
+        CHECK(buffer != 0) << "RDMABuffer has not been initialized";
+        CHECK(frame_size(data_length_in_bytes) <= peer_ring_size_ &&
+              frame_size(data_length_in_bytes) / RING_FRAME_ALIGN <= RING_UNIT_MASK)
+            << "Invalid data length to send: " << data_length_in_bytes
+            << ", its frame exceeds the ring of the peer: " << peer_ring_size_;
+        CHECK(data_length_in_bytes == 0 || channel_->get_config().max_send_sge >= 2)
+            << info() << " gathers the header and the payload, set max_send_sge of " << channel_->info() << " to 2";
+        if (pending_sends_.size() >= max_queued_)
+            return false;
+
+        PendingSend pending;
+        pending.buffer = buffer;
+        pending.data_length_in_bytes = data_length_in_bytes;
+        pending.msg_tag = msg_tag;
+        pending_sends_.push_back(pending);
+        progress();
+        if (!pending_sends_.empty()) // this one is still queued
+            num_stalls_++;
+        return true;
+    }
+
+    uint32_t RingChannel::on_send_done(struct ibv_wc *wc)
+    {
+        CHECK(wc->status == IBV_WC_SUCCESS) << "Failed to write with error " << ibv_wc_status_str(wc->status)
+                                            << " in " << info();
+        int64_t retired = channel_->retire_sqe();
+        CHECK((size_t)retired <= posted_sqes_.size()) << channel_->info() << " retires " << retired
+                                                      << " sqes, while " << info() << " only posted " << posted_sqes_.size();
+        uint32_t num_retired = 0;
+        for (int64_t index = 0; index < retired; index++)
+        {
+            if (posted_sqes_.front() == SqeKind::HEAD_READ)
+            {
+                volatile uint64_t *status_words = (volatile uint64_t *)status_words_->data_ptr;
+                fold_peer_status(status_words[PEER_HEAD], status_words[PEER_NOTIFIES]);
+                head_read_inflight_ = false;
+            }
+            else
+            {
+                num_retired++;
+            }
+            posted_sqes_.pop_front();
+        }
+        progress(); // the sq (and maybe the ring of the peer) has room again
+        return num_retired;
+    }
+
+    void RingChannel::on_recv_done(struct ibv_wc *wc, struct RingMessage *message)
+    {
+        CHECK(wc->status == IBV_WC_SUCCESS) << "Failed to recv with error " << ibv_wc_status_str(wc->status)
+                                            << " in " << info();
+        CHECK(wc->opcode == IBV_WC_RECV_RDMA_WITH_IMM) << "Unexpected opcode " << wc->opcode << " in " << info();
+        channel_->decrease_rqe();
+        channel_->recv_notification(); // the receive is given back at once, it holds no buffer
+        notifies_posted_++;
+        volatile uint64_t *status_words = (volatile uint64_t *)status_words_->data_ptr;
+        status_words[LOCAL_NOTIFIES] = notifies_posted_;
+
+        uint64_t offset = (uint64_t)(wc->imm_data >> RING_UNIT_BITS) * RING_FRAME_ALIGN;
+        uint64_t frame = (uint64_t)(wc->imm_data & RING_UNIT_MASK) * RING_FRAME_ALIGN;
+        uint64_t expected = recv_tail_ % ring_->buffer_size;
+        if (offset != expected)
+        { // the peer skipped the tail of the ring
+            CHECK(offset == 0) << "Unexpected frame at " << offset << " of the ring, while " << expected
+                               << " is expected in " << info();
+            recv_tail_ += ring_->buffer_size - expected;
+        }
+        CHECK(offset + frame <= ring_->buffer_size) << "Invalid frame (offset: " << offset << ", size: " << frame
+                                                    << ") exceeding the ring of " << info();
+
+        FrameHeader *header = (FrameHeader *)(ring_->data_ptr + offset);
+        message->data = (char *)header + sizeof(FrameHeader);
+        message->length = header->length;
+        message->msg_tag = header->msg_tag;
+        fold_peer_status(header->ack_bytes, header->ack_notifies);
+        recv_tail_ += frame;
+        received_frames_.push_back(recv_tail_);
+        progress(); // the piggybacked head may release the queued sends
+    }
+
+    void RingChannel::release()
+    {
+        CHECK(!received_frames_.empty()) << "Nothing to release in " << info();
+        volatile uint64_t *status_words = (volatile uint64_t *)status_words_->data_ptr;
+        status_words[LOCAL_HEAD] = received_frames_.front();
+        received_frames_.pop_front();
+    }
+
+    uint32_t RingChannel::progress()
+    {
+        uint32_t num_posted = 0;
+        while (!pending_sends_.empty() && channel_->sq_has_room(1))
+        {
+            if (!try_write(pending_sends_.front()))
+                break;
+            pending_sends_.pop_front();
+            num_posted++;
+        }
+
+        // the ring (or the receives) of the peer is full as we know, and nothing of the peer piggybacks its head
+        if (!pending_sends_.empty() && !head_read_inflight_ && channel_->sq_has_room())
+            read_head();
+        return num_posted;
+    }
+
+    bool RingChannel::try_write(PendingSend &pending)
+    {
+        uint64_t frame = frame_size(pending.data_length_in_bytes);
+        uint64_t offset = tail_ % peer_ring_size_;
+        uint64_t skipped = offset + frame > peer_ring_size_ ? peer_ring_size_ - offset : 0; // a frame never wraps
+        if (tail_ + skipped + frame - peer_head_ > peer_ring_size_ || frames_written_ >= peer_notifies_)
+            return false;
+        tail_ += skipped;
+        offset = tail_ % peer_ring_size_;
+
+        // a header slot is reused only after its sqe is retired, the sq never holds more than max_send_wr sqes
+        RDMABuffer *header_slot = headers_->at(frames_written_ % num_header_slots_);
+        FrameHeader *header = (FrameHeader *)header_slot->data_ptr;
+        volatile uint64_t *status_words = (volatile uint64_t *)status_words_->data_ptr;
+        header->length = pending.data_length_in_bytes;
+        header->msg_tag = pending.msg_tag;
+        header->ack_bytes = status_words[LOCAL_HEAD];
+        header->ack_notifies = notifies_posted_;
+
+        BufferSlice slices[2];
+        slices[0].buffer = header_slot;
+        slices[0].length = sizeof(FrameHeader);
+        slices[1].buffer = pending.buffer;
+        slices[1].length = pending.data_length_in_bytes;
+        struct CommDescriptor remote;
+        remote.buffer_addr_ = peer_ring_.buffer_addr_ + offset;
+        remote.buffer_length_ = frame;
+        remote.rkey_ = peer_ring_.rkey_;
+        remote.fd_ = 0;
+        uint32_t imm_data = (uint32_t)(offset / RING_FRAME_ALIGN) << RING_UNIT_BITS | (uint32_t)(frame / RING_FRAME_ALIGN);
+        channel_->write_remote(slices, pending.data_length_in_bytes == 0 ? 1 : 2, &remote, imm_data, true);
+        posted_sqes_.push_back(SqeKind::WRITE);
+        tail_ += frame;
+        frames_written_++;
+        return true;
+    }
+
+    void RingChannel::read_head()
+    {
+        BufferSlice slice;
+        slice.buffer = status_words_.get();
+        slice.offset = PEER_HEAD * sizeof(uint64_t);
+        slice.length = (PEER_NOTIFIES - PEER_HEAD + 1) * sizeof(uint64_t);
+        channel_->read_remote(&slice, 1, &peer_status_);
+        posted_sqes_.push_back(SqeKind::HEAD_READ);
+        head_read_inflight_ = true;
+        num_head_reads_++;
+        HOT_VLOG_EVERY_N(3, SHOWN_LOG_EVERN_N) << info() << " reads the head of the peer back, "
+                                           << get_free_bytes() << " bytes free as known";
+    }
+
+    void RingChannel::fold_peer_status(uint64_t head, uint64_t notifies)
+    {
+        peer_head_ = std::max(peer_head_, head);
+        peer_notifies_ = std::max(peer_notifies_, notifies);
+    }
+
+}; // end namespace rdma_core
@@ -1,5 +1,6 @@
 
 #include "rdma_server_sess.h"
+#include "rdma_bootstrap.h"
 #include "rdma_buffer.h"
 #include "rdma_session.h"
 
@@ -43,6 +44,9 @@ namespace rdma_core
 
             VLOG(2) << "The server is listening on " << work_env_.tcp_port;
             uint32_t connected = 0;
+            // the endpoints are created (and tested) by the workers, so the next peer is accepted at once
+            std::unique_ptr<RDMABootstrap> bootstrap(RDMABootstrap::build_bootstrap(work_env_.bootstrap_workers,
+                                                                                    "Accepting@" + info()));
 
             do //loop wait and build new rdma connections
             {
@@ -53,7 +57,8 @@ namespace rdma_core
                 if ((client_fd = accept(listen_fd, (struct sockaddr *)&cin, &len)) == -1)
                     LOG(FATAL) << "Error of accepting new connection";
 
-                accept_new_connection(client_fd, cin);
+                bootstrap->submit([this, client_fd, cin]
+                                  { accept_new_connection(client_fd, cin); });
 
                 connected++;
                 VLOG(3) << "received connection: " << connected << "/" << work_env_.cluster.size();
@@ -62,6 +67,7 @@ namespace rdma_core
                     break;
 
             } while (true);
+            bootstrap->wait_all();
             is_connected_ = true;
         }
     }
@@ -72,10 +78,14 @@ namespace rdma_core
         VLOG(3) << "RDMAServerSession is reconfiging the channel&adapter";
         for (auto &each_endpoint : end_point_mgr_)
         {
-            auto &a_config = each_endpoint->get_channel()->get_config();
-            a_config.using_shared_cq = true;
-            a_config.cq_key = "SharedCQ@" + info();
-            //a_config.traffic_class = 64;
+            for (auto *each_channel : each_endpoint->get_all_channels())
+            {
+                auto &a_config = each_channel->get_config();
+                a_config.using_shared_cq = true;
+                a_config.cq_key = "SharedCQ@" + info();
+                a_config.use_event_channel = work_env_.use_event;
+                //a_config.traffic_class = 64;
+            }
         }
     }
     void RDMAServerSession::post_connecting()
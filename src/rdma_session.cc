@@ -1,5 +1,7 @@
 #include "rdma_session.h"
+#include "rdma_bootstrap.h"
 #include "rdma_buffer.h"
+#include "rdma_completion_engine.h"
 #include "util/ip_qos_helper.h"
 #include <atomic>
 #include <thread>
@@ -59,67 +61,58 @@ namespace rdma_core
     {
         established_done_(aggregated_channels);
 
-        struct ibv_wc global_wc[128];
-        do
+        if (!callbacks_registered_)
+        { // the default handlers are called directly by the dispatch
+            DefaultCompletionHandler default_handler(this);
+            dispatch_CQ(aggregated_channels, default_handler);
+        }
+        else
         {
+            CallbackCompletionHandler callback_handler(process_send_done_,
+                                                       process_recv_done_,
+                                                       process_recv_write_with_imm_done_,
+                                                       process_write_done_,
+                                                       process_read_done_);
+            dispatch_CQ(aggregated_channels, callback_handler);
+        }
+
+        VLOG(3) << "Connection testing is done, everything is OK!";
+    }
+
+    template <typename Handler>
+    void RDMASession::dispatch_CQ(std::vector<RDMAChannel *> &aggregated_channels, CompletionHandler<Handler> &handler)
+    {
+        if (work_env_.use_event)
+        { // spin only for a budget after the last cqe, then block on the event channels
+            std::unique_ptr<CompletionEngine> completion_engine(
+                CompletionEngine::build_completion_engine(CompletionMode::ADAPTIVE,
+                                                          work_env_.busy_poll_us,
+                                                          64,
+                                                          "CQEngine@" + info()));
             for (auto *each_channel : aggregated_channels)
+                completion_engine->attach(each_channel);
+            completion_engine->polling_CQ(handler);
+        }
+        else
+        {
+            handler.polling_CQ(aggregated_channels);
+        }
+    }
+    std::vector<ChannelStatsSnapshot> RDMASession::snapshot_stats()
+    {
+        std::vector<ChannelStatsSnapshot> snapshots;
+        std::lock_guard<std::mutex> lock(endpoint_lock_); // only against new endpoints, the data path goes on
+        for (auto &each_endpoint : end_point_mgr_)
+        {
+            for (auto *each_channel : each_endpoint->get_all_channels())
             {
-                int num_wqe = each_channel->poll_cq_batch(global_wc, 128);
-                //std::this_thread::sleep_for(std::chrono::milliseconds(100));
-                if (num_wqe == 0)
-                    continue;
-                VLOG_EVERY_N(3, SHOWN_LOG_EVERN_N) << "The number of polled cqe is " << num_wqe;
-
-                for (int wqe_index = 0; wqe_index < num_wqe; wqe_index++)
-                {
-                    if (global_wc[wqe_index].status != IBV_WC_SUCCESS)
-                    {
-                        each_channel->show_qp_info();
-                        LOG(FATAL) << "[WARNING]: Encounting unsuccess wqe, for: "
-                                   << ibv_wc_status_str(global_wc[wqe_index].status);
-                    }
-
-                    switch (global_wc[wqe_index].opcode)
-                    {
-                        case IBV_WC_SEND:
-                        {
-                            process_send_done_(&global_wc[wqe_index], 0);
-                            break;
-                        }
-                        case IBV_WC_RECV:
-                        {
-                            process_recv_done_(&global_wc[wqe_index], 0);
-                            break;
-                        }
-                        case IBV_WC_RDMA_WRITE:
-                        {
-                            process_write_done_(&global_wc[wqe_index], 0);
-                            break;
-                        }
-                        case IBV_WC_RDMA_READ:
-                        {
-                            process_read_done_(&global_wc[wqe_index], 0);
-                            break;
-                        }
-                        case IBV_WC_RECV_RDMA_WITH_IMM:
-                        {
-                            process_recv_write_with_imm_done_(&global_wc[wqe_index],
-                                                              0);
-                            break;
-                        }
-                        default:
-                        {
-                            RDMAChannel *active_channel = (RDMAChannel *)global_wc[wqe_index].wr_id;
-                            LOG(FATAL) << "Unknown opcode from " + active_channel->info();
-                            break;
-                        }
-                    }
-                }
+                ChannelStatsSnapshot snap = each_channel->get_stats().snapshot();
+                snap.channel = each_channel->get_id();
+                snap.peer = each_endpoint->get_peer_ip();
+                snapshots.push_back(std::move(snap));
             }
-
-        } while (true);
-
-        VLOG(3) << "Connection testing is done, everything is OK!";
+        }
+        return snapshots;
     }
     void RDMASession::allocate_resources()
     {
@@ -134,15 +127,17 @@ namespace rdma_core
         std::vector<std::thread *> process_threads;
         for (auto &each_endpoint : end_point_mgr_)
         {
-            auto *channel = each_endpoint->get_channel();
-            if (all_channel.find(channel->get_completQ()) == all_channel.end())
+            for (auto *channel : each_endpoint->get_all_channels()) // every channel is served, not only channel 0
             {
-                std::vector<RDMAChannel *> tmp_;
-                all_channel.insert({channel->get_completQ(), std::move(tmp_)});
-            }
-            all_channel[channel->get_completQ()].push_back(channel);
+                if (all_channel.find(channel->get_completQ()) == all_channel.end())
+                {
+                    std::vector<RDMAChannel *> tmp_;
+                    all_channel.insert({channel->get_completQ(), std::move(tmp_)});
+                }
+                all_channel[channel->get_completQ()].push_back(channel);
 
-            aggregated_channels.push_back(channel);
+                aggregated_channels.push_back(channel);
+            }
         }
         for (auto each : all_channel)
         {
@@ -166,9 +161,10 @@ namespace rdma_core
                                                                    peer_port, work_env_,
                                                                    this);
         //new_EndPoint->connecting();
+        std::lock_guard<std::mutex> lock(endpoint_lock_);
         end_point_mgr_.push_back(std::move(std::unique_ptr<RDMAEndPoint>(new_EndPoint)));
 
-        new_EndPoint->get_channel()->setup_index_in_session(end_point_mgr_.size() - 1);
+        new_EndPoint->setup_index_in_session(end_point_mgr_.size() - 1);
         {
             // in_qps.push_back(std::shared_ptr<std::atomic_uint64_t>(new std::atomic_uint64_t(0)));
             // out_qps.push_back(std::shared_ptr<std::atomic_uint64_t>(new std::atomic_uint64_t(0)));
@@ -187,6 +183,9 @@ namespace rdma_core
         VLOG(3) << "Register callback function to process events for " << info();
         if (established_done != nullptr)
             established_done_ = established_done;
+        callbacks_registered_ = process_send_done != nullptr || process_recv_done != nullptr ||
+                                process_recv_write_with_imm_done != nullptr || process_write_done != nullptr ||
+                                process_read_done != nullptr || callbacks_registered_;
         if (process_send_done != nullptr)
             process_send_done_ = process_send_done;
         if (process_recv_done != nullptr)
@@ -259,7 +258,7 @@ namespace rdma_core
     {
         CHECK(args == 0) << "Unused arguments";
         RDMAChannel *active_channel = (RDMAChannel *)wc->wr_id;
-        VLOG_EVERY_N(3, SHOWN_LOG_EVERN_N) << "get a cqe with opcode: IBV_WC_SEND from " << active_channel->info();
+        HOT_VLOG_EVERY_N(3, SHOWN_LOG_EVERN_N) << "get a cqe with opcode: IBV_WC_SEND from " << active_channel->info();
     }
 
     void RDMASession::default_process_recv_done(struct ibv_wc *wc, void *args)
@@ -276,14 +275,11 @@ namespace rdma_core
 
         std::string tmp_send_buf = base_to_send_data;
 
-        std::string on_recv_data_info = "get a cqe with opcode: IBV_WC_RECV from " + active_channel->info();
-
-        CHECK(wc->wc_flags & IBV_WC_WITH_IMM) << on_recv_data_info
+        CHECK(wc->wc_flags & IBV_WC_WITH_IMM) << "get a cqe with opcode: IBV_WC_RECV from " << active_channel->info()
                                               << ", detected imm data failed to check for IBV_WC_RECV";
 
         MessageType val = static_cast<MessageType>(wc->imm_data);
-
-        on_recv_data_info += ", imm data: " + std::to_string(wc->imm_data) + ", MSG_TYPE: " + MsgToStr(val) + ", Receive " + std::to_string(wc->byte_len) + " bytes data";
+        uint32_t recv_length = wc->byte_len; // the logs are built in their streams, only when they are on
 
         wc->byte_len = 0;
         if (val == MessageType::REQUEST_EXCHANGE_KEY)
@@ -298,16 +294,17 @@ namespace rdma_core
 
             active_channel->insert_peer_buffer("rw_sink_buffer_for_test", remote_comm_descritor);
 
-            on_recv_data_info += ", encounting EXCHANGE_KEY_REQUEST: ";
-            on_recv_data_info += "\n--------------------------------------------------------\n";
-            on_recv_data_info += RLOG::make_string("The remote sinked buffer for read/write test (%s) is: \n"
-                                                   "buffer_addr: %p, buffer_size: %u, rkey: 0x%x",
-                                                   active_channel->get_id().c_str(),
-                                                   (uint8_t *)remote_comm_descritor.buffer_addr_,
-                                                   remote_comm_descritor.buffer_length_,
-                                                   remote_comm_descritor.rkey_);
-            on_recv_data_info += "\n--------------------------------------------------------\n";
-            VLOG(3) << on_recv_data_info;
+            VLOG(3) << "get a cqe with opcode: IBV_WC_RECV from " << active_channel->info()
+                    << ", imm data: " << wc->imm_data << ", MSG_TYPE: " << MsgToStr(val)
+                    << ", Receive " << recv_length << " bytes data, encounting EXCHANGE_KEY_REQUEST: "
+                    << "\n--------------------------------------------------------\n"
+                    << RLOG::make_string("The remote sinked buffer for read/write test (%s) is: \n"
+                                         "buffer_addr: %p, buffer_size: %u, rkey: 0x%x",
+                                         active_channel->get_id().c_str(),
+                                         (uint8_t *)remote_comm_descritor.buffer_addr_,
+                                         remote_comm_descritor.buffer_length_,
+                                         remote_comm_descritor.rkey_)
+                    << "\n--------------------------------------------------------\n";
             active_channel->recv_remote(recv_buffer, recv_buffer->buffer_size);
             //recv_buffer->clear();
             active_channel->send_remote(send_buffer, tmp_send_buf.length(),
@@ -323,7 +320,10 @@ namespace rdma_core
         }
         else if (val == MessageType::TEST_FOR_SYNC_DATA)
         {
-            on_recv_data_info += ", the received data is: " + std::string((char *)recv_buffer->data_addr());
+            HOT_VLOG_EVERY_N(3, SHOWN_LOG_EVERN_N) << "get a cqe with opcode: IBV_WC_RECV from " << active_channel->info()
+                                                   << ", imm data: " << wc->imm_data << ", MSG_TYPE: " << MsgToStr(val)
+                                                   << ", Receive " << recv_length << " bytes data"
+                                                   << ", the received data is: " << (char *)recv_buffer->data_addr();
             //recv_buffer->clear();
             active_channel->recv_remote(recv_buffer, recv_buffer->buffer_size);
 
@@ -353,7 +353,10 @@ namespace rdma_core
         }
         else
         {
-            on_recv_data_info += ", the received data is: " + std::string((char *)recv_buffer->data_addr());
+            HOT_VLOG_EVERY_N(3, SHOWN_LOG_EVERN_N) << "get a cqe with opcode: IBV_WC_RECV from " << active_channel->info()
+                                                   << ", imm data: " << wc->imm_data << ", MSG_TYPE: " << MsgToStr(val)
+                                                   << ", Receive " << recv_length << " bytes data"
+                                                   << ", the received data is: " << (char *)recv_buffer->data_addr();
             //recv_buffer->clear();
             active_channel->recv_remote(recv_buffer, recv_buffer->buffer_size);
             tmp_send_buf = base_to_send_data;
@@ -361,7 +364,6 @@ namespace rdma_core
             active_channel->send_remote(send_buffer, tmp_send_buf.length(),
                                         static_cast<uint32_t>(MessageType::UNSET));
         }
-        VLOG_EVERY_N(3, SHOWN_LOG_EVERN_N) << on_recv_data_info;
     }
     void RDMASession::default_process_write_done(struct ibv_wc *wc, void *args)
     {
@@ -376,8 +378,7 @@ namespace rdma_core
 
         CHECK((recv_buffer != nullptr) && (read_buffer != nullptr)) << "Invalid buffer query";
 
-        std::string on_write_data_info = "get a cqe with opcode: IBV_WC_RDMA_WRITE from " + active_channel->info();
-        on_write_data_info += ", i.e., Writing " + std::to_string(wc->byte_len) + " bytes to remote. Now, we try to read it back from remote.";
+        uint32_t write_length = wc->byte_len;
         wc->byte_len = 0;
         { // launching read
             read_buffer->clear();
@@ -385,7 +386,9 @@ namespace rdma_core
                                         read_buffer->buffer_size,
                                         remote_comm_descritor);
         }
-        VLOG_EVERY_N(3, SHOWN_LOG_EVERN_N) << on_write_data_info;
+        HOT_VLOG_EVERY_N(3, SHOWN_LOG_EVERN_N) << "get a cqe with opcode: IBV_WC_RDMA_WRITE from " << active_channel->info()
+                                               << ", i.e., Writing " << write_length
+                                               << " bytes to remote. Now, we try to read it back from remote.";
     }
     void RDMASession::default_process_read_done(struct ibv_wc *wc, void *args)
     {
@@ -399,8 +402,7 @@ namespace rdma_core
 
         CHECK(remote_comm_descritor != nullptr) << "Cannot find the remote buffer info for rw_sink_buffer_for_test";
 
-        std::string on_read_data_info = "get a cqe with opcode: IBV_WC_RDMA_READ from " + active_channel->info();
-        on_read_data_info += ", i.e., Reading " + std::to_string(wc->byte_len) + " bytes from remote, the data is: " + std::string((char *)read_buffer->data_addr()) + ", Now, we would write it again!";
+        uint32_t read_length = wc->byte_len;
         wc->byte_len = 0;
         { // launching write
             std::string base_to_send_data = "Greetings from " + active_channel->info() + " for 'RDMA connection test'";
@@ -411,7 +413,9 @@ namespace rdma_core
                                          static_cast<uint32_t>(MessageType::UNSET),
                                          false); // notify_peer =false;
         }
-        VLOG_EVERY_N(3, SHOWN_LOG_EVERN_N) << on_read_data_info;
+        HOT_VLOG_EVERY_N(3, SHOWN_LOG_EVERN_N) << "get a cqe with opcode: IBV_WC_RDMA_READ from " << active_channel->info()
+                                               << ", i.e., Reading " << read_length << " bytes from remote, the data is: "
+                                               << (char *)read_buffer->data_addr() << ", Now, we would write it again!";
     }
 
     void RDMASession::default_process_recv_write_with_imm_done(struct ibv_wc *wc, void *args)
@@ -421,44 +425,27 @@ namespace rdma_core
         RDMABuffer *recv_buffer = active_channel->find_buffer("recv_buffer_for_test@" + active_channel->get_id());
         CHECK(recv_buffer != nullptr) << "Invalid buffer query";
 
-        std::string on_recv_data_info = "get a cqe with opcode: IBV_WC_RECV_RDMA_WITH_IMM from " + active_channel->info();
-
-        CHECK(wc->wc_flags & IBV_WC_WITH_IMM) << on_recv_data_info
+        CHECK(wc->wc_flags & IBV_WC_WITH_IMM) << "get a cqe with opcode: IBV_WC_RECV_RDMA_WITH_IMM from " << active_channel->info()
                                               << ", detected imm data failed to check for IBV_WC_RECV_RDMA_WITH_IMM";
 
-        MessageType val = static_cast<MessageType>(wc->imm_data);
-
-        on_recv_data_info += ", imm data: " + std::to_string(wc->imm_data) + ", MSG_TYPE: " + MsgToStr(val) + ", i.e., peer has written " + std::to_string(wc->byte_len) + " bytes here.";
-
+        HOT_VLOG_EVERY_N(3, SHOWN_LOG_EVERN_N) << "get a cqe with opcode: IBV_WC_RECV_RDMA_WITH_IMM from " << active_channel->info()
+                                               << ", imm data: " << wc->imm_data
+                                               << ", MSG_TYPE: " << MsgToStr(static_cast<MessageType>(wc->imm_data))
+                                               << ", i.e., peer has written " << wc->byte_len << " bytes here.";
         wc->byte_len = 0;
         wc->imm_data = 0;
 
         active_channel->recv_remote(recv_buffer, recv_buffer->buffer_size);
-        VLOG_EVERY_N(3, SHOWN_LOG_EVERN_N) << on_recv_data_info;
     }
 
     void RDMASession::real_connecting()
     {
-        std::vector<std::unique_ptr<std::thread>> connecting_helper_threads;
-        std::atomic_bool ready = {false};
-        auto connecting_helper = [](RDMAEndPoint *end_point,
-                                    std::atomic_bool &is_ready)
-        {
-            while (!is_ready)
-                std::this_thread::sleep_for(std::chrono::milliseconds(100));
-
-            end_point->connecting();
-        };
+        std::unique_ptr<RDMABootstrap> bootstrap(RDMABootstrap::build_bootstrap(work_env_.bootstrap_workers,
+                                                                                "Connecting@" + info()));
+        std::vector<RDMAEndPoint *> endpoints;
         for (auto &each_endpoint : this->end_point_mgr_)
-        {
-            std::thread *tmp_thread = new std::thread(connecting_helper,
-                                                      each_endpoint.get(),
-                                                      std::ref(ready));
-            connecting_helper_threads.push_back(std::move(std::unique_ptr<std::thread>(tmp_thread)));
-        }
-        ready = true;
-        for (auto &helper_thread : connecting_helper_threads)
-            helper_thread->join();
+            endpoints.push_back(each_endpoint.get());
+        bootstrap->connect_all(endpoints);
     }
 
     void RDMASession::connecting()
@@ -0,0 +1,110 @@
+#include "rdma_srq.h"
+#include "rdma_config.h"
+#include "rdma_device.h"
+#include "util/logging.h"
+
+namespace rdma_core
+{
+    RDMASharedRecvQueue::RDMASharedRecvQueue(RDMAAdapter *owner,
+                                             uint32_t block_size,
+                                             uint32_t num_blocks,
+                                             uint32_t refill_batch,
+                                             std::string pool_info) :
+        pool_info_(pool_info),
+        refill_batch_(refill_batch)
+    {
+        TRACE_IN;
+        CHECK(owner != nullptr) << "The owner adapter of " << info() << " should not be empty";
+        CHECK(owner->get_shared_recvQ() != nullptr) << owner->info() << " is not attached to a shared receive queue";
+        CHECK(num_blocks > 0 && num_blocks <= owner->get_config().srq_size)
+            << "Invalid number of receive blocks: " << num_blocks
+            << ", the srq holds at most " << owner->get_config().srq_size;
+        CHECK(refill_batch_ > 0 && refill_batch_ <= num_blocks) << "Invalid refill batch: " << refill_batch_;
+
+        srq_ = owner->get_shared_recvQ();
+        low_watermark_ = num_blocks / 4;
+
+        recv_pool_.reset(RDMABuffer::allocate_buffer(block_size, num_blocks, pool_info_));
+        owner->register_buffer(recv_pool_.get());
+        attach(owner);
+
+        wr_list_.resize(num_blocks);
+        sge_list_.resize(num_blocks);
+        released_blocks_.reserve(num_blocks);
+        for (uint32_t index = 0; index < num_blocks; index++)
+            released_blocks_.push_back(recv_pool_->at(index));
+        refill();
+        VLOG(2) << "Creating " << info() << " with " << num_blocks << " blocks of "
+                << block_size << " bytes, refill batch: " << refill_batch_;
+        TRACE_OUT;
+    }
+
+    RDMASharedRecvQueue::~RDMASharedRecvQueue()
+    {
+        TRACE_IN;
+        VLOG(3) << "Releasing " << info();
+        TRACE_OUT;
+    }
+
+    bool RDMASharedRecvQueue::attach(RDMAAdapter *adapter)
+    {
+        TRACE_IN;
+        CHECK(adapter != nullptr) << "Cannot attach an empty adapter to " << info();
+        CHECK(adapter->get_shared_recvQ() == srq_) << adapter->info() << " is not attached to the srq of " << info();
+        uint32_t qp_num = adapter->get_adapter_info().qp_num;
+        if (source_map_.find(qp_num) != source_map_.end())
+        {
+            VLOG(3) << adapter->info() << " has already been attached to " << info();
+            TRACE_OUT;
+            return false;
+        }
+        source_map_[qp_num] = adapter;
+        VLOG(3) << "Attach " << adapter->info() << " (qp: 0x" << std::hex << qp_num << ") to " << info();
+        TRACE_OUT;
+        return true;
+    }
+
+    RDMABuffer *RDMASharedRecvQueue::fetch_block(struct ibv_wc *wc)
+    {
+        RDMABuffer *block = (RDMABuffer *)wc->wr_id;
+        CHECK(block != nullptr) << "Invalid receive block from " << info();
+        posted_--;
+        return block;
+    }
+
+    void RDMASharedRecvQueue::release(RDMABuffer *block)
+    {
+        CHECK(block != nullptr) << "Cannot release an empty block to " << info();
+        block->in_used = false;
+        released_blocks_.push_back(block);
+        if (released_blocks_.size() >= refill_batch_ || posted_ < low_watermark_)
+            refill();
+    }
+
+    bool RDMASharedRecvQueue::refill()
+    {
+        if (released_blocks_.empty())
+            return false;
+
+        uint32_t num_wr = released_blocks_.size();
+        for (uint32_t index = 0; index < num_wr; index++)
+        {
+            RDMABuffer *block = released_blocks_[index];
+            block->in_used = true;
+            sge_list_[index].addr = (uintptr_t)(block->data_ptr);
+            sge_list_[index].length = block->buffer_size;
+            sge_list_[index].lkey = block->mr_->lkey;
+
+            wr_list_[index].wr_id = (uint64_t)block;
+            wr_list_[index].sg_list = &sge_list_[index];
+            wr_list_[index].num_sge = 1;
+            wr_list_[index].next = (index + 1 < num_wr) ? &wr_list_[index + 1] : NULL;
+        }
+        RDMADevice::real_post_srq_recv_batch_(srq_, &wr_list_[0]);
+        posted_ += num_wr;
+        released_blocks_.clear();
+        HOT_VLOG_EVERY_N(3, SHOWN_LOG_EVERN_N) << "Refill " << num_wr << " blocks to " << info();
+        return true;
+    }
+
+}; // end namespace rdma_core
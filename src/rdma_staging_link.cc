@@ -0,0 +1,139 @@
+#include "rdma_staging_link.h"
+#include "util/logging.h"
+
+#include <string.h>
+
+namespace rdma_core
+{
+    StagingLink::StagingLink(RDMAChannel *out_channel,
+                             RDMAChannel *in_channel,
+                             uint32_t chunk_size,
+                             uint32_t pipeline_depth,
+                             std::string link_info) :
+        link_info_(link_info),
+        out_channel_(out_channel),
+        in_channel_(in_channel),
+        chunk_size_(chunk_size),
+        depth_(pipeline_depth)
+    {
+        TRACE_IN;
+        CHECK(out_channel_ != nullptr && in_channel_ != nullptr) << "Cannot build " << info() << " over an empty channel";
+        in_channel_->claim_recv_queue(info());
+        CHECK(depth_ > 0 && depth_ <= in_channel_->get_config().max_recv_wr)
+            << "Invalid pipeline depth of " << info() << ": " << depth_ << ", it should be in (0, max_recv_wr of "
+            << in_channel_->info() << "]";
+
+        staging_.reset(RDMABuffer::allocate_buffer(chunk_size_, depth_, link_info_ + "_staging", nullptr,
+                                                   RDMABuffer::device_local_policy(in_channel_)));
+        in_channel_->register_buffer(staging_.get());
+        peer_credit_.reset(RDMABuffer::allocate_buffer(sizeof(uint64_t), 1, link_info_ + "_peer_credit"));
+        out_channel_->register_buffer(peer_credit_.get());
+        memset(peer_credit_->data_ptr, 0, sizeof(uint64_t));
+        local_credit_.reset(RDMABuffer::allocate_buffer(sizeof(uint64_t), 1, link_info_ + "_local_credit"));
+        in_channel_->register_buffer(local_credit_.get());
+        memset(local_credit_->data_ptr, 0, sizeof(uint64_t));
+
+        for (uint32_t index = 0; index < depth_; index++)
+        { // posted before the handshake, so the peer never writes ahead of them
+            in_channel_->recv_notification();
+        }
+        TRACE_OUT;
+    }
+
+    StagingLink::~StagingLink()
+    {
+        TRACE_IN;
+        if (!idle())
+            LOG(WARNING) << "Releasing " << info() << " with " << out_sqes_.size() + in_sqes_.size()
+                         << " sqe(s) in flight";
+        if (!arrivals_.empty())
+            LOG(WARNING) << "Releasing " << info() << " with " << arrivals_.size() << " chunk(s) of the peer not consumed";
+        TRACE_OUT;
+    }
+
+    struct StagingLink::Descriptor StagingLink::descriptor()
+    {
+        struct Descriptor local;
+        local.staging.buffer_addr_ = (uint64_t)staging_->data_ptr;
+        local.staging.buffer_length_ = staging_->buffer_size;
+        local.staging.rkey_ = staging_->mr_->rkey;
+        local.staging.fd_ = 0;
+        local.credit.buffer_addr_ = (uint64_t)peer_credit_->data_ptr;
+        local.credit.buffer_length_ = sizeof(uint64_t);
+        local.credit.rkey_ = peer_credit_->mr_->rkey;
+        local.credit.fd_ = 0;
+        return local;
+    }
+
+    void StagingLink::connect(const struct Descriptor &out_peer, const struct Descriptor &in_peer)
+    {
+        peer_staging_ = out_peer.staging;
+        remote_credit_ = in_peer.credit;
+    }
+
+    bool StagingLink::write_chunk(const BufferSlice *slice, uint32_t chunk_id)
+    {
+        uint64_t peer_consumed = *(volatile uint64_t *)peer_credit_->data_ptr;
+        if (sent_ >= peer_consumed + depth_)
+        { // the slot is still held by the peer
+            if (!stalled_)
+                num_stalls_++;
+            stalled_ = true;
+            return false;
+        }
+        if (!out_channel_->sq_has_room())
+            return false;
+        stalled_ = false;
+
+        struct CommDescriptor remote = peer_staging_;
+        remote.buffer_addr_ += (uint64_t)(sent_ % depth_) * chunk_size_;
+        remote.buffer_length_ = slice->length;
+        out_channel_->write_remote(slice, 1, &remote, chunk_id, true);
+        posted_sqes(out_channel_).push_back(SqeKind::CHUNK_WRITE);
+        sent_++;
+        return true;
+    }
+
+    void StagingLink::write_credit()
+    {
+        if (credit_inflight_ || credit_written_ == consumed_ || !in_channel_->sq_has_room())
+            return;
+        *(volatile uint64_t *)local_credit_->data_ptr = consumed_;
+        BufferSlice slice;
+        slice.buffer = local_credit_.get();
+        slice.length = sizeof(uint64_t);
+        in_channel_->tag_next_wr((uint64_t)in_channel_); // signaled whatever the policy is, it gates the next one
+        in_channel_->write_remote(&slice, 1, &remote_credit_, 0, false);
+        posted_sqes(in_channel_).push_back(SqeKind::CREDIT_WRITE);
+        credit_inflight_ = true;
+        credit_written_ = consumed_;
+    }
+
+    void StagingLink::on_cqe(struct ibv_wc *wc)
+    {
+        CHECK(wc->status == IBV_WC_SUCCESS) << "Failed to complete with error " << ibv_wc_status_str(wc->status)
+                                            << " in " << info();
+        if (wc->opcode == IBV_WC_RECV_RDMA_WITH_IMM)
+        {
+            in_channel_->decrease_rqe();
+            in_channel_->recv_notification(); // the receive is given back at once, it holds no buffer
+            arrivals_.push_back(wc->imm_data);
+            return;
+        }
+        CHECK(wc->opcode == IBV_WC_RDMA_WRITE) << "Unexpected opcode " << wc->opcode << " in " << info();
+        CHECK(wc->wr_id == (uint64_t)out_channel_ || wc->wr_id == (uint64_t)in_channel_)
+            << "Unexpected write completion in " << info();
+        RDMAChannel *owner = (RDMAChannel *)wc->wr_id;
+        std::deque<SqeKind> &sqes = posted_sqes(owner);
+        int64_t retired = owner->retire_sqe();
+        CHECK((size_t)retired <= sqes.size()) << owner->info() << " retires " << retired << " sqes, while " << info()
+                                              << " only posted " << sqes.size();
+        for (int64_t count = 0; count < retired; count++)
+        {
+            if (sqes.front() == SqeKind::CREDIT_WRITE)
+                credit_inflight_ = false;
+            sqes.pop_front();
+        }
+    }
+
+}; // end namespace rdma_core
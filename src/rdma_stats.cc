@@ -0,0 +1,131 @@
+#include "rdma_stats.h"
+
+#include <sstream>
+
+namespace rdma_core
+{
+    std::string stats_opcode_to_str(StatsOpcode opcode)
+    {
+        switch (opcode)
+        {
+            case StatsOpcode::SEND:
+                return "send";
+            case StatsOpcode::WRITE:
+                return "write";
+            case StatsOpcode::READ:
+                return "read";
+            case StatsOpcode::RECV:
+                return "recv";
+            case StatsOpcode::RECV_WITH_IMM:
+                return "recv_with_imm";
+            default:
+                break;
+        }
+        return "unknown";
+    }
+
+    void ChannelStats::count_poll(const struct ibv_wc *wc, int num_wqe)
+    {
+        add(poll_.polls, 1);
+        if (num_wqe <= 0)
+        {
+            add(poll_.empty_polls, 1);
+            return;
+        }
+        for (int index = 0; index < num_wqe; index++)
+        {
+            if (wc[index].status != IBV_WC_SUCCESS)
+            { // the opcode of an error cqe is not valid
+                add(poll_.error_wcs, 1);
+                continue;
+            }
+            StatsOpcode opcode;
+            switch (wc[index].opcode)
+            {
+                case IBV_WC_SEND:
+                    opcode = StatsOpcode::SEND;
+                    break;
+                case IBV_WC_RDMA_WRITE:
+                    opcode = StatsOpcode::WRITE;
+                    break;
+                case IBV_WC_RDMA_READ:
+                    opcode = StatsOpcode::READ;
+                    break;
+                case IBV_WC_RECV:
+                    opcode = StatsOpcode::RECV;
+                    break;
+                case IBV_WC_RECV_RDMA_WITH_IMM:
+                    opcode = StatsOpcode::RECV_WITH_IMM;
+                    break;
+                default:
+                    continue; // atomics and the like are not posted by the adapter
+            }
+            add(poll_.completed[static_cast<uint32_t>(opcode)], 1);
+            if (wc[index].opcode & IBV_WC_RECV)
+                add(poll_.received_bytes, wc[index].byte_len);
+        }
+    }
+
+    ChannelStatsSnapshot ChannelStats::snapshot() const
+    {
+        ChannelStatsSnapshot snap;
+        for (uint32_t index = 0; index < NUM_STATS_OPCODES; index++)
+        {
+            snap.posted[index] = post_.posted[index].load(std::memory_order_relaxed);
+            snap.posted_bytes[index] = post_.posted_bytes[index].load(std::memory_order_relaxed);
+            snap.completed[index] = poll_.completed[index].load(std::memory_order_relaxed);
+        }
+        snap.max_sq_depth = post_.max_sq_depth.load(std::memory_order_relaxed);
+        snap.received_bytes = poll_.received_bytes.load(std::memory_order_relaxed);
+        snap.polls = poll_.polls.load(std::memory_order_relaxed);
+        snap.empty_polls = poll_.empty_polls.load(std::memory_order_relaxed);
+        snap.error_wcs = poll_.error_wcs.load(std::memory_order_relaxed);
+        return snap;
+    }
+
+    std::string stats_to_text(const std::vector<ChannelStatsSnapshot> &snapshots)
+    {
+        std::ostringstream out;
+        for (auto &snap : snapshots)
+        {
+            out << snap.channel << " (peer " << snap.peer << "):";
+            for (uint32_t index = 0; index < NUM_STATS_OPCODES; index++)
+            {
+                if (snap.posted[index] == 0 && snap.completed[index] == 0)
+                    continue;
+                out << " " << stats_opcode_to_str(static_cast<StatsOpcode>(index)) << " " << snap.posted[index]
+                    << "/" << snap.completed[index] << " wr posted/completed";
+                if (snap.posted_bytes[index] != 0)
+                    out << " " << snap.posted_bytes[index] << " bytes";
+                out << ",";
+            }
+            out << " received " << snap.received_bytes << " bytes, max sq depth " << snap.max_sq_depth
+                << ", polls " << snap.polls << " (" << 100.0 * snap.poll_empty_ratio() << "% empty)"
+                << ", error cqes " << snap.error_wcs << "\n";
+        }
+        return out.str();
+    }
+
+    std::string stats_to_json(const std::vector<ChannelStatsSnapshot> &snapshots)
+    {
+        std::ostringstream out;
+        out << "[";
+        for (size_t snap_index = 0; snap_index < snapshots.size(); snap_index++)
+        {
+            const ChannelStatsSnapshot &snap = snapshots[snap_index];
+            out << (snap_index == 0 ? "" : ",") << "{\"channel\":\"" << snap.channel << "\",\"peer\":\"" << snap.peer
+                << "\",\"opcodes\":{";
+            for (uint32_t index = 0; index < NUM_STATS_OPCODES; index++)
+            {
+                out << (index == 0 ? "" : ",") << "\"" << stats_opcode_to_str(static_cast<StatsOpcode>(index))
+                    << "\":{\"posted\":" << snap.posted[index] << ",\"posted_bytes\":" << snap.posted_bytes[index]
+                    << ",\"completed\":" << snap.completed[index] << "}";
+            }
+            out << "},\"received_bytes\":" << snap.received_bytes << ",\"max_sq_depth\":" << snap.max_sq_depth
+                << ",\"polls\":" << snap.polls << ",\"empty_polls\":" << snap.empty_polls
+                << ",\"poll_empty_ratio\":" << snap.poll_empty_ratio() << ",\"error_wcs\":" << snap.error_wcs << "}";
+        }
+        out << "]";
+        return out.str();
+    }
+}; // end namespace rdma_core
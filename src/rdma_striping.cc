@@ -0,0 +1,175 @@
+#include "rdma_striping.h"
+#include "util/logging.h"
+
+#include <algorithm>
+#include <set>
+
+namespace rdma_core
+{
+    StripedChannel::StripedChannel(RDMAEndPoint *endpoint,
+                                   uint32_t min_stripe_size,
+                                   std::string striping_info) :
+        striping_info_(striping_info),
+        endpoint_(endpoint),
+        min_stripe_size_(min_stripe_size)
+    {
+        TRACE_IN;
+        CHECK(endpoint_ != nullptr) << "Cannot stripe over an empty endpoint in " << info();
+        CHECK(min_stripe_size_ > 0) << "The stripe size of " << info() << " should be > 0";
+        for (uint32_t chan_index = 0; chan_index < endpoint_->get_num_channels(); chan_index++)
+            data_channels_.push_back(endpoint_->get_channel(chan_index));
+        posted_stripes_.resize(data_channels_.size());
+        VLOG(3) << "Creating " << info() << " over " << data_channels_.size()
+                << " data channel(s), min stripe size: " << min_stripe_size_;
+        TRACE_OUT;
+    }
+
+    StripedChannel::~StripedChannel()
+    {
+        TRACE_IN;
+        if (!pending_transfers_.empty())
+            LOG(WARNING) << "Releasing " << info() << " with " << pending_transfers_.size() << " transfer(s) in flight";
+        VLOG(3) << "Releasing " << info();
+        TRACE_OUT;
+    }
+
+    uint64_t StripedChannel::write_remote(RDMABuffer *buffer,                              // the buffer for data to write
+                                          size_t data_length_in_bytes,                     // data length to write
+                                          struct CommDescriptor *remote_buffer_descriptor, // remote buffer_describptor
+                                          uint32_t msg_tag,                                // tagging the message type to notify peer
+                                          bool notify_peer)                                // notify peer once all stripes land
+    {
+        CHECK(buffer != 0) << "RDMABuffer has not been initialized";
+        CHECK(remote_buffer_descriptor != 0) << "Invalid remote buffer descriptor";
+        CHECK(data_length_in_bytes <= remote_buffer_descriptor->buffer_length_)
+            << "Invalid data length to write: " << data_length_in_bytes
+            << ", peer buffer size: " << remote_buffer_descriptor->buffer_length_;
+        CHECK(data_length_in_bytes <= UINT32_MAX) << "Invalid data length to write: " << data_length_in_bytes;
+        buffer->security_check();
+        CHECK(buffer->get_registered_channel()->get_protected_domain() == data_channels_[0]->get_protected_domain())
+            << buffer->info() << " is not registered in the pd of the data channels of " << info();
+
+        uint32_t num_channels = data_channels_.size();
+        uint32_t num_stripes = std::max<size_t>(1, std::min<size_t>(num_channels, data_length_in_bytes / min_stripe_size_));
+        size_t stripe_size = (data_length_in_bytes + num_stripes - 1) / num_stripes;
+        stripe_size = (stripe_size + STRIPE_ALIGN - 1) / STRIPE_ALIGN * STRIPE_ALIGN;
+
+        uint64_t transfer_id = next_transfer_id_++;
+        StripedTransfer &transfer = pending_transfers_[transfer_id];
+        transfer.buffer = buffer;
+        transfer.notify_peer = notify_peer;
+        transfer.msg_tag = msg_tag;
+        transfer.remote_buffer_descriptor = *remote_buffer_descriptor;
+
+        size_t offset = 0;
+        uint32_t stripe_index = 0;
+        do
+        {
+            uint32_t chan_index = (next_channel_ + stripe_index) % num_channels;
+            BufferSlice slice;
+            slice.buffer = buffer;
+            slice.offset = offset;
+            slice.length = std::min(stripe_size, data_length_in_bytes - offset);
+
+            struct CommDescriptor stripe_descriptor = *remote_buffer_descriptor;
+            stripe_descriptor.buffer_addr_ += offset;
+            stripe_descriptor.buffer_length_ = slice.length;
+            data_channels_[chan_index]->write_remote(&slice, 1, &stripe_descriptor, msg_tag, false);
+            posted_stripes_[chan_index].push_back(transfer_id);
+            transfer.pending_stripes++;
+
+            offset += slice.length;
+            stripe_index++;
+        } while (offset < data_length_in_bytes);
+        next_channel_ = (next_channel_ + stripe_index) % num_channels;
+
+        HOT_VLOG_EVERY_N(3, SHOWN_LOG_EVERN_N) << info() << " splits transfer " << transfer_id << " ("
+                                           << data_length_in_bytes << " bytes) into " << stripe_index << " stripe(s)";
+        return transfer_id;
+    }
+
+    uint32_t StripedChannel::on_write_done(RDMAChannel *channel)
+    {
+        int32_t chan_index = channel_index(channel);
+        CHECK(chan_index >= 0) << channel->info() << " is not a data channel of " << info();
+
+        std::deque<uint64_t> &posted = posted_stripes_[chan_index];
+        int64_t retired = channel->retire_sqe();
+        CHECK((size_t)retired <= posted.size()) << channel->info() << " retires " << retired
+                                                << " sqes, while " << info() << " only posted " << posted.size();
+        uint32_t num_done = 0;
+        for (int64_t index = 0; index < retired; index++)
+        {
+            uint64_t transfer_id = posted.front();
+            posted.pop_front();
+            if (transfer_id == 0) // the notification of a finished transfer
+                continue;
+            if (--pending_transfers_[transfer_id].pending_stripes == 0)
+            {
+                finish(transfer_id);
+                num_done++;
+            }
+        }
+        return num_done;
+    }
+
+    bool StripedChannel::is_done(uint64_t transfer_id)
+    {
+        CHECK(transfer_id > 0 && transfer_id < next_transfer_id_) << "Unknown transfer " << transfer_id << " in " << info();
+        return pending_transfers_.find(transfer_id) == pending_transfers_.end();
+    }
+
+    void StripedChannel::wait(uint64_t transfer_id)
+    {
+        std::vector<RDMAChannel *> polled_channels; // one channel per cq
+        std::set<struct ibv_cq *> polled_cqs;
+        for (auto *channel : data_channels_)
+        {
+            if (polled_cqs.insert(channel->get_completQ()).second)
+                polled_channels.push_back(channel);
+        }
+
+        struct ibv_wc global_wc[16];
+        while (!is_done(transfer_id))
+        {
+            for (auto *channel : polled_channels)
+            {
+                int num_wqe = channel->poll_cq_batch(global_wc, 16);
+                for (int wc_index = 0; wc_index < num_wqe; wc_index++)
+                {
+                    CHECK(global_wc[wc_index].status == IBV_WC_SUCCESS)
+                        << "Failed to write the stripe with error " << ibv_wc_status_str(global_wc[wc_index].status)
+                        << " in " << info();
+                    CHECK(global_wc[wc_index].opcode == IBV_WC_RDMA_WRITE)
+                        << "Unexpected opcode " << global_wc[wc_index].opcode << " in " << info()
+                        << ", wait() requires the cqs of the data channels to carry the stripes only";
+                    on_write_done(static_cast<RDMAChannel *>((RDMAAdapter *)global_wc[wc_index].wr_id));
+                }
+            }
+        }
+    }
+
+    int32_t StripedChannel::channel_index(RDMAChannel *channel)
+    {
+        for (uint32_t chan_index = 0; chan_index < data_channels_.size(); chan_index++)
+        {
+            if (data_channels_[chan_index] == channel)
+                return chan_index;
+        }
+        return -1;
+    }
+
+    void StripedChannel::finish(uint64_t transfer_id)
+    {
+        StripedTransfer &transfer = pending_transfers_[transfer_id];
+        if (transfer.notify_peer)
+        { // the stripes are acked by the peer, so the (zero-byte) write_with_imm cannot overtake them
+            BufferSlice slice;
+            slice.buffer = transfer.buffer;
+            data_channels_[0]->write_remote(&slice, 1, &transfer.remote_buffer_descriptor, transfer.msg_tag, true);
+            posted_stripes_[0].push_back(0);
+        }
+        pending_transfers_.erase(transfer_id);
+    }
+
+}; // end namespace rdma_core
@@ -0,0 +1,425 @@
+#include "rdma_tree_allreduce.h"
+#include "rdma_memory_pool.h"
+#include "util/logging.h"
+
+#include <algorithm>
+#include <string.h>
+
+#define TREE_POLL_BATCH 32 // cqes polled at once
+
+namespace rdma_core
+{
+    namespace
+    {
+        // a binary tree rooted at rank 0 with one child, each rank hangs below the rank that clears its lowest set bit
+        // (or sets the next bit), so the leaves are the odd ranks
+        TreeNode binary_tree_node(uint32_t rank, uint32_t num_ranks)
+        {
+            TreeNode node;
+            uint32_t bit = 1;
+            while (bit < num_ranks && !(bit & rank))
+                bit <<= 1;
+            if (rank == 0)
+            {
+                if (num_ranks > 1)
+                    node.children.push_back(bit >> 1);
+                return node;
+            }
+            uint32_t parent = (rank ^ bit) | (bit << 1);
+            node.parent = parent < num_ranks ? parent : rank ^ bit;
+            uint32_t low_bit = bit >> 1;
+            if (low_bit == 0)
+                return node;
+            node.children.push_back(rank - low_bit);
+            while (low_bit != 0 && rank + low_bit >= num_ranks)
+                low_bit >>= 1;
+            if (low_bit != 0)
+                node.children.push_back(rank + low_bit);
+            return node;
+        }
+
+        // map a tree node from the shifted (or mirrored) ranks back to the real ones
+        TreeNode map_tree_node(TreeNode node, uint32_t num_ranks, bool mirror)
+        {
+            auto map_rank = [num_ranks, mirror](uint32_t rank)
+            {
+                return mirror ? num_ranks - 1 - rank : (rank + 1) % num_ranks;
+            };
+            if (node.parent >= 0)
+                node.parent = map_rank(node.parent);
+            for (auto &child : node.children)
+                child = map_rank(child);
+            return node;
+        }
+
+        uint32_t tree_height(uint32_t num_ranks, TreeShape shape, uint32_t tree_width)
+        {
+            uint32_t height = 0;
+            for (uint32_t rank = 0; rank < num_ranks; rank++)
+            {
+                std::vector<TreeNode> nodes = build_tree_nodes(rank, num_ranks, shape, tree_width);
+                for (uint32_t tree = 0; tree < nodes.size(); tree++)
+                {
+                    uint32_t hops = 0;
+                    for (TreeNode node = nodes[tree]; node.parent >= 0; hops++)
+                        node = build_tree_nodes(node.parent, num_ranks, shape, tree_width)[tree];
+                    height = std::max(height, hops);
+                }
+            }
+            return height;
+        }
+    }; // end anonymous namespace
+
+    std::vector<TreeNode> build_tree_nodes(uint32_t rank,        // the position of this rank
+                                           uint32_t num_ranks,   // how many ranks the trees hold
+                                           TreeShape shape,      // which trees
+                                           uint32_t tree_width)  // children per rank of the k-ary tree
+    {
+        CHECK(rank < num_ranks) << "Invalid rank " << rank << " of " << num_ranks << " ranks";
+        std::vector<TreeNode> nodes;
+        if (shape == TreeShape::KARY)
+        {
+            CHECK(tree_width > 0) << "The k-ary tree needs a tree width > 0";
+            TreeNode node;
+            if (rank != 0)
+                node.parent = (rank - 1) / tree_width;
+            for (uint64_t child = (uint64_t)rank * tree_width + 1;
+                 child <= (uint64_t)rank * tree_width + tree_width && child < num_ranks; child++)
+                node.children.push_back(child);
+            nodes.push_back(node);
+            return nodes;
+        }
+        nodes.push_back(binary_tree_node(rank, num_ranks));
+        // the second tree shifts the ranks by one for an odd size and mirrors them for an even size,
+        // so the leaves of one tree are the inner ranks of the other
+        if (num_ranks % 2 == 1)
+            nodes.push_back(map_tree_node(binary_tree_node((rank + num_ranks - 1) % num_ranks, num_ranks), num_ranks, false));
+        else
+            nodes.push_back(map_tree_node(binary_tree_node(num_ranks - 1 - rank, num_ranks), num_ranks, true));
+        return nodes;
+    }
+
+    AllReduceAlgorithm select_allreduce_algorithm(size_t bytes,        // bytes of the vector
+                                                  uint32_t num_ranks,  // how many ranks reduce it
+                                                  TreeShape shape,     // the trees in use
+                                                  uint32_t tree_width, // children per rank of the k-ary tree
+                                                  double hop_latency_us,
+                                                  double link_gbps)
+    {
+        if (num_ranks <= 2)
+            return AllReduceAlgorithm::RING; // the ring moves half the bytes and takes as many hops
+        double us_per_byte = 8.0 / (link_gbps * 1000);
+        double ring_us = 2.0 * (num_ranks - 1) * hop_latency_us + 2.0 * (num_ranks - 1) / num_ranks * bytes * us_per_byte;
+        // a parent writes each of its halves (or the whole vector) to every child
+        double fan_out = shape == TreeShape::KARY ? (double)tree_width : 1.0;
+        double tree_us = 2.0 * tree_height(num_ranks, shape, tree_width) * hop_latency_us + fan_out * bytes * us_per_byte;
+        return tree_us < ring_us ? AllReduceAlgorithm::TREE : AllReduceAlgorithm::RING;
+    }
+
+    std::string allreduce_algorithm_to_str(AllReduceAlgorithm algorithm)
+    {
+        switch (algorithm)
+        {
+            case AllReduceAlgorithm::RING:
+                return "ring";
+            case AllReduceAlgorithm::TREE:
+                return "tree";
+        }
+        return "unknown";
+    }
+
+    TreeAllReduce::TreeAllReduce(std::map<uint32_t, RDMAChannel *> links,
+                                 uint32_t rank,
+                                 uint32_t num_ranks,
+                                 TreeShape shape,
+                                 uint32_t tree_width,
+                                 size_t max_bytes,
+                                 uint32_t chunk_size,
+                                 uint32_t pipeline_depth,
+                                 std::string allreduce_info) :
+        allreduce_info_(allreduce_info),
+        rank_(rank),
+        num_ranks_(num_ranks),
+        shape_(shape),
+        tree_width_(tree_width),
+        max_bytes_(max_bytes),
+        chunk_size_(chunk_size),
+        depth_(pipeline_depth)
+    {
+        TRACE_IN;
+        CHECK(num_ranks_ >= 2 && rank_ < num_ranks_)
+            << "Invalid rank of " << info() << ": " << rank_ << "/" << num_ranks_ << ", the trees hold at least 2 ranks";
+        CHECK(max_bytes_ > 0 && max_bytes_ <= UINT32_MAX)
+            << "Invalid vector size of " << info() << ": " << max_bytes_ << ", it should be in (0, 4GB)";
+        CHECK(chunk_size_ > 0 && chunk_size_ % ALLREDUCE_CHUNK_ALIGN == 0)
+            << "Invalid chunk size of " << info() << ": " << chunk_size_ << ", it should be a multiple of "
+            << ALLREDUCE_CHUNK_ALIGN;
+        CHECK(depth_ > 0) << "Invalid pipeline depth of " << info() << ": " << depth_;
+
+        std::vector<TreeNode> nodes = build_tree_nodes(rank_, num_ranks_, shape_, tree_width_);
+        height_ = tree_height(num_ranks_, shape_, tree_width_);
+        std::map<uint32_t, TreeLink *> link_of_rank;
+        auto link_to = [&](uint32_t peer_rank, uint32_t tree, LinkRole role) -> TreeLink *
+        {
+            if (link_of_rank.find(peer_rank) == link_of_rank.end())
+            {
+                CHECK(links.find(peer_rank) != links.end() && links[peer_rank] != nullptr)
+                    << info() << " has no channel to rank " << peer_rank << ", its neighbor in the tree";
+                TreeLink *link = new TreeLink();
+                link->peer_rank = peer_rank;
+                link->channel = links[peer_rank];
+                std::fill(link->roles, link->roles + TREE_MAX_TREES, LinkRole::NONE);
+                links_.push_back(std::unique_ptr<TreeLink>(link));
+                link_of_rank[peer_rank] = link;
+            }
+            link_of_rank[peer_rank]->roles[tree] = role;
+            return link_of_rank[peer_rank];
+        };
+        for (uint32_t tree = 0; tree < nodes.size(); tree++)
+        {
+            Tree each_tree;
+            each_tree.node = nodes[tree];
+            if (each_tree.node.parent >= 0)
+                each_tree.parent_link = link_to(each_tree.node.parent, tree, LinkRole::PARENT);
+            for (uint32_t child : each_tree.node.children)
+                each_tree.child_links.push_back(link_to(child, tree, LinkRole::CHILD));
+            trees_.push_back(each_tree);
+        }
+        // the handshakes run in the order of the peer ranks on every rank, so no two ranks wait for each other
+        std::sort(links_.begin(), links_.end(), [](const std::unique_ptr<TreeLink> &a, const std::unique_ptr<TreeLink> &b)
+                  { return a->peer_rank < b->peer_rank; });
+
+        RDMAChannel *first_channel = links_.front()->channel;
+        work_.reset(RDMABuffer::allocate_buffer(max_bytes_, 1, allreduce_info_ + "_work",
+                                                RDMAMemoryPool::get_memory_pool(first_channel)));
+        for (auto &link : links_)
+        {
+            RDMAChannel *channel = link->channel;
+            CHECK(channel->get_protected_domain() == first_channel->get_protected_domain())
+                << channel->info() << " and " << first_channel->info() << " are on different pds, set the same pd_key "
+                << "for the links of " << info();
+            channel->register_buffer(work_.get());
+            link->staging.reset(new StagingLink(channel, channel, chunk_size_, depth_,
+                                                allreduce_info_ + "_rank" + std::to_string(link->peer_rank)));
+
+            TreeHandshake local, remote;
+            local.link = link->staging->descriptor();
+            local.rank = rank_;
+            local.num_ranks = num_ranks_;
+            local.shape = static_cast<uint32_t>(shape_);
+            local.tree_width = tree_width_;
+            local.chunk_size = chunk_size_;
+            local.pipeline_depth = depth_;
+            channel->get_registered_endpoint()->exchange_with_peer(&local, &remote, sizeof(TreeHandshake),
+                                                                    "the handshake with rank " +
+                                                                        std::to_string(link->peer_rank) + " of " + info());
+            CHECK(remote.rank == link->peer_rank) << info() << " expects rank " << link->peer_rank << " on "
+                                                  << channel->info() << ", while rank " << remote.rank << " answers";
+            CHECK(remote.num_ranks == num_ranks_ && remote.shape == local.shape && remote.tree_width == tree_width_)
+                << info() << " builds the trees of " << num_ranks_ << " ranks (shape " << local.shape << ", width "
+                << tree_width_ << "), while rank " << remote.rank << " builds the trees of " << remote.num_ranks
+                << " ranks (shape " << remote.shape << ", width " << remote.tree_width << ")";
+            CHECK(remote.chunk_size == chunk_size_ && remote.pipeline_depth == depth_)
+                << info() << " cuts " << chunk_size_ << "-byte chunks " << depth_ << " deep, while rank " << remote.rank
+                << " cuts " << remote.chunk_size << "-byte chunks " << remote.pipeline_depth << " deep";
+            link->staging->connect(remote.link, remote.link);
+
+            link_of_channel_[(uint64_t)channel] = link.get();
+            bool new_cq = true;
+            for (auto *poller : pollers_)
+                new_cq = new_cq && poller->get_completQ() != channel->get_completQ();
+            if (new_cq)
+                pollers_.push_back(channel);
+        }
+        VLOG(3) << "Creating " << info() << " as rank " << rank_ << "/" << num_ranks_ << " over " << trees_.size()
+                << " tree(s) of height " << height_ << ", " << links_.size() << " link(s), " << chunk_size_
+                << "-byte chunks, " << depth_ << " in flight per link";
+        TRACE_OUT;
+    }
+
+    TreeAllReduce::~TreeAllReduce()
+    {
+        TRACE_IN;
+        for (auto &link : links_)
+        {
+            if (!link->pending_sends.empty())
+                LOG(WARNING) << "Releasing " << info() << " with " << link->pending_sends.size()
+                             << " chunk(s) queued to rank " << link->peer_rank;
+        }
+        VLOG(3) << "Releasing " << info() << ", wrote " << get_num_chunks() << " chunk(s), stalled " << get_num_stalls()
+                << " time(s) for the credits";
+        TRACE_OUT;
+    }
+
+    void TreeAllReduce::allreduce(size_t count,        // how many elements
+                                  ReduceDataType type, // the type of the elements
+                                  ReduceOp op)         // the reduction
+    {
+        element_size_ = reduce_type_size(type);
+        CHECK(count >= trees_.size()) << info() << " splits the vector over " << trees_.size()
+                                      << " trees, it cannot reduce " << count << " element(s)";
+        CHECK(count * element_size_ <= max_bytes_) << info() << " holds " << max_bytes_ << " bytes, it cannot reduce "
+                                                   << count << " " << reduce_type_to_str(type) << " elements";
+        CHECK(final_left_ == 0) << info() << " is reentered before the last allreduce is done";
+        type_ = type;
+        op_ = op;
+
+        for (auto &link : links_)
+        {
+            link->base = link->staging->get_num_consumed();
+            link->expected = 0;
+        }
+        for (uint32_t tree = 0; tree < trees_.size(); tree++)
+        {
+            Tree &each_tree = trees_[tree];
+            each_tree.begin = tree * count / trees_.size();
+            each_tree.length = (tree + 1) * count / trees_.size() - each_tree.begin;
+            each_tree.num_chunks = std::max<uint64_t>(1, (each_tree.length * element_size_ + chunk_size_ - 1) / chunk_size_);
+            each_tree.missing.assign(each_tree.num_chunks, each_tree.child_links.size());
+            final_left_ += each_tree.num_chunks;
+            // a chunk crosses each tree edge once up and once down
+            if (each_tree.parent_link != nullptr)
+                each_tree.parent_link->expected += each_tree.num_chunks;
+            for (auto *child_link : each_tree.child_links)
+                child_link->expected += each_tree.num_chunks;
+        }
+        HOT_VLOG_EVERY_N(3, SHOWN_LOG_EVERN_N) << info() << " reduces " << count << " " << reduce_type_to_str(type)
+                                           << " elements by " << reduce_op_to_str(op) << " over " << trees_.size()
+                                           << " tree(s)";
+        for (uint32_t tree = 0; tree < trees_.size(); tree++)
+        {
+            if (trees_[tree].child_links.empty()) // a leaf holds its whole subtree already
+                for (uint32_t chunk = 0; chunk < trees_[tree].num_chunks; chunk++)
+                    on_reduced(tree, chunk);
+        }
+
+        while (!done())
+        {
+            for (auto *poller : pollers_)
+                poll_channel(poller);
+            for (auto &link : links_)
+            {
+                do { // the ready chunks go out before the next arrived one is reduced, so the wire is kept busy
+                    flush_sends(link.get());
+                    link->staging->write_credit();
+                } while (consume_next(link.get()));
+            }
+            for (auto &link : links_) // the consumed chunks may have released chunks to the other links
+                flush_sends(link.get());
+        }
+    }
+
+    void TreeAllReduce::chunk_range(Tree &tree,      // the tree of the chunk
+                                    uint32_t chunk,  // which chunk of the tree
+                                    size_t *begin,   // the first element of the chunk
+                                    size_t *length)  // how many elements of the chunk
+    {
+        size_t chunk_begin = chunk * tree.length / tree.num_chunks;
+        size_t chunk_end = (chunk + 1) * tree.length / tree.num_chunks;
+        *begin = tree.begin + chunk_begin;
+        *length = chunk_end - chunk_begin;
+    }
+
+    void TreeAllReduce::on_reduced(uint32_t tree, uint32_t chunk)
+    {
+        Tree &each_tree = trees_[tree];
+        if (each_tree.parent_link == nullptr)
+            on_final(tree, chunk); // the root holds the reduction of all ranks
+        else
+            each_tree.parent_link->pending_sends.push_back(chunk_id(tree, chunk));
+    }
+
+    void TreeAllReduce::on_final(uint32_t tree, uint32_t chunk)
+    {
+        CHECK(final_left_ > 0) << "More chunks are final than planned in " << info();
+        final_left_--;
+        for (auto *child_link : trees_[tree].child_links)
+            child_link->pending_sends.push_back(chunk_id(tree, chunk));
+    }
+
+    void TreeAllReduce::flush_sends(TreeLink *link)
+    {
+        while (!link->pending_sends.empty())
+        {
+            uint32_t id = link->pending_sends.front();
+            size_t begin, length;
+            chunk_range(trees_[id >> 31], id & 0x7FFFFFFF, &begin, &length);
+            BufferSlice slice;
+            slice.buffer = work_.get();
+            slice.offset = begin * element_size_;
+            slice.length = length * element_size_;
+            if (!link->staging->write_chunk(&slice, id))
+                return;
+            link->pending_sends.pop_front();
+        }
+    }
+
+    bool TreeAllReduce::consume_next(TreeLink *link)
+    {
+        if (!link->staging->has_arrival() || link->staging->get_num_consumed() - link->base >= link->expected)
+            return false;
+        uint32_t id = link->staging->next_arrival();
+        uint32_t tree = id >> 31, chunk = id & 0x7FFFFFFF;
+        CHECK(tree < trees_.size() && chunk < trees_[tree].num_chunks && link->roles[tree] != LinkRole::NONE)
+            << "Unexpected chunk " << chunk << " of tree " << tree << " from rank " << link->peer_rank << " in " << info();
+        size_t begin, length;
+        chunk_range(trees_[tree], chunk, &begin, &length);
+        uint8_t *dst = (uint8_t *)work_->data_ptr + begin * element_size_;
+        uint8_t *src = link->staging->next_slot();
+        link->staging->release_slot(); // the credit goes back after the reduction, in write_credit()
+        if (link->roles[tree] == LinkRole::CHILD)
+        {
+            reduce_buffers(dst, src, length, type_, op_);
+            if (--trees_[tree].missing[chunk] == 0)
+                on_reduced(tree, chunk);
+        }
+        else
+        {
+            memcpy(dst, src, length * element_size_);
+            on_final(tree, chunk);
+        }
+        return true;
+    }
+
+    void TreeAllReduce::poll_channel(RDMAChannel *channel)
+    {
+        struct ibv_wc wc[TREE_POLL_BATCH];
+        int num_cqes = channel->poll_cq_batch(wc, TREE_POLL_BATCH);
+        for (int index = 0; index < num_cqes; index++)
+        {
+            auto iter = link_of_channel_.find(wc[index].wr_id);
+            CHECK(iter != link_of_channel_.end()) << "Unexpected completion of another channel in " << info();
+            iter->second->staging->on_cqe(&wc[index]);
+        }
+    }
+
+    bool TreeAllReduce::done()
+    {
+        if (final_left_ != 0)
+            return false;
+        for (auto &link : links_)
+        {
+            if (!link->pending_sends.empty() || !link->staging->idle() ||
+                link->staging->get_num_consumed() - link->base != link->expected)
+                return false;
+        }
+        return true;
+    }
+
+    uint64_t TreeAllReduce::get_num_chunks()
+    {
+        uint64_t num_chunks = 0;
+        for (auto &link : links_)
+            num_chunks += link->staging->get_num_sent();
+        return num_chunks;
+    }
+
+    uint64_t TreeAllReduce::get_num_stalls()
+    {
+        uint64_t num_stalls = 0;
+        for (auto &link : links_)
+            num_stalls += link->staging->get_num_stalls();
+        return num_stalls;
+    }
+
+}; // end namespace rdma_core
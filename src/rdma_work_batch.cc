@@ -0,0 +1,133 @@
+#include "rdma_work_batch.h"
+#include "rdma_config.h"
+#include "util/logging.h"
+
+namespace rdma_core
+{
+    WorkBatch::WorkBatch(uint32_t max_batch_size, std::string batch_info) :
+        batch_info_(batch_info), max_batch_size_(max_batch_size)
+    {
+        TRACE_IN;
+        CHECK(max_batch_size_ > 0) << "The batch size of " << info() << " should be > 0";
+        wr_list_.resize(max_batch_size_);
+        sge_list_.resize(max_batch_size_);
+        memset(wr_list_.data(), 0, sizeof(struct ibv_send_wr) * max_batch_size_);
+        memset(sge_list_.data(), 0, sizeof(struct ibv_sge) * max_batch_size_);
+        VLOG(3) << "Creating " << info() << " with " << max_batch_size_ << " slots";
+        TRACE_OUT;
+    }
+
+    WorkBatch::~WorkBatch()
+    {
+        TRACE_IN;
+        VLOG(3) << "Releasing " << info();
+        TRACE_OUT;
+    }
+
+    struct ibv_send_wr *WorkBatch::prepare_wr(RDMABuffer *buffer,
+                                              uint32_t data_length_in_bytes)
+    {
+        CHECK(buffer != 0) << "RDMABuffer has not been initialized";
+        buffer->security_check();
+        if (full())
+        {
+            HOT_VLOG_EVERY_N(3, SHOWN_LOG_EVERN_N) << info() << " is full, post it before adding more";
+            return nullptr;
+        }
+
+        struct ibv_sge *sge = &sge_list_[num_wr_];
+        sge->addr = (uintptr_t)(buffer->data_ptr);
+        sge->length = data_length_in_bytes;
+        sge->lkey = buffer->mr_->lkey;
+
+        struct ibv_send_wr *wr = &wr_list_[num_wr_];
+        wr->next = NULL;
+        wr->sg_list = sge;
+        wr->num_sge = 1;
+        wr->send_flags = IBV_SEND_SIGNALED;
+        num_wr_++;
+        return wr;
+    }
+
+    bool WorkBatch::add_send(RDMABuffer *buffer,            // placeholder of the data to send
+                             uint32_t data_length_in_bytes, // data length to send
+                             uint32_t msg_tag)              // tagging the message type to notify peer
+    {
+        CHECK(buffer != 0) << "RDMABuffer has not been initialized";
+        CHECK(buffer->buffer_size >= data_length_in_bytes) << "Invalid data length to send: "
+                                                           << data_length_in_bytes
+                                                           << ", exceeding the maximum buffer size: "
+                                                           << buffer->buffer_size;
+        struct ibv_send_wr *wr = prepare_wr(buffer, data_length_in_bytes);
+        if (wr == nullptr)
+            return false;
+        wr->opcode = IBV_WR_SEND_WITH_IMM;
+        wr->imm_data = msg_tag; // do not considering the byte order
+        return true;
+    }
+
+    bool WorkBatch::add_write(RDMABuffer *buffer,                              // the buffer for data to write
+                              uint32_t data_length_in_bytes,                   // data length to write
+                              struct CommDescriptor *remote_buffer_descriptor, // remote buffer_describptor
+                              uint32_t msg_tag,                                // tagging the message type to notify peer
+                              bool notify_peer)                                // notify peer explicit or not
+    {
+        CHECK(buffer != 0) << "RDMABuffer has not been initialized";
+        CHECK(remote_buffer_descriptor != 0) << "Invalid remote buffer descriptor";
+        CHECK((data_length_in_bytes <= buffer->buffer_size && data_length_in_bytes <= remote_buffer_descriptor->buffer_length_))
+            << "Invalid data length to write: " << data_length_in_bytes << ", my buffer size: "
+            << buffer->buffer_size << ", peer buffer size: " << remote_buffer_descriptor->buffer_length_;
+
+        struct ibv_send_wr *wr = prepare_wr(buffer, data_length_in_bytes);
+        if (wr == nullptr)
+            return false;
+        if (notify_peer)
+        {
+            wr->opcode = IBV_WR_RDMA_WRITE_WITH_IMM;
+            wr->imm_data = msg_tag;
+        }
+        else
+        {
+            wr->opcode = IBV_WR_RDMA_WRITE;
+        }
+        wr->wr.rdma.remote_addr = remote_buffer_descriptor->buffer_addr_;
+        wr->wr.rdma.rkey = remote_buffer_descriptor->rkey_;
+        return true;
+    }
+
+    bool WorkBatch::add_read(RDMABuffer *buffer,                              // placeholder that cache the read data
+                             uint32_t data_length_in_bytes,                   // data length to read
+                             struct CommDescriptor *remote_buffer_descriptor) // remote buffer_describptor
+    {
+        CHECK(buffer != 0) << "RDMABuffer has not been initialized";
+        CHECK(remote_buffer_descriptor != 0) << "Invalid remote buffer descriptor";
+        CHECK((data_length_in_bytes <= buffer->buffer_size && data_length_in_bytes <= remote_buffer_descriptor->buffer_length_))
+            << "Invalid data length to read";
+
+        struct ibv_send_wr *wr = prepare_wr(buffer, data_length_in_bytes);
+        if (wr == nullptr)
+            return false;
+        wr->opcode = IBV_WR_RDMA_READ;
+        wr->wr.rdma.remote_addr = remote_buffer_descriptor->buffer_addr_;
+        wr->wr.rdma.rkey = remote_buffer_descriptor->rkey_;
+        return true;
+    }
+
+    struct ibv_send_wr *WorkBatch::build_chain(uint64_t wr_id)
+    {
+        if (empty())
+            return nullptr;
+        for (uint32_t index = 0; index < num_wr_; index++)
+        {
+            wr_list_[index].wr_id = wr_id;
+            wr_list_[index].next = (index + 1 < num_wr_) ? &wr_list_[index + 1] : NULL;
+        }
+        return &wr_list_[0];
+    }
+
+    void WorkBatch::clear()
+    {
+        num_wr_ = 0;
+    }
+
+}; // end namespace rdma_core